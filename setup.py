@@ -39,6 +39,9 @@ if debug:
 if bool(int(os.getenv("STARRY_UNIT_TESTS", 0))):
     macros["STARRY_UNIT_TESTS"] = 1
 
+# Parallelize the native kernels with OpenMP?
+openmp = bool(int(os.getenv("STARRY_OPENMP", 0)))
+
 # Numerical override at high l?
 if bool(int(os.getenv("STARRY_KL_NUMERICAL", 0))):
     macros["STARRY_KL_NUMERICAL"] = 1
@@ -149,6 +152,11 @@ class BuildExt(build_ext):
             )
             opts.append("/Zm10")  # debug for C1060
         extra_args = ["-O%d" % optimize]
+        if openmp:
+            if ct == "msvc":
+                opts.append("/openmp")
+            else:
+                extra_args += ["-fopenmp"]
         if debug:
             extra_args += ["-g", "-Wall", "-fno-lto"]
         else:
@@ -1,6 +1,6 @@
 # -*- coding: utf-8 -*-
 from .. import config
-from ..compat import theano, tt, ts, ifelse, scan_until
+from ..compat import theano, tt, ts, ifelse
 from .._constants import *
 from .ops import (
     sTOp,
@@ -11,8 +11,11 @@ from .ops import (
     tensordotRzOp,
     FOp,
     spotYlmOp,
+    spotsYlmOp,
     pTOp,
     minimizeOp,
+    OrbitOp,
+    OccultationsOp,
     LDPhysicalOp,
     LimbDarkOp,
     GetClOp,
@@ -21,21 +24,22 @@ from .ops import (
     CheckBoundsOp,
     OrenNayarOp,
     setMatrixOp,
+    rTDopplerOp,
+    kTDopplerOp,
+    convDopplerOp,
+    convTDopplerOp,
+    toeplitzDopplerOp,
+    dotToeplitzDopplerOp,
+    L1Op,
 )
 from .utils import logger, autocompile, is_tensor, clear_cache
 from .math import lazy_math as math
-from .math import lazy_linalg as linalg
 from scipy.special import legendre as LegendreP
+from scipy.special import comb
 from scipy.sparse import csc_matrix
 from scipy.sparse.linalg import inv as sparse_inv
-from scipy.sparse import eye as sparse_eye
 import numpy as np
-from astropy import units
 import os
-import exoplanet
-
-cho_factor = math.cholesky
-cho_solve = linalg.cho_solve
 
 # C extensions are not installed on RTD
 if os.getenv("READTHEDOCS") == "True":  # pragma: no cover
@@ -110,24 +114,30 @@ class OpsYlm(object):
         self._spotYlm = spotYlmOp(
             self._c_ops.spotYlm, self.ydeg, self.nw
         )  # Deprecated
+        self._spotsYlm = spotsYlmOp(self._c_ops.spotsYlm, self.ydeg, self.nw)
+        self._spotsZonalYlm = spotsYlmOp(
+            self._c_ops.spotsZonalYlm, self.ydeg, self.nw, zonal=True
+        )
         self._pT = pTOp(self._c_ops.pT, self.deg)
         if self.nw is None:
-            if self._reflected:
-                self._minimize = minimizeOp(
-                    self.unweighted_intensity,
-                    self.P,
-                    self.ydeg,
-                    self.udeg,
-                    self.fdeg,
-                )
-            else:
-                self._minimize = minimizeOp(
-                    self.intensity, self.P, self.ydeg, self.udeg, self.fdeg
-                )
+            # NOTE: Reflected light intensities carry an extra factor
+            # of `pi`; see the note in `unweighted_intensity`.
+            self._minimize = minimizeOp(
+                self._c_ops.minimize,
+                self.ydeg,
+                self.udeg,
+                self.fdeg,
+                norm=np.pi if self._reflected else 1.0,
+            )
         else:
             # TODO: Implement minimization for spectral maps?
             self._minimize = None
-        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.nroots)
+        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.ld_is_physical)
+
+    @property
+    def ncols(self):
+        """Number of columns of the light curve design matrix."""
+        return self.Ny
 
     @property
     def rT(self):
@@ -176,6 +186,23 @@ class OpsYlm(object):
         # Deprecated
         return self._spotYlm(amp, sigma, lat, lon)
 
+    @autocompile
+    def spotsYlm(self, amp, sigma, lat, lon):
+        """Return the summed expansion of many Gaussian spots.
+
+        The amplitudes have shape ``(nspot,)`` (or ``(nspot, nw)`` for
+        spectral maps); the sizes, latitudes and longitudes (in radians)
+        have shape ``(nspot,)``. Spots with arbitrary azimuthally symmetric
+        profiles may be expanded instead by passing, in place of the sizes,
+        the coefficients of the zonal harmonics ``Y_{l,0}`` of each spot
+        centered at the sub-observer point, with shape ``(nspot, ydeg + 1)``.
+
+        """
+        if sigma.ndim == 2:
+            return self._spotsZonalYlm(amp, sigma, lat, lon)
+        else:
+            return self._spotsYlm(amp, sigma, lat, lon)
+
     @autocompile
     def pT(self, x, y, z):
         return self._pT(x, y, z)
@@ -234,6 +261,45 @@ class OpsYlm(object):
 
         return X
 
+    def dotX(self, theta, xo, yo, zo, ro, inc, obl, u, f, M):
+        """Compute the product of the design matrix and a matrix ``M``
+        without instantiating the design matrix. Greedy mode only."""
+        return self._c_ops.dotX(
+            *self._get_dotX_args(theta, xo, yo, zo, ro, inc, obl, u, f),
+            self._get_dotX_matrix(M)
+        )
+
+    def dotXT(self, theta, xo, yo, zo, ro, inc, obl, u, f, M):
+        """Compute the product of the transpose of the design matrix and a
+        matrix ``M`` without instantiating the design matrix. Greedy mode
+        only."""
+        return self._c_ops.dotXT(
+            *self._get_dotX_args(theta, xo, yo, zo, ro, inc, obl, u, f),
+            self._get_dotX_matrix(M)
+        )
+
+    def normalX(self, theta, xo, yo, zo, ro, inc, obl, u, f, CInv, flux):
+        """Compute ``X^T C^-1 X`` and ``X^T C^-1 flux`` for a diagonal data
+        covariance ``C`` by streaming over the design matrix ``X`` in
+        chunks of time, without instantiating it. Greedy mode only."""
+        args = self._get_dotX_args(theta, xo, yo, zo, ro, inc, obl, u, f)
+        CInv = np.array(CInv, dtype=np.float64) * np.ones_like(args[0])
+        flux = np.array(flux, dtype=np.float64) * np.ones_like(args[0])
+        return self._c_ops.normalX(*args, CInv, flux)
+
+    def _get_dotX_args(self, theta, xo, yo, zo, ro, inc, obl, u, f):
+        vectors = [
+            np.atleast_1d(np.array(x, dtype=np.float64))
+            for x in (theta, xo, yo, zo)
+        ]
+        scalars = [float(x) for x in (ro, inc, obl)]
+        u, f = [np.atleast_1d(np.array(x, dtype=np.float64)) for x in (u, f)]
+        return vectors + scalars + [u, f]
+
+    def _get_dotX_matrix(self, M):
+        M = np.array(M, dtype=np.float64)
+        return M.reshape(M.shape[0], -1)
+
     @autocompile
     def flux(self, theta, xo, yo, zo, ro, inc, obl, y, u, f):
         """Compute the light curve."""
@@ -345,6 +411,22 @@ class OpsYlm(object):
         # We need the shape to be (nframes, npix, npix)
         return res.dimshuffle(2, 0, 1)
 
+    @autocompile
+    def render_poly(self, theta, inc, obl, y, u, f):
+        """Return the polynomial coefficients of the map on the sky.
+
+        These include the limb darkening and any filters, so that the
+        intensity at each frame is the polynomial evaluated on the unit
+        disk. The result has shape ``(npoly, nframes)``.
+        """
+        Ry = self.left_project(
+            tt.transpose(tt.tile(y, [theta.shape[0], 1])), inc, obl, theta
+        )
+        A1Ry = ts.dot(self.A1, Ry)
+        if self.filter:
+            A1Ry = tt.dot(self.F(u, f), A1Ry)
+        return A1Ry
+
     @autocompile
     def expand_spot(self, amp, sigma, lat, lon):
         """Return the spherical harmonic expansion of a Gaussian spot [DEPRECATED]."""
@@ -687,30 +769,27 @@ class OpsYlm(object):
         i = l * (l + 1)
         S = np.exp(-0.5 * i * spot_smoothing ** 2)
         self._spot_Bp = S[:, None] * A
-        self._spot_idx = i
         self._spot_theta = theta
         self._spot_fac = spot_fac
 
     @autocompile
     def spot(self, contrast, radius, lat, lon):
+        """Return the summed expansion of many spots.
 
-        # Compute unit-intensity spot at (0, 0)
-        z = self._spot_fac * (self._spot_theta - radius)
-        b = 1.0 / (1.0 + tt.exp(-z)) - 1.0
-        yT = tt.zeros((1, self.Ny))
-        yT = tt.set_subtensor(yT[:, self._spot_idx], tt.dot(self._spot_Bp, b))
-
-        # Rotate in latitude then in longitude
-        yT = self.dotR(yT, np.array(1.0), np.array(0.0), np.array(0.0), lat)
-        yT = self.dotR(yT, np.array(0.0), np.array(1.0), np.array(0.0), -lon)
+        The contrasts have shape ``(nspot,)`` (or ``(nspot, nw)`` for
+        spectral maps); the radii, latitudes and longitudes (in radians)
+        have shape ``(nspot,)``.
 
-        # Reshape and we're done
-        if self.nw is None:
-            y = yT.reshape((-1,)) * contrast
-        else:
-            y = yT.reshape((-1, 1)) * tt.reshape(contrast, (1, -1))
+        """
+        # Zonal expansions of the unit-intensity spots at (0, 0)
+        z = self._spot_fac * (
+            tt.shape_padright(self._spot_theta) - tt.shape_padleft(radius)
+        )
+        b = 1.0 / (1.0 + tt.exp(-z)) - 1.0
+        b = tt.transpose(tt.dot(self._spot_Bp, b))
 
-        return y
+        # Rotate them to their lat/lon and sum them in a single call
+        return self.spotsYlm(contrast, b, lat, lon)
 
 
 class OpsLD(object):
@@ -724,10 +803,44 @@ class OpsLD(object):
         self.udeg = udeg
         self.nw = nw
 
+        # The design matrix is a single column (the total flux)
+        self.ncols = 1
+
         # Set up the ops
         self._get_cl = GetClOp()
         self._limbdark = LimbDarkOp()
-        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.nroots)
+        self._LimbDarkIsPhysical = LDPhysicalOp(_c_ops.ld_is_physical)
+
+        # Polynomial basis representation of each limb darkening term
+        self._P = self._get_ld_poly()
+
+    def _get_ld_poly(self):
+        """Return the matrix ``P`` such that the intensity profile is the
+        polynomial ``-dot(P, u)`` in the starry basis.
+
+        We expand each term ``(1 - z)^k`` and use ``z^2 = 1 - x^2 - y^2``
+        to reduce all powers of ``z`` to at most one.
+        """
+        P = np.zeros(((self.udeg + 1) ** 2, self.udeg + 1))
+        for k in range(self.udeg + 1):
+            for i in range(k + 1):
+                # z^i = z^(i % 2) (1 - x^2 - y^2)^(i // 2)
+                j, odd = divmod(i, 2)
+                for a in range(j + 1):
+                    for b in range(j - a + 1):
+                        c = (
+                            comb(k, i)
+                            * comb(j, a)
+                            * comb(j - a, b)
+                            * (-1) ** (i + a + b)
+                        )
+                        l = 2 * (a + b) + odd
+                        if odd:
+                            m = l - 1 - 4 * a
+                        else:
+                            m = l - 4 * a
+                        P[l * l + l + m, k] += c
+        return P
 
     @autocompile
     def limbdark_is_physical(self, u):
@@ -792,6 +905,15 @@ class OpsLD(object):
         image = self.render_ld(res, u)
         return tt.tile(image, (nframes, 1, 1))
 
+    @autocompile
+    def render_poly(self, theta, inc, obl, y, u, f):
+        """Return the polynomial coefficients of the map on the sky.
+
+        See :py:meth:`OpsYlm.render_poly`.
+        """
+        p = -tt.dot(tt.as_tensor_variable(self._P), u)
+        return tt.tile(tt.shape_padright(p), (1, theta.shape[0]))
+
     @autocompile
     def render_ld(self, res, u):
         """Simplified version of `render` w/o the extra params.
@@ -886,17 +1008,89 @@ class OpsRV(OpsYlm):
             * np.pi
         )
 
+    @autocompile
+    def X_rv(self, theta, xo, yo, zo, ro, inc, obl, u, f, f0):
+        """Compute the design matrices for two filters in a single pass.
+
+        Returns the horizontal stack of the design matrices for the filters
+        ``f`` and ``f0``. The occultation solution and the rotations are
+        shared between the two: we interleave the rows of the two
+        pre-rotation matrices so a single call to ``right_project``
+        rotates both of them.
+        """
+        # Determine shapes
+        rows = theta.shape[0]
+        cols = self.rTA1.shape[1]
+        X = tt.zeros((rows, 2 * cols))
+
+        # Compute the occultation mask
+        b = tt.sqrt(xo ** 2 + yo ** 2)
+        b_rot = tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
+        b_occ = tt.invert(b_rot)
+        i_rot = tt.arange(b.size)[b_rot]
+        i_occ = tt.arange(b.size)[b_occ]
+
+        # Compute the filter operators
+        F = self.F(u, f)
+        F0 = self.F(u, f0)
+
+        # Rotation operator
+        rTA1 = tt.concatenate(
+            (
+                ts.dot(tt.dot(self.rT, F), self.A1),
+                ts.dot(tt.dot(self.rT, F0), self.A1),
+            )
+        )
+        nrot = theta[i_rot].shape[0]
+        rTA1 = tt.tile(rTA1, (nrot, 1))
+        X = tt.set_subtensor(
+            X[i_rot],
+            tt.reshape(
+                self.right_project(
+                    rTA1, inc, obl, tt.repeat(theta[i_rot], 2)
+                ),
+                (nrot, 2 * cols),
+            ),
+        )
+
+        # Occultation + rotation operator
+        sT = self.sT(b[i_occ], ro)
+        sTA = ts.dot(sT, self.A)
+        theta_z = tt.arctan2(xo[i_occ], yo[i_occ])
+        sTAR = self.tensordotRz(sTA, theta_z)
+        A1InvFA1 = ts.dot(ts.dot(self.A1Inv, F), self.A1)
+        A1InvF0A1 = ts.dot(ts.dot(self.A1Inv, F0), self.A1)
+        nocc = theta[i_occ].shape[0]
+        sTAR = tt.reshape(
+            tt.concatenate(
+                (tt.dot(sTAR, A1InvFA1), tt.dot(sTAR, A1InvF0A1)), axis=1
+            ),
+            (2 * nocc, cols),
+        )
+        X = tt.set_subtensor(
+            X[i_occ],
+            tt.reshape(
+                self.right_project(
+                    sTAR, inc, obl, tt.repeat(theta[i_occ], 2)
+                ),
+                (nocc, 2 * cols),
+            ),
+        )
+
+        return X
+
     @autocompile
     def rv(self, theta, xo, yo, zo, ro, inc, obl, y, u, veq, alpha):
         """Compute the observed radial velocity anomaly."""
-        # Compute the velocity-weighted intensity
+        # Compute the velocity-weighted intensity and the intensity
         f = self.compute_rv_filter(inc, obl, veq, alpha)
-        Iv = self.flux(theta, xo, yo, zo, ro, inc, obl, y, u, f)
-
-        # Compute the inverse of the intensity
         f0 = tt.zeros_like(f)
         f0 = tt.set_subtensor(f0[0], np.pi)
-        I = self.flux(theta, xo, yo, zo, ro, inc, obl, y, u, f0)
+        X = self.X_rv(theta, xo, yo, zo, ro, inc, obl, u, f, f0)
+        Iv = tt.dot(X[:, : self.Ny], y)
+        I = tt.dot(X[:, self.Ny :], y)
+
+        # Compute the inverse of the intensity
         invI = tt.ones((1,)) / I
         invI = tt.where(tt.isinf(invI), 0.0, invI)
 
@@ -1490,6 +1684,16 @@ class OpsOblate(OpsYlm):
         # Greens-to-poly change of basis
         self.A2_Nyuf_x_Nyuf = ts.as_sparse_variable(ops_yuf_0_0.A2)
 
+    @property
+    def ncols(self):
+        """Number of columns of the light curve design matrix. The
+        gravity darkening filter is only folded into the design matrix
+        for monochromatic maps."""
+        if self.nw is None and self.fdeg > 0:
+            return self.Ny
+        else:
+            return (self.ydeg + self.fdeg + 1) ** 2
+
     @autocompile
     def tensordotRz(self, matrix, theta):
         if self.ydeg + self.fdeg == 0:
@@ -1751,6 +1955,9 @@ class OpsDoppler(OpsYlm):
         vsini_max,
         clight,
         log_lambda_padded,
+        conv_mode="auto",
+        precision="double",
+        kT_cache_size=None,
         **kwargs
     ):
         # Init the regular ops (with nw = nc, since that's
@@ -1778,21 +1985,60 @@ class OpsDoppler(OpsYlm):
             / (np.exp(-2 * lam_kernel) + 1)
         )
 
-        # Pre-compute the CSR matrix indices
-        self.indptr = (self.Ny * self.nk) * np.arange(
-            self.nw + 1, dtype="int32"
+        # Change of basis matrix (ydeg + udeg)
+        self._A1Big = ts.as_sparse_variable(self._c_ops.A1Big)
+
+        # Native line broadening kernels
+        self._rT = rTDopplerOp(
+            self._c_ops.rTDoppler, (self.ydeg + self.udeg + 1) ** 2
+        )
+        self._kT = kTDopplerOp(
+            self._c_ops.kTDoppler, self.xamp, self.Ny, self.vsini_max
+        )
+
+        # The block-Toeplitz Doppler matrix as a structured operator that
+        # stores each kernel once: its products, and (only if explicitly
+        # requested) the assembled dense or sparse matrix
+        self._dot_toeplitz = dotToeplitzDopplerOp(
+            _c_ops.DopplerToeplitz, self.nwp
         )
-        i0 = np.reshape(np.arange(self.nk), (-1, 1))
-        i1 = self.nwp * np.arange(self.Ny).reshape(1, -1)
-        i2 = np.arange(self.nw).reshape(1, -1)
-        self.indices = np.reshape(
-            np.transpose(np.reshape(np.transpose(i0 + i1), (-1, 1)) + i2),
-            (-1,),
+        self._toeplitz = toeplitzDopplerOp(_c_ops.DopplerToeplitz, self.nwp)
+        self._toeplitz_dense = toeplitzDopplerOp(
+            _c_ops.DopplerToeplitz, self.nwp, dense=True
         )
-        self.shape = np.array([self.nw, self.Ny * self.nwp])
 
-        # Change of basis matrix (ydeg + udeg)
-        self._A1Big = ts.as_sparse_variable(self._c_ops.A1Big)
+        # Native L1 solver
+        self._L1 = L1Op(_c_ops.l1_solve)
+
+        # Memory budget for the caches of rotated kernels (both the
+        # kernel tensors above and those used in the matrix-free products)
+        if kT_cache_size is None:
+            kT_cache_size = self._c_ops.dopplerCacheSize
+        self.kT_cache_size = kT_cache_size
+
+        # Native convolutions (direct or FFT) of the spectra with the
+        # kernels, for `Ny` (full design matrix), `nc` (fixed map) and
+        # one (fixed spectrum) channels. The precision is a flag in the
+        # same integer code.
+        modes = {"auto": 0, "direct": 1, "fft": 2}
+        if conv_mode not in modes:
+            raise ValueError(
+                "Keyword `conv_mode` must be one of `auto`, `direct`, `fft`."
+            )
+        precisions = {"double": 0, "mixed": 4}
+        if precision not in precisions:
+            raise ValueError(
+                "Keyword `precision` must be one of `double`, `mixed`."
+            )
+        self.conv_mode = conv_mode
+        self.precision = precision
+        self._conv_mode = mode = modes[conv_mode] | precisions[precision]
+        conv, convT = self._c_ops.convDoppler, self._c_ops.convTDoppler
+        self._conv_Ny = convDopplerOp(conv, self.Ny, mode)
+        self._convT_Ny = convTDopplerOp(convT, self.Ny, mode)
+        self._conv_nc = convDopplerOp(conv, self.nc, mode)
+        self._convT_nc = convTDopplerOp(convT, self.nc, mode)
+        self._conv_1 = convDopplerOp(conv, 1, mode)
 
     @autocompile
     def enforce_shape(self, tensor, shape):
@@ -1813,45 +2059,7 @@ class OpsDoppler(OpsYlm):
     @autocompile
     def get_rT(self, x):
         """The `rho^T` solution vector."""
-        deg = self.ydeg + self.udeg
-        sijk = tt.zeros((deg + 1, deg + 1, 2, tt.shape(x)[0]))
-
-        # Initial conditions
-        r2 = tt.maximum(1 - x ** 2, tt.zeros_like(x))
-
-        # Silly hack to prevent issues with the undefined derivative at x = 1
-        # This just computes the square root of r2, zeroing out values very
-        # close to zero.
-        r = tt.maximum(1 - x ** 2, tt.zeros_like(x) + 1e-100) ** 0.5
-        r = tt.switch(tt.gt(r, 1e-49), r, tt.zeros_like(r))
-
-        sijk = tt.set_subtensor(sijk[0, 0, 0], 2 * r)
-        sijk = tt.set_subtensor(sijk[0, 0, 1], 0.5 * np.pi * r2)
-
-        # Upward recursion in j
-        for j in range(2, deg + 1, 2):
-            sijk = tt.set_subtensor(
-                sijk[0, j, 0], ((j - 1.0) / (j + 1.0)) * r2 * sijk[0, j - 2, 0]
-            )
-            sijk = tt.set_subtensor(
-                sijk[0, j, 1], ((j - 1.0) / (j + 2.0)) * r2 * sijk[0, j - 2, 1]
-            )
-
-        # Upward recursion in i
-        for i in range(1, deg + 1):
-            sijk = tt.set_subtensor(sijk[i], sijk[i - 1] * x)
-
-        # Full vector
-        N = (deg + 1) ** 2
-        s = tt.zeros((N, tt.shape(x)[0]))
-        n = np.arange(N)
-        LAM = np.floor(np.sqrt(n))
-        DEL = 0.5 * (n - LAM ** 2)
-        i = np.array(np.floor(LAM - DEL), dtype=int)
-        j = np.array(np.floor(DEL), dtype=int)
-        k = np.array(np.ceil(DEL) - np.floor(DEL), dtype=int)
-        s = tt.set_subtensor(s[n], sijk[i, j, k])
-        return s
+        return self._rT(x)
 
     @autocompile
     def get_kT0(self, rT):
@@ -1878,70 +2086,23 @@ class OpsDoppler(OpsYlm):
         rT = self.get_rT(x)
         kT0 = self.get_kT0(rT)[0]
 
-        # Create the Toeplitz matrix
-        indptr = self.nk * np.arange(self.nw + 1, dtype="int32")
-        i0 = np.arange(self.nk).reshape(-1, 1)
-        i2 = np.arange(self.nw).reshape(1, -1)
-        indices = np.transpose(i0 + i2).reshape(-1)
-        shape = np.array([self.nw, self.nwp])
-        data = tt.tile(tt.reshape(kT0, (-1,)), self.nw)
-        A = ts.basic.CSR(data, indices, indptr, shape)
-
-        # Return a dense version
-        return ts.DenseFromSparse()(A)
+        # Assemble the (dense) Toeplitz matrix
+        return self._toeplitz_dense(tt.reshape(kT0, (1, 1, -1)))
 
     @autocompile
     def get_kT(self, inc, theta, veq, u):
         """
         Get the kernels at an array of angular phases `theta`.
 
+        The line broadening kernels, the limb darkening operator and the
+        rotation to each epoch are all computed in a single native call.
         """
-        # Compute the convolution kernels
-        vsini = self.enforce_bounds(veq * tt.sin(inc), 0.0, self.vsini_max)
-        x = self.get_x(vsini)
-        rT = self.get_rT(x)
-        kT0 = self.get_kT0(rT)
-
-        # Compute the limb darkening operator
-        if self.udeg > 0:
-            F = self.F(
-                tt.as_tensor_variable(u), tt.as_tensor_variable([np.pi])
-            )
-            L = ts.dot(ts.dot(self.A1Inv, F), self.A1)
-            kT0 = tt.dot(tt.transpose(L), kT0)
-
-        # Compute the kernels at each epoch
-        kT = tt.zeros((self.nt, self.Ny, self.nk))
-        for m in range(self.nt):
-            kT = tt.set_subtensor(
-                kT[m],
-                tt.transpose(
-                    self.right_project(
-                        tt.transpose(kT0),
-                        inc,
-                        tt.as_tensor_variable(0.0),
-                        theta[m],
-                    )
-                ),
-            )
-        return kT
-
-    @autocompile
-    def get_D_data(self, kT0, inc, theta_scalar):
-        """
-        Return the Doppler matrix as a stack of data arrays.
-
-        """
-        # Rotate the kernels
-        kT = tt.transpose(
-            self.right_project(
-                tt.transpose(kT0),
-                inc,
-                tt.as_tensor_variable(0.0),
-                theta_scalar,
-            )
+        return self._kT(
+            tt.as_tensor_variable(veq),
+            tt.as_tensor_variable(inc),
+            tt.as_tensor_variable(theta),
+            tt.as_tensor_variable(u),
         )
-        return tt.tile(tt.reshape(kT, (-1,)), self.nw)
 
     @autocompile
     def get_D(self, inc, theta, veq, u):
@@ -1950,37 +2111,20 @@ class OpsDoppler(OpsYlm):
 
         This is a horizontal stack of Toeplitz convolution matrices, one per
         spherical harmonic. These matrices are then stacked vertically for
-        each rotational phase.
+        each rotational phase. The sparse matrix is assembled natively from
+        the structured Toeplitz operator, which stores each kernel once.
 
         In general, instantiating this matrix (even in its sparse form) is not
-        a good idea: it's very slow, and can consume a ton of memory!
+        a good idea: it stores ``nw`` copies of each kernel, and can consume
+        a ton of memory! Products with it should be computed with
+        :py:meth:`get_D_operator` or :py:meth:`dotD`, which only ever store
+        the kernels.
         """
         # Compute the convolution kernels
-        vsini = self.enforce_bounds(veq * tt.sin(inc), 0.0, self.vsini_max)
-        x = self.get_x(vsini)
-        rT = self.get_rT(x)
-        kT0 = self.get_kT0(rT)
-
-        # Compute the limb darkening operator
-        if self.udeg > 0:
-            F = self.F(
-                tt.as_tensor_variable(u), tt.as_tensor_variable([np.pi])
-            )
-            L = ts.dot(ts.dot(self.A1Inv, F), self.A1)
-            kT0 = tt.dot(tt.transpose(L), kT0)
+        kT = self.get_kT(inc, theta, veq, u)
 
-        # Stack to get the full matrix
-        return ts.vstack(
-            [
-                ts.basic.CSR(
-                    self.get_D_data(kT0, inc, theta[m]),
-                    self.indices,
-                    self.indptr,
-                    self.shape,
-                )
-                for m in range(self.nt)
-            ]
-        )
+        # Assemble the block-Toeplitz matrix
+        return self._toeplitz(kT)
 
     @autocompile
     def get_D_fixed_spectrum(self, inc, theta, veq, u, spectrum):
@@ -1994,14 +2138,10 @@ class OpsDoppler(OpsYlm):
         # Get the convolution kernels
         kT = self.get_kT(inc, theta, veq, u)
 
-        # The dot product is just a 2d convolution!
-        product = tt.nnet.conv2d(
-            tt.reshape(spectrum, (self.nc, 1, 1, self.nwp)),
-            tt.reshape(kT, (self.nt * self.Ny, 1, 1, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            input_shape=(self.nc, 1, 1, self.nwp),
-            filter_shape=(self.nt * self.Ny, 1, 1, self.nk),
+        # The dot product is just a convolution!
+        product = self._conv_1(
+            tt.reshape(spectrum, (self.nc, self.nwp)),
+            tt.reshape(kT, (self.nt * self.Ny, self.nk)),
         )
         product = tt.reshape(product, (self.nc, self.nt, self.Ny, self.nw))
         product = tt.swapaxes(product, 1, 2)
@@ -2014,20 +2154,24 @@ class OpsDoppler(OpsYlm):
         """
         Return the Doppler matrix for a fixed map.
 
+        This is the block-Toeplitz matrix of the kernels dotted into the
+        Ylms, so it is assembled directly from the ``nt * nc`` kernels
+        of the fixed map, without ever forming the full Doppler matrix.
+
         In general, instantiating this matrix (even in its sparse form) is not
         a good idea: it's much, much faster to use
         `dot_design_matrix_fixed_map_into` below.
 
         """
-        D = self.get_D(inc, theta, veq, u)
-        I = ts.as_sparse_variable(sparse_eye(self.nwp, format="csr"))
-        Y = ts.hstack(
-            [
-                ts.vstack([y[n, k] * I for n in range(self.Ny)])
-                for k in range(self.nc)
-            ]
-        )
-        return ts.dot(D, Y)
+        # Get the convolution kernels
+        kT = self.get_kT(inc, theta, veq, u)
+
+        # Dot them into the Ylms
+        # kTy has shape (nt, nc, nk)
+        kTy = tt.swapaxes(tt.dot(tt.transpose(y), kT), 0, 1)
+
+        # Assemble the block-Toeplitz matrix
+        return self._toeplitz(kTy)
 
     @autocompile
     def dot_design_matrix_fixed_map_into(self, inc, theta, veq, u, y, matrix):
@@ -2035,7 +2179,7 @@ class OpsDoppler(OpsYlm):
         Dot the Doppler design matrix for a fixed Ylm map
         into an arbitrary dense `matrix`. This is equivalent to
         ``tt.dot(get_D_fixed_map(), matrix)``, but computes the
-        product with a single `conv2d` operation.
+        product with a single native convolution.
 
         """
         # Get the convolution kernels
@@ -2049,14 +2193,10 @@ class OpsDoppler(OpsYlm):
         if matrix.ndim == 1:
             matrix = tt.shape_padright(matrix)
 
-        # The dot product is just a 2d convolution!
-        product = tt.nnet.conv2d(
-            tt.reshape(tt.transpose(matrix), (-1, self.nc, 1, self.nwp)),
-            tt.reshape(kTy, (self.nt, self.nc, 1, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            input_shape=(None, self.nc, 1, self.nwp),
-            filter_shape=(self.nt, self.nc, 1, self.nk),
+        # The dot product is just a convolution!
+        product = self._conv_nc(
+            tt.reshape(tt.transpose(matrix), (-1, self.nwp)),
+            tt.reshape(kTy, (self.nt * self.nc, self.nk)),
         )
         return tt.transpose(tt.reshape(product, (-1, self.nt * self.nw)))
 
@@ -2068,7 +2208,7 @@ class OpsDoppler(OpsYlm):
         Dot the transpose of the Doppler design matrix for a fixed Ylm map
         into an arbitrary dense `matrix`. This is equivalent to
         ``tt.dot(get_D_fixed_map().transpose(), matrix)``, but computes the
-        product with a single `conv2d_transpose` operation.
+        product with a single native transposed convolution.
 
         """
         # Get the convolution kernels
@@ -2082,25 +2222,19 @@ class OpsDoppler(OpsYlm):
         if matrix.ndim == 1:
             matrix = tt.shape_padright(matrix)
 
-        # The dot product is just a 2d convolution!
-        product = tt.nnet.conv2d_transpose(
-            tt.reshape(tt.transpose(matrix), (-1, self.nt, 1, self.nw)),
-            tt.reshape(kTy, (self.nt, 1, self.nc, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            output_shape=(None, 1, self.nc, self.nwp),
-            filter_shape=(self.nt, 1, self.nc, self.nk),
+        # The dot product is just a transposed convolution!
+        product = self._convT_nc(
+            tt.reshape(tt.transpose(matrix), (-1, self.nw)),
+            tt.reshape(kTy, (self.nt * self.nc, self.nk)),
         )
-        product = tt.swapaxes(product, 2, 3)
-        product = tt.swapaxes(product, 0, 3)
-        return tt.reshape(product, (self.nc * self.nwp, -1))
+        return tt.transpose(tt.reshape(product, (-1, self.nc * self.nwp)))
 
     @autocompile
     def dot_design_matrix_into(self, inc, theta, veq, u, matrix):
         """
         Dot the full Doppler design matrix into an arbitrary dense `matrix`.
         This is equivalent to ``tt.dot(get_D(), matrix)``, but computes the
-        product with a single `conv2d` operation.
+        product with a single native convolution.
 
         """
         # Get the convolution kernels
@@ -2110,14 +2244,10 @@ class OpsDoppler(OpsYlm):
         if matrix.ndim == 1:
             matrix = tt.shape_padright(matrix)
 
-        # The dot product is just a 2d convolution!
-        product = tt.nnet.conv2d(
-            tt.reshape(tt.transpose(matrix), (-1, self.Ny, 1, self.nwp)),
-            tt.reshape(kT, (self.nt, self.Ny, 1, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            input_shape=(None, self.Ny, 1, self.nwp),
-            filter_shape=(self.nt, self.Ny, 1, self.nk),
+        # The dot product is just a convolution!
+        product = self._conv_Ny(
+            tt.reshape(tt.transpose(matrix), (-1, self.nwp)),
+            tt.reshape(kT, (self.nt * self.Ny, self.nk)),
         )
         return tt.transpose(tt.reshape(product, (-1, self.nt * self.nw)))
 
@@ -2127,7 +2257,7 @@ class OpsDoppler(OpsYlm):
         Dot the transpose of the full Doppler design matrix into an arbitrary
         dense `matrix`. This is equivalent to
         ``tt.dot(get_D().transpose(), matrix)``, but computes the product with
-        a single `conv2d` operation.
+        a single native transposed convolution.
 
         """
         # Get the convolution kernels
@@ -2137,56 +2267,221 @@ class OpsDoppler(OpsYlm):
         if matrix.ndim == 1:
             matrix = tt.shape_padright(matrix)
 
-        # The dot product is just a 2d convolution!
-        product = tt.nnet.conv2d_transpose(
-            tt.reshape(tt.transpose(matrix), (-1, self.nt, 1, self.nw)),
-            tt.reshape(kT, (self.nt, 1, self.Ny, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            output_shape=(None, 1, self.Ny, self.nwp),
-            filter_shape=(self.nt, 1, self.Ny, self.nk),
+        # The dot product is just a transposed convolution!
+        product = self._convT_Ny(
+            tt.reshape(tt.transpose(matrix), (-1, self.nw)),
+            tt.reshape(kT, (self.nt * self.Ny, self.nk)),
+        )
+        return tt.transpose(tt.reshape(product, (-1, self.Ny * self.nwp)))
+
+    @property
+    def kT_cache_size(self):
+        """Total memory budget in bytes for the caches of rotated kernels.
+
+        The budget is split evenly between the cache of the kernels
+        returned by the ``kT`` op and the cache of the native Doppler
+        operator, so the two never hold more than this in total.
+        """
+        return self._kT.cache_size + self._c_ops.dopplerCacheSize
+
+    @kT_cache_size.setter
+    def kT_cache_size(self, value):
+        value = int(value)
+        if value < 0:
+            raise ValueError("Keyword `kT_cache_size` must be non-negative.")
+        self._kT.cache_size = value // 2
+        self._c_ops.dopplerCacheSize = value - value // 2
+
+    def get_D_operator(self, inc, theta, veq, u):
+        """Return the full Doppler matrix as a structured block-Toeplitz
+        operator that stores each kernel once and builds the rows of the
+        matrix on demand. Its ``dot`` method computes the products with
+        the matrix (or its transpose) and its ``matrix`` method assembles
+        the sparse matrix returned by :py:meth:`get_D`. Greedy mode
+        only."""
+        kT = np.array(self.get_kT(inc, theta, veq, u), dtype=np.float64)
+        return _c_ops.DopplerToeplitz(
+            np.reshape(kT, (-1, self.nk)), self.Ny, self.nwp
+        )
+
+    def dotD(self, inc, theta, veq, u, M, transpose=False):
+        """Compute the product of the full Doppler design matrix (or its
+        transpose) and a matrix ``M`` without instantiating the design
+        matrix. The kernels are rotated to each epoch on the fly. Greedy
+        mode only."""
+        return self._c_ops.dotDoppler(
+            *self._get_dotD_args(inc, theta, veq, u),
+            self._get_dotX_matrix(M),
+            self.nwp,
+            transpose,
+            self._conv_mode,
+        )
+
+    def dotD_fixed_map(self, inc, theta, veq, u, y, M, transpose=False):
+        """Compute the product of the Doppler design matrix for a fixed
+        map ``y`` (or its transpose) and a matrix ``M`` without
+        instantiating the design matrix. Greedy mode only."""
+        y = np.reshape(np.array(y, dtype=np.float64), (self.Ny, -1))
+        return self._c_ops.dotDopplerFixedMap(
+            *self._get_dotD_args(inc, theta, veq, u),
+            y,
+            self._get_dotX_matrix(M),
+            self.nwp,
+            transpose,
+            self._conv_mode,
+        )
+
+    def dotD_fixed_spectrum(
+        self, inc, theta, veq, u, spectrum, M, transpose=False
+    ):
+        """Compute the product of the Doppler design matrix for a fixed
+        ``spectrum`` (or its transpose) and a matrix ``M`` without
+        instantiating the design matrix. Greedy mode only."""
+        spectrum = np.reshape(
+            np.array(spectrum, dtype=np.float64), (-1, self.nwp)
+        )
+        return self._c_ops.dotDopplerFixedSpectrum(
+            *self._get_dotD_args(inc, theta, veq, u),
+            spectrum,
+            self._get_dotX_matrix(M),
+            transpose,
+            self._conv_mode,
+        )
+
+    def solve_bilinear(
+        self,
+        inc,
+        theta,
+        veq,
+        u,
+        flux,
+        flux_err,
+        Si2e,
+        spatial_mean,
+        spatial_inv_cov,
+        spectral_mean,
+        spectral_inv_cov,
+        spectral_guess,
+        baseline,
+        baseline_var,
+        T,
+        linear,
+        continuum_idx,
+        cg_tol=1e-10,
+        cg_maxiter=0,
+        tol=0.0,
+    ):
+        """Solve for the map and the spectrum by alternating between
+        conjugate gradient solves for each conditioned on the other. The
+        priors must be diagonal. Returns the map, the spectrum, the
+        baseline, and the convergence history. Greedy mode only."""
+        return self._c_ops.solveDopplerBilinear(
+            *self._get_dotD_args(inc, theta, veq, u),
+            np.array(flux, dtype=np.float64),
+            np.array(flux_err, dtype=np.float64),
+            csc_matrix(Si2e, dtype=np.float64),
+            np.array(spatial_mean, dtype=np.float64),
+            np.array(spatial_inv_cov, dtype=np.float64),
+            np.array(spectral_mean, dtype=np.float64),
+            np.array(spectral_inv_cov, dtype=np.float64),
+            np.array(spectral_guess, dtype=np.float64),
+            np.array(baseline, dtype=np.float64),
+            float(baseline_var),
+            np.atleast_1d(np.array(T, dtype=np.float64)),
+            bool(linear),
+            int(continuum_idx),
+            float(cg_tol),
+            int(cg_maxiter),
+            float(tol),
+            self._conv_mode,
+        )
+
+    def _get_pixel_args(self, x, y, z, w, eps):
+        x, y, z = [
+            np.array(v, dtype=np.float64).reshape(-1) for v in (x, y, z)
+        ]
+        w = np.array(w, dtype=np.float64) * np.ones_like(x)
+        return x, y, z, w, float(eps)
+
+    def pixel_transform(self, x, y, z, w, eps):
+        """Return the matrices ``(Y2P, P2Y)`` that transform between
+        spherical harmonic coefficients and the intensity at the points
+        ``(x, y, z)``, where ``P2Y`` is the pseudo-inverse of ``Y2P``
+        with pixel weights ``w`` and regularization ``eps``. These are
+        computed natively and cached for the last grid. Greedy mode only."""
+        return self._c_ops.pixelTransform(
+            *self._get_pixel_args(x, y, z, w, eps)
+        )
+
+    def dot_pixel_transform(self, x, y, z, w, eps, M, inverse=False):
+        """Dot the (cached) pixel transform ``P2Y`` or, if ``inverse`` is
+        True, ``Y2P`` into the columns of ``M`` in parallel. See
+        ``pixel_transform``. Greedy mode only."""
+        return self._c_ops.dotPixelTransform(
+            *self._get_pixel_args(x, y, z, w, eps),
+            np.array(M, dtype=np.float64),
+            bool(inverse),
         )
-        product = tt.swapaxes(product, 2, 3)
-        product = tt.swapaxes(product, 0, 3)
-        return tt.reshape(product, (self.Ny * self.nwp, -1))
+
+    def validate_precision(self, inc, theta, veq, u, a):
+        """Compare the flux computed with the mixed precision convolution
+        to the flux computed in double precision for the spectral map
+        ``a``, of shape ``(Ny, nwp)``. Returns the error and its (first
+        order) elementwise upper bound, ``(nk + 2) 2^-24`` times the
+        convolution of ``|a|`` with the absolute value of the kernels,
+        both of shape ``(nt, nw)``. Greedy mode only."""
+        kT = np.reshape(
+            self.get_kT(inc, theta, veq, u), (self.nt * self.Ny, self.nk)
+        )
+        a = np.reshape(np.array(a, dtype=np.float64), (self.Ny, self.nwp))
+        conv = self._c_ops.convDoppler
+        flux = conv(a, kT, self.Ny, 1)
+        flux_mixed = conv(a, kT, self.Ny, 1 | 4)
+        bound = (self.nk + 2) * 2.0 ** -24 * conv(
+            np.abs(a), np.abs(kT), self.Ny, 1
+        )
+        return flux_mixed - flux, bound
+
+    def _get_dotD_args(self, inc, theta, veq, u):
+        veq, inc = float(veq), float(inc)
+        self._kT.check_bounds(veq, inc)
+        theta = np.atleast_1d(np.array(theta, dtype=np.float64))
+        u = np.atleast_1d(np.array(u, dtype=np.float64))
+        return self.xamp, veq, inc, theta, u
 
     @autocompile
     def get_flux_from_design(self, inc, theta, veq, u, a):
         """
         Compute the flux by dotting the design matrix into
         the spectral map. This is the *slow* way of computing
-        the model.
+        the model. The rows of the design matrix are built on
+        demand from the kernels, so it is never instantiated.
 
         """
-        D = self.get_D(inc, theta, veq, u)
-        flux = ts.dot(D, a)
+        kT = self.get_kT(inc, theta, veq, u)
+        flux = self._dot_toeplitz(kT, tt.reshape(a, (-1, 1)))
         return tt.reshape(flux, (self.nt, self.nw))
 
     @autocompile
     def get_flux_from_conv(self, inc, theta, veq, u, a):
         """
-        Compute the flux via a single 2d convolution.
+        Compute the flux via a single native convolution.
         This is the *faster* way of computing the model.
 
         """
         # Get the convolution kernels
         kT = self.get_kT(inc, theta, veq, u)
 
-        # The flux is just a 2d convolution!
-        flux = tt.nnet.conv2d(
-            tt.reshape(a, (1, self.Ny, 1, self.nwp)),
-            tt.reshape(kT, (self.nt, self.Ny, 1, self.nk)),
-            border_mode="valid",
-            filter_flip=False,
-            input_shape=(1, self.Ny, 1, self.nwp),
-            filter_shape=(self.nt, self.Ny, 1, self.nk),
+        # The flux is just a convolution!
+        return self._conv_Ny(
+            tt.reshape(a, (self.Ny, self.nwp)),
+            tt.reshape(kT, (self.nt * self.Ny, self.nk)),
         )
-        return flux[0, :, 0, :]
 
     @autocompile
     def get_flux_from_dotconv(self, inc, theta, veq, u, y, spectrum):
         """
-        Compute the flux via a dot product followed by a 2d convolution.
+        Compute the flux via a dot product followed by a convolution.
         This is usually the *fastest* way of computing the model.
 
         """
@@ -2198,7 +2493,7 @@ class OpsDoppler(OpsYlm):
     @autocompile
     def get_flux_from_convdot(self, inc, theta, veq, u, y, spectrum):
         """
-        Compute the flux via a 2d convolution follwed by a dot product.
+        Compute the flux via a convolution followed by a dot product.
         This is very fast, but usually slightly slower than
         ``get_flux_from_dotconv``.
 
@@ -2208,37 +2503,23 @@ class OpsDoppler(OpsYlm):
         return tt.reshape(flux, (self.nt, self.nw))
 
     @autocompile
-    def L1(self, ATA, ATy, lam, maxiter, eps, tol):
+    def L1(self, ATA, ATy, lam, maxiter, eps, tol, x0=None):
         """
-        L1 regularized least squares via iterated ridge (L2) regression.
-        See Section 2.5 of
-
-            https://www.cs.ubc.ca/~schmidtm/Documents/2005_Notes_Lasso.pdf
+        L1 regularized least squares, i.e., the minimum of
 
-        The basic idea is to iteratively zero out the prior on the weights
-        until convergence.
+            1/2 w^T ATA w - ATy^T w + lam |w|_1
 
-        TODO: Use `non_sequences`.
+        computed natively with the alternating direction method of
+        multipliers (ADMM). ``ATA`` is diagonalized once, after which each
+        iteration costs two matrix-vector products. The solver may be
+        warm-started at ``x0`` (default zero). The parameter ``eps`` is
+        ignored; it is only kept for backwards compatibility with the
+        previous iterated ridge regression solver.
 
         """
-        N = tt.shape(ATA)[0]
-        didx = (tt.arange(N), tt.arange(N))
-        w = tt.ones_like(ATA[0])
-
-        def step(w_prev):
-            absw = tt.abs_(w_prev)
-            absw = tt.switch(
-                tt.gt(absw, lam * eps), absw, lam * eps * tt.ones_like(absw)
-            )
-            KInv = tt.as_tensor_variable(ATA)
-            KInv = tt.inc_subtensor(KInv[didx], lam / absw)
-            choK = cho_factor(KInv)
-            w_new = cho_solve(choK, ATy)
-            chisq = tt.sum((w_prev - w_new) ** 2)
-            return w_new, scan_until(chisq < tol)
-
-        w, _ = theano.scan(step, outputs_info=w, n_steps=maxiter)
-        return w[-1]
+        if x0 is None:
+            x0 = tt.zeros_like(ATy)
+        return self._L1(ATA, ATy, lam, maxiter, tol, x0)
 
 
 class OpsSystem(object):
@@ -2255,6 +2536,8 @@ class OpsSystem(object):
         texp=None,
         oversample=7,
         order=0,
+        adaptive=False,
+        tol=1e-8,
     ):
         # System members
         self.primary = primary
@@ -2267,6 +2550,18 @@ class OpsSystem(object):
         self.texp = texp
         self.oversample = oversample
         self.order = order
+        self.adaptive = adaptive
+        self.tol = tol
+
+        # Keplerian solvers
+        self._orbit = OrbitOp(
+            _c_ops.orbit, G_grav, c_light, light_delay=light_delay
+        )
+        self._orbit_no_delay = OrbitOp(
+            _c_ops.orbit, G_grav, c_light, light_delay=False
+        )
+        self._occultations = OccultationsOp(_c_ops.occultations)
+        self._c_ops_ld = {}
 
     @autocompile
     def position(
@@ -2283,49 +2578,38 @@ class OpsSystem(object):
         sec_iorb,
     ):
         """Compute the Cartesian positions of all bodies."""
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=1.0,  # doesn't matter
-        )
-        # Position of the primary
-        if len(self.secondaries) > 1:
-            xyz = tt.sum(orbit.get_star_position(t), axis=-1)
-            x_pri = tt.reshape(xyz[0], (-1, 1))
-            y_pri = tt.reshape(xyz[1], (-1, 1))
-            z_pri = tt.reshape(xyz[2], (-1, 1))
-        else:
-            x_pri, y_pri, z_pri = orbit.get_star_position(t)
+        mtot = pri_m + sec_m
 
-        # The shape of `x`, `y`, `z` in `exoplanet` is unreliable!
-        if x_pri.ndim == 1:
-            x_pri = tt.reshape(x_pri, (-1, 1))
-            y_pri = tt.reshape(y_pri, (-1, 1))
-            z_pri = tt.reshape(z_pri, (-1, 1))
+        # Position of the primary
+        x_pri, y_pri, z_pri = self._orbit_no_delay(
+            t,
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            -sec_m / mtot,
+        )
+        x_pri = tt.sum(x_pri, axis=-1, keepdims=True)
+        y_pri = tt.sum(y_pri, axis=-1, keepdims=True)
+        z_pri = tt.sum(z_pri, axis=-1, keepdims=True)
 
         # Positions of the secondaries
-        try:
-            x_sec, y_sec, z_sec = orbit.get_planet_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x_sec, y_sec, z_sec = orbit.get_planet_position(t)
-
-        # The shape of `x`, `y`, `z` in `exoplanet` is unreliable!
-        if x_sec.ndim == 1:
-            x_sec = tt.reshape(x_sec, (-1, 1))
-            y_sec = tt.reshape(y_sec, (-1, 1))
-            z_sec = tt.reshape(z_sec, (-1, 1))
+        x_sec, y_sec, z_sec = self._orbit(
+            t,
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            pri_m / mtot,
+        )
 
         # Concatenate them
         x = tt.transpose(tt.concatenate((x_pri, x_sec), axis=-1))
@@ -2367,63 +2651,741 @@ class OpsSystem(object):
         sec_sigr,
     ):
         """Compute the system light curve design matrix."""
-        # Exposure time integration?
-        if self.texp != 0.0:
-
-            texp = tt.as_tensor_variable(self.texp)
-            oversample = int(self.oversample)
-            oversample += 1 - oversample % 2
-            stencil = np.ones(oversample)
-
-            # Construct the exposure time integration stencil
-            if self.order == 0:
-                dt = np.linspace(-0.5, 0.5, 2 * oversample + 1)[1:-1:2]
-            elif self.order == 1:
-                dt = np.linspace(-0.5, 0.5, oversample)
-                stencil[1:-1] = 2
-            elif self.order == 2:
-                dt = np.linspace(-0.5, 0.5, oversample)
-                stencil[1:-1:2] = 4
-                stencil[2:-1:2] = 2
-            else:
-                raise ValueError("Parameter `order` must be <= 2")
-            stencil /= np.sum(stencil)
-
-            if texp.ndim == 0:
-                dt = texp * dt
-            else:
-                dt = tt.shape_padright(texp) * dt
-            t = tt.shape_padright(t) + dt
-            t = tt.reshape(t, (-1,))
-
-        # Compute the relative positions of all bodies
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+        return self._X(
+            t,
+            pri_r,
+            pri_m,
+            pri_prot,
+            pri_t0,
+            pri_theta0,
+            pri_amp,
+            pri_inc,
+            pri_obl,
+            pri_fproj,
+            pri_u,
+            pri_f,
+            sec_r,
+            sec_m,
+            sec_prot,
+            sec_t0,
+            sec_theta0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            sec_amp,
+            sec_inc,
+            sec_obl,
+            sec_u,
+            sec_f,
+            sec_sigr,
+        )
+
+    def flux_batch(
+        self,
+        t,
+        r,
+        m,
+        prot,
+        t0,
+        theta0,
+        porb,
+        ecc,
+        w,
+        Omega,
+        iorb,
+        inc,
+        obl,
+        u,
+        f,
+        y,
+    ):
+        """Compute the flux of a batch of systems in a single native call.
+
+        The body parameters are matrices of shape ``(nbatch, nbody)``,
+        where the first body is the primary (whose orbital elements are
+        ignored), and ``u``, ``f``, and ``y`` are lists with the limb
+        darkening coefficients, the filter, and the amplitude-weighted
+        Ylm coefficients of each body. The systems are evaluated in
+        parallel and their design matrices are never instantiated.
+        Emitted light only, with no adaptive exposure time integration.
+        Greedy mode only.
+        """
+        if self.texp == 0.0:
+            dt, stencil = np.zeros(1), np.ones(1)
+        else:
+            dt, stencil = self._stencil()
+        return _c_ops.flux_batch(
+            self._body_c_ops,
+            t,
+            dt,
+            stencil,
+            float(self.texp),
+            r,
+            m,
+            prot,
+            t0,
+            theta0,
+            porb,
+            ecc,
+            w,
+            Omega,
+            iorb,
+            inc,
+            obl,
+            u,
+            f,
+            y,
+            G_grav,
+            c_light,
+            self.light_delay,
+        )
+
+    @property
+    def _body_c_ops(self):
+        """The C++ ops of the maps of all bodies. Limb-darkened maps are
+        represented by spherical harmonic ops of degree zero."""
+        c_ops = []
+        for body in [self.primary] + list(self.secondaries):
+            if hasattr(body.map.ops, "_c_ops"):
+                c_ops.append(body.map.ops._c_ops)
+            else:
+                udeg = body.map.ops.udeg
+                if udeg not in self._c_ops_ld:
+                    self._c_ops_ld[udeg] = _c_ops.Ops(0, udeg, 0)
+                c_ops.append(self._c_ops_ld[udeg])
+        return c_ops
+
+    @autocompile
+    def flux_batch_scan(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_fproj,
+        pri_u,
+        pri_f,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_f,
+        sec_sigr,
+        ay,
+    ):
+        """Compute the flux of a batch of systems.
+
+        All arguments except ``t`` have a leading batch dimension, and
+        ``ay`` holds the amplitude-weighted Ylm vectors of all bodies.
+        The systems are evaluated in a single ``scan`` so that the graph
+        is built and compiled only once for the entire batch. This is
+        the fallback of ``flux_batch`` for reflected light, oblate, and
+        adaptively integrated systems.
+        """
+
+        def step(*args):
+            *args, ay, t = args
+            return tt.dot(self._X(t, *args), ay)
+
+        flux, _ = theano.scan(
+            step,
+            sequences=[
+                pri_r,
+                pri_m,
+                pri_prot,
+                pri_t0,
+                pri_theta0,
+                pri_amp,
+                pri_inc,
+                pri_obl,
+                pri_fproj,
+                pri_u,
+                pri_f,
+                sec_r,
+                sec_m,
+                sec_prot,
+                sec_t0,
+                sec_theta0,
+                sec_porb,
+                sec_ecc,
+                sec_w,
+                sec_Omega,
+                sec_iorb,
+                sec_amp,
+                sec_inc,
+                sec_obl,
+                sec_u,
+                sec_f,
+                sec_sigr,
+                ay,
+            ],
+            non_sequences=[t],
+        )
+        return flux
+
+    @autocompile
+    def X_blocks(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_fproj,
+        pri_u,
+        pri_f,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_f,
+        sec_sigr,
+        mask,
+    ):
+        """Compute only the blocks of the system design matrix of the
+        bodies for which ``mask`` is nonzero."""
+        return self._X(
+            t,
+            pri_r,
+            pri_m,
+            pri_prot,
+            pri_t0,
+            pri_theta0,
+            pri_amp,
+            pri_inc,
+            pri_obl,
+            pri_fproj,
+            pri_u,
+            pri_f,
+            sec_r,
+            sec_m,
+            sec_prot,
+            sec_t0,
+            sec_theta0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            sec_amp,
+            sec_inc,
+            sec_obl,
+            sec_u,
+            sec_f,
+            sec_sigr,
+            mask=mask,
+        )
+
+    def _X(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_fproj,
+        pri_u,
+        pri_f,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_f,
+        sec_sigr,
+        pri_f0=None,
+        sec_f0=None,
+        mask=None,
+    ):
+        """Compute the exposure-integrated system design matrix.
+
+        If the identity filters ``pri_f0`` and ``sec_f0`` are provided (RV
+        maps only), the design matrix of each body is the horizontal stack
+        of its design matrices for the filters ``f`` and ``f0``. If
+        ``mask`` is provided, only the blocks of the bodies for which it
+        is nonzero are computed; all others are set to zero.
+        """
+        kwargs = dict(pri_f0=pri_f0, sec_f0=sec_f0, mask=mask)
+        args = (
+            pri_r,
+            pri_m,
+            pri_prot,
+            pri_t0,
+            pri_theta0,
+            pri_amp,
+            pri_inc,
+            pri_obl,
+            pri_fproj,
+            pri_u,
+            pri_f,
+            sec_r,
+            sec_m,
+            sec_prot,
+            sec_t0,
+            sec_theta0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            sec_amp,
+            sec_inc,
+            sec_obl,
+            sec_u,
+            sec_f,
+            sec_sigr,
+        )
+
+        # No exposure time integration
+        if self.texp == 0.0:
+            return self._design(t, *args, **kwargs)
+
+        # Per-cadence exposure times
+        texp = tt.ones_like(t) * self.texp
+
+        # Adaptive exposure time integration
+        if self.adaptive:
+            flag = self._near_contact(
+                t,
+                texp,
+                pri_r,
+                pri_m,
+                sec_r,
+                sec_m,
+                sec_t0,
+                sec_porb,
+                sec_ecc,
+                sec_w,
+                sec_Omega,
+                sec_iorb,
+            )
+            return self._integrate_adaptive(
+                t, texp, flag, pri_prot, sec_prot, *args, **kwargs
+            )
+
+        # Evaluate on the fine grid and sum
+        dt, stencil = self._stencil()
+        t = tt.shape_padright(t) + tt.shape_padright(texp) * dt
+        t = tt.reshape(t, (-1,))
+        X = self._design(t, *args, **kwargs)
+        stencil = tt.shape_padright(tt.shape_padleft(stencil, 1), 1)
+        return tt.sum(
+            stencil * tt.reshape(X, (-1, len(dt), X.shape[1])), axis=1
+        )
+
+    def _stencil(self):
+        """Return the exposure time integration offsets and weights.
+
+        The offsets are in units of the exposure time, relative to the
+        middle of the exposure.
+        """
+        oversample = int(self.oversample)
+        oversample += 1 - oversample % 2
+        stencil = np.ones(oversample)
+        if self.order == 0:
+            dt = np.linspace(-0.5, 0.5, 2 * oversample + 1)[1:-1:2]
+        elif self.order == 1:
+            dt = np.linspace(-0.5, 0.5, oversample)
+            stencil[1:-1] = 2
+        elif self.order == 2:
+            dt = np.linspace(-0.5, 0.5, oversample)
+            stencil[1:-1:2] = 4
+            stencil[2:-1:2] = 2
+        else:
+            raise ValueError("Parameter `order` must be <= 2")
+        stencil /= np.sum(stencil)
+        return dt, stencil
+
+    def _nlevels(self):
+        """Number of refinement levels of the adaptive integration."""
+        nlevels = int(np.ceil(np.log2(max(self.oversample - 1, 2))))
+        return max(1, nlevels - 1)
+
+    def sample_offsets(self):
+        """Return the offsets of all instants at which we may evaluate
+        the design matrix within an exposure, in units of ``texp``."""
+        if self.texp == 0.0:
+            return np.zeros(1)
+        elif self.adaptive:
+            return np.linspace(-0.5, 0.5, 2 ** (self._nlevels() + 1) + 1)
+        else:
+            return self._stencil()[0]
+
+    def occultors(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        sec_r,
+        sec_m,
+        sec_t0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+    ):
+        """Return the set of bodies that occult each body (greedy only).
+
+        Body ``0`` is the primary. The occultations are evaluated at
+        every instant returned by :py:meth:`sample_offsets`, so these
+        are exactly the occultations computed in the design matrix.
+        """
+        t = np.reshape(t, (-1, 1)) + np.reshape(
+            self.texp, (-1, 1)
+        ) * self.sample_offsets()
+        t = np.reshape(t, -1)
+        x, y, z = _c_ops.orbit(
+            t,
+            float(pri_m),
+            *[
+                np.reshape(arg, -1)
+                for arg in (
+                    sec_m,
+                    sec_t0,
+                    sec_porb,
+                    sec_ecc,
+                    sec_w,
+                    sec_Omega,
+                    sec_iorb,
+                    np.ones_like(sec_m),
+                )
+            ],
+            G_grav,
+            c_light,
+            self.light_delay,
+        )
+        zero = np.zeros((len(t), 1))
+        _, ptr = _c_ops.occultations(
+            np.hstack((zero, x)),
+            np.hstack((zero, y)),
+            np.hstack((zero, z)),
+            np.append(pri_r, sec_r),
+        )
+        nb = len(self.secondaries) + 1
+        return [
+            frozenset(
+                j for j in range(nb) if ptr[i * nb + j + 1] > ptr[i * nb + j]
+            )
+            for i in range(nb)
+        ]
+
+    def composite(self, p, x, y, z, r, res, extent, out=None):
+        """Rasterize all bodies onto a common image (greedy only).
+
+        The inputs are the sky-frame polynomials and positions returned
+        by :py:meth:`render_poly`, the radii of all bodies, the image
+        resolution, and the image ``extent`` as ``(xmin, xmax, ymin,
+        ymax)``. The image is written into ``out``, a C-contiguous
+        float64 array of shape ``(nt, res, res)``, which is allocated if
+        not provided. Returns ``out``.
+        """
+        x = np.atleast_2d(x)
+        if out is None:
+            out = np.empty((x.shape[0], int(res), int(res)))
+        _c_ops.composite(
+            [np.atleast_2d(pk) for pk in p],
+            x,
+            np.atleast_2d(y),
+            np.atleast_2d(z),
+            np.reshape(r, -1),
+            int(res),
+            *[float(e) for e in extent],
+            out,
+        )
+        return out
+
+    def _near_contact(
+        self,
+        t,
+        texp,
+        pri_r,
+        pri_m,
+        sec_r,
+        sec_m,
+        sec_t0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+    ):
+        """Flag the cadences during which any two bodies may overlap.
+
+        We compute the sky positions of all bodies at the start, middle,
+        and end of each exposure. A cadence is flagged if, for any pair of
+        bodies, the smallest sampled separation minus the largest distance
+        travelled between consecutive samples is less than the sum of
+        their radii. This is conservative for exposures that are short
+        compared to the orbital periods.
+        """
+        nt = t.shape[0]
+        x, y, _ = self._orbit(
+            tt.concatenate((t - 0.5 * texp, t, t + 0.5 * texp)),
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            tt.ones_like(sec_m),
+        )
+
+        # Positions relative to the primary, shape `(3, nt, nbodies)`
+        nsec = len(self.secondaries)
+        x = tt.concatenate((tt.zeros_like(x[:, :1]), x), axis=1)
+        y = tt.concatenate((tt.zeros_like(y[:, :1]), y), axis=1)
+        x = tt.reshape(x, (3, nt, nsec + 1))
+        y = tt.reshape(y, (3, nt, nsec + 1))
+        r = tt.concatenate((tt.reshape(pri_r, (1,)), sec_r))
+
+        flag = None
+        for i in range(nsec + 1):
+            for j in range(i + 1, nsec + 1):
+                dx = x[:, :, i] - x[:, :, j]
+                dy = y[:, :, i] - y[:, :, j]
+                b = tt.min(tt.sqrt(dx ** 2 + dy ** 2), axis=0)
+                step = tt.max(
+                    tt.sqrt(
+                        (dx[1:] - dx[:-1]) ** 2 + (dy[1:] - dy[:-1]) ** 2
+                    ),
+                    axis=0,
+                )
+                overlap = tt.lt(b - step, r[i] + r[j])
+                flag = overlap if flag is None else flag | overlap
+        return flag
+
+    def _phase_average(self, X, pri_prot, sec_prot, rv=False):
+        """Average the phase curve design matrix over the exposures.
+
+        ``X`` is the design matrix at the middle of each exposure, in the
+        absence of occultations. The phase curve of each body depends on
+        time only through the rotation ``R_z(theta)`` of its map about its
+        axis, which rotates the terms of order ``m`` by an angle
+        ``m theta``. Over an exposure of length ``texp``, the average of
+        this rotation is the rotation at the middle of the exposure scaled
+        by ``sinc(pi m texp / prot)``, so the integrated design matrix of
+        a body is ``X R_x(-pi / 2) S R_x(pi / 2)``, where ``S`` is this
+        diagonal scaling and ``R_x(pi / 2)`` is the final rotation to the
+        polar frame in :py:meth:`OpsYlm.right_project`.
+        """
+        bodies = [self.primary] + list(self.secondaries)
+        prot = [pri_prot] + [sec_prot[i] for i in range(len(bodies) - 1)]
+        one = math.to_tensor(1.0)
+        zero = math.to_tensor(0.0)
+        blocks = []
+        col = 0
+        for body, prot_k in zip(bodies, prot):
+            ops = body.map.ops
+            for _ in range(2 if rv else 1):
+                Xk = X[:, col : col + ops.ncols]
+                col += ops.ncols
+                if isinstance(ops, OpsLD) or ops.ydeg == 0:
+                    blocks.append(Xk)
+                    continue
+                prot_k = tt.switch(
+                    tt.eq(prot_k, 0.0), math.to_tensor(np.inf), prot_k
+                )
+                n = np.arange(ops.Ny)
+                l = np.floor(np.sqrt(n))
+                x = (np.pi * self.texp * (n - l ** 2 - l)) / prot_k
+                x0 = tt.eq(x, 0.0)
+                x_ = tt.switch(x0, one, x)
+                S = tt.switch(x0, one, tt.sin(x_) / x_)
+                Q = ops.dotR(
+                    tt.eye(ops.Ny), one, zero, zero, -0.5 * np.pi
+                ) * tt.shape_padleft(S)
+                Q = ops.dotR(Q, one, zero, zero, 0.5 * np.pi)
+                blocks.append(tt.dot(Xk, Q))
+        return tt.horizontal_stack(*blocks)
+
+    def _integrate_adaptive(
+        self, t, texp, flag, pri_prot, sec_prot, *args, **kwargs
+    ):
+        """Adaptive exposure time integration of the design matrix.
+
+        Away from any contact point, the flux is just the phase curve,
+        whose exposure integral we compute in closed form from the design
+        matrix at the middle of the exposure (see
+        :py:meth:`_phase_average`). The cadences in ``flag`` are
+        integrated with a three-point Simpson rule, which we refine by
+        halving the step, re-using all previous function evaluations,
+        until two consecutive estimates agree to within ``self.tol``
+        relative to the largest entry of the corresponding row of the
+        design matrix, or until there are at least ``self.oversample``
+        points per exposure. There is no closed form for the phase curves
+        in reflected light or of oblate bodies, so in those cases all
+        cadences are integrated with the Simpson rule.
+        """
+        nt = t.shape[0]
+        nlevels = self._nlevels()
+
+        # Evaluate everything at the middle of the exposures
+        Xc = self._design(t, *args, **kwargs)
+        if self._reflected or self._oblate:
+            X = Xc
+            idx = tt.arange(nt)
+        else:
+            X = self._phase_average(
+                Xc, pri_prot, sec_prot, rv=kwargs.get("pri_f0") is not None
+            )
+            idx = tt.arange(nt)[flag]
+
+        # Three-point Simpson rule for the cadences in `idx`. We keep
+        # track of the endpoints `E`, the old interior points `A`, and the
+        # newest interior points `B`, so that with `N` intervals the
+        # integral is `(E + 2 * A + 4 * B) / (3 * N)`.
+        ni = idx.shape[0]
+        X0 = self._design(
+            tt.concatenate(
+                (t[idx] - 0.5 * texp[idx], t[idx] + 0.5 * texp[idx])
+            ),
+            *args,
+            **kwargs
+        )
+        E = X0[:ni] + X0[ni:]
+        B = Xc[idx]
+        A = tt.zeros_like(B)
+        Xs = (E + 4 * B) / 6
+
+        # Refine; `sub` indexes the cadences in `idx`
+        sub = tt.arange(ni)
+        for level in range(1, nlevels + 1):
+            n = 2 ** level
+            dt = (np.arange(n) + 0.5) / n - 0.5
+            i = idx[sub]
+            tnew = tt.reshape(
+                tt.shape_padright(t[i]) + tt.shape_padright(texp[i]) * dt,
+                (-1,),
+            )
+            Bnew = tt.sum(
+                tt.reshape(
+                    self._design(tnew, *args, **kwargs), (-1, n, X.shape[1])
+                ),
+                axis=1,
+            )
+            Anew = A[sub] + B[sub]
+            Xnew = (E[sub] + 2 * Anew + 4 * Bnew) / (6 * n)
+            err = tt.max(tt.abs_(Xnew - Xs[sub]), axis=1) / 15
+            scale = tt.max(tt.abs_(Xnew), axis=1)
+            A = tt.set_subtensor(A[sub], Anew)
+            B = tt.set_subtensor(B[sub], Bnew)
+            Xs = tt.set_subtensor(Xs[sub], Xnew)
+            sub = sub[tt.gt(err, self.tol * scale)]
+
+        return tt.set_subtensor(X[idx], Xs)
+
+    def _design(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_fproj,
+        pri_u,
+        pri_f,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_f,
+        sec_sigr,
+        pri_f0=None,
+        sec_f0=None,
+        mask=None,
+    ):
+        """Compute the system design matrix at the instants ``t``."""
+        # In RV mode, the design matrices of each body for the filters
+        # `f` and `f0` are computed together and stacked horizontally
+        if pri_f0 is None:
+            pri_X = self.primary.map.ops.X
+            sec_X = [sec.map.ops.X for sec in self.secondaries]
+        else:
+
+            def pri_X(*args):
+                return self.primary.map.ops.X_rv(*args, pri_f0)
+
+            def sec_X_rv(i):
+                return lambda *args: self.secondaries[i].map.ops.X_rv(
+                    *args, sec_f0[i]
+                )
+
+            sec_X = [sec_X_rv(i) for i in range(len(self.secondaries))]
+
+        # Compute the relative positions of all bodies
+        x, y, z = self._orbit(
+            t,
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            tt.ones_like(sec_m),
         )
-        try:
-            x, y, z = orbit.get_relative_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x, y, z = orbit.get_relative_position(t)
-
-        # The shape of `x`, `y`, `z` in `exoplanet` is unreliable!
-        if x.ndim == 1:
-            x = tt.reshape(x, (-1, 1))
-            y = tt.reshape(y, (-1, 1))
-            z = tt.reshape(z, (-1, 1))
 
         # Get all rotational phases
         pri_prot = ifelse(
@@ -2452,7 +3414,7 @@ class OpsSystem(object):
                 pri_f,
             )
         else:
-            phase_pri = pri_amp * self.primary.map.ops.X(
+            phase_pri = pri_amp * pri_X(
                 theta_pri,
                 tt.zeros_like(t),
                 tt.zeros_like(t),
@@ -2488,7 +3450,7 @@ class OpsSystem(object):
         else:
             phase_sec = [
                 sec_amp[i]
-                * sec.map.ops.X(
+                * sec_X[i](
                     theta_sec[i],
                     -x[:, i],
                     -y[:, i],
@@ -2506,35 +3468,39 @@ class OpsSystem(object):
         occ_pri = tt.zeros_like(phase_pri)
         occ_sec = [tt.zeros_like(ps) for ps in phase_sec]
 
-        # Compute the period if we were given a semi-major axis
-        sec_porb = tt.switch(
-            tt.eq(sec_porb, 0.0),
-            (G_grav * (pri_m + sec_m) * sec_porb ** 2 / (4 * np.pi ** 2))
-            ** (1.0 / 3),
-            sec_porb,
+        # Index all occultation events. Body `0` is the primary, which
+        # sits at the origin; the events in which body `i` is occulted
+        # by body `j` are `idx[ptr[k]:ptr[k + 1]]` with `k = i * nb + j`
+        nb = len(self.secondaries) + 1
+        zero = tt.zeros_like(x[:, :1])
+        idx, ptr = self._occultations(
+            tt.concatenate((zero, x), axis=1),
+            tt.concatenate((zero, y), axis=1),
+            tt.concatenate((zero, z), axis=1),
+            tt.concatenate((tt.reshape(pri_r, (1,)), sec_r)),
         )
 
+        def events(i, j):
+            k = i * nb + j
+            return idx[ptr[k] : ptr[k + 1]]
+
         # Compute transits across the primary
         for i, _ in enumerate(self.secondaries):
-            xo = x[:, i] / pri_r
-            yo = y[:, i] / pri_r
-            zo = z[:, i] / pri_r
+            n = events(0, i + 1)
+            xo = x[n, i] / pri_r
+            yo = y[n, i] / pri_r
+            zo = z[n, i] / pri_r
             ro = sec_r[i] / pri_r
-            b = tt.sqrt(xo ** 2 + yo ** 2)
-            b_occ = tt.invert(
-                tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-            )
-            idx = tt.arange(b.shape[0])[b_occ]
             if self._oblate:
                 occ_pri = tt.set_subtensor(
-                    occ_pri[idx],
-                    occ_pri[idx]
+                    occ_pri[n],
+                    occ_pri[n]
                     + pri_amp
                     * self.primary.map.ops.X(
-                        theta_pri[idx],
-                        xo[idx],
-                        yo[idx],
-                        zo[idx],
+                        theta_pri[n],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         pri_inc,
                         pri_obl,
@@ -2542,76 +3508,71 @@ class OpsSystem(object):
                         pri_u,
                         pri_f,
                     )
-                    - phase_pri[idx],
+                    - phase_pri[n],
                 )
             else:
                 occ_pri = tt.set_subtensor(
-                    occ_pri[idx],
-                    occ_pri[idx]
+                    occ_pri[n],
+                    occ_pri[n]
                     + pri_amp
-                    * self.primary.map.ops.X(
-                        theta_pri[idx],
-                        xo[idx],
-                        yo[idx],
-                        zo[idx],
+                    * pri_X(
+                        theta_pri[n],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         pri_inc,
                         pri_obl,
                         pri_u,
                         pri_f,
                     )
-                    - phase_pri[idx],
+                    - phase_pri[n],
                 )
 
         # Compute occultations by the primary
         for i, sec in enumerate(self.secondaries):
-
-            xo = -x[:, i] / sec_r[i]
-            yo = -y[:, i] / sec_r[i]
-            zo = -z[:, i] / sec_r[i]
+            n = events(i + 1, 0)
+            xo = -x[n, i] / sec_r[i]
+            yo = -y[n, i] / sec_r[i]
+            zo = -z[n, i] / sec_r[i]
             ro = pri_r / sec_r[i]
-            b = tt.sqrt(xo ** 2 + yo ** 2)
-            b_occ = tt.invert(
-                tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-            )
-            idx = tt.arange(b.shape[0])[b_occ]
             if self._oblate:
                 # TODO: Occultations *by* an oblate occultor are not
                 # currently supported. The following code ignores any
                 # oblateness and instead treats the body as a spherical
                 # occultor with radius equal to its equatorial radius.
                 occ_sec[i] = tt.set_subtensor(
-                    occ_sec[i][idx],
-                    occ_sec[i][idx]
+                    occ_sec[i][n],
+                    occ_sec[i][n]
                     + sec_amp[i]
                     * sec.map.ops.X(
-                        theta_sec[i, idx],
-                        xo[idx],
-                        yo[idx],
-                        zo[idx],
+                        theta_sec[i, n],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         sec_inc[i],
                         sec_obl[i],
                         sec_u[i],
                         sec_f[i],
                     )
-                    - phase_sec[i][idx],
+                    - phase_sec[i][n],
                 )
             elif self._reflected:
                 occ_sec[i] = tt.set_subtensor(
-                    occ_sec[i][idx],
-                    occ_sec[i][idx]
+                    occ_sec[i][n],
+                    occ_sec[i][n]
                     + pri_amp
                     * sec_amp[i]
                     * sec.map.ops.X(
-                        theta_sec[i, idx],
-                        xo[idx],  # the primary is both the source...
-                        yo[idx],
-                        zo[idx],
+                        theta_sec[i, n],
+                        xo,  # the primary is both the source...
+                        yo,
+                        zo,
                         ro,
-                        xo[idx],  # ... and the occultor
-                        yo[idx],
-                        zo[idx],
+                        xo,  # ... and the occultor
+                        yo,
+                        zo,
                         ro,
                         sec_inc[i],
                         sec_obl[i],
@@ -2619,25 +3580,25 @@ class OpsSystem(object):
                         sec_f[i],
                         sec_sigr[i],
                     )
-                    - phase_sec[i][idx],
+                    - phase_sec[i][n],
                 )
             else:
                 occ_sec[i] = tt.set_subtensor(
-                    occ_sec[i][idx],
-                    occ_sec[i][idx]
+                    occ_sec[i][n],
+                    occ_sec[i][n]
                     + sec_amp[i]
-                    * sec.map.ops.X(
-                        theta_sec[i, idx],
-                        xo[idx],
-                        yo[idx],
-                        zo[idx],
+                    * sec_X[i](
+                        theta_sec[i, n],
+                        xo,
+                        yo,
+                        zo,
                         ro,
                         sec_inc[i],
                         sec_obl[i],
                         sec_u[i],
                         sec_f[i],
                     )
-                    - phase_sec[i][idx],
+                    - phase_sec[i][n],
                 )
 
         # Compute secondary-secondary occultations
@@ -2645,33 +3606,29 @@ class OpsSystem(object):
             for j, _ in enumerate(self.secondaries):
                 if i == j:
                     continue
-                xo = (-x[:, i] + x[:, j]) / sec_r[i]
-                yo = (-y[:, i] + y[:, j]) / sec_r[i]
-                zo = (-z[:, i] + z[:, j]) / sec_r[i]
+                n = events(i + 1, j + 1)
+                xo = (-x[n, i] + x[n, j]) / sec_r[i]
+                yo = (-y[n, i] + y[n, j]) / sec_r[i]
+                zo = (-z[n, i] + z[n, j]) / sec_r[i]
                 ro = sec_r[j] / sec_r[i]
-                b = tt.sqrt(xo ** 2 + yo ** 2)
-                b_occ = tt.invert(
-                    tt.ge(b, 1.0 + ro) | tt.le(zo, 0.0) | tt.eq(ro, 0.0)
-                )
-                idx = tt.arange(b.shape[0])[b_occ]
                 if self._reflected:
-                    xs = -x[:, i] / sec_r[i]
-                    ys = -y[:, i] / sec_r[i]
-                    zs = -z[:, i] / sec_r[i]
+                    xs = -x[n, i] / sec_r[i]
+                    ys = -y[n, i] / sec_r[i]
+                    zs = -z[n, i] / sec_r[i]
                     occ_sec[i] = tt.set_subtensor(
-                        occ_sec[i][idx],
-                        occ_sec[i][idx]
+                        occ_sec[i][n],
+                        occ_sec[i][n]
                         + sec_amp[i]
                         * pri_amp
                         * sec.map.ops.X(
-                            theta_sec[i, idx],
-                            xs[idx],  # the primary is the source
-                            ys[idx],
-                            zs[idx],
+                            theta_sec[i, n],
+                            xs,  # the primary is the source
+                            ys,
+                            zs,
                             pri_r / sec_r[i],
-                            xo[idx],  # another secondary is the occultor
-                            yo[idx],
-                            zo[idx],
+                            xo,  # another secondary is the occultor
+                            yo,
+                            zo,
                             ro,
                             sec_inc[i],
                             sec_obl[i],
@@ -2679,44 +3636,46 @@ class OpsSystem(object):
                             sec_f[i],
                             sec_sigr[i],
                         )
-                        - phase_sec[i][idx],
+                        - phase_sec[i][n],
                     )
                 else:
                     occ_sec[i] = tt.set_subtensor(
-                        occ_sec[i][idx],
-                        occ_sec[i][idx]
+                        occ_sec[i][n],
+                        occ_sec[i][n]
                         + sec_amp[i]
-                        * sec.map.ops.X(
-                            theta_sec[i, idx],
-                            xo[idx],
-                            yo[idx],
-                            zo[idx],
+                        * sec_X[i](
+                            theta_sec[i, n],
+                            xo,
+                            yo,
+                            zo,
                             ro,
                             sec_inc[i],
                             sec_obl[i],
                             sec_u[i],
                             sec_f[i],
                         )
-                        - phase_sec[i][idx],
+                        - phase_sec[i][n],
                     )
 
-        # Concatenate the design matrices
-        X_pri = phase_pri + occ_pri
-        X_sec = [ps + os for ps, os in zip(phase_sec, occ_sec)]
-        X = tt.horizontal_stack(X_pri, *X_sec)
-
-        # Sum and return
-        if self.texp == 0.0:
-
-            return X
-
-        else:
-
-            stencil = tt.shape_padright(tt.shape_padleft(stencil, 1), 1)
-            return tt.sum(
-                stencil * tt.reshape(X, (-1, self.oversample, X.shape[1])),
-                axis=1,
-            )
+        # Concatenate the design matrices. Since `ifelse` is lazy, the
+        # blocks of the masked bodies are never evaluated.
+        X = [phase_pri + occ_pri] + [
+            ps + os for ps, os in zip(phase_sec, occ_sec)
+        ]
+        if mask is not None:
+            ncols = [
+                body.map.ops.ncols * (1 if pri_f0 is None else 2)
+                for body in [self.primary] + list(self.secondaries)
+            ]
+            X = [
+                ifelse(
+                    tt.neq(mask[k], 0),
+                    Xk,
+                    tt.zeros((t.shape[0], ncols[k]), dtype=Xk.dtype),
+                )
+                for k, Xk in enumerate(X)
+            ]
+        return tt.horizontal_stack(*X)
 
     @autocompile
     def rv(
@@ -2756,11 +3715,6 @@ class OpsSystem(object):
         keplerian,
     ):
         """Compute the observed system radial velocity (RV maps only)."""
-        # TODO: This method is currently very inefficient, as it
-        # calls `X` twice per call and instantiates an `orbit`
-        # instance up to three separate times per call. We should
-        # re-code the logic from `X()` in here to optimize it.
-
         # Compute the RV filter
         pri_f = self.primary.map.ops.compute_rv_filter(
             pri_inc, pri_obl, pri_veq, pri_alpha
@@ -2779,8 +3733,9 @@ class OpsSystem(object):
         pri_f0 = tt.set_subtensor(pri_f0[0], np.pi)
         sec_f0 = tt.as_tensor_variable([pri_f0 for sec in self.secondaries])
 
-        # Compute the two design matrices
-        X = self.X(
+        # Compute the velocity-weighted and the intensity design
+        # matrices of all bodies in a single pass
+        X = self._X(
             t,
             pri_r,
             pri_m,
@@ -2809,94 +3764,122 @@ class OpsSystem(object):
             sec_u,
             sec_f,
             sec_sigr,
+            pri_f0=pri_f0,
+            sec_f0=sec_f0,
         )
 
-        X0 = self.X(
+        # Get the indices of X corresponding to each body
+        # and to each of the two filters
+        Ny = [self.primary.map.Ny] + [sec.map.Ny for sec in self.secondaries]
+        y = [pri_y] + [sec_y[n] for n in range(len(self.secondaries))]
+        Iv = []
+        invI = []
+        n = 0
+        for k in range(len(Ny)):
+
+            # Compute the integral of the velocity-weighted intensity
+            Iv.append(tt.dot(X[:, n : n + Ny[k]], y[k]))
+
+            # Compute the inverse of the integral of the intensity
+            invI.append(
+                tt.ones((1,)) / tt.dot(X[:, n + Ny[k] : n + 2 * Ny[k]], y[k])
+            )
+            n += 2 * Ny[k]
+
+        Iv = tt.as_tensor_variable(Iv)
+        invI = tt.as_tensor_variable(invI)
+        invI = tt.where(tt.isinf(invI), 0.0, invI)
+
+        # The RV anomaly is just the product
+        rv = Iv * invI
+
+        # Compute the Keplerian RV from the relative positions. These
+        # are the same positions used in the design matrix when there is
+        # no exposure time integration and no light travel time delay
+        if self.light_delay:
+            orbit = self._orbit_no_delay
+        else:
+            orbit = self._orbit
+        x, y, z = orbit(
             t,
-            pri_r,
             pri_m,
-            pri_prot,
-            pri_t0,
-            pri_theta0,
-            pri_amp,
-            pri_inc,
-            pri_obl,
-            pri_fproj,
-            pri_u,
-            pri_f0,
-            sec_r,
             sec_m,
-            sec_prot,
             sec_t0,
-            sec_theta0,
             sec_porb,
             sec_ecc,
             sec_w,
             sec_Omega,
             sec_iorb,
-            sec_amp,
-            sec_inc,
-            sec_obl,
-            sec_u,
-            sec_f0,
-            sec_sigr,
-        )
-
-        # Get the indices of X corresponding to each body
-        pri_inds = np.arange(0, self.primary.map.Ny, dtype=int)
-        sec_inds = [None for sec in self.secondaries]
-        n = self.primary.map.Ny
-        for i, sec in enumerate(self.secondaries):
-            sec_inds[i] = np.arange(n, n + sec.map.Ny, dtype=int)
-            n += sec.map.Ny
-
-        # Compute the integral of the velocity-weighted intensity
-        Iv = tt.as_tensor_variable(
-            [tt.dot(X[:, pri_inds], pri_y)]
-            + [
-                tt.dot(X[:, sec_inds[n]], sec_y[n])
-                for n in range(len(self.secondaries))
-            ]
-        )
-
-        # Compute the inverse of the integral of the intensity
-        invI = tt.as_tensor_variable(
-            [tt.ones((1,)) / tt.dot(X0[:, pri_inds], pri_y)]
-            + [
-                tt.ones((1,)) / tt.dot(X0[:, sec_inds[n]], sec_y[n])
-                for n in range(len(self.secondaries))
-            ]
-        )
-        invI = tt.where(tt.isinf(invI), 0.0, invI)
-
-        # The RV anomaly is just the product
-        rv = Iv * invI
-
-        # Compute the Keplerian RV
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+            tt.ones_like(sec_m),
         )
         return ifelse(
             keplerian,
             tt.inc_subtensor(
                 rv[1:],
                 tt.transpose(
-                    orbit.get_radial_velocity(
-                        t, output_units=units.m / units.s
+                    self._keplerian_rv(
+                        x,
+                        y,
+                        z,
+                        pri_m,
+                        sec_m,
+                        sec_porb,
+                        sec_ecc,
+                        sec_w,
+                        sec_Omega,
+                        sec_iorb,
                     )
                 ),
             ),
             rv,
         )
 
+    def _keplerian_rv(
+        self,
+        x,
+        y,
+        z,
+        pri_m,
+        sec_m,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+    ):
+        """Radial velocity of the primary in m/s due to each secondary.
+
+        We recover the eccentric anomaly from the positions of each
+        secondary relative to the primary, and differentiate the
+        line-of-sight position with respect to time analytically.
+        """
+        mtot = pri_m + sec_m
+        n = 2 * np.pi / sec_porb
+        a = (G_grav * mtot * sec_porb ** 2 / (4 * np.pi ** 2)) ** (1.0 / 3)
+        cosw, sinw = tt.cos(sec_w), tt.sin(sec_w)
+        cosO, sinO = tt.cos(sec_Omega), tt.sin(sec_Omega)
+        cosi, sini = tt.cos(sec_iorb), tt.sin(sec_iorb)
+        sqrt1me2 = tt.sqrt(1 - sec_ecc ** 2)
+
+        # Rotate back into the orbital plane
+        p = cosO * x + sinO * y
+        q = cosi * (cosO * y - sinO * x) - sini * z
+        xorb = cosw * p + sinw * q
+        yorb = cosw * q - sinw * p
+
+        # Eccentric anomaly and its time derivative
+        cosE = -xorb / a + sec_ecc
+        sinE = -yorb / (a * sqrt1me2)
+        dEdt = n / (1 - sec_ecc * cosE)
+
+        # Line-of-sight velocity of the secondary relative to the primary
+        dxorb = a * sinE * dEdt
+        dyorb = -a * sqrt1me2 * cosE * dEdt
+        vz = -sini * (sinw * dxorb + cosw * dyorb)
+
+        # Reflex velocity of the primary, positive away from the observer
+        return vz * sec_m / mtot * rv_conv
+
     @autocompile
     def render(
         self,
@@ -2932,33 +3915,18 @@ class OpsSystem(object):
     ):
         """Render all of the bodies in the system."""
         # Compute the relative positions of all bodies
-        orbit = exoplanet.orbits.KeplerianOrbit(
-            period=sec_porb,
-            t0=sec_t0,
-            incl=sec_iorb,
-            ecc=sec_ecc,
-            omega=sec_w,
-            Omega=sec_Omega,
-            m_planet=sec_m,
-            m_star=pri_m,
-            r_star=pri_r,
+        x, y, z = self._orbit(
+            t,
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            tt.ones_like(sec_m),
         )
-        try:
-            x, y, z = orbit.get_relative_position(
-                t, light_delay=self.light_delay
-            )
-        except TypeError:
-            if self.light_delay:
-                logger.warn(
-                    "This version of `exoplanet` does not model light delays."
-                )
-            x, y, z = orbit.get_relative_position(t)
-
-        # The shape of `x`, `y`, `z` in `exoplanet` is unreliable!
-        if x.ndim == 1:
-            x = tt.reshape(x, (-1, 1))
-            y = tt.reshape(y, (-1, 1))
-            z = tt.reshape(z, (-1, 1))
 
         # Get all rotational phases
         pri_prot = ifelse(
@@ -3038,3 +4006,91 @@ class OpsSystem(object):
 
         # Return the images and secondary orbital positions
         return img_pri, img_sec, x, y, z
+
+    @autocompile
+    def render_poly(
+        self,
+        t,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_y,
+        pri_u,
+        pri_f,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_y,
+        sec_u,
+        sec_f,
+    ):
+        """Return the sky positions of all bodies and the polynomials
+        describing their surfaces, for use with the native compositor.
+
+        The outputs are the ``x``, ``y``, and ``z`` positions of all
+        bodies relative to the primary, each of shape ``(nt, nbody)``,
+        followed by the polynomial coefficients of each body, of shape
+        ``(npoly, nt)``, weighted by the body amplitudes. Body ``0`` is
+        the primary.
+        """
+        # Compute the relative positions of all bodies
+        x, y, z = self._orbit(
+            t,
+            pri_m,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            tt.ones_like(sec_m),
+        )
+        x = tt.concatenate((tt.zeros_like(x[:, :1]), x), axis=1)
+        y = tt.concatenate((tt.zeros_like(y[:, :1]), y), axis=1)
+        z = tt.concatenate((tt.zeros_like(z[:, :1]), z), axis=1)
+
+        # Get all rotational phases
+        pri_prot = ifelse(
+            tt.eq(pri_prot, 0.0), math.to_tensor(np.inf), pri_prot
+        )
+        theta_pri = (2 * np.pi) / pri_prot * (t - pri_t0) + pri_theta0
+        sec_prot = tt.switch(
+            tt.eq(sec_prot, 0.0), math.to_tensor(np.inf), sec_prot
+        )
+        theta_sec = (2 * np.pi) / tt.shape_padright(sec_prot) * (
+            tt.shape_padleft(t) - tt.shape_padright(sec_t0)
+        ) + tt.shape_padright(sec_theta0)
+
+        # Sky-frame polynomials of all the maps
+        p = [
+            pri_amp
+            * self.primary.map.ops.render_poly(
+                theta_pri, pri_inc, pri_obl, pri_y, pri_u, pri_f
+            )
+        ] + [
+            sec_amp[i]
+            * sec.map.ops.render_poly(
+                theta_sec[i],
+                sec_inc[i],
+                sec_obl[i],
+                sec_y[i],
+                sec_u[i],
+                sec_f[i],
+            )
+            for i, sec in enumerate(self.secondaries)
+        ]
+        return [x, y, z] + p
@@ -3,12 +3,30 @@ from .. import config
 from ..compat import theano, tt, ts, slinalg, floatX
 from .._constants import *
 from .utils import *
+from .ops import CovarianceSolveOp
 import numpy as np
 from scipy.linalg import block_diag as scipy_block_diag
 import scipy
 from scipy.sparse import issparse, csr_matrix
-
-__all__ = ["lazy_math", "greedy_math", "lazy_linalg", "greedy_linalg", "nadam"]
+from scipy.sparse.linalg import aslinearoperator
+import os
+
+# C extensions are not installed on RTD
+if os.getenv("READTHEDOCS") == "True":  # pragma: no cover
+    _c_ops = None
+else:
+    from .. import _c_ops
+
+__all__ = [
+    "lazy_math",
+    "greedy_math",
+    "lazy_linalg",
+    "greedy_linalg",
+    "nadam",
+    "BandedCovariance",
+    "SemiseparableCovariance",
+    "LowRankCovariance",
+]
 
 
 # Cholesky solve
@@ -26,20 +44,183 @@ def _cho_solve(cho_A, b):
     return _solve_upper(tt.transpose(cho_A), _solve_lower(cho_A, b))
 
 
+class StructuredCovariance(object):
+    """Base class for data covariance matrices with structure that allows
+    linear-time solves. These are never instantiated as dense matrices;
+    instead, all solves are performed in C++ via :py:meth:`solve`. The
+    covariance is factorized only once, and the factorization is reused
+    by all subsequent solves and by :py:meth:`lndet`.
+    """
+
+    kind = None
+
+    def __init__(self, factor, *params):
+        self._params = [self._cast(p) for p in params]
+        self._factor_type = getattr(_c_ops, factor, None)
+        self._op = CovarianceSolveOp(self._factor_type)
+        self._factor = None
+
+    @staticmethod
+    def _cast(p):
+        if is_tensor(p):
+            return tt.as_tensor_variable(p).astype(floatX)
+        else:
+            return np.array(p, dtype=floatX)
+
+    def solve(self, B, lazy):
+        """Return ``C^-1 B`` and the log determinant of ``C``.
+
+        Args:
+            B (matrix): The right hand side, of shape ``(N, M)``.
+            lazy (bool): Return a Theano graph?
+        """
+        if lazy:
+            return self._op(B, *self._params)
+        else:
+            factor = self.factor()
+            return factor.solve(np.atleast_2d(B)), factor.lndet
+
+    def lndet(self, lazy):
+        """Return the log determinant of ``C``.
+
+        Args:
+            lazy (bool): Return a Theano graph?
+        """
+        if lazy:
+            # The factorization is cached by the op and shared with
+            # all other solves with the same parameters
+            return self._op(tt.zeros((self.N, 0)), *self._params)[1]
+        else:
+            return self.factor().lndet
+
+    def factor(self):
+        """Return the C++ factorization of the covariance, computing it on
+        the first call. Greedy mode only."""
+        if self._factor is None:
+            self._factor = self._factor_type(*self._params)
+        return self._factor
+
+
+class BandedCovariance(StructuredCovariance):
+    """A banded data covariance matrix.
+
+    Args:
+        C (matrix): The covariance in lower band storage, of shape
+            ``(N, w + 1)`` for a matrix of bandwidth ``w``: the element
+            ``C[i, k]`` is the covariance between data points ``i`` and
+            ``i - k``. Elements with ``i - k < 0`` are ignored.
+
+    Solves cost ``O(N w^2)``.
+    """
+
+    kind = "banded"
+
+    def __init__(self, C):
+        super(BandedCovariance, self).__init__("BandedCovariance", C)
+        self.N = self._params[0].shape[0]
+
+
+class SemiseparableCovariance(StructuredCovariance):
+    """A semiseparable data covariance matrix of the ``celerite`` form.
+
+    The covariance between data points at times ``t_i`` and ``t_j`` is
+    the sum of a set of real and complex terms evaluated at
+    ``tau = |t_i - t_j|``, plus a diagonal term.
+
+    Args:
+        t (vector): The times of the data points, sorted in increasing order.
+        diag (scalar or vector): The diagonal (white noise) variance.
+        real_terms (tuple, optional): A tuple of vectors ``(a, c)``
+            describing the real terms ``a exp(-c tau)``. Default is None.
+        complex_terms (tuple, optional): A tuple of vectors
+            ``(a, b, c, d)`` describing the complex terms
+            ``exp(-c tau) (a cos(d tau) + b sin(d tau))``. Default is None.
+
+    Solves cost ``O(N J^2)``, where ``J`` is the number of real terms plus
+    twice the number of complex terms.
+    """
+
+    kind = "semiseparable"
+
+    def __init__(self, t, diag, real_terms=None, complex_terms=None):
+        if real_terms is None:
+            real_terms = [np.zeros(0)] * 2
+        if complex_terms is None:
+            complex_terms = [np.zeros(0)] * 4
+        assert len(real_terms) == 2, "Real terms must be a tuple `(a, c)`."
+        assert (
+            len(complex_terms) == 4
+        ), "Complex terms must be a tuple `(a, b, c, d)`."
+        t = self._cast(t)
+        diag = self._cast(diag)
+        terms = [self._cast(p) for p in list(real_terms) + list(complex_terms)]
+        if is_tensor(t, diag, *terms):
+            diag = diag * tt.ones_like(t)
+            terms = [tt.reshape(p, (-1,)) for p in terms]
+        else:
+            diag = diag * np.ones_like(t)
+            terms = [np.reshape(p, -1) for p in terms]
+        super(SemiseparableCovariance, self).__init__(
+            "SemiseparableCovariance", t, diag, *terms
+        )
+        self.N = self._params[0].shape[0]
+
+
+class LowRankCovariance(StructuredCovariance):
+    """A diagonal data covariance matrix plus a low-rank update,
+    ``C = diag(D) + U S U^T``.
+
+    Args:
+        D (scalar or vector): The diagonal variance.
+        U (matrix): The low-rank basis, of shape ``(N, K)``.
+        S (scalar, vector, or matrix, optional): The covariance of the
+            low-rank terms, of shape ``(K, K)`` if a matrix. Default is 1.
+
+    Solves use the Woodbury identity and cost ``O(N K^2)``.
+    """
+
+    kind = "lowrank"
+
+    def __init__(self, D, U, S=1.0):
+        U = self._cast(U)
+        S = self._cast(S)
+        D = self._cast(D)
+        if is_tensor(U, S, D):
+            D = D * tt.ones(U.shape[0])
+            if S.ndim < 2:
+                S = S * tt.eye(U.shape[1])
+        else:
+            D = D * np.ones(U.shape[0])
+            if S.ndim < 2:
+                S = S * np.eye(U.shape[1])
+        super(LowRankCovariance, self).__init__("LowRankCovariance", D, U, S)
+        self.N = self._params[1].shape[0]
+
+
 def _get_covariance(math, linalg, C=None, cho_C=None, N=None):
     """A container for covariance matrices.
 
     Args:
-        C (scalar, vector, or matrix, optional): The covariance.
-            Defaults to None.
+        C (scalar, vector, matrix, or StructuredCovariance, optional):
+            The covariance. Defaults to None.
         cho_C (matrix, optional): The lower Cholesky factorization of
             the covariance. Defaults to None.
         N (int, optional): The number of rows/columns in the covariance
             matrix, required if ``C`` is a scalar. Defaults to None.
     """
 
+    # User provided a structured covariance
+    if isinstance(C, StructuredCovariance):
+
+        value = C
+        cholesky = C
+        inverse = C
+        lndet = C.lndet(math.lazy)
+        kind = C.kind
+        N = C.N
+
     # User provided the Cholesky factorization
-    if cho_C is not None:
+    elif cho_C is not None:
 
         cholesky = math.cast(cho_C)
         value = math.dot(cholesky, math.transpose(cholesky))
@@ -226,6 +407,35 @@ class MathType(type):
             else:
                 raise ValueError("At least one input must be sparse.")
 
+    def spline_operator(cls, x, xout, k=3, tol=0.0):
+        """Return the sparse (``csr``) matrix that interpolates data on
+        the grid ``x`` onto the grid ``xout`` with an interpolating spline
+        of order ``k`` (the same as ``scipy``'s
+        ``InterpolatedUnivariateSpline``), dropping entries smaller than
+        ``tol`` in absolute value. The grids must be numerical."""
+        assert not is_tensor(x, xout), "The grids must be numerical."
+        return _c_ops.spline_operator(
+            np.array(x, dtype=np.float64),
+            np.array(xout, dtype=np.float64),
+            int(k),
+            float(tol),
+        )
+
+    def spline_dot(cls, x, xout, M, k=3, transpose=False):
+        """Dot the spline operator from the grid ``x`` onto the grid
+        ``xout`` (or, if ``transpose`` is True, its transpose) into the
+        numerical matrix ``M`` without forming it explicitly."""
+        assert not is_tensor(x, xout, M), "The inputs must be numerical."
+        M = np.array(M, dtype=np.float64)
+        res = _c_ops.spline_dot(
+            np.array(x, dtype=np.float64),
+            np.array(xout, dtype=np.float64),
+            int(k),
+            np.reshape(M, (M.shape[0], -1)),
+            bool(transpose),
+        )
+        return np.reshape(res, (-1,) + M.shape[1:])
+
     def __getattr__(cls, attr):
         if cls.lazy:
             return getattr(tt, attr)
@@ -240,8 +450,7 @@ class LinAlgType(type):
     def cho_solve(self, cho_A, b):
         return _cho_solve(cho_A, b)
 
-    @autocompile
-    def solve(self, X, flux, cho_C, mu, LInv):
+    def solve(cls, X, flux, cho_C, mu, LInv):
         """
         Compute the maximum a posteriori (MAP) prediction for the
         spherical harmonic coefficients of a map given a flux timeseries.
@@ -250,7 +459,7 @@ class LinAlgType(type):
             X (matrix): The flux design matrix.
             flux (array): The flux timeseries.
             cho_C (scalar/vector/matrix): The lower cholesky factorization
-                of the data covariance.
+                of the data covariance, or a ``StructuredCovariance``.
             mu (array): The prior mean of the spherical harmonic coefficients.
             LInv (scalar/vector/matrix): The inverse prior covariance of the
                 spherical harmonic coefficients.
@@ -261,16 +470,324 @@ class LinAlgType(type):
             covariance matrix.
 
         """
-        # Compute C^-1 . X
+        if isinstance(cho_C, StructuredCovariance):
+            CInvX, CInvf, _ = cls._structured_solve(cho_C, X, flux)
+            return cls._solve_posterior(X, CInvX, CInvf, mu, LInv)
+        else:
+            return cls._solve(X, flux, cho_C, mu, LInv)
+
+    def lnlike(cls, X, flux, C, mu, L):
+        """
+        Compute the log marginal likelihood of the data given a design matrix.
+
+        Args:
+            X (matrix): The flux design matrix.
+            flux (array): The flux timeseries.
+            C (scalar/vector/matrix): The data covariance matrix, or a
+                ``StructuredCovariance``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            L (scalar/vector/matrix): The prior covariance of the spherical
+                harmonic coefficients.
+
+        Returns:
+            The log marginal likelihood of the `flux` vector conditioned on
+            the design matrix `X`. This is the likelihood marginalized over
+            all possible spherical harmonic vectors, which is analytically
+            computable for the linear `starry` model.
+
+        .. note::
+            Structured covariances are never instantiated as dense
+            matrices, so for these this is equivalent to
+            :py:meth:`lnlike_woodbury`.
+
+        """
+        if isinstance(C, StructuredCovariance):
+            CInvX, CInvf, lndetC = cls._structured_solve(C, X, flux)
+            math = lazy_math if cls.lazy else greedy_math
+            L = math.cast(L)
+            if L.ndim < 2:
+                LInv = 1.0 / L
+                lndetL = math.sum(math.log(L * math.ones(X.shape[1])))
+            else:
+                cho_L = math.cholesky(L)
+                LInv = cls.cho_solve(cho_L, math.eye(X.shape[1]))
+                lndetL = 2 * math.sum(math.log(math.diag(cho_L)))
+            return cls._lnlike_woodbury(
+                X, CInvX, flux, CInvf, mu, LInv, lndetC, lndetL
+            )
+        else:
+            return cls._lnlike(X, flux, C, mu, L)
+
+    def lnlike_woodbury(cls, X, flux, CInv, mu, LInv, lndetC, lndetL):
+        """
+        Compute the log marginal likelihood of the data given a design matrix
+        using the Woodbury identity.
+
+        Args:
+            X (matrix): The flux design matrix.
+            flux (array): The flux timeseries.
+            CInv (scalar/vector/matrix): The inverse data covariance matrix,
+                or a ``StructuredCovariance``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            L (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+
+        Returns:
+            The log marginal likelihood of the `flux` vector conditioned on
+            the design matrix `X`. This is the likelihood marginalized over
+            all possible spherical harmonic vectors, which is analytically
+            computable for the linear `starry` model.
+
+        """
+        if isinstance(CInv, StructuredCovariance):
+            CInvX, CInvf, lndetC = cls._structured_solve(CInv, X, flux)
+        else:
+            CInvX, CInvf = cls._dense_apply(X, flux, CInv)
+        return cls._lnlike_woodbury(
+            X, CInvX, flux, CInvf, mu, LInv, lndetC, lndetL
+        )
+
+    def solve_cg(cls, X, flux, CInv, mu, LInv, tol=1e-10, maxiter=None):
+        """
+        Compute the maximum a posteriori (MAP) prediction for the
+        spherical harmonic coefficients of a map using the preconditioned
+        conjugate gradient method.
+
+        This solves the normal equations
+        ``(X^T C^-1 X + L^-1) y = X^T C^-1 flux + L^-1 mu`` using only
+        products of the design matrix (and its transpose) with vectors,
+        so ``X`` may be a ``scipy.sparse.linalg.LinearOperator``. The
+        prior covariance ``L`` is used as the preconditioner.
+
+        Args:
+            X (matrix or LinearOperator): The flux design matrix.
+            flux (array): The flux timeseries.
+            CInv (scalar/vector/matrix): The inverse data covariance, or
+                a ``StructuredCovariance``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+            tol (float, optional): The tolerance on the norm of the
+                residual relative to the norm of the right hand side.
+                Default is ``1e-10``.
+            maxiter (int, optional): The maximum number of iterations.
+                Default is ten times the number of coefficients.
+
+        Returns:
+            The vector of spherical harmonic coefficients corresponding to the
+            MAP solution and ``None``, since the posterior covariance is
+            never computed.
+
+        .. note::
+            This method is only available in greedy mode.
+
+        """
+        if cls.lazy:
+            raise NotImplementedError(
+                "The conjugate gradient solver is only available "
+                "in greedy mode."
+            )
+        X = aslinearoperator(X)
+        flux = np.array(flux, dtype=floatX)
+        N = X.shape[1]
+
+        # Data covariance
+        if isinstance(CInv, StructuredCovariance):
+            CInvdot = lambda v: CInv.solve(np.reshape(v, (-1, 1)), False)[0][
+                :, 0
+            ]
+        elif np.ndim(CInv) < 2:
+            CInvdot = lambda v: CInv * v
+        else:
+            CInvdot = lambda v: np.dot(CInv, v)
+
+        # Prior covariance (our preconditioner)
+        LInv = np.array(LInv, dtype=floatX)
+        if LInv.ndim < 2:
+            LInv = LInv * np.ones(N)
+            LInvdot = lambda v: LInv * v
+            Ldot = lambda v: v / LInv
+        else:
+            cho_LInv = scipy.linalg.cho_factor(LInv, lower=True)
+            LInvdot = lambda v: np.dot(LInv, v)
+            Ldot = lambda v: scipy.linalg.cho_solve(cho_LInv, v)
+
+        # The left and right hand sides of the normal equations
+        Wdot = lambda v: X.rmatvec(CInvdot(X.matvec(v))) + LInvdot(v)
+        rhs = X.rmatvec(CInvdot(flux)) + LInvdot(mu)
+
+        # Preconditioned conjugate gradient, starting at the prior mean
+        if maxiter is None:
+            maxiter = 10 * N
+        yhat = np.array(mu, dtype=floatX) * np.ones(N)
+        r = rhs - Wdot(yhat)
+        z = Ldot(r)
+        p = np.array(z)
+        rz = np.dot(r, z)
+        rhs_norm = np.linalg.norm(rhs)
+        for i in range(maxiter):
+            if np.linalg.norm(r) <= tol * rhs_norm:
+                break
+            Wp = Wdot(p)
+            alpha = rz / np.dot(p, Wp)
+            yhat += alpha * p
+            r -= alpha * Wp
+            z = Ldot(r)
+            rz, rz_prev = np.dot(r, z), rz
+            p = z + (rz / rz_prev) * p
+        else:
+            if np.linalg.norm(r) > tol * rhs_norm:
+                logger.warning(
+                    "The conjugate gradient solver did not converge "
+                    "after {} iterations.".format(maxiter)
+                )
+
+        return yhat, None
+
+    def solve_l1(
+        cls, X, flux, CInv, mu, LInv, lam, tol=1e-10, maxiter=None, x0=None
+    ):
+        """
+        Compute the maximum a posteriori (MAP) prediction for the
+        spherical harmonic coefficients of a map with an additional
+        Laplace (L1) prior on their deviations from the prior mean.
+
+        This minimizes
+        ``1/2 r^T C^-1 r + 1/2 (y - mu)^T L^-1 (y - mu) + lam |y - mu|_1``,
+        where ``r = flux - X y``, with the native ADMM solver, which
+        favors sparse deviations from the prior mean.
+
+        Args:
+            X (matrix): The flux design matrix.
+            flux (array): The flux timeseries.
+            CInv (scalar/vector/matrix): The inverse data covariance, or
+                a ``StructuredCovariance``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+            lam (scalar): The L1 regularization parameter.
+            tol (float, optional): The tolerance on the squared change in
+                the solution between iterations. Default is ``1e-10``.
+            maxiter (int, optional): The maximum number of iterations.
+                Default is ten times the number of coefficients.
+            x0 (array, optional): The starting guess. Default is the prior
+                mean.
+
+        Returns:
+            The vector of spherical harmonic coefficients corresponding to the
+            MAP solution and ``None``, since the posterior covariance is
+            not computed.
+
+        .. note::
+            This method is only available in greedy mode.
+
+        """
+        if cls.lazy:
+            raise NotImplementedError(
+                "The L1 solver is only available in greedy mode."
+            )
+        if issparse(X):
+            X = X.toarray()
+        X = np.array(X, dtype=floatX)
+        flux = np.array(flux, dtype=floatX)
+        N = X.shape[1]
+        mu = np.array(mu, dtype=floatX) * np.ones(N)
+
+        # The normal equations
+        if isinstance(CInv, StructuredCovariance):
+            CInvX = CInv.solve(X, False)[0]
+        elif np.ndim(CInv) == 0:
+            CInvX = CInv * X
+        elif np.ndim(CInv) == 1:
+            CInvX = np.reshape(CInv, (-1, 1)) * X
+        else:
+            CInvX = np.dot(CInv, X)
+        ATA = np.dot(X.T, CInvX)
+        LInv = np.array(LInv, dtype=floatX)
+        if LInv.ndim < 2:
+            ATA[np.diag_indices_from(ATA)] += LInv
+        else:
+            ATA += LInv
+        ATy = np.dot(CInvX.T, flux - np.dot(X, mu))
+
+        # Solve for the deviations from the prior mean
+        if maxiter is None:
+            maxiter = 10 * N
+        if x0 is None:
+            x0 = np.zeros(N)
+        else:
+            x0 = np.array(x0, dtype=floatX) - mu
+        w, niter = _c_ops.l1_solve(ATA, ATy, lam, x0, maxiter, tol)
+        if niter >= maxiter:
+            logger.warning(
+                "The L1 solver did not converge "
+                "after {} iterations.".format(maxiter)
+            )
+
+        return mu + w, None
+
+    def _structured_solve(cls, C, X, flux):
+        """Return ``C^-1 X``, ``C^-1 flux``, and ``log|C|`` for a
+        structured covariance ``C`` with a single factorization."""
+        math = lazy_math if cls.lazy else greedy_math
+        B = math.concatenate(
+            (math.cast(X), math.reshape(math.cast(flux), (-1, 1))), axis=1
+        )
+        CInvB, lndetC = C.solve(B, cls.lazy)
+        return CInvB[:, :-1], CInvB[:, -1], lndetC
+
+    @autocompile
+    def _dense_apply(cls, X, flux, CInv):
+        """Return ``C^-1 X`` and ``C^-1 flux`` given ``C^-1``."""
+        if CInv.ndim == 0:
+            return X * CInv, flux * CInv
+        elif CInv.ndim == 1:
+            return X * tt.shape_padright(CInv), flux * CInv
+        else:
+            return tt.dot(CInv, X), tt.dot(CInv, flux)
+
+    @autocompile
+    def _solve(cls, X, flux, cho_C, mu, LInv):
+        # Compute C^-1 . X and C^-1 . flux
         if cho_C.ndim == 0:
             CInvX = X / cho_C ** 2
+            CInvf = flux / cho_C ** 2
         elif cho_C.ndim == 1:
-            CInvX = tt.dot(tt.diag(1 / cho_C ** 2), X)
+            CInvX = X / tt.shape_padright(cho_C ** 2)
+            CInvf = flux / cho_C ** 2
         else:
             CInvX = _cho_solve(cho_C, X)
+            CInvf = _cho_solve(cho_C, flux)
+        return cls._solve_posterior(X, CInvX, CInvf, mu, LInv)
+
+    @autocompile
+    def _solve_posterior(cls, X, CInvX, CInvf, mu, LInv):
+        XTCInvX = tt.dot(tt.transpose(X), CInvX)
+        XTCInvf = tt.dot(tt.transpose(X), CInvf)
+        return cls.solve_normal(XTCInvX, XTCInvf, mu, LInv)
+
+    @autocompile
+    def solve_normal(cls, XTCInvX, XTCInvf, mu, LInv):
+        """
+        Compute the maximum a posteriori (MAP) prediction for the
+        spherical harmonic coefficients of a map given the normal
+        equation matrices ``X^T C^-1 X`` and ``X^T C^-1 flux``.
+
+        Args:
+            XTCInvX (matrix): The product ``X^T C^-1 X``.
+            XTCInvf (array): The product ``X^T C^-1 flux``.
+            mu (array): The prior mean of the spherical harmonic coefficients.
+            LInv (scalar/vector/matrix): The inverse prior covariance of the
+                spherical harmonic coefficients.
+
+        Returns:
+            The vector of spherical harmonic coefficients corresponding to the
+            MAP solution and the Cholesky factorization of the corresponding
+            covariance matrix.
 
+        """
         # Compute W = X^T . C^-1 . X + L^-1
-        W = tt.dot(tt.transpose(X), CInvX)
+        W = XTCInvX
         if LInv.ndim == 0:
             W = tt.inc_subtensor(
                 W[tuple((tt.arange(W.shape[0]), tt.arange(W.shape[0])))], LInv
@@ -287,33 +804,14 @@ class LinAlgType(type):
 
         # Compute the max like y and its covariance matrix
         cho_W = slinalg.cholesky(W)
-        M = _cho_solve(cho_W, tt.transpose(CInvX))
-        yhat = tt.dot(M, flux) + _cho_solve(cho_W, LInvmu)
+        yhat = _cho_solve(cho_W, XTCInvf + LInvmu)
         ycov = _cho_solve(cho_W, tt.eye(cho_W.shape[0]))
         cho_ycov = slinalg.cholesky(ycov)
 
         return yhat, cho_ycov
 
     @autocompile
-    def lnlike(cls, X, flux, C, mu, L):
-        """
-        Compute the log marginal likelihood of the data given a design matrix.
-
-        Args:
-            X (matrix): The flux design matrix.
-            flux (array): The flux timeseries.
-            C (scalar/vector/matrix): The data covariance matrix.
-            mu (array): The prior mean of the spherical harmonic coefficients.
-            L (scalar/vector/matrix): The prior covariance of the spherical
-                harmonic coefficients.
-
-        Returns:
-            The log marginal likelihood of the `flux` vector conditioned on
-            the design matrix `X`. This is the likelihood marginalized over
-            all possible spherical harmonic vectors, which is analytically
-            computable for the linear `starry` model.
-
-        """
+    def _lnlike(cls, X, flux, C, mu, L):
         # Compute the GP mean
         gp_mu = tt.dot(X, mu)
 
@@ -321,7 +819,7 @@ class LinAlgType(type):
         if L.ndim == 0:
             XLX = tt.dot(X, tt.transpose(X)) * L
         elif L.ndim == 1:
-            XLX = tt.dot(tt.dot(X, tt.diag(L)), tt.transpose(X))
+            XLX = tt.dot(X * L, tt.transpose(X))
         else:
             XLX = tt.dot(tt.dot(X, L), tt.transpose(X))
 
@@ -345,70 +843,37 @@ class LinAlgType(type):
         return lnlike[0, 0]
 
     @autocompile
-    def lnlike_woodbury(cls, X, flux, CInv, mu, LInv, lndetC, lndetL):
-        """
-        Compute the log marginal likelihood of the data given a design matrix
-        using the Woodbury identity.
-
-        Args:
-            X (matrix): The flux design matrix.
-            flux (array): The flux timeseries.
-            CInv (scalar/vector/matrix): The inverse data covariance matrix.
-            mu (array): The prior mean of the spherical harmonic coefficients.
-            L (scalar/vector/matrix): The inverse prior covariance of the
-                spherical harmonic coefficients.
-
-        Returns:
-            The log marginal likelihood of the `flux` vector conditioned on
-            the design matrix `X`. This is the likelihood marginalized over
-            all possible spherical harmonic vectors, which is analytically
-            computable for the linear `starry` model.
-
-        """
-        # Compute the GP mean
-        gp_mu = tt.dot(X, mu)
-
-        # Residual vector
-        r = tt.reshape(flux - gp_mu, (-1, 1))
-
-        # Inverse of GP covariance via Woodbury identity
-        if CInv.ndim == 0:
-            U = X * CInv
-        elif CInv.ndim == 1:
-            U = tt.dot(tt.diag(CInv), X)
-        else:
-            U = tt.dot(CInv, X)
+    def _lnlike_woodbury(cls, X, CInvX, flux, CInvf, mu, LInv, lndetC, lndetL):
+        # Residual vector and its product with C^-1
+        r = flux - tt.dot(X, mu)
+        CInvr = CInvf - tt.dot(CInvX, mu)
 
+        # W = X^T . C^-1 . X + L^-1
+        W = tt.dot(tt.transpose(X), CInvX)
         if LInv.ndim == 0:
-            W = tt.dot(tt.transpose(X), U) + LInv * tt.eye(U.shape[1])
+            W += LInv * tt.eye(W.shape[0])
         elif LInv.ndim == 1:
-            W = tt.dot(tt.transpose(X), U) + tt.diag(LInv)
+            W += tt.diag(LInv)
         else:
-            W = tt.dot(tt.transpose(X), U) + LInv
+            W += LInv
         cho_W = slinalg.cholesky(W)
 
-        if CInv.ndim == 0:
-            SInv = CInv * tt.eye(U.shape[0]) - tt.dot(
-                U, _cho_solve(cho_W, tt.transpose(U))
-            )
-        elif CInv.ndim == 1:
-            SInv = tt.diag(CInv) - tt.dot(
-                U, _cho_solve(cho_W, tt.transpose(U))
-            )
-        else:
-            SInv = CInv - tt.dot(U, _cho_solve(cho_W, tt.transpose(U)))
+        # r^T . S^-1 . r via the Woodbury identity, where
+        # S = C + X . L . X^T is the GP covariance
+        z = tt.dot(tt.transpose(X), CInvr)
+        rSInvr = tt.dot(r, CInvr) - tt.dot(z, _cho_solve(cho_W, z))
 
         # Determinant of GP covariance
         lndetW = 2 * tt.sum(tt.log(tt.diag(cho_W)))
-        lndetS = lndetW + lndetC + lndetL
+        lndetS = lndetW + lndetC + tt.sum(lndetL)
 
         # Compute the marginal likelihood
         N = X.shape[0]
-        lnlike = -0.5 * tt.dot(tt.transpose(r), tt.dot(SInv, r))
+        lnlike = -0.5 * rSInvr
         lnlike -= 0.5 * lndetS
         lnlike -= 0.5 * N * tt.log(2 * np.pi)
 
-        return lnlike[0, 0]
+        return lnlike
 
     @autocompile
     def _cho_solve(cls, cho_A, b):
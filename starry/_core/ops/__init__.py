@@ -1,9 +1,13 @@
 # -*- coding: utf-8 -*-
+from .covariance import *
+from .doppler import *
 from .exceptions import *
 from .filter import *
 from .integration import *
+from .lasso import *
 from .limbdark import *
 from .minimize import *
+from .orbit import *
 from .polybasis import *
 from .rotation import *
 from .spot import *
@@ -0,0 +1,102 @@
+# -*- coding: utf-8 -*-
+from ...compat import Apply, Op, tt, theano
+import numpy as np
+
+__all__ = ["CovarianceSolveOp"]
+
+
+class CovarianceSolveOp(Op):
+    """Solve a linear system with a structured covariance matrix.
+
+    The inputs are the right hand side ``B``, a matrix, followed by the
+    parameters describing the covariance ``C``, which are passed directly
+    to the constructor ``factor`` of its C++ factorization. The outputs are
+    ``C^-1 B`` and the log determinant of ``C``. The factorization is cached
+    and only recomputed when the parameters change.
+
+    .. note::
+        The gradient with respect to the covariance parameters is only
+        implemented for factorizations that provide a ``grad`` method
+        (banded and low-rank covariances); for all others, it is only
+        implemented with respect to ``B``.
+    """
+
+    def __init__(self, factor):
+        self.factor = factor
+        self._key = None
+        self._factor = None
+        self._grad_op = CovarianceSolveGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [inputs[0].type(), tt.TensorType(inputs[0].dtype, ())()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [shapes[0], ()]
+
+    def _get_factor(self, params):
+        key = tuple((p.shape, p.dtype.str, p.tobytes()) for p in params)
+        if key != self._key:
+            self._factor = self.factor(*params)
+            self._key = key
+        return self._factor
+
+    def perform(self, node, inputs, outputs):
+        B, *params = inputs
+        factor = self._get_factor(params)
+        outputs[0][0] = np.array(factor.solve(B), dtype=node.outputs[0].dtype)
+        outputs[1][0] = np.array(factor.lndet, dtype=node.outputs[1].dtype)
+
+    def grad(self, inputs, gradients):
+        B, *params = inputs
+        X = self(*inputs)[0]
+        bX, blndet = gradients
+        if isinstance(bX.type, theano.gradient.DisconnectedType):
+            bB = tt.zeros_like(B)
+            G = tt.zeros_like(X)
+        else:
+            # The covariance is symmetric
+            bB = self(bX, *params)[0]
+            G = bB
+        if isinstance(blndet.type, theano.gradient.DisconnectedType):
+            blndet = tt.zeros((), dtype=X.dtype)
+        if hasattr(self.factor, "grad"):
+            bparams = self._grad_op(X, G, blndet, *params)
+            if len(params) == 1:
+                bparams = [bparams]
+        else:
+            bparams = [
+                theano.gradient.grad_not_implemented(self, n + 1, p)
+                for n, p in enumerate(params)
+            ]
+        return [bB] + list(bparams)
+
+
+class CovarianceSolveGradientOp(Op):
+    """Gradient of :py:class:`CovarianceSolveOp` with respect to the
+    covariance parameters.
+
+    The inputs are ``X = C^-1 B``, ``G = C^-1 bX``, the gradient with
+    respect to the log determinant, and the covariance parameters.
+    """
+
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[3:]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[3:]
+
+    def perform(self, node, inputs, outputs):
+        X, G, blndet, *params = inputs
+        factor = self.base_op._get_factor(params)
+        bparams = factor.grad(X, G, blndet)
+        for n, (bp, p) in enumerate(zip(bparams, params)):
+            outputs[n][0] = np.array(np.reshape(bp, p.shape), dtype=p.dtype)
@@ -0,0 +1,417 @@
+# -*- coding: utf-8 -*-
+from ...compat import Apply, Op, tt, ts
+from collections import OrderedDict
+from scipy.sparse import csr_matrix
+import numpy as np
+
+__all__ = [
+    "rTDopplerOp",
+    "kTDopplerOp",
+    "convDopplerOp",
+    "convTDopplerOp",
+    "toeplitzDopplerOp",
+    "dotToeplitzDopplerOp",
+]
+
+
+class rTDopplerOp(Op):
+    """The Doppler `rho^T` line broadening solution vector."""
+
+    def __init__(self, func, N):
+        self.func = func
+        self.N = N
+        self._grad_op = rTDopplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[0].dtype, (False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [(self.N, shapes[0][0])]
+
+    def perform(self, node, inputs, outputs):
+        outputs[0][0] = self.func(*inputs)
+
+    def grad(self, inputs, gradients):
+        return [self._grad_op(*(inputs + gradients))]
+
+
+class rTDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [inputs[0].type()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [shapes[0]]
+
+    def perform(self, node, inputs, outputs):
+        bx = self.base_op.func(*inputs)
+        outputs[0][0] = np.reshape(bx, np.shape(inputs[0]))
+
+
+class kTDopplerOp(Op):
+    """The Doppler line broadening kernels rotated to each epoch.
+
+    The inputs are ``veq``, ``inc``, ``theta`` and ``u``; the output has
+    shape ``(nt, Ny, nk)``. Since the kernels are usually evaluated many
+    times at fixed geometry (e.g., in the iterative solvers), they are
+    kept in a least recently used cache keyed on the inputs, up to a
+    total of ``cache_size`` bytes.
+    """
+
+    def __init__(self, func, xamp, Ny, vsini_max, cache_size=0):
+        self.func = func
+        self.xamp = np.array(xamp, dtype=np.float64)
+        self.Ny = Ny
+        self.vsini_max = float(vsini_max)
+        self._cache = OrderedDict()
+        self._cache_nbytes = 0
+        self.cache_size = cache_size
+        self._grad_op = kTDopplerGradientOp(self)
+
+    @property
+    def cache_size(self):
+        return self._cache_size
+
+    @cache_size.setter
+    def cache_size(self, value):
+        self._cache_size = int(value)
+        self._evict()
+
+    def clear_cache(self):
+        self._cache.clear()
+        self._cache_nbytes = 0
+
+    def _evict(self):
+        while self._cache_nbytes > self._cache_size:
+            _, kT = self._cache.popitem(last=False)
+            self._cache_nbytes -= kT.nbytes
+
+    def check_bounds(self, veq, inc):
+        vsini = veq * np.sin(inc)
+        if vsini < 0:
+            raise ValueError("vsini out of bounds: %f < %f" % (vsini, 0.0))
+        elif vsini > self.vsini_max:
+            raise ValueError(
+                "vsini out of bounds: %f > %f" % (vsini, self.vsini_max)
+            )
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[2].dtype, (False, False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [(shapes[2][0], self.Ny, len(self.xamp))]
+
+    def perform(self, node, inputs, outputs):
+        veq, inc, theta, u = inputs
+        key = tuple(
+            (np.shape(i), np.asarray(i).dtype.str, np.asarray(i).tobytes())
+            for i in inputs
+        )
+        kT = self._cache.get(key, None)
+        if kT is None:
+            self.check_bounds(veq, inc)
+            kT = self.func(self.xamp, veq, inc, np.atleast_1d(theta), u)
+            kT = np.reshape(kT, (-1, self.Ny, len(self.xamp)))
+            if kT.nbytes <= self._cache_size:
+                self._cache[key] = kT
+                self._cache_nbytes += kT.nbytes
+                self._evict()
+        else:
+            self._cache.move_to_end(key)
+
+        # Downstream ops may modify the output in place
+        outputs[0][0] = np.array(kT)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class kTDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        veq, inc, theta, u, bkT = inputs
+        bkT = np.reshape(bkT, (-1, len(self.base_op.xamp)))
+        bveq, binc, btheta, bu = self.base_op.func(
+            self.base_op.xamp, veq, inc, np.atleast_1d(theta), u, bkT
+        )
+        outputs[0][0] = np.reshape(bveq, np.shape(veq))
+        outputs[1][0] = np.reshape(binc, np.shape(inc))
+        outputs[2][0] = np.reshape(btheta, np.shape(theta))
+        outputs[3][0] = np.reshape(bu, np.shape(u))
+
+
+class convDopplerOp(Op):
+    """The Doppler convolution of spectra with line broadening kernels.
+
+    The inputs are ``nb * nc`` spectra of length ``nwp`` and ``no * nc``
+    kernels of length ``nk``; the output has shape ``(nb * no, nw)``.
+    This is equivalent to an unflipped, valid ``conv2d`` with ``nc``
+    input channels and ``no`` output channels. The convolution is done
+    either directly or via FFT according to ``mode`` (0 for automatic,
+    1 for direct, 2 for FFT, plus 4 for a mixed precision direct
+    convolution).
+    """
+
+    def __init__(self, func, nc, mode=0):
+        self.func = func
+        self.nc = nc
+        self.mode = mode
+        self._grad_op = convDopplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[0].dtype, (False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [
+            (
+                (shapes[0][0] // self.nc) * (shapes[1][0] // self.nc),
+                shapes[0][1] - shapes[1][1] + 1,
+            )
+        ]
+
+    def perform(self, node, inputs, outputs):
+        x, k = inputs
+        outputs[0][0] = self.func(x, k, self.nc, self.mode)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class convDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        x, k, bout = inputs
+        bx, bk = self.base_op.func(
+            x, k, self.base_op.nc, self.base_op.mode, bout
+        )
+        outputs[0][0] = np.reshape(bx, np.shape(x))
+        outputs[1][0] = np.reshape(bk, np.shape(k))
+
+
+class convTDopplerOp(Op):
+    """The transpose of the Doppler convolution.
+
+    The inputs are ``nb * no`` vectors of length ``nw`` and ``no * nc``
+    kernels of length ``nk``; the output has shape ``(nb * nc, nwp)``.
+    This is equivalent to an unflipped ``conv2d_transpose``.
+    """
+
+    def __init__(self, func, nc, mode=0):
+        self.func = func
+        self.nc = nc
+        self.mode = mode
+        self._grad_op = convTDopplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[0].dtype, (False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [
+            (
+                (shapes[0][0] // (shapes[1][0] // self.nc)) * self.nc,
+                shapes[0][1] + shapes[1][1] - 1,
+            )
+        ]
+
+    def perform(self, node, inputs, outputs):
+        y, k = inputs
+        outputs[0][0] = self.func(y, k, self.nc, self.mode)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class convTDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        y, k, bout = inputs
+        by, bk = self.base_op.func(
+            y, k, self.base_op.nc, self.base_op.mode, bout
+        )
+        outputs[0][0] = np.reshape(by, np.shape(y))
+        outputs[1][0] = np.reshape(bk, np.shape(k))
+
+
+class toeplitzDopplerOp(Op):
+    """The block-Toeplitz Doppler matrix.
+
+    The input is the tensor of kernels of shape ``(nt, nch, nk)``; the
+    output is the matrix of shape ``(nt * nw, nch * nwp)`` whose row
+    ``t * nw + w`` holds the kernel for each channel ``n`` at epoch ``t``
+    starting at column ``n * nwp + w``. The matrix is assembled natively
+    from the structured operator ``cls``, which stores each kernel once,
+    either in ``csr`` form or, if ``dense`` is True, as a dense matrix.
+    Products with the matrix should use :py:class:`dotToeplitzDopplerOp`
+    instead, which never assembles it.
+    """
+
+    def __init__(self, cls, nwp, dense=False):
+        self.cls = cls
+        self.nwp = nwp
+        self.dense = dense
+        self._grad_op = toeplitzDopplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        if self.dense:
+            outputs = [tt.TensorType(inputs[0].dtype, (False, False))()]
+        else:
+            outputs = [ts.SparseType(format="csr", dtype=inputs[0].dtype)()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [
+            (
+                shapes[0][0] * (self.nwp - shapes[0][2] + 1),
+                shapes[0][1] * self.nwp,
+            )
+        ]
+
+    def operator(self, kT):
+        nch, nk = kT.shape[1], kT.shape[2]
+        return self.cls(np.reshape(kT, (-1, nk)), nch, self.nwp)
+
+    def perform(self, node, inputs, outputs):
+        D = self.operator(inputs[0])
+        if self.dense:
+            outputs[0][0] = D.dense()
+        else:
+            outputs[0][0] = D.matrix()
+
+    def grad(self, inputs, gradients):
+        return [self._grad_op(*(inputs + gradients))]
+
+
+class toeplitzDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        if self.base_op.dense:
+            bD = tt.as_tensor_variable(inputs[1])
+        else:
+            bD = ts.as_sparse_variable(inputs[1])
+        inputs = [tt.as_tensor_variable(inputs[0]), bD]
+        outputs = [inputs[0].type()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        kT, bD = inputs
+        bkT = self.base_op.operator(kT).matrixGrad(
+            csr_matrix(bD, dtype=np.float64)
+        )
+        outputs[0][0] = np.reshape(bkT, np.shape(kT))
+
+
+class dotToeplitzDopplerOp(Op):
+    """The product of the block-Toeplitz Doppler matrix and a matrix.
+
+    The inputs are the tensor of kernels of shape ``(nt, nch, nk)`` and a
+    matrix of shape ``(nch * nwp, m)``; the output is the product of the
+    matrix assembled by :py:class:`toeplitzDopplerOp` and the input
+    matrix, of shape ``(nt * nw, m)``. It is computed natively with the
+    structured operator ``cls``, building the rows of the Doppler matrix
+    on demand.
+    """
+
+    def __init__(self, cls, nwp):
+        self.cls = cls
+        self.nwp = nwp
+        self._grad_op = dotToeplitzDopplerGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.TensorType(inputs[1].dtype, (False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [
+            (shapes[0][0] * (self.nwp - shapes[0][2] + 1), shapes[1][1])
+        ]
+
+    def operator(self, kT):
+        nch, nk = kT.shape[1], kT.shape[2]
+        return self.cls(np.reshape(kT, (-1, nk)), nch, self.nwp)
+
+    def perform(self, node, inputs, outputs):
+        kT, M = inputs
+        outputs[0][0] = self.operator(kT).dot(M, False)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class dotToeplitzDopplerGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        kT, M, bout = inputs
+        D = self.base_op.operator(kT)
+        outputs[0][0] = np.reshape(D.dotGrad(M, bout), np.shape(kT))
+        outputs[1][0] = np.reshape(D.dot(bout, True), np.shape(M))
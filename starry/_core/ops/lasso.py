@@ -0,0 +1,41 @@
+# -*- coding: utf-8 -*-
+from ...compat import Apply, Op, tt, theano
+import numpy as np
+
+__all__ = ["L1Op"]
+
+
+class L1Op(Op):
+    """L1-regularized least squares.
+
+    The inputs are the matrix ``A``, the vector ``b``, the regularization
+    parameter ``lam``, the maximum number of iterations, the tolerance, and
+    the starting guess ``x0``. The output is the minimum of
+    ``1/2 x^T A x - b^T x + lam |x|_1``.
+
+    .. note::
+        The gradient is not implemented.
+    """
+
+    def __init__(self, func):
+        self.func = func
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [inputs[1].type()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [shapes[1]]
+
+    def perform(self, node, inputs, outputs):
+        A, b, lam, maxiter, tol, x0 = inputs
+        x, _ = self.func(A, b, float(lam), x0, int(maxiter), float(tol))
+        outputs[0][0] = np.array(x, dtype=node.outputs[0].dtype)
+
+    def grad(self, inputs, gradients):
+        return [
+            theano.gradient.grad_not_implemented(self, n, p)
+            for n, p in enumerate(inputs)
+        ]
@@ -0,0 +1,147 @@
+/**
+\file composite.h
+\brief Rendering of all bodies in a system onto a common image.
+
+*/
+
+#ifndef _STARRY_COMPOSITE_H_
+#define _STARRY_COMPOSITE_H_
+
+#include "utils.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace starry {
+namespace composite {
+
+using namespace utils;
+
+/**
+Render the disks of several bodies onto a common image for each of
+`nt` frames.
+
+Body `k` is a disk of radius `r(k)` centered at `(x(n, k), y(n, k))`
+in frame `n`, and its intensity is the polynomial in the starry basis
+with coefficients `p[k].col(n)`, evaluated on the unit disk. The
+polynomials must already be rotated to the sky frame and include any
+limb darkening or filters. The image spans `[xmin, xmax]` by
+`[ymin, ymax]` with `res` by `res` pixels, with the origin at the
+lower left, and pixels not covered by any body are `NaN`. The image is
+written into the caller's buffer `img`, which must have shape
+`(nt, res * res)`, so that no temporary copy of it is ever made.
+
+In each frame we paint the bodies in order of increasing `z`, so the
+ones closer to the observer occult the ones behind them. Each body
+only visits the pixels in its bounding box, and we tabulate the powers
+of the disk coordinates once per row and column of the box.
+
+*/
+template <typename Scalar>
+inline void render(const std::vector<Matrix<Scalar>> &p,
+                   const Matrix<Scalar> &x, const Matrix<Scalar> &y,
+                   const Matrix<Scalar> &z, const Vector<Scalar> &r,
+                   const int res, const Scalar &xmin, const Scalar &xmax,
+                   const Scalar &ymin, const Scalar &ymax,
+                   Eigen::Ref<Matrix<double, RowMajor>> img) {
+  int nt = x.rows();
+  int nbody = x.cols();
+  std::vector<int> deg(nbody);
+  for (int k = 0; k < nbody; ++k)
+    deg[k] = static_cast<int>(round(sqrt(Scalar(p[k].rows())))) - 1;
+#ifndef STARRY_NO_EXCEPTIONS
+  if ((int(p.size()) != nbody) || (y.rows() != nt) || (y.cols() != nbody) ||
+      (z.rows() != nt) || (z.cols() != nbody) || (r.size() != nbody))
+    throw std::invalid_argument("Mismatch in the number of bodies or frames.");
+  for (int k = 0; k < nbody; ++k) {
+    if (((deg[k] + 1) * (deg[k] + 1) != p[k].rows()) || (p[k].cols() != nt))
+      throw std::invalid_argument("Invalid shape for the polynomial.");
+  }
+  if ((res < 1) || (xmax <= xmin) || (ymax <= ymin))
+    throw std::invalid_argument("Invalid image resolution or extent.");
+  if ((img.rows() != nt) || (img.cols() != res * res))
+    throw std::invalid_argument("Invalid shape for the output image.");
+#endif
+  int maxdeg = *std::max_element(deg.begin(), deg.end());
+  Scalar dx = (xmax - xmin) / res;
+  Scalar dy = (ymax - ymin) / res;
+  img.setConstant(std::numeric_limits<double>::quiet_NaN());
+
+#ifdef _OPENMP
+#pragma omp parallel for if (nt > 1)
+#endif
+  for (int n = 0; n < nt; ++n) {
+
+    // Far to near
+    std::vector<int> order(nbody);
+    for (int k = 0; k < nbody; ++k)
+      order[k] = k;
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return z(n, a) < z(n, b); });
+
+    Matrix<Scalar> up, vp;
+    for (int k : order) {
+      if (r(k) <= 0)
+        continue;
+
+      // Bounding box of the disk
+      int i0 = std::max(0, int(floor((x(n, k) - r(k) - xmin) / dx)));
+      int i1 = std::min(res - 1, int(ceil((x(n, k) + r(k) - xmin) / dx)));
+      int j0 = std::max(0, int(floor((y(n, k) - r(k) - ymin) / dy)));
+      int j1 = std::min(res - 1, int(ceil((y(n, k) + r(k) - ymin) / dy)));
+      if ((i1 < i0) || (j1 < j0))
+        continue;
+
+      // Powers of the disk coordinates along the box
+      up.resize(i1 - i0 + 1, maxdeg + 1);
+      vp.resize(j1 - j0 + 1, maxdeg + 1);
+      for (int i = i0; i <= i1; ++i) {
+        up(i - i0, 0) = 1;
+        if (maxdeg > 0)
+          up(i - i0, 1) = (xmin + (i + 0.5) * dx - x(n, k)) / r(k);
+        for (int l = 2; l <= deg[k]; ++l)
+          up(i - i0, l) = up(i - i0, l - 1) * up(i - i0, 1);
+      }
+      for (int j = j0; j <= j1; ++j) {
+        vp(j - j0, 0) = 1;
+        if (maxdeg > 0)
+          vp(j - j0, 1) = (ymin + (j + 0.5) * dy - y(n, k)) / r(k);
+        for (int l = 2; l <= deg[k]; ++l)
+          vp(j - j0, l) = vp(j - j0, l - 1) * vp(j - j0, 1);
+      }
+
+      // Evaluate the polynomial on the disk
+      Scalar u, v, w, I;
+      for (int j = j0; j <= j1; ++j) {
+        v = (ymin + (j + 0.5) * dy - y(n, k)) / r(k);
+        for (int i = i0; i <= i1; ++i) {
+          u = (xmin + (i + 0.5) * dx - x(n, k)) / r(k);
+          w = 1 - u * u - v * v;
+          if (w < 0)
+            continue;
+          w = sqrt(w);
+          I = 0;
+          int m0 = 0;
+          for (int l = 0; l <= deg[k]; ++l) {
+            for (int m = -l; m <= l; ++m) {
+              if ((l + m) % 2 == 0) {
+                I += p[k](m0, n) * up(i - i0, (l - m) / 2) *
+                     vp(j - j0, (l + m) / 2);
+              } else {
+                I += p[k](m0, n) * up(i - i0, (l - m - 1) / 2) *
+                     vp(j - j0, (l + m - 1) / 2) * w;
+              }
+              ++m0;
+            }
+          }
+          img(n, j * res + i) = static_cast<double>(I);
+        }
+      }
+    }
+  }
+}
+
+} // namespace composite
+} // namespace starry
+#endif
@@ -0,0 +1,346 @@
+/**
+\file covariance.h
+\brief Structured data covariance matrices with linear-time solves.
+
+*/
+
+#ifndef _STARRY_COVARIANCE_H_
+#define _STARRY_COVARIANCE_H_
+
+#include "utils.h"
+#include <algorithm>
+
+namespace starry {
+namespace covariance {
+
+using namespace utils;
+
+/**
+A symmetric positive definite banded covariance matrix.
+
+The matrix is given in lower band storage: `ab(i, k)` is the element
+`C(i, i - k)` for `k = 0, ..., w`, where `w` is the bandwidth. Elements
+with `i - k < 0` are ignored. The Cholesky factorization is stored in
+the same format and costs `O(N w^2)`; each solve costs `O(N w)`. The
+gradient costs `O(N w^2)` plus `O(N w)` per right hand side.
+
+*/
+template <typename Scalar> class Banded {
+
+protected:
+  Matrix<Scalar> L;
+  int N;
+  int w;
+
+public:
+  Scalar lndet;
+  Matrix<Scalar> bab; /**< Gradient w/ respect to `ab` */
+
+  explicit Banded(const Matrix<Scalar> &ab)
+      : L(ab), N(ab.rows()), w(ab.cols() - 1) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (w < 0)
+      throw std::invalid_argument("Invalid shape for the banded matrix.");
+#endif
+    Scalar s;
+    lndet = 0;
+    for (int i = 0; i < N; ++i) {
+      for (int k = std::max(0, i - w); k <= i; ++k) {
+        s = L(i, i - k);
+        for (int j = std::max(0, i - w); j < k; ++j)
+          s -= L(i, i - j) * L(k, k - j);
+        if (k < i) {
+          L(i, i - k) = s / L(k, 0);
+        } else {
+#ifndef STARRY_NO_EXCEPTIONS
+          if (!(s > 0))
+            throw std::runtime_error("Matrix is not positive definite.");
+#endif
+          L(i, 0) = sqrt(s);
+          lndet += 2 * log(L(i, 0));
+        }
+      }
+    }
+  }
+
+  /**
+  Compute `C^-1 B` in place.
+
+  */
+  template <typename T> inline void solve(MatrixBase<T> &B) const {
+    for (int i = 0; i < N; ++i) {
+      for (int k = 1; k <= std::min(i, w); ++k)
+        B.row(i) -= L(i, k) * B.row(i - k);
+      B.row(i) /= L(i, 0);
+    }
+    for (int i = N - 1; i >= 0; --i) {
+      for (int k = 1; k <= std::min(N - 1 - i, w); ++k)
+        B.row(i) -= L(i + k, k) * B.row(i + k);
+      B.row(i) /= L(i, 0);
+    }
+  }
+
+  /**
+  Compute the gradient of a scalar function of `X = C^-1 B` and of the
+  log determinant with respect to `ab`, given `X`, `G = C^-1 bX`, and
+  the gradient `blndet` with respect to the log determinant. This is
+
+      bC = -G X^T + blndet C^-1,
+
+  projected onto the band. Only the band of `C^-1` is needed, which we
+  get by selected inversion of the Cholesky factor (Takahashi et al. 1973).
+
+  */
+  inline void grad(const Matrix<Scalar> &X, const Matrix<Scalar> &G,
+                   const Scalar &blndet) {
+    // The band of the inverse, `Z(i, k) = C^-1(i, i - k)`
+    Matrix<Scalar> Z(N, w + 1);
+    Z.setZero();
+    auto Zat = [&Z](int a, int b) -> Scalar & {
+      return (a >= b) ? Z(a, a - b) : Z(b, b - a);
+    };
+    for (int i = N - 1; i >= 0; --i) {
+      int imax = std::min(N - 1, i + w);
+      for (int j = imax; j >= i; --j) {
+        Scalar s = (j == i) ? 1 / L(i, 0) : 0;
+        for (int m = i + 1; m <= imax; ++m)
+          s -= L(m, m - i) * Zat(m, j);
+        Z(j, j - i) = s / L(i, 0);
+      }
+    }
+
+    // Project onto the band; off-diagonal elements appear twice
+    bab.setZero(N, w + 1);
+    for (int i = 0; i < N; ++i) {
+      bab(i, 0) = blndet * Z(i, 0) - G.row(i).dot(X.row(i));
+      for (int k = 1; k <= std::min(i, w); ++k)
+        bab(i, k) = 2 * blndet * Z(i, k) - G.row(i).dot(X.row(i - k)) -
+                    G.row(i - k).dot(X.row(i));
+    }
+  }
+};
+
+/**
+A semiseparable covariance matrix of the `celerite` form.
+
+The kernel is a sum of `Jr` real terms, `a exp(-c tau)`, and `Jc` complex
+terms, `exp(-c tau) (a cos(d tau) + b sin(d tau))`, evaluated at sorted
+times `t`, plus a diagonal term `diag`. We compute the factorization
+`C = L D L^T` with `L = I + tril(U W^T)` following Foreman-Mackey et al.
+(2017), which costs `O(N J^2)` with `J = Jr + 2 Jc`.
+
+*/
+template <typename Scalar> class Semiseparable {
+
+protected:
+  Vector<Scalar> t;
+  Vector<Scalar> c;
+  Vector<Scalar> d;
+  Matrix<Scalar> U;
+  Matrix<Scalar> W;
+  int N;
+  int J;
+
+public:
+  Scalar lndet;
+
+  Semiseparable(const Vector<Scalar> &t, const Vector<Scalar> &diag,
+                const Vector<Scalar> &ar, const Vector<Scalar> &cr,
+                const Vector<Scalar> &ac, const Vector<Scalar> &bc,
+                const Vector<Scalar> &cc, const Vector<Scalar> &dc)
+      : t(t), N(t.size()), J(ar.size() + 2 * ac.size()) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((diag.size() != N) || (cr.size() != ar.size()) ||
+        (bc.size() != ac.size()) || (cc.size() != ac.size()) ||
+        (dc.size() != ac.size()))
+      throw std::invalid_argument("Mismatch in the size of the kernel terms.");
+    for (int n = 1; n < N; ++n) {
+      if (t(n) < t(n - 1))
+        throw std::invalid_argument("The times must be sorted.");
+    }
+#endif
+    int Jr = ar.size();
+    int Jc = ac.size();
+
+    // The low-rank representation of the kernel
+    Matrix<Scalar> V(N, J);
+    Vector<Scalar> A = diag.array() + ar.sum() + ac.sum();
+    U.resize(N, J);
+    c.resize(J);
+    c.head(Jr) = cr;
+    U.leftCols(Jr) = Vector<Scalar>::Ones(N) * ar.transpose();
+    V.leftCols(Jr).setOnes();
+    Scalar cosdt, sindt;
+    for (int j = 0; j < Jc; ++j) {
+      c(Jr + 2 * j) = cc(j);
+      c(Jr + 2 * j + 1) = cc(j);
+      for (int n = 0; n < N; ++n) {
+        cosdt = cos(dc(j) * t(n));
+        sindt = sin(dc(j) * t(n));
+        U(n, Jr + 2 * j) = ac(j) * cosdt + bc(j) * sindt;
+        U(n, Jr + 2 * j + 1) = ac(j) * sindt - bc(j) * cosdt;
+        V(n, Jr + 2 * j) = cosdt;
+        V(n, Jr + 2 * j + 1) = sindt;
+      }
+    }
+
+    // Factorize
+    d.resize(N);
+    W.resize(N, J);
+    lndet = 0;
+    if (N == 0)
+      return;
+    Matrix<Scalar> S = Matrix<Scalar>::Zero(J, J);
+    RowVector<Scalar> tmp(J);
+    Vector<Scalar> p(J);
+    d(0) = A(0);
+    for (int n = 0; n < N; ++n) {
+      if (n > 0) {
+        p = (-c * (t(n) - t(n - 1))).array().exp();
+        S += d(n - 1) * W.row(n - 1).transpose() * W.row(n - 1);
+        S = p.asDiagonal() * S * p.asDiagonal();
+        tmp = U.row(n) * S;
+        d(n) = A(n) - tmp.dot(U.row(n));
+      } else {
+        tmp.setZero();
+      }
+#ifndef STARRY_NO_EXCEPTIONS
+      if (!(d(n) > 0))
+        throw std::runtime_error("Matrix is not positive definite.");
+#endif
+      W.row(n) = (V.row(n) - tmp) / d(n);
+      lndet += log(d(n));
+    }
+  }
+
+  /**
+  Compute `C^-1 B` in place.
+
+  */
+  template <typename T> inline void solve(MatrixBase<T> &B) const {
+    int M = B.cols();
+    Matrix<Scalar> F = Matrix<Scalar>::Zero(J, M);
+    Vector<Scalar> p(J);
+
+    // Solve L z = B
+    for (int n = 1; n < N; ++n) {
+      p = (-c * (t(n) - t(n - 1))).array().exp();
+      F = p.asDiagonal() * (F + W.row(n - 1).transpose() * B.row(n - 1));
+      B.row(n) -= U.row(n) * F;
+    }
+
+    // Solve D y = z
+    B.array().colwise() /= d.array();
+
+    // Solve L^T x = y
+    F.setZero();
+    for (int n = N - 2; n >= 0; --n) {
+      p = (-c * (t(n + 1) - t(n))).array().exp();
+      F = p.asDiagonal() * (F + U.row(n + 1).transpose() * B.row(n + 1));
+      B.row(n) -= W.row(n) * F;
+    }
+  }
+};
+
+/**
+A diagonal covariance matrix plus a low-rank update,
+`C = diag(D) + U S U^T`, where `U` is `N x K` and `S` is `K x K`.
+
+Solves use the Woodbury identity and cost `O(N K)` after an
+`O(N K^2)` factorization of the `K x K` capacitance matrix
+`S^-1 + U^T D^-1 U`. The gradient costs `O(N K^2)` plus `O(N K)` per
+right hand side.
+
+*/
+template <typename Scalar> class LowRank {
+
+protected:
+  Matrix<Scalar> U;
+  Matrix<Scalar> S;
+  Vector<Scalar> DInv;
+  Matrix<Scalar> DInvU;
+  Eigen::LLT<Matrix<Scalar>> cho_M;
+
+public:
+  Scalar lndet;
+  Vector<Scalar> bD; /**< Gradient w/ respect to `D` */
+  Matrix<Scalar> bU; /**< Gradient w/ respect to `U` */
+  Matrix<Scalar> bS; /**< Gradient w/ respect to `S` */
+
+  LowRank(const Vector<Scalar> &D, const Matrix<Scalar> &U,
+          const Matrix<Scalar> &S)
+      : U(U), S(S) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((U.rows() != D.size()) || (S.rows() != U.cols()) ||
+        (S.cols() != U.cols()))
+      throw std::invalid_argument("Mismatch in the size of the low-rank "
+                                  "covariance terms.");
+    if (!(D.array() > 0).all())
+      throw std::runtime_error("Matrix is not positive definite.");
+#endif
+    int K = U.cols();
+    DInv = D.cwiseInverse();
+    DInvU = DInv.asDiagonal() * U;
+    Eigen::LLT<Matrix<Scalar>> cho_S(S);
+#ifndef STARRY_NO_EXCEPTIONS
+    if (cho_S.info() != Eigen::Success)
+      throw std::runtime_error("Matrix is not positive definite.");
+#endif
+    Matrix<Scalar> M = cho_S.solve(Matrix<Scalar>::Identity(K, K));
+    M += U.transpose() * DInvU;
+    cho_M.compute(M);
+#ifndef STARRY_NO_EXCEPTIONS
+    if (cho_M.info() != Eigen::Success)
+      throw std::runtime_error("Matrix is not positive definite.");
+#endif
+    lndet = D.array().log().sum() +
+            2 * cho_S.matrixLLT().diagonal().array().log().sum() +
+            2 * cho_M.matrixLLT().diagonal().array().log().sum();
+  }
+
+  /**
+  Compute `C^-1 B` in place.
+
+  */
+  template <typename T> inline void solve(MatrixBase<T> &B) const {
+    Matrix<Scalar> UTDInvB = DInvU.transpose() * B;
+    B = DInv.asDiagonal() * B;
+    B -= DInvU * cho_M.solve(UTDInvB);
+  }
+
+  /**
+  Compute the gradient of a scalar function of `X = C^-1 B` and of the
+  log determinant with respect to `D`, `U`, and `S`, given `X`,
+  `G = C^-1 bX`, and the gradient `blndet` with respect to the log
+  determinant. This is
+
+      bC = -G X^T + blndet C^-1,
+
+  projected onto the parameters. The diagonal of `C^-1` follows from
+  `diag(D) C^-1 = I - U S U^T C^-1`. Only the lower triangle of `S` is
+  read by the factorization, so that is where its gradient goes.
+
+  */
+  inline void grad(const Matrix<Scalar> &X, const Matrix<Scalar> &G,
+                   const Scalar &blndet) {
+    Matrix<Scalar> CInvU = U;
+    solve(CInvU);
+    Matrix<Scalar> US = U * S;
+    Matrix<Scalar> XTU = X.transpose() * U;
+    Matrix<Scalar> GTU = G.transpose() * U;
+    Vector<Scalar> diagCInv =
+        DInv.cwiseProduct(Vector<Scalar>::Ones(U.rows()) -
+                          US.cwiseProduct(CInvU).rowwise().sum());
+    bD = blndet * diagCInv - G.cwiseProduct(X).rowwise().sum();
+    bU = (blndet * CInvU - G * XTU) * S.transpose() +
+         (blndet * CInvU - X * GTU) * S;
+    bS = blndet * U.transpose() * CInvU - GTU.transpose() * XTU;
+    bS += bS.transpose().eval();
+    bS.diagonal() /= 2;
+    bS.template triangularView<Eigen::StrictlyUpper>().setZero();
+  }
+};
+
+} // namespace covariance
+} // namespace starry
+#endif
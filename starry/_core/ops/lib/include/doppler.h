@@ -0,0 +1,1230 @@
+/**
+\file doppler.h
+\brief Line broadening kernels and convolutions for Doppler imaging.
+
+*/
+
+#ifndef _STARRY_DOPPLER_H_
+#define _STARRY_DOPPLER_H_
+
+#include "basis.h"
+#include "filter.h"
+#include "utils.h"
+#include "wigner.h"
+#include <complex>
+#include <type_traits>
+#include <unsupported/Eigen/FFT>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace starry {
+namespace doppler {
+
+using namespace utils;
+
+/**
+Compute the `rho^T` line broadening solution vector for a map of degree
+`deg` along the lines of constant Doppler shift `x`. The result has
+shape `((deg + 1)^2, nk)`.
+
+This is templated so we can compute its derivative with respect to `x`
+by autodiff; since each column only depends on the corresponding
+element of `x`, a single derivative suffices.
+
+*/
+template <typename T>
+inline void computeRT(const int deg, const RowVector<T> &x, Matrix<T> &rT) {
+  int nk = x.size();
+
+  // Initial conditions. Note that the derivative of `r` is undefined
+  // at `x = 1`, so we zero out values very close to zero.
+  RowVector<T> r2(nk), r(nk);
+  for (int k = 0; k < nk; ++k) {
+    r2(k) = 1 - x(k) * x(k);
+    if (r2(k) > 1e-98) {
+      r(k) = sqrt(r2(k));
+    } else {
+      r2(k) = 0.0;
+      r(k) = 0.0;
+    }
+  }
+
+  // Upward recursion in j; row `2 * j + k` holds `s_0jk`
+  Matrix<T> s0 = Matrix<T>::Zero(2 * (deg + 1), nk);
+  s0.row(0) = T(2.0) * r;
+  s0.row(1) = 0.5 * pi<T>() * r2;
+  for (int j = 2; j < deg + 1; j += 2) {
+    s0.row(2 * j) =
+        T((j - 1.0) / (j + 1.0)) * r2.cwiseProduct(s0.row(2 * j - 4));
+    s0.row(2 * j + 1) =
+        T((j - 1.0) / (j + 2.0)) * r2.cwiseProduct(s0.row(2 * j - 3));
+  }
+
+  // Upward recursion in i: `s_ijk = x^i s_0jk`
+  Matrix<T> xi(deg + 1, nk);
+  xi.row(0).setOnes();
+  for (int i = 1; i < deg + 1; ++i)
+    xi.row(i) = xi.row(i - 1).cwiseProduct(x);
+
+  // The full vector
+  rT.resize((deg + 1) * (deg + 1), nk);
+  for (int l = 0, n = 0; l < deg + 1; ++l) {
+    for (int m = -l; m < l + 1; ++m, ++n) {
+      int k = (l + m) % 2;
+      int i = (l - m - k) / 2;
+      int j = (l + m - k) / 2;
+      rT.row(n) = xi.row(i).cwiseProduct(s0.row(2 * j + k));
+    }
+  }
+}
+
+/**
+Compute the gradient of the `rho^T` solution vector with respect to
+`x` given the gradient `brT` of the output.
+
+*/
+template <typename Scalar>
+inline void computeRT(const int deg, const RowVector<Scalar> &x,
+                      const Matrix<Scalar> &brT, RowVector<Scalar> &bx) {
+  using ADType = ADScalar<Scalar, 1>;
+  int nk = x.size();
+  RowVector<ADType> x_ad(nk);
+  for (int k = 0; k < nk; ++k) {
+    x_ad(k).value() = x(k);
+    x_ad(k).derivatives() = Vector<Scalar>::Ones(1);
+  }
+  Matrix<ADType> rT_ad;
+  computeRT(deg, x_ad, rT_ad);
+  bx.setZero(nk);
+  for (int n = 0; n < rT_ad.rows(); ++n) {
+    for (int k = 0; k < nk; ++k) {
+      bx(k) += brT(n, k) * rT_ad(n, k).derivatives()(0);
+    }
+  }
+}
+
+/**
+The Doppler imaging line broadening kernels.
+
+Given the equatorial velocity `veq`, the inclination `inc`, the limb
+darkening coefficients `u` and the rotational phases `theta` of the
+`nt` epochs, we compute the limb-darkened kernels `kT0`, of shape
+`(Ny, nk)`, and the kernels rotated to each epoch, `kT`, stored as a
+matrix of shape `(nt * Ny, nk)` whose row `m * Ny + n` is the kernel
+for spherical harmonic `n` at epoch `m`. The kernels are sampled at the
+points `xamp / vsini` spanning the kernel in log wavelength.
+
+The rotation to each epoch is the same operation performed by
+`right_project` in the Python layer at zero obliquity. We fold the
+time-independent rotations into `kT0` once, and then apply the `z`
+rotations for all epochs in a single `tensordotRz` call.
+
+*/
+template <class Scalar> class Kernel {
+protected:
+  const basis::Basis<Scalar> &B;
+  wigner::Wigner<Scalar> &W;
+  filter::Filter<Scalar> &F;
+  const int ydeg;
+  const int udeg;
+  const int Ny;
+  const int N;
+
+  // Intermediate results we need for the gradient
+  Scalar vsini;
+  RowVector<Scalar> x;
+  Matrix<Scalar> q;
+  Scalar norm;
+  Matrix<Scalar> L;
+  Matrix<Scalar> P0, P1, P3, Q, Q4;
+  Vector<Scalar> theta_rep;
+
+  inline void check(const RowVector<Scalar> &xamp, const Vector<Scalar> &u) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (xamp.size() < 1)
+      throw std::invalid_argument("The kernel must have at least one point.");
+    if ((udeg > 0) && (u.size() != udeg + 1))
+      throw std::invalid_argument(
+          "Mismatch in the number of limb darkening coefficients.");
+#endif
+  }
+
+public:
+  Matrix<Scalar> rT;  /**< The line broadening solution vector */
+  Matrix<Scalar> kT0; /**< The limb-darkened kernels at zero phase */
+  Matrix<Scalar> kT;  /**< The rotated kernels at each epoch */
+  Scalar bveq;
+  Scalar binc;
+  Vector<Scalar> btheta;
+  Vector<Scalar> bu;
+
+  explicit Kernel(const basis::Basis<Scalar> &B, wigner::Wigner<Scalar> &W,
+                  filter::Filter<Scalar> &F)
+      : B(B), W(W), F(F), ydeg(B.ydeg), udeg(B.udeg),
+        Ny((B.ydeg + 1) * (B.ydeg + 1)),
+        N((B.ydeg + B.udeg + 1) * (B.ydeg + B.udeg + 1)) {}
+
+  /**
+  Compute the limb-darkened kernels `kT0` and their representation in
+  the polar frame, from which the kernels at any epoch can be obtained
+  with a single rotation about `z` (see `rotate`).
+
+  */
+  inline void computeKT0(const RowVector<Scalar> &xamp, const Scalar &veq,
+                         const Scalar &inc, const Vector<Scalar> &u) {
+    check(xamp, u);
+
+    // The line broadening kernels (min vsini is 1 m/s)
+    vsini = veq * sin(inc);
+    x = xamp / std::max(Scalar(1.0), vsini);
+    computeRT(ydeg + udeg, x, rT);
+    q = B.A1_big.transpose() * rT;
+    norm = q.row(0).sum();
+    kT0 = q / norm;
+
+    // Limb darkening
+    if (udeg > 0) {
+      Vector<Scalar> f(1);
+      f << pi<Scalar>();
+      F.computeF(u, f);
+      L = B.A1Inv * F.F * B.A1;
+      kT0 = (L.transpose() * kT0).eval();
+    }
+
+    // Rotate to the polar frame
+    P0 = kT0.transpose();
+    if (ydeg > 0) {
+      W.dotR(P0, Scalar(-1.0), Scalar(0.0), Scalar(0.0),
+             inc - 0.5 * pi<Scalar>());
+      P1 = W.dotR_result;
+      W.dotR(P1, Scalar(1.0), Scalar(0.0), Scalar(0.0), -0.5 * pi<Scalar>());
+      P3 = W.dotR_result;
+    } else {
+      P1 = P0;
+      P3 = P0;
+    }
+  }
+
+  /**
+  Rotate the polar frame kernels computed in `computeKT0` to the epoch
+  with rotational phase `theta`, returning a matrix of shape `(Ny, nk)`.
+  This does not modify any of the intermediates saved for the gradient.
+
+  */
+  inline void rotate(const Scalar &theta, Matrix<Scalar, RowMajor> &kTm) {
+    int nk = P3.rows();
+    if (ydeg > 0) {
+      Vector<Scalar> theta_m = Vector<Scalar>::Constant(nk, theta);
+      W.tensordotRz(P3, theta_m);
+      Matrix<Scalar> R = W.tensordotRz_result;
+      W.dotR(R, Scalar(1.0), Scalar(0.0), Scalar(0.0), 0.5 * pi<Scalar>());
+      kTm = W.dotR_result.transpose();
+    } else {
+      kTm = P3.transpose();
+    }
+  }
+
+  /**
+  Compute the kernels.
+
+  */
+  inline void compute(const RowVector<Scalar> &xamp, const Scalar &veq,
+                      const Scalar &inc, const Vector<Scalar> &theta,
+                      const Vector<Scalar> &u) {
+    computeKT0(xamp, veq, inc, u);
+    int nt = theta.size();
+    int nk = xamp.size();
+
+    // Rotate to each epoch and back to the observer's frame
+    Q.resize(nt * nk, Ny);
+    theta_rep.resize(nt * nk);
+    for (int m = 0; m < nt; ++m) {
+      Q.middleRows(m * nk, nk) = P3;
+      theta_rep.segment(m * nk, nk).setConstant(theta(m));
+    }
+    Matrix<Scalar> Q5;
+    if (ydeg > 0) {
+      W.tensordotRz(Q, theta_rep);
+      Q4 = W.tensordotRz_result;
+      W.dotR(Q4, Scalar(1.0), Scalar(0.0), Scalar(0.0), 0.5 * pi<Scalar>());
+      Q5 = W.dotR_result;
+    } else {
+      Q4 = Q;
+      Q5 = Q;
+    }
+    kT.resize(nt * Ny, nk);
+    for (int m = 0; m < nt; ++m)
+      kT.middleRows(m * Ny, Ny) = Q5.middleRows(m * nk, nk).transpose();
+  }
+
+  /**
+  Compute the gradient of the rotated kernels `kT` with respect to
+  `veq`, `inc`, `theta` and `u` given the gradient `bkT` of the output.
+
+  */
+  inline void compute(const RowVector<Scalar> &xamp, const Scalar &veq,
+                      const Scalar &inc, const Vector<Scalar> &theta,
+                      const Vector<Scalar> &u, const Matrix<Scalar> &bkT) {
+    compute(xamp, veq, inc, theta, u);
+    int nt = theta.size();
+    int nk = xamp.size();
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((bkT.rows() != nt * Ny) || (bkT.cols() != nk))
+      throw std::invalid_argument("Invalid shape for the kernel gradient.");
+#endif
+
+    // Back to the polar frame
+    Matrix<Scalar> bQ(nt * nk, Ny);
+    for (int m = 0; m < nt; ++m)
+      bQ.middleRows(m * nk, nk) = bkT.middleRows(m * Ny, Ny).transpose();
+    btheta.setZero(nt);
+    binc = 0.0;
+    Matrix<Scalar> bP3 = Matrix<Scalar>::Zero(nk, Ny);
+    Matrix<Scalar> bP0;
+    if (ydeg > 0) {
+      W.dotR(Q4, Scalar(1.0), Scalar(0.0), Scalar(0.0), 0.5 * pi<Scalar>(),
+             bQ);
+      W.tensordotRz(Q, theta_rep, W.dotR_bM);
+      for (int m = 0; m < nt; ++m) {
+        btheta(m) = W.tensordotRz_btheta.segment(m * nk, nk).sum();
+        bP3 += W.tensordotRz_bM.middleRows(m * nk, nk);
+      }
+      W.dotR(P1, Scalar(1.0), Scalar(0.0), Scalar(0.0), -0.5 * pi<Scalar>(),
+             bP3);
+      Matrix<Scalar> bP1 = W.dotR_bM;
+      W.dotR(P0, Scalar(-1.0), Scalar(0.0), Scalar(0.0),
+             inc - 0.5 * pi<Scalar>(), bP1);
+      bP0 = W.dotR_bM;
+      binc += W.dotR_btheta;
+    } else {
+      for (int m = 0; m < nt; ++m)
+        bP3 += bQ.middleRows(m * nk, nk);
+      bP0 = bP3;
+    }
+    Matrix<Scalar> bk = bP0.transpose();
+
+    // Limb darkening
+    if (udeg > 0) {
+      Matrix<Scalar> k = q / norm;
+      Matrix<Scalar> bL = k * bk.transpose();
+      Vector<Scalar> f(1);
+      f << pi<Scalar>();
+      F.computeF(u, f, B.A1Inv.transpose() * bL * B.A1.transpose());
+      bu = F.bu;
+      bk = (L * bk).eval();
+    } else {
+      bu.setZero(u.size());
+    }
+
+    // Normalization
+    Matrix<Scalar> bq = bk / norm;
+    bq.row(0).array() -= bk.cwiseProduct(q).sum() / (norm * norm);
+
+    // Line broadening kernels
+    Matrix<Scalar> brT = B.A1_big * bq;
+    RowVector<Scalar> bx;
+    computeRT(ydeg + udeg, x, brT, bx);
+    Scalar bvsini = 0.0;
+    if (vsini > 1.0)
+      bvsini = -bx.cwiseProduct(xamp).sum() / (vsini * vsini);
+    bveq = bvsini * sin(inc);
+    binc += bvsini * veq * cos(inc);
+  }
+};
+
+/**
+Convolution strategies for the Doppler design matrix products. The
+`ConvSingle` flag may be OR'd into any of the strategies to compute the
+direct convolutions in mixed precision (see the `mixed` namespace).
+
+*/
+enum ConvolutionMode {
+  ConvAuto = 0,
+  ConvDirect = 1,
+  ConvFFT = 2,
+  ConvStrategy = 3,
+  ConvSingle = 4
+};
+
+/**
+Return the smallest FFT length no smaller than `n` that is a multiple of
+four (so the real transforms take the fast path) and has no prime
+factors larger than five.
+
+*/
+inline int fftSize(const int n) {
+  for (int m = 4 * ((n + 3) / 4);; m += 4) {
+    int r = m;
+    for (int p : {2, 3, 5}) {
+      while (r % p == 0)
+        r /= p;
+    }
+    if (r == 1)
+      return m;
+  }
+}
+
+/**
+Decide whether to convolve via FFT. We compare the number of
+multiply-adds of the direct method, `nb * no * nc * nw * nk`, to the
+cost of the `nb * nc + no * nc + nb * no` real transforms of length
+`nfft` plus the products in the frequency domain. The FFT path runs in
+double precision, so we never choose it automatically in multiprecision
+builds. In mixed precision mode, the direct method processes twice as
+many elements per SIMD instruction, so we halve its cost.
+
+*/
+template <typename Scalar>
+inline bool useFFT(const int mode, const int nb, const int no, const int nc,
+                   const int nwp, const int nk) {
+  if ((mode & ConvStrategy) == ConvDirect)
+    return false;
+  else if ((mode & ConvStrategy) == ConvFFT)
+    return true;
+  if (!std::is_same<Scalar, double>::value)
+    return false;
+  double nfft = fftSize(nwp);
+  double npairs = double(nb) * no * nc;
+  double direct = npairs * (nwp - nk + 1) * nk;
+  if (mode & ConvSingle)
+    direct *= 0.5;
+  double fft = 2.0 * npairs * (0.5 * nfft + 1) +
+               STARRY_DOPPLER_FFT_COST * (double(nb) * nc + double(no) * nc +
+                                          double(nb) * no) *
+                   nfft * std::log2(nfft);
+  return fft < direct;
+}
+
+namespace fft {
+
+using Complex = std::complex<double>;
+using Spectra = Eigen::Matrix<Complex, Eigen::Dynamic, Eigen::Dynamic, RowMajor>;
+
+/**
+Compute the half spectra of the rows of `x`, zero-padded to length
+`nfft`, optionally reversing each row first.
+
+*/
+template <typename Scalar>
+inline void rfft(const Matrix<Scalar, RowMajor> &x, const int nfft,
+                 const bool reverse, Spectra &X) {
+  int nrows = x.rows();
+  int ncols = x.cols();
+  X.resize(nrows, nfft / 2 + 1);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    std::vector<double> buf(nfft);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int i = 0; i < nrows; ++i) {
+      std::fill(buf.begin(), buf.end(), 0.0);
+      for (int j = 0; j < ncols; ++j)
+        buf[reverse ? ncols - 1 - j : j] = static_cast<double>(x(i, j));
+      fft.fwd(X.row(i).data(), buf.data(), nfft);
+    }
+  }
+}
+
+/**
+Compute `out(i * n1 + j) = irfft(sum_c A(i * na + c) * B(j * nb + c))`
+for all `i < n0`, `j < n1`, keeping the `len` samples starting at
+`offset`. The strides `na`, `nb` and the channel stride `sa`, `sb` let
+us express all three Doppler products with the same kernel; if `conj`
+is set, the rows of `A` are conjugated.
+
+*/
+template <typename Scalar>
+inline void irfftSum(const Spectra &A, const Spectra &B, const int n0,
+                     const int n1, const int nc, const int na, const int sa,
+                     const int nb, const int sb, const bool conj,
+                     const int nfft, const int offset, const int len,
+                     Matrix<Scalar, RowMajor> &out) {
+  int nh = nfft / 2 + 1;
+  out.resize(n0 * n1, len);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    Eigen::Matrix<Complex, 1, Eigen::Dynamic> acc(nh);
+    std::vector<double> buf(nfft);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int ij = 0; ij < n0 * n1; ++ij) {
+      int i = ij / n1;
+      int j = ij % n1;
+      acc.setZero();
+      for (int c = 0; c < nc; ++c) {
+        if (conj)
+          acc += A.row(i * na + c * sa).conjugate().cwiseProduct(
+              B.row(j * nb + c * sb));
+        else
+          acc += A.row(i * na + c * sa).cwiseProduct(B.row(j * nb + c * sb));
+      }
+      fft.inv(buf.data(), acc.data(), nfft);
+      for (int k = 0; k < len; ++k)
+        out(ij, k) = static_cast<Scalar>(buf[offset + k]);
+    }
+  }
+}
+
+} // namespace fft
+
+namespace mixed {
+
+using MatrixF = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, RowMajor>;
+using RowVectorF = Eigen::Matrix<float, 1, Eigen::Dynamic>;
+
+/**
+Mixed precision versions of the direct Doppler convolutions below. The
+inputs are rounded to single precision (halving the memory traffic of
+the inner loops and doubling their SIMD width), and the products and
+their sums over the `nk` kernel points are accumulated in single
+precision. The longer reductions (over channels, over outputs, and over
+blocks of `STARRY_DOPPLER_SINGLE_BLOCK` wavelength bins) are accumulated
+in `Scalar`.
+
+To first order in the unit roundoff `u = 2^-24`, rounding the two
+inputs and each product and sum gives the elementwise bound
+
+    |out - out_exact| <= (nk + 2) u sum |k| |x|
+
+for `convolve` and `convolveT`, where the sum is over the same terms as
+the convolution itself (i.e., it is the convolution of `|x|` with
+`|k|`). The bound for `convolveK` is the same with `nk` replaced by
+`STARRY_DOPPLER_SINGLE_BLOCK`.
+
+*/
+template <typename Scalar>
+inline void convolve(const Matrix<Scalar, RowMajor> &x,
+                     const Matrix<Scalar, RowMajor> &k, const int nc,
+                     Matrix<Scalar, RowMajor> &out) {
+  int nk = k.cols();
+  int nw = x.cols() - nk + 1;
+  int nb = x.rows() / nc;
+  int no = k.rows() / nc;
+  MatrixF xf = x.template cast<float>();
+  MatrixF kf = k.template cast<float>();
+  out.setZero(nb * no, nw);
+  int nsplit = 1;
+#ifdef _OPENMP
+  if ((nb * no < omp_get_max_threads()) && !omp_in_parallel())
+    nsplit = nc;
+#pragma omp parallel
+#endif
+  {
+    Matrix<Scalar, RowMajor> acc;
+    if (nsplit > 1)
+      acc.setZero(nb * no, nw);
+    Matrix<Scalar, RowMajor> &res = (nsplit > 1) ? acc : out;
+    RowVectorF tmp(nw);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int n = 0; n < nb * no * nsplit; ++n) {
+      int bo = n / nsplit;
+      int b = bo / no;
+      int o = bo % no;
+      int c0 = (nsplit > 1) ? n % nsplit : 0;
+      int c1 = (nsplit > 1) ? c0 + 1 : nc;
+      for (int c = c0; c < c1; ++c) {
+        tmp.setZero();
+        for (int i = 0; i < nk; ++i) {
+          tmp += kf(o * nc + c, i) * xf.row(b * nc + c).segment(i, nw);
+        }
+        res.row(bo) += tmp.template cast<Scalar>();
+      }
+    }
+    if (nsplit > 1) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      out += acc;
+    }
+  }
+}
+
+template <typename Scalar>
+inline void convolveT(const Matrix<Scalar, RowMajor> &y,
+                      const Matrix<Scalar, RowMajor> &k, const int nc,
+                      Matrix<Scalar, RowMajor> &out) {
+  int nw = y.cols();
+  int nk = k.cols();
+  int nwp = nw + nk - 1;
+  int no = k.rows() / nc;
+  int nb = y.rows() / no;
+  MatrixF yf = y.template cast<float>();
+  MatrixF kf = k.template cast<float>();
+  out.setZero(nb * nc, nwp);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    RowVectorF tmp(nwp);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int bc = 0; bc < nb * nc; ++bc) {
+      int b = bc / nc;
+      int c = bc % nc;
+      for (int o = 0; o < no; ++o) {
+        tmp.setZero();
+        for (int i = 0; i < nk; ++i) {
+          tmp.segment(i, nw) += kf(o * nc + c, i) * yf.row(b * no + o);
+        }
+        out.row(bc) += tmp.template cast<Scalar>();
+      }
+    }
+  }
+}
+
+template <typename Scalar>
+inline void convolveK(const Matrix<Scalar, RowMajor> &x,
+                      const Matrix<Scalar, RowMajor> &y, const int nc,
+                      Matrix<Scalar, RowMajor> &out) {
+  int nwp = x.cols();
+  int nw = y.cols();
+  int nk = nwp - nw + 1;
+  int nb = x.rows() / nc;
+  int no = y.rows() / nb;
+  int bs = STARRY_DOPPLER_SINGLE_BLOCK;
+  MatrixF xf = x.template cast<float>();
+  MatrixF yf = y.template cast<float>();
+  out.setZero(no * nc, nk);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int oc = 0; oc < no * nc; ++oc) {
+    int o = oc / nc;
+    int c = oc % nc;
+    for (int b = 0; b < nb; ++b) {
+      for (int i = 0; i < nk; ++i) {
+        Scalar sum = 0.0;
+        for (int j = 0; j < nw; j += bs) {
+          int len = std::min(bs, nw - j);
+          sum += yf.row(b * no + o)
+                     .segment(j, len)
+                     .dot(xf.row(b * nc + c).segment(i + j, len));
+        }
+        out(oc, i) += sum;
+      }
+    }
+  }
+}
+
+} // namespace mixed
+
+/**
+The Doppler convolution. Given `nb` batches of `nc` spectra `x`, of
+shape `(nb * nc, nwp)`, and `no` sets of `nc` kernels `k`, of shape
+`(no * nc, nk)`, compute the (unflipped) valid convolution
+
+    out(b * no + o, j) = sum_c sum_i x(b * nc + c, j + i) k(o * nc + c, i)
+
+of shape `(nb * no, nw)`, where `nw = nwp - nk + 1`. This is the
+operation performed by `conv2d` in the Theano implementation of the
+design matrix products. If the `ConvSingle` flag is set in `mode`, the
+direct convolution is computed in mixed precision (the FFT convolution
+always runs in double precision).
+
+*/
+template <typename Scalar>
+inline void convolve(const Matrix<Scalar, RowMajor> &x,
+                     const Matrix<Scalar, RowMajor> &k, const int nc,
+                     Matrix<Scalar, RowMajor> &out,
+                     const int mode = ConvAuto) {
+  int nwp = x.cols();
+  int nk = k.cols();
+  int nw = nwp - nk + 1;
+  int nb = x.rows() / nc;
+  int no = k.rows() / nc;
+#ifndef STARRY_NO_EXCEPTIONS
+  if ((x.rows() != nb * nc) || (k.rows() != no * nc) || (nw < 1))
+    throw std::invalid_argument("Invalid shape in the Doppler convolution.");
+#endif
+  if (useFFT<Scalar>(mode, nb, no, nc, nwp, nk)) {
+    int nfft = fftSize(nwp);
+    fft::Spectra X, K;
+    fft::rfft(x, nfft, false, X);
+    fft::rfft(k, nfft, true, K);
+    fft::irfftSum(X, K, nb, no, nc, nc, 1, nc, 1, false, nfft, nk - 1, nw,
+                  out);
+  } else if (mode & ConvSingle) {
+    mixed::convolve(x, k, nc, out);
+  } else {
+    // When there are fewer outputs than threads (as in a matrix-vector
+    // product), we also split the sum over the channels across threads
+    out.setZero(nb * no, nw);
+    int nsplit = 1;
+#ifdef _OPENMP
+    if ((nb * no < omp_get_max_threads()) && !omp_in_parallel())
+      nsplit = nc;
+#pragma omp parallel
+#endif
+    {
+      Matrix<Scalar, RowMajor> acc;
+      if (nsplit > 1)
+        acc.setZero(nb * no, nw);
+      Matrix<Scalar, RowMajor> &res = (nsplit > 1) ? acc : out;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int n = 0; n < nb * no * nsplit; ++n) {
+        int bo = n / nsplit;
+        int b = bo / no;
+        int o = bo % no;
+        int c0 = (nsplit > 1) ? n % nsplit : 0;
+        int c1 = (nsplit > 1) ? c0 + 1 : nc;
+        for (int c = c0; c < c1; ++c) {
+          for (int i = 0; i < nk; ++i) {
+            res.row(bo) += k(o * nc + c, i) *
+                           x.row(b * nc + c).segment(i, nw);
+          }
+        }
+      }
+      if (nsplit > 1) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        out += acc;
+      }
+    }
+  }
+}
+
+/**
+The adjoint of the Doppler convolution with respect to the spectra.
+Given `y`, of shape `(nb * no, nw)`, compute
+
+    out(b * nc + c, j + i) = sum_o y(b * no + o, j) k(o * nc + c, i)
+
+of shape `(nb * nc, nwp)`. This is the operation performed by
+`conv2d_transpose` in the Theano implementation.
+
+*/
+template <typename Scalar>
+inline void convolveT(const Matrix<Scalar, RowMajor> &y,
+                      const Matrix<Scalar, RowMajor> &k, const int nc,
+                      Matrix<Scalar, RowMajor> &out,
+                      const int mode = ConvAuto) {
+  int nw = y.cols();
+  int nk = k.cols();
+  int nwp = nw + nk - 1;
+  int no = k.rows() / nc;
+  int nb = no > 0 ? y.rows() / no : 0;
+#ifndef STARRY_NO_EXCEPTIONS
+  if ((k.rows() != no * nc) || (no < 1) || (y.rows() != nb * no))
+    throw std::invalid_argument("Invalid shape in the Doppler convolution.");
+#endif
+  if (useFFT<Scalar>(mode, nb, no, nc, nwp, nk)) {
+    int nfft = fftSize(nwp);
+    fft::Spectra Y, K;
+    fft::rfft(y, nfft, false, Y);
+    fft::rfft(k, nfft, false, K);
+    fft::irfftSum(Y, K, nb, nc, no, no, 1, 1, nc, false, nfft, 0, nwp, out);
+  } else if (mode & ConvSingle) {
+    mixed::convolveT(y, k, nc, out);
+  } else {
+    out.setZero(nb * nc, nwp);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int bc = 0; bc < nb * nc; ++bc) {
+      int b = bc / nc;
+      int c = bc % nc;
+      for (int o = 0; o < no; ++o) {
+        for (int i = 0; i < nk; ++i) {
+          out.row(bc).segment(i, nw) +=
+              k(o * nc + c, i) * y.row(b * no + o);
+        }
+      }
+    }
+  }
+}
+
+/**
+The adjoint of the Doppler convolution with respect to the kernels.
+Given the spectra `x`, of shape `(nb * nc, nwp)`, and `y`, of shape
+`(nb * no, nw)`, compute
+
+    out(o * nc + c, i) = sum_b sum_j y(b * no + o, j) x(b * nc + c, j + i)
+
+of shape `(no * nc, nk)`.
+
+*/
+template <typename Scalar>
+inline void convolveK(const Matrix<Scalar, RowMajor> &x,
+                      const Matrix<Scalar, RowMajor> &y, const int nc,
+                      Matrix<Scalar, RowMajor> &out,
+                      const int mode = ConvAuto) {
+  int nwp = x.cols();
+  int nw = y.cols();
+  int nk = nwp - nw + 1;
+  int nb = x.rows() / nc;
+  int no = nb > 0 ? y.rows() / nb : 0;
+#ifndef STARRY_NO_EXCEPTIONS
+  if ((x.rows() != nb * nc) || (nb < 1) || (y.rows() != nb * no) || (nk < 1))
+    throw std::invalid_argument("Invalid shape in the Doppler convolution.");
+#endif
+  if (useFFT<Scalar>(mode, nb, no, nc, nwp, nk)) {
+    int nfft = fftSize(nwp);
+    fft::Spectra X, Y;
+    fft::rfft(x, nfft, false, X);
+    fft::rfft(y, nfft, false, Y);
+    fft::irfftSum(Y, X, no, nc, nb, 1, no, 1, nc, true, nfft, 0, nk, out);
+  } else if (mode & ConvSingle) {
+    mixed::convolveK(x, y, nc, out);
+  } else {
+    out.setZero(no * nc, nk);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int oc = 0; oc < no * nc; ++oc) {
+      int o = oc / nc;
+      int c = oc % nc;
+      for (int b = 0; b < nb; ++b) {
+        for (int i = 0; i < nk; ++i) {
+          out(oc, i) += y.row(b * no + o).dot(x.row(b * nc + c).segment(i, nw));
+        }
+      }
+    }
+  }
+}
+
+/**
+The block-Toeplitz Doppler matrix `D` as a structured operator.
+
+`D` has shape `(nt * nw, nch * nwp)`: row `t * nw + w` holds the kernel
+for channel `n` at epoch `t` in columns `n * nwp + w + j`, for `j` in
+`[0, nk)`. The channels are either the spherical harmonics (the full
+design matrix) or the components of a fixed map (whose kernels are the
+products of the map with those of the harmonics). We store each of the
+`nt * nch` kernels once and build the rows on demand, so the products
+with `D`, its transpose, and their gradients cost
+`O(nt * nw * nch * nk)` per column without ever storing the `nw` copies
+of each kernel. The explicit matrix (dense or CSR) is only assembled
+if explicitly requested.
+
+*/
+template <class Scalar> class Toeplitz {
+protected:
+  Matrix<Scalar, RowMajor> kT; // The kernels, shape `(nt * nch, nk)`
+
+public:
+  const int nch;
+  const int nwp;
+  const int nk;
+  const int nw;
+  const int nt;
+
+  explicit Toeplitz(const Matrix<Scalar, RowMajor> &kT, const int nch,
+                    const int nwp)
+      : kT(kT), nch(nch), nwp(nwp), nk(kT.cols()), nw(nwp - nk + 1),
+        nt(nch > 0 ? kT.rows() / nch : 0) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((nch < 1) || (nw < 1) || (nt * nch != kT.rows()))
+      throw std::invalid_argument("Invalid shape in the Doppler matrix.");
+#endif
+  }
+
+  inline int rows() const { return nt * nw; }
+
+  inline int cols() const { return nch * nwp; }
+
+  /**
+  Compute row `r` of `D` in sparse form: the `nch * nk` column indices
+  `idx` and the corresponding values `val`.
+
+  */
+  inline void row(const int r, Vector<int> &idx,
+                  RowVector<Scalar> &val) const {
+    int t = r / nw;
+    int w = r % nw;
+    idx.resize(nch * nk);
+    val.resize(nch * nk);
+    for (int n = 0, i = 0; n < nch; ++n) {
+      for (int j = 0; j < nk; ++j, ++i) {
+        idx(i) = n * nwp + w + j;
+        val(i) = kT(t * nch + n, j);
+      }
+    }
+  }
+
+  /**
+  Compute `out = D M` (or `out = D^T M` if `TRANSPOSE`).
+
+  */
+  template <bool TRANSPOSE>
+  inline void dot(const Matrix<Scalar> &M, Matrix<Scalar> &out) const {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (M.rows() != (TRANSPOSE ? rows() : cols()))
+      throw std::invalid_argument("Invalid shape in the Doppler matrix.");
+#endif
+    if (TRANSPOSE) {
+      // Each channel owns a distinct block of rows of the output
+      out.setZero(cols(), M.cols());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int n = 0; n < nch; ++n) {
+        for (int t = 0; t < nt; ++t) {
+          for (int w = 0; w < nw; ++w) {
+            for (int j = 0; j < nk; ++j)
+              out.row(n * nwp + w + j) +=
+                  kT(t * nch + n, j) * M.row(t * nw + w);
+          }
+        }
+      }
+    } else {
+      out.setZero(rows(), M.cols());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int r = 0; r < rows(); ++r) {
+        int t = r / nw;
+        int w = r % nw;
+        for (int n = 0; n < nch; ++n) {
+          for (int j = 0; j < nk; ++j)
+            out.row(r) += kT(t * nch + n, j) * M.row(n * nwp + w + j);
+        }
+      }
+    }
+  }
+
+  /**
+  The gradient of `D M` with respect to the kernels, given the gradient
+  `bout` with respect to the product.
+
+  */
+  inline void dotGrad(const Matrix<Scalar> &M, const Matrix<Scalar> &bout,
+                      Matrix<Scalar, RowMajor> &bkT) const {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((M.rows() != cols()) || (bout.rows() != rows()) ||
+        (bout.cols() != M.cols()))
+      throw std::invalid_argument("Invalid shape in the Doppler matrix.");
+#endif
+    bkT.setZero(nt * nch, nk);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < nt * nch; ++i) {
+      int t = i / nch;
+      int n = i % nch;
+      for (int w = 0; w < nw; ++w) {
+        for (int j = 0; j < nk; ++j)
+          bkT(i, j) += bout.row(t * nw + w).dot(M.row(n * nwp + w + j));
+      }
+    }
+  }
+
+  /**
+  Assemble the dense matrix `D`.
+
+  */
+  inline void dense(Matrix<Scalar, RowMajor> &D) const {
+    D.setZero(rows(), cols());
+    Vector<int> idx;
+    RowVector<Scalar> val;
+    for (int r = 0; r < rows(); ++r) {
+      row(r, idx, val);
+      for (int i = 0; i < idx.size(); ++i)
+        D(r, idx(i)) = val(i);
+    }
+  }
+
+  /**
+  Assemble the sparse matrix `D` in CSR form. Its index structure is
+  implicit, so we write the row pointers, column indices and values in
+  a single pass over the (already sorted) nonzeros.
+
+  */
+  inline void matrix(Eigen::SparseMatrix<Scalar, RowMajor> &D) const {
+    int nnzrow = nch * nk;
+    D.resize(rows(), cols());
+    D.resizeNonZeros(std::size_t(rows()) * nnzrow);
+    auto *outer = D.outerIndexPtr();
+    auto *inner = D.innerIndexPtr();
+    Scalar *value = D.valuePtr();
+    for (int r = 0; r <= rows(); ++r)
+      outer[r] = r * nnzrow;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int r = 0; r < rows(); ++r) {
+      Vector<int> idx;
+      RowVector<Scalar> val;
+      row(r, idx, val);
+      std::size_t i0 = std::size_t(r) * nnzrow;
+      for (int i = 0; i < nnzrow; ++i) {
+        inner[i0 + i] = idx(i);
+        value[i0 + i] = val(i);
+      }
+    }
+  }
+
+  /**
+  The gradient of the matrix `D` with respect to the kernels: the sum of
+  the entries of `bD` over each Toeplitz diagonal of each block. Entries
+  of `bD` outside the band of `D` are ignored, since they do not depend
+  on the kernels.
+
+  */
+  inline void matrixGrad(const Eigen::SparseMatrix<Scalar, RowMajor> &bD,
+                         Matrix<Scalar, RowMajor> &bkT) const {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((bD.rows() != rows()) || (bD.cols() != cols()))
+      throw std::invalid_argument("Invalid shape in the Doppler matrix.");
+#endif
+    bkT.setZero(nt * nch, nk);
+    for (int r = 0; r < bD.outerSize(); ++r) {
+      int t = r / nw;
+      int w = r % nw;
+      for (typename Eigen::SparseMatrix<Scalar, RowMajor>::InnerIterator it(
+               bD, r);
+           it; ++it) {
+        int n = it.col() / nwp;
+        int j = it.col() % nwp - w;
+        if ((j >= 0) && (j < nk))
+          bkT(t * nch + n, j) += it.value();
+      }
+    }
+  }
+};
+
+/**
+The Doppler imaging design matrix as a linear operator.
+
+The full design matrix `D`, of shape `(nt * nw, Ny * nwp)`, is a stack of
+Toeplitz convolution matrices, one per spherical harmonic and epoch.
+Rather than instantiating it, we keep only the limb-darkened kernels in
+the polar frame and rotate them to each epoch on the fly, computing the
+products with `D` and its transpose one epoch at a time via the Doppler
+convolution. The kernels rotated to the most recent set of epochs are
+cached (up to a memory budget of `cache_size` bytes), since iterative
+solvers compute many products at fixed geometry. We also provide the
+products with the design matrices for a fixed map `y`, of shape
+`(Ny, nc)`, and for a fixed spectrum, of shape `(nc, nwp)`.
+
+All matrices follow the layout of the Python design matrices: the input
+to `D` is indexed as `n * nwp + w` (harmonic `n`, wavelength `w`), the
+input to the fixed map product as `c * nwp + w` (component `c`), the
+input to the fixed spectrum product as `c * Ny + n`, and the output as
+`t * nw + w` (epoch `t`).
+
+*/
+template <class Scalar> class Operator {
+protected:
+  Kernel<Scalar> K;
+  const int Ny;
+
+  // The parameters of the current kernels
+  RowVector<Scalar> xamp_;
+  Scalar veq_;
+  Scalar inc_;
+  Vector<Scalar> u_;
+  bool computed;
+
+  // The kernels rotated to the epochs `theta_`
+  Vector<Scalar> theta_;
+  std::vector<Matrix<Scalar, RowMajor>> kTcache;
+
+  /**
+  Rotate the kernels to each of the epochs `theta`, reusing the kernels
+  from the previous call if neither the epochs nor the kernel parameters
+  have changed. Returns false if the rotated kernels would exceed the
+  memory budget `cache_size`, in which case the caller should rotate
+  them on the fly.
+
+  */
+  inline bool rotateAll(const Vector<Scalar> &theta) {
+    int nt = theta.size();
+    std::size_t nbytes = std::size_t(nt) * Ny * xamp_.size() * sizeof(Scalar);
+    if (nbytes > cache_size) {
+      kTcache.clear();
+      theta_.resize(0);
+      return false;
+    }
+    if ((int(kTcache.size()) == nt) && (theta_.size() == nt) &&
+        (theta_ == theta))
+      return true;
+    kTcache.resize(nt);
+    for (int t = 0; t < nt; ++t)
+      K.rotate(theta(t), kTcache[t]);
+    theta_ = theta;
+    return true;
+  }
+
+  /**
+  Dot the design matrix for `nch` channels into `M` (or its transpose
+  into `M` if `TRANSPOSE`), where the kernel for channel `c` at epoch `t`
+  is the product of `Y^T` with the rotated kernels. If `Y` is empty, the
+  channels are the spherical harmonics themselves.
+
+  */
+  template <bool TRANSPOSE>
+  inline void product(const Vector<Scalar> &theta, const Matrix<Scalar> &Y,
+                      const Matrix<Scalar> &M, const int nwp,
+                      Matrix<Scalar> &out, const int mode) {
+    int nt = theta.size();
+    int nk = xamp_.size();
+    int nw = nwp - nk + 1;
+    int nch = Y.size() ? Y.cols() : Ny;
+    int m = M.cols();
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((Y.size() && (Y.rows() != Ny)) ||
+        (M.rows() != (TRANSPOSE ? nt * nw : nch * nwp)))
+      throw std::invalid_argument("Invalid shape in the Doppler operator.");
+#endif
+
+    // Column `i` of `M` (or of the output) is row `i` of a row-major
+    // `(m, nch * nwp)` matrix, i.e., `m * nch` spectra of length `nwp`
+    Matrix<Scalar, RowMajor> x, kTm, k, y, res;
+    Matrix<Scalar, RowMajor> acc;
+    if (TRANSPOSE) {
+      acc.setZero(m * nch, nwp);
+    } else {
+      x = Eigen::Map<const Matrix<Scalar, RowMajor>>(M.data(), m * nch, nwp);
+      out.resize(nt * nw, m);
+    }
+    bool cached = rotateAll(theta);
+    for (int t = 0; t < nt; ++t) {
+      if (!cached)
+        K.rotate(theta(t), kTm);
+      const Matrix<Scalar, RowMajor> &kTt = cached ? kTcache[t] : kTm;
+      if (Y.size())
+        k = Y.transpose() * kTt;
+      else
+        k = kTt;
+      if (TRANSPOSE) {
+        y = M.middleRows(t * nw, nw).transpose();
+        convolveT(y, k, nch, res, mode);
+        acc += res;
+      } else {
+        convolve(x, k, nch, res, mode);
+        out.middleRows(t * nw, nw) = res.transpose();
+      }
+    }
+    if (TRANSPOSE)
+      out = Eigen::Map<const Matrix<Scalar>>(acc.data(), nch * nwp, m);
+  }
+
+public:
+  std::size_t cache_size; /**< Memory budget for the rotated kernels */
+
+  explicit Operator(const basis::Basis<Scalar> &B, wigner::Wigner<Scalar> &W,
+                    filter::Filter<Scalar> &F)
+      : K(B, W, F), Ny((B.ydeg + 1) * (B.ydeg + 1)), computed(false),
+        cache_size(STARRY_DOPPLER_CACHE_SIZE) {}
+
+  /**
+  Compute the kernels in the polar frame. This is a no-op if the
+  parameters haven't changed since the last call.
+
+  */
+  inline void compute(const RowVector<Scalar> &xamp, const Scalar &veq,
+                      const Scalar &inc, const Vector<Scalar> &u) {
+    if (computed && (xamp.size() == xamp_.size()) && (xamp == xamp_) &&
+        (veq == veq_) && (inc == inc_) && (u.size() == u_.size()) &&
+        (u == u_))
+      return;
+    K.computeKT0(xamp, veq, inc, u);
+    kTcache.clear();
+    theta_.resize(0);
+    xamp_ = xamp;
+    veq_ = veq;
+    inc_ = inc;
+    u_ = u;
+    computed = true;
+  }
+
+  /**
+  The number of points in each kernel.
+
+  */
+  inline int nk() const { return xamp_.size(); }
+
+  /**
+  Return the rotated kernels at the epoch with rotational phase `theta`,
+  a matrix of shape `(Ny, nk)`.
+
+  */
+  inline void kernels(const Scalar &theta, Matrix<Scalar, RowMajor> &kTm) {
+    K.rotate(theta, kTm);
+  }
+
+  /**
+  Dot the full design matrix into `M`, of shape `(Ny * nwp, m)`.
+
+  */
+  template <bool TRANSPOSE>
+  inline void dot(const Vector<Scalar> &theta, const Matrix<Scalar> &M,
+                  const int nwp, Matrix<Scalar> &out,
+                  const int mode = ConvAuto) {
+    product<TRANSPOSE>(theta, Matrix<Scalar>(), M, nwp, out, mode);
+  }
+
+  /**
+  Dot the design matrix for a fixed map `y` into `M`, of shape
+  `(nc * nwp, m)`.
+
+  */
+  template <bool TRANSPOSE>
+  inline void dotFixedMap(const Vector<Scalar> &theta,
+                          const Matrix<Scalar> &y, const Matrix<Scalar> &M,
+                          const int nwp, Matrix<Scalar> &out,
+                          const int mode = ConvAuto) {
+    product<TRANSPOSE>(theta, y, M, nwp, out, mode);
+  }
+
+  /**
+  Dot the design matrix for a fixed `spectrum` into `M`, of shape
+  `(nc * Ny, m)`. We form the spectral maps `M_i^T spectrum` for each
+  column `i` and dot the full design matrix into them (or, for the
+  transpose, project the output of the full transpose product onto the
+  spectrum).
+
+  */
+  template <bool TRANSPOSE>
+  inline void dotFixedSpectrum(const Vector<Scalar> &theta,
+                               const Matrix<Scalar> &spectrum,
+                               const Matrix<Scalar> &M, Matrix<Scalar> &out,
+                               const int mode = ConvAuto) {
+    int nc = spectrum.rows();
+    int nwp = spectrum.cols();
+    int m = M.cols();
+    if (TRANSPOSE) {
+      Matrix<Scalar> g;
+      dot<true>(theta, M, nwp, g, mode);
+      out.resize(nc * Ny, m);
+      for (int i = 0; i < m; ++i) {
+        Eigen::Map<const Matrix<Scalar>> G(g.col(i).data(), nwp, Ny);
+        Eigen::Map<Matrix<Scalar>>(out.col(i).data(), Ny, nc) =
+            G.transpose() * spectrum.transpose();
+      }
+    } else {
+#ifndef STARRY_NO_EXCEPTIONS
+      if (M.rows() != nc * Ny)
+        throw std::invalid_argument("Invalid shape in the Doppler operator.");
+#endif
+      Matrix<Scalar> a(Ny * nwp, m);
+      for (int i = 0; i < m; ++i) {
+        Eigen::Map<const Matrix<Scalar>> Z(M.col(i).data(), Ny, nc);
+        Eigen::Map<Matrix<Scalar>>(a.col(i).data(), nwp, Ny) =
+            (Z * spectrum).transpose();
+      }
+      dot<false>(theta, a, nwp, out, mode);
+    }
+  }
+};
+
+} // namespace doppler
+} // namespace starry
+#endif
@@ -0,0 +1,460 @@
+/**
+\file doppler_solve.h
+\brief Bilinear solver for the Doppler imaging problem.
+
+*/
+
+#ifndef _STARRY_DOPPLER_SOLVE_H_
+#define _STARRY_DOPPLER_SOLVE_H_
+
+#include "doppler.h"
+#include "utils.h"
+#include <Eigen/SparseCore>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace starry {
+namespace doppler {
+
+using namespace utils;
+
+/**
+Solve the symmetric positive definite system `A x = b` with the Jacobi
+preconditioned conjugate gradient method, where `A` is a functor
+computing the product `A x` and `Pinv` is the inverse of the diagonal
+of `A`. On input, `x` is the starting guess. Iterate until the norm of
+the residual is at most `tol` times the norm of `b` and return the
+number of iterations.
+
+*/
+template <typename Scalar, class Product>
+inline int cg(const Product &A, const Vector<Scalar> &b,
+              const Vector<Scalar> &Pinv, Vector<Scalar> &x, const Scalar &tol,
+              const int maxiter) {
+  Vector<Scalar> Ap;
+  A(x, Ap);
+  Vector<Scalar> r = b - Ap;
+  Vector<Scalar> z = Pinv.cwiseProduct(r);
+  Vector<Scalar> p = z;
+  Scalar rz = r.dot(z), rz_prev;
+  Scalar bnorm = b.norm();
+  int i;
+  for (i = 0; i < maxiter; ++i) {
+    if (r.norm() <= tol * bnorm)
+      break;
+    A(p, Ap);
+    Scalar alpha = rz / p.dot(Ap);
+    x += alpha * p;
+    r -= alpha * Ap;
+    z = Pinv.cwiseProduct(r);
+    rz_prev = rz;
+    rz = r.dot(z);
+    p = z + (rz / rz_prev) * p;
+  }
+  return i;
+}
+
+/**
+Alternating least squares solver for the spectral map.
+
+Given a spectral timeseries, we alternate between solving for the map
+`y`, of shape `(Ny, nc)`, conditioned on the current spectrum, and for
+the spectrum, of shape `(nc, nwp)`, conditioned on the current map, as
+in the Python implementation of `DopplerMap.solve`. Each half-step is a
+linear problem with a diagonal Gaussian prior, which we solve with the
+conjugate gradient method starting from the previous solution, so
+neither design matrix is ever instantiated. The kernels are rotated to
+each epoch once up front, and the products are parallelized over the
+epochs (and, within the convolutions, over the components).
+
+As in the Python implementation, the data covariance for the map step
+is tempered by a factor `T` that decreases over the iterations, and,
+when the data is normalized and the baseline is unknown, includes a
+term `baseline_var` for each epoch that we invert with the
+Sherman-Morrison formula; the baseline is re-estimated from the
+continuum of the model after each map step.
+
+The model is computed on the internal wavelength grid (of size `nwi`)
+and interpolated to the output grid with the sparse matrix `Si2e`, of
+shape `(nw, nwi)`.
+
+*/
+template <class Scalar> class Bilinear {
+protected:
+  Operator<Scalar> &DO;
+
+  // Dimensions
+  int Ny;
+  int nt;
+  int nw;
+  int nwi;
+  int nwp;
+  int nk;
+  int nc;
+
+  // The data, the interpolation matrix, and the kernels at each epoch
+  Matrix<Scalar, RowMajor> flux;
+  Matrix<Scalar, RowMajor> flux_err;
+  Eigen::SparseMatrix<Scalar> Si2e;
+  Eigen::SparseMatrix<Scalar> Si2eSq;
+  std::vector<Matrix<Scalar, RowMajor>> kT;
+
+  // The kernels for the current map at each epoch, of shape `(nc, nk)`
+  std::vector<Matrix<Scalar, RowMajor>> kY;
+
+  // The inverse data covariance: diagonal `d` plus a rank-one term
+  Matrix<Scalar, RowMajor> d;
+  Vector<Scalar> gamma;
+
+  int mode;
+
+  /**
+  Compute the model on the output grid for the kernels `k` at each epoch
+  and the spectra `x`, of shape `(nc, nwp)`.
+
+  */
+  inline void model(const std::vector<Matrix<Scalar, RowMajor>> &k,
+                    const Matrix<Scalar, RowMajor> &x,
+                    Matrix<Scalar, RowMajor> &out) {
+    out.resize(nt, nw);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int t = 0; t < nt; ++t) {
+      Matrix<Scalar, RowMajor> res;
+      convolve(x, k[t], nc, res, mode);
+      out.row(t) = (Si2e * res.row(0).transpose()).transpose();
+    }
+  }
+
+  /**
+  Multiply the residuals `r`, of shape `(nt, nw)`, by the inverse data
+  covariance in place.
+
+  */
+  inline void applyCInv(Matrix<Scalar, RowMajor> &r) {
+    for (int t = 0; t < nt; ++t) {
+      Scalar dr = d.row(t).dot(r.row(t));
+      r.row(t) = d.row(t).cwiseProduct(r.row(t)) - gamma(t) * dr * d.row(t);
+    }
+  }
+
+  /**
+  Compute the inverse data covariance of the map step.
+
+  */
+  inline void setCInv(const Vector<Scalar> &baseline, const Scalar &T,
+                      const Scalar &baseline_var) {
+    d.resize(nt, nw);
+    gamma.resize(nt);
+    for (int t = 0; t < nt; ++t) {
+      d.row(t) = (T * (baseline(t) * flux_err.row(t)).array().square())
+                     .inverse()
+                     .matrix();
+      gamma(t) = baseline_var / (1.0 + baseline_var * d.row(t).sum());
+    }
+  }
+
+  /**
+  Dot the transpose of the design matrix for the current `spectrum` into
+  the residuals `r`, of shape `(nt, nw)`. We correlate the residuals with
+  the spectrum to get the gradient with respect to the kernels of each
+  component and project it onto the spherical harmonic kernels.
+
+  */
+  inline void dotMapStepT(const Matrix<Scalar, RowMajor> &spectrum,
+                          const Matrix<Scalar, RowMajor> &r,
+                          Vector<Scalar> &out) {
+    Matrix<Scalar> acc = Matrix<Scalar>::Zero(Ny, nc);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      Matrix<Scalar> acc_t = Matrix<Scalar>::Zero(Ny, nc);
+      Matrix<Scalar, RowMajor> ri(1, nwi), G;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int t = 0; t < nt; ++t) {
+        ri.row(0) = (Si2e.transpose() * r.row(t).transpose()).transpose();
+        convolveK(spectrum, ri, nc, G, mode);
+        acc_t += kT[t] * G.transpose();
+      }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      acc += acc_t;
+    }
+    out = Eigen::Map<Vector<Scalar>>(acc.data(), Ny * nc);
+  }
+
+  /**
+  Compute the product of the map step normal matrix (without the prior)
+  and `z`. The kernels for the forward product are the products of the
+  spherical harmonic kernels with the map for each component.
+
+  */
+  inline void dotMapStep(const Matrix<Scalar, RowMajor> &spectrum,
+                         const Vector<Scalar> &z, Vector<Scalar> &out) {
+    Eigen::Map<const Matrix<Scalar>> Z(z.data(), Ny, nc);
+    std::vector<Matrix<Scalar, RowMajor>> k(nt);
+    for (int t = 0; t < nt; ++t)
+      k[t] = Z.transpose() * kT[t];
+    Matrix<Scalar, RowMajor> r;
+    model(k, spectrum, r);
+    applyCInv(r);
+    dotMapStepT(spectrum, r, out);
+  }
+
+  /**
+  Dot the transpose of the design matrix for the current map into the
+  residuals `r`, of shape `(nt, nw)`.
+
+  */
+  inline void dotSpectrumStepT(const Matrix<Scalar, RowMajor> &r,
+                               Vector<Scalar> &out) {
+    Matrix<Scalar, RowMajor> acc = Matrix<Scalar, RowMajor>::Zero(nc, nwp);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      Matrix<Scalar, RowMajor> acc_t = Matrix<Scalar, RowMajor>::Zero(nc, nwp);
+      Matrix<Scalar, RowMajor> ri(1, nwi), res;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int t = 0; t < nt; ++t) {
+        ri.row(0) = (Si2e.transpose() * r.row(t).transpose()).transpose();
+        convolveT(ri, kY[t], nc, res, mode);
+        acc_t += res;
+      }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      acc += acc_t;
+    }
+    out = Eigen::Map<Vector<Scalar>>(acc.data(), nc * nwp);
+  }
+
+  /**
+  Compute the product of the spectrum step normal matrix (without the
+  prior) and `z`.
+
+  */
+  inline void dotSpectrumStep(const Vector<Scalar> &z, Vector<Scalar> &out) {
+    Matrix<Scalar, RowMajor> X =
+        Eigen::Map<const Matrix<Scalar, RowMajor>>(z.data(), nc, nwp);
+    Matrix<Scalar, RowMajor> r;
+    model(kY, X, r);
+    applyCInv(r);
+    dotSpectrumStepT(r, out);
+  }
+
+  /**
+  The weights of the squared design matrix elements on the internal
+  grid in the approximate diagonal of the normal matrix. This is exact
+  in the absence of interpolation and if we neglect the rank-one term
+  in the data covariance.
+
+  */
+  inline RowVector<Scalar> weights(const int t) {
+    return (Si2eSq.transpose() * d.row(t).transpose()).transpose();
+  }
+
+  /**
+  The inverse of the (approximate) diagonal of the map step normal matrix.
+
+  */
+  inline void precondMapStep(const Matrix<Scalar, RowMajor> &spectrum,
+                             const Vector<Scalar> &invL, Vector<Scalar> &Pinv) {
+    Vector<Scalar> P = Vector<Scalar>::Zero(nc * Ny);
+    for (int t = 0; t < nt; ++t) {
+      // Row `c * Ny + n` is the convolution of component `c` of the
+      // spectrum with the kernel for harmonic `n`
+      Matrix<Scalar, RowMajor> res;
+      convolve(spectrum, kT[t], 1, res, mode);
+      P += res.array().square().matrix() * weights(t).transpose();
+    }
+    Pinv = (P + invL).cwiseInverse();
+  }
+
+  /**
+  The inverse of the (approximate) diagonal of the spectrum step normal
+  matrix.
+
+  */
+  inline void precondSpectrumStep(const Vector<Scalar> &invL,
+                                  Vector<Scalar> &Pinv) {
+    Matrix<Scalar, RowMajor> P = Matrix<Scalar, RowMajor>::Zero(nc, nwp);
+    for (int t = 0; t < nt; ++t) {
+      Matrix<Scalar, RowMajor> w = weights(t), res;
+      Matrix<Scalar, RowMajor> kY2 = kY[t].array().square();
+      convolveT(w, kY2, nc, res, mode);
+      P += res;
+    }
+    Pinv = (Eigen::Map<Vector<Scalar>>(P.data(), nc * nwp) + invL)
+               .cwiseInverse();
+  }
+
+public:
+  Matrix<Scalar> y;                  /**< The map, of shape `(Ny, nc)` */
+  Matrix<Scalar, RowMajor> spectrum; /**< The spectrum, of shape `(nc, nwp)` */
+  Vector<Scalar> baseline;           /**< The baseline at each epoch */
+  Matrix<Scalar> history; /**< `T`, the relative changes in the map and the
+                             spectrum, and the number of CG iterations in
+                             each step at each iteration */
+
+  explicit Bilinear(Operator<Scalar> &DO) : DO(DO) {}
+
+  /**
+  Solve for the map and the spectrum.
+
+  The priors on the map and the spectrum are given by their means `ymu`
+  and `smu` and (diagonal) inverse variances `yinvL` and `sinvL`, of the
+  same shapes as `y` and `spectrum`. The iterations begin at the prior
+  mean of the map and at the spectrum `guess`. If `linear`, the
+  `baseline` is fixed (and the data covariance doesn't include the
+  baseline variance); otherwise, the baseline is re-estimated after
+  each map step from the model at the continuum index `cidx`. We stop
+  early once we reach the final temperature and the relative changes in
+  both the map and the spectrum are smaller than `tol`. If `maxiter` is
+  zero, we allow ten times the number of unknowns in each CG solve.
+
+  */
+  inline void solve(const Vector<Scalar> &theta, const Matrix<Scalar> &flux_,
+                    const Matrix<Scalar> &flux_err_,
+                    const Eigen::SparseMatrix<Scalar> &Si2e_,
+                    const Matrix<Scalar> &ymu, const Matrix<Scalar> &yinvL,
+                    const Matrix<Scalar> &smu, const Matrix<Scalar> &sinvL,
+                    const Matrix<Scalar> &guess, const Vector<Scalar> &baseline_,
+                    const Scalar &baseline_var, const Vector<Scalar> &T,
+                    const bool linear, const int cidx, const Scalar &cg_tol,
+                    const int cg_maxiter, const Scalar &tol,
+                    const int mode_ = ConvAuto) {
+
+    // Dimensions
+    Ny = ymu.rows();
+    nt = theta.size();
+    nw = flux_.cols();
+    nwi = Si2e_.cols();
+    nk = DO.nk();
+    nwp = nwi + nk - 1;
+    nc = ymu.cols();
+    mode = mode_;
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((flux_.rows() != nt) || (flux_err_.rows() != nt) ||
+        (flux_err_.cols() != nw) || (Si2e_.rows() != nw) ||
+        (ymu.rows() != Ny) || (yinvL.rows() != Ny) || (yinvL.cols() != nc) ||
+        (smu.rows() != nc) || (smu.cols() != nwp) || (sinvL.rows() != nc) ||
+        (sinvL.cols() != nwp) || (guess.rows() != nc) ||
+        (guess.cols() != nwp) || (baseline_.size() != nt) ||
+        (cidx < 0) || (cidx >= nw))
+      throw std::invalid_argument("Invalid shape in the Doppler solver.");
+#endif
+
+    // Store the data and rotate the kernels to each epoch
+    flux = flux_;
+    flux_err = flux_err_;
+    Si2e = Si2e_;
+    Si2eSq = Si2e.cwiseAbs2();
+    kT.resize(nt);
+    kY.resize(nt);
+    for (int t = 0; t < nt; ++t)
+      DO.kernels(theta(t), kT[t]);
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((nt > 0) && (kT[0].rows() != Ny))
+      throw std::invalid_argument("Invalid shape in the Doppler solver.");
+#endif
+
+    // The priors, unrolled in the order of the unknowns
+    Vector<Scalar> ymu_flat = Eigen::Map<const Vector<Scalar>>(ymu.data(),
+                                                               Ny * nc);
+    Vector<Scalar> yinvL_flat =
+        Eigen::Map<const Vector<Scalar>>(yinvL.data(), Ny * nc);
+    Matrix<Scalar, RowMajor> tmp = smu;
+    Vector<Scalar> smu_flat = Eigen::Map<Vector<Scalar>>(tmp.data(), nc * nwp);
+    tmp = sinvL;
+    Vector<Scalar> sinvL_flat =
+        Eigen::Map<Vector<Scalar>>(tmp.data(), nc * nwp);
+
+    // Initial guesses
+    Vector<Scalar> y_flat = ymu_flat;
+    spectrum = guess;
+    Vector<Scalar> s_flat =
+        Eigen::Map<Vector<Scalar>>(spectrum.data(), nc * nwp);
+    baseline = baseline_;
+    int ymaxiter = cg_maxiter > 0 ? cg_maxiter : 10 * Ny * nc;
+    int smaxiter = cg_maxiter > 0 ? cg_maxiter : 10 * nc * nwp;
+
+    // Iterate
+    int niter = T.size();
+    history.resize(niter, 5);
+    Vector<Scalar> rhs, Pinv, prev;
+    Matrix<Scalar, RowMajor> f(nt, nw), m;
+    int i;
+    for (i = 0; i < niter; ++i) {
+
+      // The data un-normalized by the current baseline
+      for (int t = 0; t < nt; ++t)
+        f.row(t) = baseline(t) * flux.row(t);
+
+      // Solve for the map
+      setCInv(baseline, T(i), linear ? Scalar(0.0) : baseline_var);
+      auto A = [&](const Vector<Scalar> &z, Vector<Scalar> &out) {
+        dotMapStep(spectrum, z, out);
+        out += yinvL_flat.cwiseProduct(z);
+      };
+      m = f;
+      applyCInv(m);
+      dotMapStepT(spectrum, m, rhs);
+      rhs += yinvL_flat.cwiseProduct(ymu_flat);
+      precondMapStep(spectrum, yinvL_flat, Pinv);
+      prev = y_flat;
+      history(i, 3) = cg<Scalar>(A, rhs, Pinv, y_flat, cg_tol, ymaxiter);
+      history(i, 1) = (y_flat - prev).norm() / y_flat.norm();
+      y = Eigen::Map<Matrix<Scalar>>(y_flat.data(), Ny, nc);
+
+      // The kernels for the current map
+      for (int t = 0; t < nt; ++t)
+        kY[t] = y.transpose() * kT[t];
+
+      // Refine the baseline estimate
+      if (!linear) {
+        model(kY, spectrum, m);
+        baseline = m.col(cidx);
+        for (int t = 0; t < nt; ++t)
+          f.row(t) = baseline(t) * flux.row(t);
+      }
+
+      // Solve for the spectrum
+      setCInv(baseline, Scalar(1.0), Scalar(0.0));
+      auto B = [&](const Vector<Scalar> &z, Vector<Scalar> &out) {
+        dotSpectrumStep(z, out);
+        out += sinvL_flat.cwiseProduct(z);
+      };
+      m = f;
+      applyCInv(m);
+      dotSpectrumStepT(m, rhs);
+      rhs += sinvL_flat.cwiseProduct(smu_flat);
+      precondSpectrumStep(sinvL_flat, Pinv);
+      prev = s_flat;
+      history(i, 4) = cg<Scalar>(B, rhs, Pinv, s_flat, cg_tol, smaxiter);
+      history(i, 2) = (s_flat - prev).norm() / s_flat.norm();
+      spectrum = Eigen::Map<Matrix<Scalar, RowMajor>>(s_flat.data(), nc, nwp);
+      history(i, 0) = T(i);
+
+      // Check for convergence at the final temperature
+      if ((T(i) == T(niter - 1)) && (history(i, 1) < tol) &&
+          (history(i, 2) < tol)) {
+        ++i;
+        break;
+      }
+    }
+    history.conservativeResize(i, 5);
+  }
+};
+
+} // namespace doppler
+} // namespace starry
+#endif
@@ -11,9 +11,16 @@
 
 // Includes
 #include "basis.h"
+#include "composite.h"
+#include "covariance.h"
+#include "doppler_solve.h"
+#include "kepler.h"
+#include "lasso.h"
 #include "ops.h"
 #include "reflected/scatter.h"
+#include "spline.h"
 #include "sturm.h"
+#include "system.h"
 #include "utils.h"
 #include <iostream>
 #include <pybind11/eigen.h>
@@ -31,6 +38,18 @@ using Scalar = Multi;
 using Scalar = double;
 #endif
 
+// Bind the log determinant and the solve method of a factorized
+// structured covariance
+template <class T> void bindCovariance(py::class_<T> &cls) {
+  cls.def_property_readonly(
+      "lndet", [](const T &C) { return static_cast<double>(C.lndet); });
+  cls.def("solve", [](const T &C, const Matrix<double> &B) {
+    Matrix<Scalar> X = B.template cast<Scalar>();
+    C.solve(X);
+    return Matrix<double>(X.template cast<double>());
+  });
+}
+
 // Register the Python module
 PYBIND11_MODULE(_c_ops, m) {
   // Import some useful stuff
@@ -443,6 +462,60 @@ PYBIND11_MODULE(_c_ops, m) {
                           ops.W.tensordotRz_btheta.template cast<double>());
   });
 
+  // Matrix-free product of the design matrix and a matrix
+  Ops.def("dotX", [](starry::Ops<Scalar> &ops, const Vector<double> &theta,
+                     const Vector<double> &xo, const Vector<double> &yo,
+                     const Vector<double> &zo, const double &ro,
+                     const double &inc, const double &obl,
+                     const Vector<double> &u, const Vector<double> &f,
+                     const Matrix<double> &M) {
+    Matrix<Scalar> result;
+    ops.template dotX<false>(
+        theta.template cast<Scalar>(), xo.template cast<Scalar>(),
+        yo.template cast<Scalar>(), zo.template cast<Scalar>(),
+        static_cast<Scalar>(ro), static_cast<Scalar>(inc),
+        static_cast<Scalar>(obl), u.template cast<Scalar>(),
+        f.template cast<Scalar>(), M.template cast<Scalar>(), result);
+    return result.template cast<double>();
+  });
+
+  // Matrix-free product of the transpose of the design matrix and a matrix
+  Ops.def("dotXT", [](starry::Ops<Scalar> &ops, const Vector<double> &theta,
+                      const Vector<double> &xo, const Vector<double> &yo,
+                      const Vector<double> &zo, const double &ro,
+                      const double &inc, const double &obl,
+                      const Vector<double> &u, const Vector<double> &f,
+                      const Matrix<double> &M) {
+    Matrix<Scalar> result;
+    ops.template dotX<true>(
+        theta.template cast<Scalar>(), xo.template cast<Scalar>(),
+        yo.template cast<Scalar>(), zo.template cast<Scalar>(),
+        static_cast<Scalar>(ro), static_cast<Scalar>(inc),
+        static_cast<Scalar>(obl), u.template cast<Scalar>(),
+        f.template cast<Scalar>(), M.template cast<Scalar>(), result);
+    return result.template cast<double>();
+  });
+
+  // Streaming accumulation of the normal equation matrices
+  Ops.def("normalX", [](starry::Ops<Scalar> &ops, const Vector<double> &theta,
+                        const Vector<double> &xo, const Vector<double> &yo,
+                        const Vector<double> &zo, const double &ro,
+                        const double &inc, const double &obl,
+                        const Vector<double> &u, const Vector<double> &f,
+                        const Vector<double> &CInv,
+                        const Vector<double> &flux) {
+    Matrix<Scalar> XTCInvX;
+    Vector<Scalar> XTCInvf;
+    ops.normalX(theta.template cast<Scalar>(), xo.template cast<Scalar>(),
+                yo.template cast<Scalar>(), zo.template cast<Scalar>(),
+                static_cast<Scalar>(ro), static_cast<Scalar>(inc),
+                static_cast<Scalar>(obl), u.template cast<Scalar>(),
+                f.template cast<Scalar>(), CInv.template cast<Scalar>(),
+                flux.template cast<Scalar>(), XTCInvX, XTCInvf);
+    return py::make_tuple(XTCInvX.template cast<double>(),
+                          XTCInvf.template cast<double>());
+  });
+
   // Filter operator
   Ops.def("F", [](starry::Ops<Scalar> &ops, const Vector<double> &u,
                   const Vector<double> &f) {
@@ -459,6 +532,218 @@ PYBIND11_MODULE(_c_ops, m) {
                           ops.F.bf.template cast<double>());
   });
 
+  // Doppler line broadening solution vector
+  Ops.def("rTDoppler", [](starry::Ops<Scalar> &ops, const Vector<double> &x) {
+    Matrix<Scalar> rT;
+    starry::doppler::computeRT(ops.ydeg + ops.udeg,
+                               RowVector<Scalar>(x.template cast<Scalar>()),
+                               rT);
+    return rT.template cast<double>();
+  });
+
+  // Gradient of the Doppler line broadening solution vector
+  Ops.def("rTDoppler", [](starry::Ops<Scalar> &ops, const Vector<double> &x,
+                          const Matrix<double> &brT) {
+    RowVector<Scalar> bx;
+    starry::doppler::computeRT(ops.ydeg + ops.udeg,
+                               RowVector<Scalar>(x.template cast<Scalar>()),
+                               Matrix<Scalar>(brT.template cast<Scalar>()),
+                               bx);
+    return bx.template cast<double>();
+  });
+
+  // Doppler line broadening kernels at each epoch
+  Ops.def("kTDoppler", [](starry::Ops<Scalar> &ops, const Vector<double> &xamp,
+                          const double &veq, const double &inc,
+                          const Vector<double> &theta,
+                          const Vector<double> &u) {
+    ops.DK.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                   static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                   theta.template cast<Scalar>(), u.template cast<Scalar>());
+    return ops.DK.kT.template cast<double>();
+  });
+
+  // Gradient of the Doppler line broadening kernels at each epoch
+  Ops.def("kTDoppler", [](starry::Ops<Scalar> &ops, const Vector<double> &xamp,
+                          const double &veq, const double &inc,
+                          const Vector<double> &theta, const Vector<double> &u,
+                          const Matrix<double> &bkT) {
+    ops.DK.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                   static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                   theta.template cast<Scalar>(), u.template cast<Scalar>(),
+                   bkT.template cast<Scalar>());
+    return py::make_tuple(static_cast<double>(ops.DK.bveq),
+                          static_cast<double>(ops.DK.binc),
+                          ops.DK.btheta.template cast<double>(),
+                          ops.DK.bu.template cast<double>());
+  });
+
+  // Doppler convolution of spectra with line broadening kernels
+  Ops.def("convDoppler", [](starry::Ops<Scalar> &ops,
+                            const Matrix<double, RowMajor> &x,
+                            const Matrix<double, RowMajor> &k, const int nc,
+                            const int mode) {
+    Matrix<Scalar, RowMajor> out;
+    starry::doppler::convolve(
+        Matrix<Scalar, RowMajor>(x.template cast<Scalar>()),
+        Matrix<Scalar, RowMajor>(k.template cast<Scalar>()), nc, out, mode);
+    return out.template cast<double>();
+  });
+
+  // Gradient of the Doppler convolution
+  Ops.def("convDoppler", [](starry::Ops<Scalar> &ops,
+                            const Matrix<double, RowMajor> &x,
+                            const Matrix<double, RowMajor> &k, const int nc,
+                            const int mode,
+                            const Matrix<double, RowMajor> &bout) {
+    Matrix<Scalar, RowMajor> x_ = x.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> k_ = k.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> bout_ = bout.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> bx, bk;
+    starry::doppler::convolveT(bout_, k_, nc, bx, mode);
+    starry::doppler::convolveK(x_, bout_, nc, bk, mode);
+    return py::make_tuple(bx.template cast<double>(),
+                          bk.template cast<double>());
+  });
+
+  // Transpose of the Doppler convolution
+  Ops.def("convTDoppler", [](starry::Ops<Scalar> &ops,
+                             const Matrix<double, RowMajor> &y,
+                             const Matrix<double, RowMajor> &k, const int nc,
+                             const int mode) {
+    Matrix<Scalar, RowMajor> out;
+    starry::doppler::convolveT(
+        Matrix<Scalar, RowMajor>(y.template cast<Scalar>()),
+        Matrix<Scalar, RowMajor>(k.template cast<Scalar>()), nc, out, mode);
+    return out.template cast<double>();
+  });
+
+  // Gradient of the transpose of the Doppler convolution
+  Ops.def("convTDoppler", [](starry::Ops<Scalar> &ops,
+                             const Matrix<double, RowMajor> &y,
+                             const Matrix<double, RowMajor> &k, const int nc,
+                             const int mode,
+                             const Matrix<double, RowMajor> &bout) {
+    Matrix<Scalar, RowMajor> y_ = y.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> k_ = k.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> bout_ = bout.template cast<Scalar>();
+    Matrix<Scalar, RowMajor> by, bk;
+    starry::doppler::convolve(bout_, k_, nc, by, mode);
+    starry::doppler::convolveK(bout_, y_, nc, bk, mode);
+    return py::make_tuple(by.template cast<double>(),
+                          bk.template cast<double>());
+  });
+
+  // Product of the Doppler design matrix (or its transpose) and a matrix
+  Ops.def("dotDoppler", [](starry::Ops<Scalar> &ops,
+                           const Vector<double> &xamp, const double &veq,
+                           const double &inc, const Vector<double> &theta,
+                           const Vector<double> &u, const Matrix<double> &M,
+                           const int nwp, const bool transpose,
+                           const int mode) {
+    ops.DO.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                   static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                   u.template cast<Scalar>());
+    Matrix<Scalar> out;
+    if (transpose)
+      ops.DO.template dot<true>(theta.template cast<Scalar>(),
+                                M.template cast<Scalar>(), nwp, out, mode);
+    else
+      ops.DO.template dot<false>(theta.template cast<Scalar>(),
+                                 M.template cast<Scalar>(), nwp, out, mode);
+    return out.template cast<double>();
+  });
+
+  // Product of the Doppler design matrix for a fixed map and a matrix
+  Ops.def("dotDopplerFixedMap", [](starry::Ops<Scalar> &ops,
+                                   const Vector<double> &xamp,
+                                   const double &veq, const double &inc,
+                                   const Vector<double> &theta,
+                                   const Vector<double> &u,
+                                   const Matrix<double> &y,
+                                   const Matrix<double> &M, const int nwp,
+                                   const bool transpose, const int mode) {
+    ops.DO.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                   static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                   u.template cast<Scalar>());
+    Matrix<Scalar> out;
+    if (transpose)
+      ops.DO.template dotFixedMap<true>(
+          theta.template cast<Scalar>(), y.template cast<Scalar>(),
+          M.template cast<Scalar>(), nwp, out, mode);
+    else
+      ops.DO.template dotFixedMap<false>(
+          theta.template cast<Scalar>(), y.template cast<Scalar>(),
+          M.template cast<Scalar>(), nwp, out, mode);
+    return out.template cast<double>();
+  });
+
+  // Memory budget for the cache of rotated Doppler kernels
+  Ops.def_property(
+      "dopplerCacheSize",
+      [](starry::Ops<Scalar> &ops) { return ops.DO.cache_size; },
+      [](starry::Ops<Scalar> &ops, const std::size_t &size) {
+        ops.DO.cache_size = size;
+      });
+
+  // Product of the Doppler design matrix for a fixed spectrum and a matrix
+  Ops.def("dotDopplerFixedSpectrum", [](starry::Ops<Scalar> &ops,
+                                        const Vector<double> &xamp,
+                                        const double &veq, const double &inc,
+                                        const Vector<double> &theta,
+                                        const Vector<double> &u,
+                                        const Matrix<double> &spectrum,
+                                        const Matrix<double> &M,
+                                        const bool transpose,
+                                        const int mode) {
+    ops.DO.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                   static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                   u.template cast<Scalar>());
+    Matrix<Scalar> out;
+    if (transpose)
+      ops.DO.template dotFixedSpectrum<true>(
+          theta.template cast<Scalar>(), spectrum.template cast<Scalar>(),
+          M.template cast<Scalar>(), out, mode);
+    else
+      ops.DO.template dotFixedSpectrum<false>(
+          theta.template cast<Scalar>(), spectrum.template cast<Scalar>(),
+          M.template cast<Scalar>(), out, mode);
+    return out.template cast<double>();
+  });
+
+  // Bilinear solve for the Doppler map and spectrum
+  Ops.def("solveDopplerBilinear",
+          [](starry::Ops<Scalar> &ops, const Vector<double> &xamp,
+             const double &veq, const double &inc, const Vector<double> &theta,
+             const Vector<double> &u, const Matrix<double> &flux,
+             const Matrix<double> &flux_err,
+             const Eigen::SparseMatrix<double> &Si2e,
+             const Matrix<double> &ymu, const Matrix<double> &yinvL,
+             const Matrix<double> &smu, const Matrix<double> &sinvL,
+             const Matrix<double> &guess, const Vector<double> &baseline,
+             const double &baseline_var, const Vector<double> &T,
+             const bool linear, const int cidx, const double &cg_tol,
+             const int cg_maxiter, const double &tol, const int mode) {
+            ops.DO.compute(RowVector<Scalar>(xamp.template cast<Scalar>()),
+                           static_cast<Scalar>(veq), static_cast<Scalar>(inc),
+                           u.template cast<Scalar>());
+            starry::doppler::Bilinear<Scalar> solver(ops.DO);
+            solver.solve(
+                theta.template cast<Scalar>(), flux.template cast<Scalar>(),
+                flux_err.template cast<Scalar>(), Si2e.template cast<Scalar>(),
+                ymu.template cast<Scalar>(), yinvL.template cast<Scalar>(),
+                smu.template cast<Scalar>(), sinvL.template cast<Scalar>(),
+                guess.template cast<Scalar>(), baseline.template cast<Scalar>(),
+                static_cast<Scalar>(baseline_var), T.template cast<Scalar>(),
+                linear, cidx, static_cast<Scalar>(cg_tol), cg_maxiter,
+                static_cast<Scalar>(tol), mode);
+            return py::make_tuple(
+                solver.y.template cast<double>(),
+                Matrix<double>(solver.spectrum.template cast<double>()),
+                solver.baseline.template cast<double>(),
+                solver.history.template cast<double>());
+          });
+
   // Compute the Ylm expansion of a gaussian spot
   Ops.def("spotYlm", [](starry::Ops<Scalar> &ops, const RowVector<Scalar> &amp,
                         const Scalar &sigma, const Scalar &lat,
@@ -481,6 +766,95 @@ PYBIND11_MODULE(_c_ops, m) {
         static_cast<double>(ops.blat), static_cast<double>(ops.blon));
   });
 
+  // Compute the summed Ylm expansion of many gaussian spots
+  Ops.def("spotsYlm", [](starry::Ops<Scalar> &ops, const Matrix<double> &amp,
+                         const Vector<double> &sigma, const Vector<double> &lat,
+                         const Vector<double> &lon) {
+    ops.spotsYlm(amp.template cast<Scalar>(), sigma.template cast<Scalar>(),
+                 lat.template cast<Scalar>(), lon.template cast<Scalar>());
+    return ops.SP.y.template cast<double>();
+  });
+
+  // Gradient of the summed Ylm expansion of many gaussian spots
+  Ops.def("spotsYlm", [](starry::Ops<Scalar> &ops, const Matrix<double> &amp,
+                         const Vector<double> &sigma, const Vector<double> &lat,
+                         const Vector<double> &lon, const Matrix<double> &by) {
+    ops.spotsYlm(amp.template cast<Scalar>(), sigma.template cast<Scalar>(),
+                 lat.template cast<Scalar>(), lon.template cast<Scalar>(),
+                 by.template cast<Scalar>());
+    return py::make_tuple(ops.SP.bamp.template cast<double>(),
+                          ops.SP.bsigma.template cast<double>(),
+                          ops.SP.blat.template cast<double>(),
+                          ops.SP.blon.template cast<double>());
+  });
+
+  // Compute the summed Ylm expansion of many spots with arbitrary profiles
+  Ops.def("spotsZonalYlm",
+          [](starry::Ops<Scalar> &ops, const Matrix<double> &amp,
+             const Matrix<double> &b, const Vector<double> &lat,
+             const Vector<double> &lon) {
+            ops.spotsZonalYlm(
+                amp.template cast<Scalar>(), b.template cast<Scalar>(),
+                lat.template cast<Scalar>(), lon.template cast<Scalar>());
+            return ops.SP.y.template cast<double>();
+          });
+
+  // Gradient of the summed Ylm expansion of many spots with arbitrary profiles
+  Ops.def("spotsZonalYlm",
+          [](starry::Ops<Scalar> &ops, const Matrix<double> &amp,
+             const Matrix<double> &b, const Vector<double> &lat,
+             const Vector<double> &lon, const Matrix<double> &by) {
+            ops.spotsZonalYlm(
+                amp.template cast<Scalar>(), b.template cast<Scalar>(),
+                lat.template cast<Scalar>(), lon.template cast<Scalar>(),
+                by.template cast<Scalar>());
+            return py::make_tuple(ops.SP.bamp.template cast<double>(),
+                                  ops.SP.bb.template cast<double>(),
+                                  ops.SP.blat.template cast<double>(),
+                                  ops.SP.blon.template cast<double>());
+          });
+
+  // Global minimum of the map intensity
+  Ops.def("minimize", [](starry::Ops<Scalar> &ops, const Vector<double> &y,
+                         const Vector<double> &u, const Vector<double> &f,
+                         const int oversample, const int ntries,
+                         const double &latmin, const double &latmax,
+                         const double &lonmin, const double &lonmax) {
+    ops.minimize(y.template cast<Scalar>(), u.template cast<Scalar>(),
+                 f.template cast<Scalar>(), oversample, ntries,
+                 static_cast<Scalar>(latmin), static_cast<Scalar>(latmax),
+                 static_cast<Scalar>(lonmin), static_cast<Scalar>(lonmax));
+    return py::make_tuple(
+        static_cast<double>(ops.M.lat), static_cast<double>(ops.M.lon),
+        static_cast<double>(ops.M.I), ops.M.niter);
+  });
+
+  // Spherical harmonic <-> pixel transform matrices
+  Ops.def("pixelTransform",
+          [](starry::Ops<Scalar> &ops, const RowVector<double> &x,
+             const RowVector<double> &y, const RowVector<double> &z,
+             const Vector<double> &w, const double &eps) {
+            ops.PX.compute(x.template cast<Scalar>(), y.template cast<Scalar>(),
+                           z.template cast<Scalar>(), w.template cast<Scalar>(),
+                           static_cast<Scalar>(eps));
+            return py::make_tuple(ops.PX.Y2P.template cast<double>(),
+                                  ops.PX.P2Y.template cast<double>());
+          });
+
+  // Apply the spherical harmonic <-> pixel transform to many columns
+  Ops.def("dotPixelTransform",
+          [](starry::Ops<Scalar> &ops, const RowVector<double> &x,
+             const RowVector<double> &y, const RowVector<double> &z,
+             const Vector<double> &w, const double &eps,
+             const Matrix<double> &M, const bool inverse) {
+            ops.PX.compute(x.template cast<Scalar>(), y.template cast<Scalar>(),
+                           z.template cast<Scalar>(), w.template cast<Scalar>(),
+                           static_cast<Scalar>(eps));
+            Matrix<Scalar> out;
+            ops.PX.apply(M.template cast<Scalar>(), inverse, out);
+            return out.template cast<double>();
+          });
+
   // Oren-Nayar (1994) illumination polynomial (reflected light)
   Ops.def("OrenNayarPolynomial",
           [](starry::Ops<Scalar> &ops, const Vector<double> &b,
@@ -508,11 +882,304 @@ PYBIND11_MODULE(_c_ops, m) {
                                                static_cast<Scalar>(b));
         });
 
+  // Batched check of limb darkening physicality (one vector per row)
+  m.def("ld_is_physical", [](const Matrix<double, RowMajor> &U) {
+    return starry::sturm::isphysical<Scalar>(U.template cast<Scalar>());
+  });
+
+  // Positions of all bodies on Keplerian orbits
+  m.def("orbit", [](const Vector<double> &t, const double &mpri,
+                    const Vector<double> &msec, const Vector<double> &t0,
+                    const Vector<double> &porb, const Vector<double> &ecc,
+                    const Vector<double> &w, const Vector<double> &Omega,
+                    const Vector<double> &inc, const Vector<double> &fac,
+                    const double &G, const double &c, const bool light_delay) {
+    starry::kepler::Orbit<Scalar> orbit(static_cast<Scalar>(G),
+                                        static_cast<Scalar>(c));
+    orbit.compute(t.template cast<Scalar>(), static_cast<Scalar>(mpri),
+                  msec.template cast<Scalar>(), t0.template cast<Scalar>(),
+                  porb.template cast<Scalar>(), ecc.template cast<Scalar>(),
+                  w.template cast<Scalar>(), Omega.template cast<Scalar>(),
+                  inc.template cast<Scalar>(), fac.template cast<Scalar>(),
+                  light_delay);
+    return py::make_tuple(orbit.x.template cast<double>(),
+                          orbit.y.template cast<double>(),
+                          orbit.z.template cast<double>());
+  });
+
+  // Gradient of the positions of all bodies on Keplerian orbits
+  m.def("orbit", [](const Vector<double> &t, const double &mpri,
+                    const Vector<double> &msec, const Vector<double> &t0,
+                    const Vector<double> &porb, const Vector<double> &ecc,
+                    const Vector<double> &w, const Vector<double> &Omega,
+                    const Vector<double> &inc, const Vector<double> &fac,
+                    const double &G, const double &c, const bool light_delay,
+                    const Matrix<double> &bx, const Matrix<double> &by,
+                    const Matrix<double> &bz) {
+    starry::kepler::Orbit<Scalar> orbit(static_cast<Scalar>(G),
+                                        static_cast<Scalar>(c));
+    orbit.compute(t.template cast<Scalar>(), static_cast<Scalar>(mpri),
+                  msec.template cast<Scalar>(), t0.template cast<Scalar>(),
+                  porb.template cast<Scalar>(), ecc.template cast<Scalar>(),
+                  w.template cast<Scalar>(), Omega.template cast<Scalar>(),
+                  inc.template cast<Scalar>(), fac.template cast<Scalar>(),
+                  light_delay, bx.template cast<Scalar>(),
+                  by.template cast<Scalar>(), bz.template cast<Scalar>());
+    return py::make_tuple(
+        orbit.bt.template cast<double>(), static_cast<double>(orbit.bmpri),
+        orbit.bmsec.template cast<double>(), orbit.bt0.template cast<double>(),
+        orbit.bporb.template cast<double>(),
+        orbit.becc.template cast<double>(), orbit.bw.template cast<double>(),
+        orbit.bOmega.template cast<double>(),
+        orbit.binc.template cast<double>(), orbit.bfac.template cast<double>());
+  });
+
+  // Index of all occultation events in a system
+  m.def("occultations", [](const Matrix<double> &x, const Matrix<double> &y,
+                           const Matrix<double> &z, const Vector<double> &r) {
+    Vector<int> idx, ptr;
+    starry::kepler::occultations<Scalar>(
+        x.template cast<Scalar>(), y.template cast<Scalar>(),
+        z.template cast<Scalar>(), r.template cast<Scalar>(), idx, ptr);
+    return py::make_tuple(idx, ptr);
+  });
+
+  // Total flux of a batch of systems
+  m.def("flux_batch",
+        [](const std::vector<starry::Ops<Scalar> *> &ops,
+           const Vector<double> &t, const Vector<double> &dt,
+           const Vector<double> &stencil, const double &texp,
+           const Matrix<double> &r, const Matrix<double> &m,
+           const Matrix<double> &prot, const Matrix<double> &t0,
+           const Matrix<double> &theta0, const Matrix<double> &porb,
+           const Matrix<double> &ecc, const Matrix<double> &w,
+           const Matrix<double> &Omega, const Matrix<double> &iorb,
+           const Matrix<double> &inc, const Matrix<double> &obl,
+           const std::vector<Matrix<double>> &u,
+           const std::vector<Vector<double>> &f,
+           const std::vector<Matrix<double>> &y, const double &G,
+           const double &c, const bool light_delay) {
+          std::vector<Matrix<Scalar>> u_(u.size()), y_(y.size());
+          std::vector<Vector<Scalar>> f_(f.size());
+          for (size_t k = 0; k < u.size(); ++k)
+            u_[k] = u[k].template cast<Scalar>();
+          for (size_t k = 0; k < f.size(); ++k)
+            f_[k] = f[k].template cast<Scalar>();
+          for (size_t k = 0; k < y.size(); ++k)
+            y_[k] = y[k].template cast<Scalar>();
+          starry::system::Batch<Scalar> batch(ops, static_cast<Scalar>(G),
+                                              static_cast<Scalar>(c),
+                                              light_delay);
+          batch.compute(
+              t.template cast<Scalar>(), dt.template cast<Scalar>(),
+              stencil.template cast<Scalar>(), static_cast<Scalar>(texp),
+              r.template cast<Scalar>(), m.template cast<Scalar>(),
+              prot.template cast<Scalar>(), t0.template cast<Scalar>(),
+              theta0.template cast<Scalar>(), porb.template cast<Scalar>(),
+              ecc.template cast<Scalar>(), w.template cast<Scalar>(),
+              Omega.template cast<Scalar>(), iorb.template cast<Scalar>(),
+              inc.template cast<Scalar>(), obl.template cast<Scalar>(), u_,
+              f_, y_);
+          return Matrix<double>(batch.flux.template cast<double>());
+        });
+
+  // Render all bodies in a system onto a common image, writing into the
+  // caller's array `img` of shape `(nt, res, res)`
+  m.def("composite", [](const std::vector<Matrix<double>> &p,
+                        const Matrix<double> &x, const Matrix<double> &y,
+                        const Matrix<double> &z, const Vector<double> &r,
+                        const int res, const double &xmin, const double &xmax,
+                        const double &ymin, const double &ymax,
+                        py::array img) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (!img.dtype().is(py::dtype::of<double>()) ||
+        !(img.flags() & py::array::c_style) || !img.writeable())
+      throw std::invalid_argument(
+          "The output image must be a writeable, C-contiguous array of "
+          "64-bit floats.");
+    if ((img.ndim() != 3) || (img.shape(0) != x.rows()) ||
+        (img.shape(1) != res) || (img.shape(2) != res))
+      throw std::invalid_argument(
+          "The output image must have shape `(nt, res, res)`.");
+#endif
+    std::vector<Matrix<Scalar>> p_(p.size());
+    for (size_t k = 0; k < p.size(); ++k)
+      p_[k] = p[k].template cast<Scalar>();
+    Eigen::Map<Matrix<double, RowMajor>> img_(
+        static_cast<double *>(img.mutable_data()), x.rows(), res * res);
+    starry::composite::render<Scalar>(
+        p_, x.template cast<Scalar>(), y.template cast<Scalar>(),
+        z.template cast<Scalar>(), r.template cast<Scalar>(), res,
+        static_cast<Scalar>(xmin), static_cast<Scalar>(xmax),
+        static_cast<Scalar>(ymin), static_cast<Scalar>(ymax), img_);
+  });
+
+  // Structured covariances, factorized once on construction
+  py::class_<starry::covariance::Banded<Scalar>> Banded(m,
+                                                        "BandedCovariance");
+  Banded.def(py::init([](const Matrix<double> &ab) {
+    return new starry::covariance::Banded<Scalar>(ab.template cast<Scalar>());
+  }));
+  bindCovariance(Banded);
+  Banded.def("grad", [](starry::covariance::Banded<Scalar> &C,
+                        const Matrix<double> &X, const Matrix<double> &G,
+                        const double &blndet) {
+    C.grad(X.template cast<Scalar>(), G.template cast<Scalar>(),
+           static_cast<Scalar>(blndet));
+    return py::make_tuple(C.bab.template cast<double>());
+  });
+
+  py::class_<starry::covariance::Semiseparable<Scalar>> Semiseparable(
+      m, "SemiseparableCovariance");
+  Semiseparable.def(py::init(
+      [](const Vector<double> &t, const Vector<double> &diag,
+         const Vector<double> &ar, const Vector<double> &cr,
+         const Vector<double> &ac, const Vector<double> &bc,
+         const Vector<double> &cc, const Vector<double> &dc) {
+        return new starry::covariance::Semiseparable<Scalar>(
+            t.template cast<Scalar>(), diag.template cast<Scalar>(),
+            ar.template cast<Scalar>(), cr.template cast<Scalar>(),
+            ac.template cast<Scalar>(), bc.template cast<Scalar>(),
+            cc.template cast<Scalar>(), dc.template cast<Scalar>());
+      }));
+  bindCovariance(Semiseparable);
+
+  py::class_<starry::covariance::LowRank<Scalar>> LowRank(m,
+                                                          "LowRankCovariance");
+  LowRank.def(py::init([](const Vector<double> &D, const Matrix<double> &U,
+                          const Matrix<double> &S) {
+    return new starry::covariance::LowRank<Scalar>(D.template cast<Scalar>(),
+                                                   U.template cast<Scalar>(),
+                                                   S.template cast<Scalar>());
+  }));
+  bindCovariance(LowRank);
+  LowRank.def("grad", [](starry::covariance::LowRank<Scalar> &C,
+                         const Matrix<double> &X, const Matrix<double> &G,
+                         const double &blndet) {
+    C.grad(X.template cast<Scalar>(), G.template cast<Scalar>(),
+           static_cast<Scalar>(blndet));
+    return py::make_tuple(C.bD.template cast<double>(),
+                          C.bU.template cast<double>(),
+                          C.bS.template cast<double>());
+  });
+
+  // The block-Toeplitz Doppler matrix as a structured operator
+  using Toeplitz = starry::doppler::Toeplitz<Scalar>;
+  py::class_<Toeplitz> DopplerToeplitz(m, "DopplerToeplitz");
+  DopplerToeplitz.def(py::init([](const Matrix<double, RowMajor> &kT,
+                                  const int nch, const int nwp) {
+    return new Toeplitz(
+        Matrix<Scalar, RowMajor>(kT.template cast<Scalar>()), nch, nwp);
+  }));
+  DopplerToeplitz.def_property_readonly("shape", [](const Toeplitz &D) {
+    return py::make_tuple(D.rows(), D.cols());
+  });
+  DopplerToeplitz.def("row", [](const Toeplitz &D, const int r) {
+    if ((r < 0) || (r >= D.rows()))
+      throw std::out_of_range("Row index out of range.");
+    Vector<int> idx;
+    RowVector<Scalar> val;
+    D.row(r, idx, val);
+    return py::make_tuple(idx, RowVector<double>(val.template cast<double>()));
+  });
+  DopplerToeplitz.def("dot", [](const Toeplitz &D, const Matrix<double> &M,
+                                const bool transpose) {
+    Matrix<Scalar> out;
+    if (transpose)
+      D.template dot<true>(M.template cast<Scalar>(), out);
+    else
+      D.template dot<false>(M.template cast<Scalar>(), out);
+    return Matrix<double>(out.template cast<double>());
+  });
+  DopplerToeplitz.def("dotGrad", [](const Toeplitz &D, const Matrix<double> &M,
+                                    const Matrix<double> &bout) {
+    Matrix<Scalar, RowMajor> bkT;
+    D.dotGrad(M.template cast<Scalar>(), bout.template cast<Scalar>(), bkT);
+    return Matrix<double, RowMajor>(bkT.template cast<double>());
+  });
+  DopplerToeplitz.def("dense", [](const Toeplitz &D) {
+    Matrix<Scalar, RowMajor> D_;
+    D.dense(D_);
+    return Matrix<double, RowMajor>(D_.template cast<double>());
+  });
+  DopplerToeplitz.def("matrix", [](const Toeplitz &D) {
+    Eigen::SparseMatrix<Scalar, RowMajor> D_;
+    D.matrix(D_);
+    return Eigen::SparseMatrix<double, RowMajor>(D_.template cast<double>());
+  });
+  DopplerToeplitz.def(
+      "matrixGrad",
+      [](const Toeplitz &D, const Eigen::SparseMatrix<double, RowMajor> &bD) {
+        Matrix<Scalar, RowMajor> bkT;
+        D.matrixGrad(
+            Eigen::SparseMatrix<Scalar, RowMajor>(bD.template cast<Scalar>()),
+            bkT);
+        return Matrix<double, RowMajor>(bkT.template cast<double>());
+      });
+
+  // L1-regularized least squares
+  m.def("l1_solve", [](const Matrix<double> &A, const Vector<double> &b,
+                       const double &lam, const Vector<double> &x0,
+                       const int maxiter, const double &tol) {
+    Matrix<Scalar> A_ = A.template cast<Scalar>();
+    starry::lasso::ADMM<Scalar> solver(A_);
+    Vector<Scalar> x = x0.template cast<Scalar>();
+    int niter = solver.solve(b.template cast<Scalar>(),
+                             static_cast<Scalar>(lam), x, maxiter,
+                             static_cast<Scalar>(tol));
+    return py::make_tuple(x.template cast<double>(), niter);
+  });
+
+  // Sparse spline resampling operator
+  m.def("spline_operator", [](const Vector<double> &x, const Vector<double> &xo,
+                              const int k, const double &tol) {
+    starry::spline::Resampler<Scalar> S(x.template cast<Scalar>(),
+                                        xo.template cast<Scalar>(), k);
+    Eigen::SparseMatrix<double, RowMajor> M =
+        S.matrix(static_cast<Scalar>(tol)).template cast<double>();
+    return M;
+  });
+
+  // Matrix-free product with a spline resampling operator (or its transpose)
+  m.def("spline_dot", [](const Vector<double> &x, const Vector<double> &xo,
+                         const int k, const Matrix<double> &M,
+                         const bool transpose) {
+    starry::spline::Resampler<Scalar> S(x.template cast<Scalar>(),
+                                        xo.template cast<Scalar>(), k);
+    Matrix<Scalar> out;
+    if (transpose)
+      S.dotT(M.template cast<Scalar>(), out);
+    else
+      S.dot(M.template cast<Scalar>(), out);
+    return Matrix<double>(out.template cast<double>());
+  });
+
 #ifdef STARRY_UNIT_TESTS
 
   m.attr("STARRY_UNIT_TESTS") = py::bool_(1);
 
-  // TODO: Unit tests for C++ functions here.
+  // The occultation solution vector and its derivatives with respect to
+  // `b` and `r`, stacked along each row, computed with the solver
+  // specialized to degree `lmax` (if `fixed`) or with the dynamic solver
+  m.def("sT_solver", [](const int lmax, const Vector<double> &b,
+                        const double &r, const bool fixed) {
+    std::unique_ptr<starry::solver::GreensBase<Scalar>> G;
+    if (fixed)
+      G.reset(starry::solver::GreensFactory<Scalar>::make(lmax));
+    else
+      G.reset(new starry::solver::GreensImpl<Scalar, Eigen::Dynamic>(lmax));
+    int N = (lmax + 1) * (lmax + 1);
+    RowVector<Scalar> sT(N), dsTdb(N), dsTdr(N);
+    Matrix<double, RowMajor> res(b.size(), 3 * N);
+    for (int n = 0; n < b.size(); ++n) {
+      G->compute(static_cast<Scalar>(b(n)), static_cast<Scalar>(r), sT,
+                 dsTdb, dsTdr);
+      res.block(n, 0, 1, N) = sT.template cast<double>();
+      res.block(n, N, 1, N) = dsTdb.template cast<double>();
+      res.block(n, 2 * N, 1, N) = dsTdr.template cast<double>();
+    }
+    return res;
+  });
 
 #else
 
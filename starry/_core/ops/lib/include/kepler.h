@@ -0,0 +1,356 @@
+/**
+\file kepler.h
+\brief Keplerian orbits.
+
+*/
+
+#ifndef _STARRY_KEPLER_H_
+#define _STARRY_KEPLER_H_
+
+#include "utils.h"
+#include <algorithm>
+
+namespace starry {
+namespace kepler {
+
+using namespace utils;
+
+/**
+Solve Kepler's equation `M = E - e sin(E)` for the eccentric anomaly.
+
+We use the cubic starter of Markley (1995), which is accurate to
+better than ~1e-3 everywhere in `0 <= e < 1`, followed by at most
+`STARRY_KEPLER_MAX_ITER` Halley steps. The result is in `[0, 2 pi)`.
+
+*/
+template <typename Scalar>
+inline Scalar eccentricAnomaly(const Scalar &M_, const Scalar &e) {
+  Scalar twopi = 2 * pi<Scalar>();
+  Scalar M = M_ - twopi * floor(M_ / twopi);
+  if (e == 0)
+    return M;
+
+  // The solution is symmetric about `M = pi`
+  bool flip = M > pi<Scalar>();
+  if (flip)
+    M = twopi - M;
+
+  // Markley (1995) starter
+  Scalar pisq = pi<Scalar>() * pi<Scalar>();
+  Scalar alpha = (3 * pisq + 1.6 * pi<Scalar>() * (pi<Scalar>() - M) / (1 + e)) /
+                 (pisq - 6);
+  Scalar d = 3 * (1 - e) + alpha * e;
+  Scalar q = 2 * alpha * d * (1 - e) - M * M;
+  Scalar r = 3 * alpha * d * (d - 1 + e) * M + M * M * M;
+  Scalar w = pow(abs(r) + sqrt(q * q * q + r * r), Scalar(2.0) / 3);
+  Scalar E = (2 * r * w / (w * w + w * q + q * q) + M) / d;
+
+  // Halley refinement
+  Scalar se, ce, f0, f1, dE;
+  for (int i = 0; i < STARRY_KEPLER_MAX_ITER; ++i) {
+    se = e * sin(E);
+    ce = e * cos(E);
+    f0 = E - se - M;
+    f1 = 1 - ce;
+    dE = -f0 / (f1 - 0.5 * f0 * se / f1);
+    E += dE;
+    if (abs(dE) < STARRY_KEPLER_TOL)
+      break;
+  }
+
+  return flip ? twopi - E : E;
+}
+
+/**
+Solve Kepler's equation for the eccentric anomaly.
+AutoDiff specialization: the derivatives are propagated
+analytically via the implicit function theorem, so we
+never differentiate through the iterations.
+
+*/
+template <typename T, int N>
+inline ADScalar<T, N> eccentricAnomaly(const ADScalar<T, N> &M,
+                                       const ADScalar<T, N> &e) {
+  T E = eccentricAnomaly(M.value(), e.value());
+  T dEdM = T(1.0) / (1 - e.value() * cos(E));
+  return ADScalar<T, N>(E, dEdM * (M.derivatives() +
+                                   sin(E) * e.derivatives()));
+}
+
+/**
+Position of a body on a Keplerian orbit in the observer frame, in
+the same convention as `exoplanet.orbits.KeplerianOrbit`. The body
+sits at `fac` times the position of the secondary relative to the
+primary, so `fac = 1` gives the relative position. The time `t0` is
+the time of transit and `+z` points toward the observer.
+
+If `light_delay` is set, we evaluate the orbit at the retarded time,
+i.e., the time at which light left the body in order to cross the
+`z = 0` plane at time `t`.
+
+*/
+template <typename T, typename Scalar>
+inline void position(const T &t, const T &mpri, const T &msec, const T &t0,
+                     const T &porb, const T &ecc, const T &w, const T &Omega,
+                     const T &inc, const T &fac, const Scalar &G,
+                     const Scalar &c, const bool light_delay, T &x, T &y,
+                     T &z) {
+  // Orbital elements
+  T n = 2 * pi<Scalar>() / porb;
+  T a = pow(G * (mpri + msec) * porb * porb / (4 * pi<Scalar>() * pi<Scalar>()),
+            Scalar(1.0) / 3);
+  T cosw = cos(w), sinw = sin(w);
+  T cosO = cos(Omega), sinO = sin(Omega);
+  T cosi = cos(inc), sini = sin(inc);
+  T sqrt1me2 = sqrt(1 - ecc * ecc);
+  T scale = -fac * a;
+
+  // Reference time (periastron passage)
+  T E0 = 2 * atan2(sqrt(1 - ecc) * cosw, sqrt(1 + ecc) * (1 + sinw));
+  T tref = t0 - (E0 - ecc * sin(E0)) / n;
+
+  // Position in the orbital plane, rotated by `w` about `z`
+  // and by `-inc` about `x`
+  T M, E, cosE, sinE, xorb, yorb, p, q;
+  auto inplane = [&](const T &time) {
+    M = (time - tref) * n;
+    E = eccentricAnomaly(M, ecc);
+    cosE = cos(E);
+    sinE = sin(E);
+    xorb = scale * (cosE - ecc);
+    yorb = scale * sqrt1me2 * sinE;
+    p = cosw * xorb - sinw * yorb;
+    q = sinw * xorb + cosw * yorb;
+  };
+  inplane(t);
+  if (light_delay) {
+    z = -sini * q;
+    inplane(t + z / c);
+  }
+
+  // Rotate by `Omega` about `z`
+  x = cosO * p - sinO * cosi * q;
+  y = sinO * p + cosO * cosi * q;
+  z = -sini * q;
+}
+
+/**
+Index of all occultation events in a system of `nbody` bodies.
+
+Given the sky positions `x`, `y`, and `z` of all bodies, each with
+shape `(nt, nbody)`, and their radii `r`, find all times at which
+body `i` is occulted by body `j`, i.e., the two disks overlap and
+`j` is in front of `i`. At each time we sweep over the bodies sorted
+by the left edge of their disks, so pairs whose extents along `x` do
+not overlap are never tested. Bodies of zero radius neither occult
+nor get occulted.
+
+The events are stored in compressed sparse row format over the
+ordered pairs: the time indices at which body `i` is occulted by
+body `j` are `idx(ptr(k))` through `idx(ptr(k + 1) - 1)`, in
+ascending order, where `k = i * nbody + j`.
+
+*/
+template <typename Scalar>
+inline void occultations(const Matrix<Scalar> &x, const Matrix<Scalar> &y,
+                         const Matrix<Scalar> &z, const Vector<Scalar> &r,
+                         Vector<int> &idx, Vector<int> &ptr) {
+  int nt = x.rows();
+  int nbody = x.cols();
+#ifndef STARRY_NO_EXCEPTIONS
+  if ((y.rows() != nt) || (y.cols() != nbody) || (z.rows() != nt) ||
+      (z.cols() != nbody) || (r.size() != nbody))
+    throw std::invalid_argument("Mismatch in the number of bodies or times.");
+#endif
+
+  // Find the events for each ordered pair
+  std::vector<std::vector<int>> events(nbody * nbody);
+  std::vector<int> order(nbody);
+  Scalar dx, dy, rsum;
+  for (int n = 0; n < nt; ++n) {
+    for (int k = 0; k < nbody; ++k)
+      order[k] = k;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return x(n, a) - r(a) < x(n, b) - r(b);
+    });
+    for (int a = 0; a < nbody; ++a) {
+      int i = order[a];
+      if (r(i) <= 0)
+        continue;
+      for (int b = a + 1; b < nbody; ++b) {
+        int j = order[b];
+        if (x(n, j) - r(j) >= x(n, i) + r(i))
+          break;
+        if (r(j) <= 0)
+          continue;
+        dx = x(n, j) - x(n, i);
+        dy = y(n, j) - y(n, i);
+        rsum = r(i) + r(j);
+        if (dx * dx + dy * dy >= rsum * rsum)
+          continue;
+        if (z(n, j) > z(n, i))
+          events[i * nbody + j].push_back(n);
+        else if (z(n, i) > z(n, j))
+          events[j * nbody + i].push_back(n);
+      }
+    }
+  }
+
+  // Flatten them
+  ptr.resize(nbody * nbody + 1);
+  ptr(0) = 0;
+  for (int k = 0; k < nbody * nbody; ++k)
+    ptr(k + 1) = ptr(k) + events[k].size();
+  idx.resize(ptr(nbody * nbody));
+  for (int k = 0; k < nbody * nbody; ++k)
+    std::copy(events[k].begin(), events[k].end(), idx.data() + ptr(k));
+}
+
+/**
+Positions of all secondary bodies at all times.
+
+*/
+template <typename Scalar> class Orbit {
+protected:
+  using ADType = ADScalar<Scalar, 10>;
+  const Scalar G; /**< Gravitational constant */
+  const Scalar c; /**< Speed of light */
+
+  inline void check(const Vector<Scalar> &msec, const Vector<Scalar> &t0,
+                    const Vector<Scalar> &porb, const Vector<Scalar> &ecc,
+                    const Vector<Scalar> &w, const Vector<Scalar> &Omega,
+                    const Vector<Scalar> &inc, const Vector<Scalar> &fac) {
+#ifndef STARRY_NO_EXCEPTIONS
+    int nsec = msec.size();
+    if ((t0.size() != nsec) || (porb.size() != nsec) ||
+        (ecc.size() != nsec) || (w.size() != nsec) ||
+        (Omega.size() != nsec) || (inc.size() != nsec) ||
+        (fac.size() != nsec))
+      throw std::invalid_argument("Mismatch in the number of bodies.");
+    for (int k = 0; k < nsec; ++k) {
+      if ((ecc(k) < 0) || (ecc(k) >= 1))
+        throw std::invalid_argument("Eccentricity must be in the range [0, 1).");
+      if (porb(k) <= 0)
+        throw std::invalid_argument("Orbital period must be positive.");
+    }
+#endif
+  }
+
+public:
+  // Positions, shape `(nt, nsec)`
+  Matrix<Scalar> x;
+  Matrix<Scalar> y;
+  Matrix<Scalar> z;
+
+  // Gradients
+  Vector<Scalar> bt;
+  Scalar bmpri;
+  Vector<Scalar> bmsec;
+  Vector<Scalar> bt0;
+  Vector<Scalar> bporb;
+  Vector<Scalar> becc;
+  Vector<Scalar> bw;
+  Vector<Scalar> bOmega;
+  Vector<Scalar> binc;
+  Vector<Scalar> bfac;
+
+  explicit Orbit(const Scalar &G, const Scalar &c) : G(G), c(c) {}
+
+  /**
+  Compute the positions of all bodies.
+
+  */
+  inline void compute(const Vector<Scalar> &t, const Scalar &mpri,
+                      const Vector<Scalar> &msec, const Vector<Scalar> &t0,
+                      const Vector<Scalar> &porb, const Vector<Scalar> &ecc,
+                      const Vector<Scalar> &w, const Vector<Scalar> &Omega,
+                      const Vector<Scalar> &inc, const Vector<Scalar> &fac,
+                      const bool light_delay) {
+    check(msec, t0, porb, ecc, w, Omega, inc, fac);
+    int nt = t.size();
+    int nsec = msec.size();
+    x.resize(nt, nsec);
+    y.resize(nt, nsec);
+    z.resize(nt, nsec);
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2) if (nt * nsec > 1000)
+#endif
+    for (int k = 0; k < nsec; ++k) {
+      for (int i = 0; i < nt; ++i) {
+        position(t(i), mpri, msec(k), t0(k), porb(k), ecc(k), w(k), Omega(k),
+                 inc(k), fac(k), G, c, light_delay, x(i, k), y(i, k), z(i, k));
+      }
+    }
+  }
+
+  /**
+  Compute the gradient of the positions of all bodies
+  given the gradients `bx`, `by`, and `bz` of the outputs.
+
+  */
+  inline void compute(const Vector<Scalar> &t, const Scalar &mpri,
+                      const Vector<Scalar> &msec, const Vector<Scalar> &t0,
+                      const Vector<Scalar> &porb, const Vector<Scalar> &ecc,
+                      const Vector<Scalar> &w, const Vector<Scalar> &Omega,
+                      const Vector<Scalar> &inc, const Vector<Scalar> &fac,
+                      const bool light_delay, const Matrix<Scalar> &bx,
+                      const Matrix<Scalar> &by, const Matrix<Scalar> &bz) {
+    check(msec, t0, porb, ecc, w, Omega, inc, fac);
+    int nt = t.size();
+    int nsec = msec.size();
+
+    // Per-body contributions to the shared gradients
+    Matrix<Scalar> bt_(nt, nsec);
+    Vector<Scalar> bmpri_(nsec);
+    bmsec.resize(nsec);
+    bt0.resize(nsec);
+    bporb.resize(nsec);
+    becc.resize(nsec);
+    bw.resize(nsec);
+    bOmega.resize(nsec);
+    binc.resize(nsec);
+    bfac.resize(nsec);
+
+#ifdef _OPENMP
+#pragma omp parallel for if (nsec > 1)
+#endif
+    for (int k = 0; k < nsec; ++k) {
+      ADType mpri_ad(mpri, 10, 1);
+      ADType msec_ad(msec(k), 10, 2);
+      ADType t0_ad(t0(k), 10, 3);
+      ADType porb_ad(porb(k), 10, 4);
+      ADType ecc_ad(ecc(k), 10, 5);
+      ADType w_ad(w(k), 10, 6);
+      ADType Omega_ad(Omega(k), 10, 7);
+      ADType inc_ad(inc(k), 10, 8);
+      ADType fac_ad(fac(k), 10, 9);
+      ADType x_ad, y_ad, z_ad;
+      Eigen::Matrix<Scalar, 10, 1> g = Eigen::Matrix<Scalar, 10, 1>::Zero();
+      for (int i = 0; i < nt; ++i) {
+        ADType t_ad(t(i), 10, 0);
+        position(t_ad, mpri_ad, msec_ad, t0_ad, porb_ad, ecc_ad, w_ad,
+                 Omega_ad, inc_ad, fac_ad, G, c, light_delay, x_ad, y_ad, z_ad);
+        Eigen::Matrix<Scalar, 10, 1> gi = bx(i, k) * x_ad.derivatives() +
+                                          by(i, k) * y_ad.derivatives() +
+                                          bz(i, k) * z_ad.derivatives();
+        bt_(i, k) = gi(0);
+        g += gi;
+      }
+      bmpri_(k) = g(1);
+      bmsec(k) = g(2);
+      bt0(k) = g(3);
+      bporb(k) = g(4);
+      becc(k) = g(5);
+      bw(k) = g(6);
+      bOmega(k) = g(7);
+      binc(k) = g(8);
+      bfac(k) = g(9);
+    }
+    bt = bt_.rowwise().sum();
+    bmpri = bmpri_.sum();
+  }
+};
+
+} // namespace kepler
+} // namespace starry
+#endif
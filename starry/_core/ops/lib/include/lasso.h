@@ -0,0 +1,162 @@
+/**
+\file lasso.h
+\brief L1-regularized least squares.
+
+*/
+
+#ifndef _STARRY_LASSO_H_
+#define _STARRY_LASSO_H_
+
+#include "utils.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace starry {
+namespace lasso {
+
+using namespace utils;
+
+/**
+Solve the L1-regularized least squares problem
+
+    min_x 1/2 x^T A x - b^T x + lam |x|_1
+
+for a symmetric positive (semi-)definite matrix `A` (i.e., the normal
+equations of a LASSO problem) via the alternating direction method of
+multipliers (ADMM) applied to the splitting `x = z`. The `x` update is a
+ridge regression with the matrix `A + rho I`; we diagonalize `A` once up
+front, so each iteration costs two (multithreaded) dense matrix-vector
+products, for any value of `rho`. The `z` update is a soft thresholding.
+The penalty parameter `rho` starts at the mean eigenvalue of `A` and is
+adapted every `STARRY_L1_RHO_INTERVAL` iterations by residual balancing
+(Boyd et al. 2011, Section 3.4.1).
+
+The `solve` method takes the starting guess in `x`, from which we also
+initialize the dual variable, so the solver can be warm-started from a
+previous solution. We iterate until both the squared primal residual
+`|x - z|^2` and the squared change in `z` are less than `tol`, or
+`maxiter` is reached, and return the (sparse) solution `z` in `x`,
+along with the number of iterations.
+
+*/
+template <typename Scalar> class ADMM {
+
+protected:
+  const Matrix<Scalar> &A;
+  int N;
+  Scalar rho;
+  Matrix<Scalar> Q;   // The eigenvectors of `A`
+  Vector<Scalar> lam; // The eigenvalues of `A`
+  Vector<Scalar> tmp;
+
+  /**
+  Compute `Q^T v`, parallelized over the (contiguous) columns of `Q`.
+
+  */
+  inline void dotQT(const Vector<Scalar> &v, Vector<Scalar> &out) const {
+    out.resize(N);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < N; ++i)
+      out(i) = Q.col(i).dot(v);
+  }
+
+  /**
+  Compute `Q v`, parallelized over chunks of columns of `Q`.
+
+  */
+  inline void dotQ(const Vector<Scalar> &v, Vector<Scalar> &out) const {
+    out.setZero(N);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      Vector<Scalar> acc = Vector<Scalar>::Zero(N);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for (int i = 0; i < N; ++i)
+        acc += v(i) * Q.col(i);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      out += acc;
+    }
+  }
+
+public:
+  explicit ADMM(const Matrix<Scalar> &A) : A(A), N(A.rows()) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (A.cols() != N)
+      throw std::invalid_argument("Matrix `A` must be square.");
+#endif
+    Eigen::SelfAdjointEigenSolver<Matrix<Scalar>> solver(A);
+    Q = solver.eigenvectors();
+    lam = solver.eigenvalues().cwiseMax(0);
+
+    // Start with the mean of the eigenvalues
+    rho = N > 0 ? lam.mean() : Scalar(1.0);
+    if (!(rho > 0))
+      rho = 1.0;
+  }
+
+  inline int solve(const Vector<Scalar> &b, const Scalar &lambda,
+                   Vector<Scalar> &x, const int maxiter, const Scalar &tol) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((b.size() != N) || (x.size() != N))
+      throw std::invalid_argument("Invalid shape in the L1 solver.");
+#endif
+
+    // Initialize the dual variable at its optimal value given `z`
+    Vector<Scalar> z = x;
+    Vector<Scalar> u = ((b - A * z) / rho)
+                           .cwiseMax(-lambda / rho)
+                           .cwiseMin(lambda / rho);
+    Vector<Scalar> v, z_prev;
+    Scalar r2, s2;
+    int i;
+    for (i = 0; i < maxiter; ++i) {
+
+      // Ridge step
+      dotQT(b + rho * (z - u), tmp);
+      tmp.array() /= lam.array() + rho;
+      dotQ(tmp, x);
+
+      // Soft thresholding
+      z_prev = z;
+      v = x + u;
+      Scalar k = lambda / rho;
+      z = (v.array() - k).cwiseMax(0) + (v.array() + k).cwiseMin(0);
+
+      // Dual update
+      u += x - z;
+
+      // Check for convergence
+      r2 = (x - z).squaredNorm();
+      s2 = (z - z_prev).squaredNorm();
+      if ((r2 < tol) && (s2 < tol)) {
+        ++i;
+        break;
+      }
+
+      // Balance the primal and dual residuals
+      if ((i + 1) % STARRY_L1_RHO_INTERVAL == 0) {
+        Scalar r = sqrt(r2), s = rho * sqrt(s2);
+        if ((r > 10 * s) || (s > 10 * r)) {
+          Scalar f = r > s ? 2.0 : 0.5;
+          rho *= f;
+          u /= f;
+        }
+      }
+    }
+    x = z;
+    return i;
+  }
+};
+
+} // namespace lasso
+} // namespace starry
+#endif
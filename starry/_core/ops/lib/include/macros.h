@@ -87,6 +87,64 @@
 #define STARRY_MAX_LMAX 50
 #endif
 
+//! Specialize the occultation solver at compile time up to this degree
+#ifndef STARRY_MAX_FIXED_DEG
+#define STARRY_MAX_FIXED_DEG 5
+#endif
+
+//! Maximum number of Newton iterations when refining the map minimum
+#ifndef STARRY_MINIMIZE_MAX_ITER
+#define STARRY_MINIMIZE_MAX_ITER 100
+#endif
+
+//! Convergence tolerance (in radians) when refining the map minimum
+#ifndef STARRY_MINIMIZE_TOL
+#define STARRY_MINIMIZE_TOL 1e-10
+#endif
+
+//! Number of cadences per chunk in the matrix-free design matrix products
+#ifndef STARRY_DESIGN_CHUNK
+#define STARRY_DESIGN_CHUNK 512
+#endif
+
+//! Relative cost of one FFT butterfly vs. one multiply-add in the Doppler
+//! convolutions; used to choose between direct and FFT convolution
+#ifndef STARRY_DOPPLER_FFT_COST
+#define STARRY_DOPPLER_FFT_COST 2.0
+#endif
+
+//! Number of wavelength bins summed in single precision before each
+//! double precision reduction in the mixed precision Doppler convolutions
+#ifndef STARRY_DOPPLER_SINGLE_BLOCK
+#define STARRY_DOPPLER_SINGLE_BLOCK 256
+#endif
+
+//! Memory budget (in bytes) for caching the rotated Doppler kernels
+#ifndef STARRY_DOPPLER_CACHE_SIZE
+#define STARRY_DOPPLER_CACHE_SIZE 268435456
+#endif
+
+//! Number of iterations between updates of the ADMM penalty parameter
+#ifndef STARRY_L1_RHO_INTERVAL
+#define STARRY_L1_RHO_INTERVAL 10
+#endif
+
+//! Fraction of the drop tolerance below which we stop the local solves
+//! for the rows of the sparse spline resampling operators
+#ifndef STARRY_SPLINE_TOL_FACTOR
+#define STARRY_SPLINE_TOL_FACTOR 1e-3
+#endif
+
+//! Maximum number of Halley steps when solving Kepler's equation
+#ifndef STARRY_KEPLER_MAX_ITER
+#define STARRY_KEPLER_MAX_ITER 5
+#endif
+
+//! Convergence tolerance (in radians) when solving Kepler's equation
+#ifndef STARRY_KEPLER_TOL
+#define STARRY_KEPLER_TOL 1e-15
+#endif
+
 //! If |sin(theta)| or |cos(theta)| is less than this, set  0
 #ifndef STARRY_T_TOL
 #define STARRY_T_TOL 1e-12
@@ -0,0 +1,314 @@
+/**
+\file minimize.h
+\brief Global minimum of the map intensity.
+
+*/
+
+#ifndef _STARRY_MINIMIZE_H_
+#define _STARRY_MINIMIZE_H_
+
+#include "utils.h"
+#include <algorithm>
+
+namespace starry {
+namespace minimize {
+
+using namespace utils;
+
+/**
+Evaluate a polynomial map of degree `deg` (coefficients `p` in the
+starry polynomial basis) at a point on the unit sphere, along with
+its gradient and Hessian with respect to latitude and longitude.
+
+The point on the sphere is
+
+    x = cos(lat) sin(lon)
+    y = sin(lat)
+    z = cos(lat) cos(lon)
+
+which matches the convention in `OpsYlm.latlon_to_xyz`.
+
+*/
+template <typename Scalar>
+inline Scalar intensity(const int deg, const Vector<Scalar> &p,
+                        const Scalar &lat, const Scalar &lon,
+                        Pair<Scalar> &grad, Eigen::Matrix<Scalar, 2, 2> &hess) {
+  Scalar clat = cos(lat), slat = sin(lat);
+  Scalar clon = cos(lon), slon = sin(lon);
+  Scalar x = clat * slon, y = slat, z = clat * clon;
+
+  // Powers of `x` and `y` (the basis is at most linear in `z`)
+  Vector<Scalar> xp(deg + 1), yp(deg + 1);
+  xp(0) = 1;
+  yp(0) = 1;
+  for (int k = 1; k < deg + 1; ++k) {
+    xp(k) = xp(k - 1) * x;
+    yp(k) = yp(k - 1) * y;
+  }
+
+  // Value, gradient & Hessian in Cartesian coordinates
+  Scalar I = 0;
+  UnitVector<Scalar> g = UnitVector<Scalar>::Zero();
+  Eigen::Matrix<Scalar, 3, 3> H = Eigen::Matrix<Scalar, 3, 3>::Zero();
+  int i, j, n = 0;
+  Scalar c, t, tx, ty, txx, tyy, txy;
+  for (int l = 0; l < deg + 1; ++l) {
+    for (int m = -l; m < l + 1; ++m) {
+      c = p(n++);
+      if (c == 0)
+        continue;
+      bool odd = (l + m) % 2 != 0;
+      i = odd ? (l - m - 1) / 2 : (l - m) / 2;
+      j = odd ? (l + m - 1) / 2 : (l + m) / 2;
+      t = xp(i) * yp(j);
+      tx = i > 0 ? i * xp(i - 1) * yp(j) : 0;
+      ty = j > 0 ? j * xp(i) * yp(j - 1) : 0;
+      txx = i > 1 ? i * (i - 1) * xp(i - 2) * yp(j) : 0;
+      tyy = j > 1 ? j * (j - 1) * xp(i) * yp(j - 2) : 0;
+      txy = (i > 0) && (j > 0) ? i * j * xp(i - 1) * yp(j - 1) : 0;
+      if (odd) {
+        I += c * t * z;
+        g(0) += c * tx * z;
+        g(1) += c * ty * z;
+        g(2) += c * t;
+        H(0, 0) += c * txx * z;
+        H(1, 1) += c * tyy * z;
+        H(0, 1) += c * txy * z;
+        H(0, 2) += c * tx;
+        H(1, 2) += c * ty;
+      } else {
+        I += c * t;
+        g(0) += c * tx;
+        g(1) += c * ty;
+        H(0, 0) += c * txx;
+        H(1, 1) += c * tyy;
+        H(0, 1) += c * txy;
+      }
+    }
+  }
+  H(1, 0) = H(0, 1);
+  H(2, 0) = H(0, 2);
+  H(2, 1) = H(1, 2);
+
+  // Jacobian of (x, y, z) with respect to (lat, lon)
+  Eigen::Matrix<Scalar, 3, 2> J;
+  J << -slat * slon, clat * clon, clat, 0, -slat * clon, -clat * slon;
+
+  // Second derivatives of (x, y, z) with respect to (lat, lon)
+  UnitVector<Scalar> d2ll, d2lL, d2LL;
+  d2ll << -x, -y, -z;
+  d2lL << -slat * clon, 0, slat * slon;
+  d2LL << -x, 0, -z;
+
+  // Chain rule
+  grad = J.transpose() * g;
+  hess = J.transpose() * H * J;
+  hess(0, 0) += g.dot(d2ll);
+  hess(0, 1) += g.dot(d2lL);
+  hess(1, 0) += g.dot(d2lL);
+  hess(1, 1) += g.dot(d2LL);
+  return I;
+}
+
+/**
+Global minimum finder for the map intensity.
+
+We evaluate the intensity on a deterministic Fibonacci lattice
+over the (optionally bounded) region of the sphere, then refine
+the `ntries` lowest lattice points with a damped Newton iteration
+using the analytic gradient and Hessian of the polynomial.
+
+*/
+template <typename Scalar> class Minimizer {
+protected:
+  int npts;
+  Vector<Scalar> lat_grid;
+  Vector<Scalar> lon_grid;
+  Scalar latmin, latmax, lonmin, lonmax;
+  bool bounded;
+
+  // Lattice cache
+  int deg_cache, oversample_cache;
+  Scalar latmin_cache, latmax_cache, lonmin_cache, lonmax_cache;
+
+  inline void project(Pair<Scalar> &x) {
+    x(0) = max(latmin, std::min(latmax, x(0)));
+    if (bounded) {
+      x(1) = max(lonmin, std::min(lonmax, x(1)));
+    } else {
+      x(1) = angle(Scalar(x(1) + pi<Scalar>()), 2 * pi<Scalar>()) -
+             pi<Scalar>();
+    }
+  }
+
+  /**
+  Refine a minimum starting at `x` via damped Newton iterations.
+  Falls back to steepest descent when the Hessian is not positive
+  definite. Returns the number of iterations taken.
+
+  */
+  inline int refine(const int deg, const Vector<Scalar> &p, Pair<Scalar> &x,
+                    Scalar &I) {
+    Pair<Scalar> g, d, xnew;
+    Eigen::Matrix<Scalar, 2, 2> H, Hdummy;
+    Pair<Scalar> gdummy;
+    Scalar Inew, slope, alpha;
+    I = intensity(deg, p, x(0), x(1), g, H);
+    int iter;
+    for (iter = 0; iter < STARRY_MINIMIZE_MAX_ITER; ++iter) {
+
+      // Newton direction if the Hessian is positive definite
+      Scalar det = H(0, 0) * H(1, 1) - H(0, 1) * H(1, 0);
+      if ((H(0, 0) > 0) && (det > 0)) {
+        d << -(H(1, 1) * g(0) - H(0, 1) * g(1)) / det,
+            -(H(0, 0) * g(1) - H(1, 0) * g(0)) / det;
+      } else {
+        d = -g;
+      }
+      slope = g.dot(d);
+      if (slope >= 0) {
+        d = -g;
+        slope = -g.squaredNorm();
+      }
+      if (-slope < STARRY_MINIMIZE_TOL * STARRY_MINIMIZE_TOL)
+        break;
+
+      // Backtracking line search (Armijo)
+      alpha = 1.0;
+      bool accepted = false;
+      while (alpha > STARRY_MINIMIZE_TOL) {
+        xnew = x + alpha * d;
+        project(xnew);
+        Inew = intensity(deg, p, xnew(0), xnew(1), gdummy, Hdummy);
+        if (Inew <= I + 1e-4 * alpha * slope) {
+          accepted = true;
+          break;
+        }
+        alpha *= 0.5;
+      }
+      if (!accepted)
+        break;
+      if ((xnew - x).norm() < STARRY_MINIMIZE_TOL) {
+        x = xnew;
+        I = Inew;
+        break;
+      }
+      x = xnew;
+      I = intensity(deg, p, x(0), x(1), g, H);
+    }
+    return iter;
+  }
+
+public:
+  Scalar lat;  /**< Latitude of the minimum */
+  Scalar lon;  /**< Longitude of the minimum */
+  Scalar I;    /**< Intensity at the minimum */
+  int niter;   /**< Number of Newton iterations in the best refinement */
+
+  explicit Minimizer()
+      : npts(0), latmin(-0.5 * pi<Scalar>()), latmax(0.5 * pi<Scalar>()),
+        lonmin(-pi<Scalar>()), lonmax(pi<Scalar>()), bounded(false),
+        deg_cache(-1), oversample_cache(-1), lat(0), lon(0), I(0), niter(0) {}
+
+  /**
+  Compute the Fibonacci lattice on which we do the coarse search.
+  The lattice is equal-area over the bounded region, with a density
+  of `oversample * 4 * (deg + 1)^2` points over the full sphere.
+
+  */
+  inline void setup(const int deg, const int oversample, const Scalar &latmin_,
+                    const Scalar &latmax_, const Scalar &lonmin_,
+                    const Scalar &lonmax_) {
+    // Check the cache
+    if ((npts > 0) && (deg == deg_cache) && (oversample == oversample_cache) &&
+        (latmin_ == latmin_cache) && (latmax_ == latmax_cache) &&
+        (lonmin_ == lonmin_cache) && (lonmax_ == lonmax_cache))
+      return;
+    deg_cache = deg;
+    oversample_cache = oversample;
+    latmin_cache = latmin_;
+    latmax_cache = latmax_;
+    lonmin_cache = lonmin_;
+    lonmax_cache = lonmax_;
+
+    latmin = max(latmin_, Scalar(-0.5 * pi<Scalar>()));
+    latmax = std::min(latmax_, Scalar(0.5 * pi<Scalar>()));
+    lonmin = lonmin_;
+    lonmax = lonmax_;
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((latmax <= latmin) || (lonmax <= lonmin))
+      throw std::invalid_argument("Invalid latitude/longitude bounds.");
+#endif
+    bounded = (lonmax - lonmin) < 2 * pi<Scalar>();
+    Scalar smin = sin(latmin), smax = sin(latmax);
+    Scalar frac = (smax - smin) * (lonmax - lonmin) / (4 * pi<Scalar>());
+    int npts_full = max(1, oversample) * 4 * (deg + 1) * (deg + 1);
+    npts = max(16, int(ceil(Scalar(npts_full) * frac)));
+    lat_grid.resize(npts);
+    lon_grid.resize(npts);
+    Scalar golden = 0.5 * (sqrt(Scalar(5.0)) - 1);
+    for (int k = 0; k < npts; ++k) {
+      Scalar s = smin + (smax - smin) * (k + 0.5) / npts;
+      Scalar q = k * golden;
+      q -= floor(q);
+      lat_grid(k) = asin(s);
+      lon_grid(k) = lonmin + (lonmax - lonmin) * q;
+    }
+  }
+
+  /**
+  Find the global minimum of the polynomial map `p` of degree `deg`.
+
+  */
+  inline void compute(const int deg, const Vector<Scalar> &p,
+                      const int ntries) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (npts == 0)
+      throw std::runtime_error("Must call `setup()` before minimizing.");
+#endif
+
+    // Coarse search on the lattice
+    Vector<Scalar> I_grid(npts);
+    Pair<Scalar> g;
+    Eigen::Matrix<Scalar, 2, 2> H;
+    for (int k = 0; k < npts; ++k)
+      I_grid(k) = intensity(deg, p, lat_grid(k), lon_grid(k), g, H);
+
+    // Starting points: the `ntries` lowest lattice values
+    int nstart = max(1, std::min(ntries, npts));
+    std::vector<int> idx(npts);
+    for (int k = 0; k < npts; ++k)
+      idx[k] = k;
+    std::partial_sort(idx.begin(), idx.begin() + nstart, idx.end(),
+                      [&I_grid](int a, int b) { return I_grid(a) < I_grid(b); });
+
+    // Refine each one
+    Matrix<Scalar> x(2, nstart);
+    Vector<Scalar> Ix(nstart);
+    std::vector<int> iters(nstart);
+#ifdef _OPENMP
+#pragma omp parallel for if (nstart > 1)
+#endif
+    for (int k = 0; k < nstart; ++k) {
+      Pair<Scalar> xk;
+      xk << lat_grid(idx[k]), lon_grid(idx[k]);
+      iters[k] = refine(deg, p, xk, Ix(k));
+      x.col(k) = xk;
+    }
+
+    // Keep the best one
+    int best = 0;
+    for (int k = 1; k < nstart; ++k) {
+      if (Ix(k) < Ix(best))
+        best = k;
+    }
+    lat = x(0, best);
+    lon = x(1, best);
+    I = Ix(best);
+    niter = iters[best];
+  }
+};
+
+} // namespace minimize
+} // namespace starry
+#endif
@@ -9,12 +9,107 @@
 
 #include "utils.h"
 #include "wigner.h"
+#include <memory>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace starry {
 namespace misc {
 
 using namespace utils;
 
+/**
+Axis `u` and angle `theta` of the compound rotation
+
+        R = R(yhat, lon) . R(xhat, -lat)
+
+that moves a spot from the sub-observer point to a given latitude/longitude.
+Also returns the norm `normu` of the unnormalized axis.
+
+*/
+template <class Scalar>
+inline void spotAxis(const Scalar &lat, const Scalar &lon,
+                     UnitVector<Scalar> &u, Scalar &theta, Scalar &normu) {
+  Scalar tol = 10 * mach_eps<Scalar>();
+  if ((abs(lat) > tol) || (abs(lon) > tol)) {
+    Scalar clat = cos(lat);
+    Scalar clon = cos(lon);
+    Scalar slat = sin(lat);
+    Scalar slon = sin(lon);
+    Scalar costheta = 0.5 * (clon + clat + clon * clat - 1);
+    u << -slat * (1 + clon), slon * (1 + clat), slon * slat;
+    normu = u.norm();
+    u /= normu;
+    Scalar sintheta = 0.5 * normu;
+    theta = atan2(sintheta, costheta);
+  } else {
+    theta = 0.0;
+    u << 0, 1, 0;
+    normu = 1;
+  }
+}
+
+/**
+Rotate the Ylm expansion `y` of a spot centered at the sub-observer point
+to a given latitude/longitude on the map.
+
+*/
+template <class Scalar>
+inline void rotateSpot(Matrix<Scalar> &y, const Scalar &lat, const Scalar &lon,
+                       wigner::Wigner<Scalar> &W) {
+  UnitVector<Scalar> u;
+  Scalar theta, normu;
+  spotAxis(lat, lon, u, theta, normu);
+  if (theta != 0) {
+    W.dotR(y.transpose(), u(0), u(1), u(2), -theta);
+    y = W.dotR_result.transpose();
+  }
+}
+
+/**
+Compute the gradient of `rotateSpot` given the unrotated expansion `y`.
+
+On return, `W.dotR_bM` holds the gradient with respect to `y^T`.
+
+*/
+template <class Scalar>
+inline void rotateSpot(const Matrix<Scalar> &y, const Scalar &lat,
+                       const Scalar &lon, const Matrix<Scalar> &by,
+                       wigner::Wigner<Scalar> &W, Scalar &blat, Scalar &blon) {
+  // Axis & angle of rotation
+  UnitVector<Scalar> u;
+  Scalar theta, normu;
+  spotAxis(lat, lon, u, theta, normu);
+  Scalar clat = cos(lat);
+  Scalar clon = cos(lon);
+  Scalar slat = sin(lat);
+  Scalar slon = sin(lon);
+
+  // Backprop through the rotation
+  W.dotR(y.transpose(), u(0), u(1), u(2), -theta, by.transpose());
+
+  // lat
+  Scalar termz = (clat * (1 + clon) * (1 + clon) * slat - slat * slon * slon) /
+                 (normu * normu * normu);
+  Scalar dxdl = -clat * (1 + clon) / normu + (1 + clon) * slat * termz;
+  Scalar dydl = -slat * slon / normu - (1 + clat) * slon * termz;
+  Scalar dzdl = clat * slon / normu - slat * slon * termz;
+  Scalar dthetadl = -u(0);
+  blat = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
+          dthetadl * W.dotR_btheta);
+
+  // lon
+  termz = (clon * (1 + clat) * (1 + clat) * slon - slon * slat * slat) /
+          (normu * normu * normu);
+  dxdl = slat * slon / normu + (1 + clon) * slat * termz;
+  dydl = (1 + clat) * clon / normu - (1 + clat) * slon * termz;
+  dzdl = clon * slat / normu - slat * slon * termz;
+  dthetadl = u(1);
+  blon = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
+          dthetadl * W.dotR_btheta);
+}
+
 /**
 Compute the Ylm expansion of a spot at a given latitude/longitude on the map.
 
@@ -55,27 +150,7 @@ inline Matrix<Scalar> spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
     y.row(n * n + n) = amp * sqrt(2 * n + 1) * (IP(n) / IP(0));
 
   // Rotate the spot to the correct lat/lon
-  // We are computing the compound rotation matrix
-  //
-  //         R = R(yhat, lon) . R(xhat, -lat)
-  //
-  // in one go.
-  Scalar tol = 10 * mach_eps<Scalar>();
-  if ((abs(lat) > tol) || (abs(lon) > tol)) {
-    Scalar clat = cos(lat);
-    Scalar clon = cos(lon);
-    Scalar slat = sin(lat);
-    Scalar slon = sin(lon);
-    Scalar costheta = 0.5 * (clon + clat + clon * clat - 1);
-    UnitVector<Scalar> u;
-    u << -slat * (1 + clon), slon * (1 + clat), slon * slat;
-    Scalar normu = u.norm();
-    u /= normu;
-    Scalar sintheta = 0.5 * normu;
-    Scalar theta = atan2(sintheta, costheta);
-    W.dotR(y.transpose(), u(0), u(1), u(2), -theta);
-    y = W.dotR_result.transpose();
-  }
+  rotateSpot(y, lat, lon, W);
 
   return y;
 }
@@ -84,39 +159,29 @@ inline Matrix<Scalar> spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
 Compute the gradient of the Ylm expansion of a spot at a
 given latitude/longitude on the map.
 
-This routine uses forward diff pretty inefficiently and
-can be sped up if we think about it more carefully.
+All gradients are computed in reverse mode: we back-propagate `by`
+through the compound rotation (a single call to `W.dotR`) and then
+analytically through the `IP` / `ID` recursion to get `bsigma`.
 
 */
 template <class Scalar>
-inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma_,
+inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
                     const Scalar &lat, const Scalar &lon,
-                    const Matrix<double> &by, int l, wigner::Wigner<Scalar> &W,
+                    const Matrix<Scalar> &by, int l, wigner::Wigner<Scalar> &W,
                     RowVector<Scalar> &bamp, Scalar &bsigma, Scalar &blat,
                     Scalar &blon) {
 
-  // Forward diff for sigma
-  // TODO: Compute the backprop expression
-  using ADType = ADScalar<Scalar, 1>;
-  ADType sigma = sigma_;
-  sigma.derivatives() = Vector<Scalar>::Unit(1, 0);
-
   // Compute the integrals recursively
-  Vector<ADType> IP(l + 1);
-  Vector<ADType> ID(l + 1);
+  Vector<Scalar> IP(l + 1);
+  Vector<Scalar> ID(l + 1);
   Vector<Scalar> y((l + 1) * (l + 1));
   y.setZero();
-  ADType yn;
-  Vector<Scalar> dydsigma((l + 1) * (l + 1));
-  dydsigma.setZero();
 
   // Constants
-  ADType a = 1.0 / (2 * sigma * sigma);
-  ADType sqrta = sqrt(a);
-  ADType erfa = erf(2 * sqrta.value());
-  erfa.derivatives()(0) =
-      -sqrt(32 / pi<Scalar>()) * exp(-4 * a.value()) * a.value();
-  ADType term = exp(-4 * a);
+  Scalar a = 1.0 / (2 * sigma * sigma);
+  Scalar sqrta = sqrt(a);
+  Scalar erfa = erf(2 * sqrta);
+  Scalar term = exp(-4 * a);
 
   // Seeding values
   IP(0) = root_pi<Scalar>() / (2 * sqrta) * erfa;
@@ -134,73 +199,281 @@ inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma_,
   }
 
   // Compute the coefficients of the expansion (w/o the amplitude)
+  for (int n = 0; n < l + 1; ++n)
+    y(n * n + n) = sqrt(2 * n + 1) * (IP(n) / IP(0));
+
+  // Backprop through the rotation to the correct lat/lon
+  Matrix<Scalar> y_amp = y * amp;
+  rotateSpot(y_amp, lat, lon, by, W, blat, blon);
+
+  // Amplitude: `dotR_bM` is the gradient w/ respect to `y_amp^T`
+  bamp = (W.dotR_bM * y).transpose();
+
+  // Gradient w/ respect to the unrotated coefficients
+  Vector<Scalar> bIP(l + 1), bID(l + 1);
+  Scalar by0, bIP0 = 0;
   for (int n = 0; n < l + 1; ++n) {
-    yn = sqrt(2 * n + 1) * (IP(n) / IP(0));
-    y(n * n + n) = yn.value();
-    dydsigma(n * n + n) = yn.derivatives()(0);
+    by0 = amp.dot(W.dotR_bM.col(n * n + n));
+    bIP(n) = by0 * sqrt(2 * n + 1) / IP(0);
+    bIP0 -= by0 * sqrt(2 * n + 1) * IP(n) / (IP(0) * IP(0));
   }
+  bIP(0) += bIP0;
+  bID.setZero();
 
-  // Rotate the spot to the correct lat/lon
-  Scalar tol = 10 * mach_eps<Scalar>();
-  UnitVector<Scalar> u;
-  Scalar normu;
-  Scalar theta;
-  Scalar clat = cos(lat);
-  Scalar clon = cos(lon);
-  Scalar slat = sin(lat);
-  Scalar slon = sin(lon);
+  // Backprop through the recursion
+  Scalar ba = 0, bterm = 0, bsqrta = 0, berfa = 0;
+  sgn = (l % 2 == 0) ? -1 : 1;
+  for (int n = l; n > 1; --n) {
+    // ID(n) = (2n - 1) IP(n - 1) + ID(n - 2)
+    bIP(n - 1) += (2.0 * n - 1.0) * bID(n);
+    bID(n - 2) += bID(n);
 
-  // Axis & angle of rotation
-  if ((abs(lat) > tol) || (abs(lon) > tol)) {
-    Scalar costheta = 0.5 * (clon + clat + clon * clat - 1);
-    u << -slat * (1 + clon), slon * (1 + clat), slon * slat;
-    normu = u.norm();
-    u /= normu;
-    Scalar sintheta = 0.5 * normu;
-    theta = atan2(sintheta, costheta);
-  } else {
-    theta = 0.0;
-    u << 0, 1, 0;
-    normu = 1;
+    // IP(n) = c1 / a * (ID(n - 1) + sgn * term - 1) + c2 IP(n - 1) - c3 IP(n
+    // - 2)
+    Scalar c1 = (2.0 * n - 1.0) / (2.0 * n);
+    bID(n - 1) += c1 / a * bIP(n);
+    bterm += c1 / a * sgn * bIP(n);
+    ba -= c1 * (ID(n - 1) + sgn * term - 1.0) / (a * a) * bIP(n);
+    bIP(n - 1) += (2.0 * n - 1.0) / n * bIP(n);
+    bIP(n - 2) -= (n - 1.0) / n * bIP(n);
+    sgn *= -1;
   }
+  if (l > 0) {
+    // ID(1) = IP(0)
+    bIP(0) += bID(1);
 
-  // Gradient w/ respect to lat, lon, and sigma
-  Matrix<Scalar> y_amp = y * amp;
-  W.dotR(y_amp.transpose(), u(0), u(1), u(2), -theta, by.transpose());
+    // IP(1)
+    bsqrta += root_pi<Scalar>() * erfa / (2 * a) * bIP(1);
+    berfa += root_pi<Scalar>() * sqrta / (2 * a) * bIP(1);
+    bterm += bIP(1) / (2 * a);
+    ba -= (root_pi<Scalar>() * sqrta * erfa + term - 1) / (2 * a * a) * bIP(1);
+  }
 
-  // lat
-  Scalar termz = (clat * (1 + clon) * (1 + clon) * slat - slat * slon * slon) /
-                 (normu * normu * normu);
-  Scalar dxdl = -clat * (1 + clon) / normu + (1 + clon) * slat * termz;
-  Scalar dydl = -slat * slon / normu - (1 + clat) * slon * termz;
-  Scalar dzdl = clat * slon / normu - slat * slon * termz;
-  Scalar dthetadl = -u(0);
-  blat = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
-          dthetadl * W.dotR_btheta);
+  // IP(0)
+  berfa += root_pi<Scalar>() / (2 * sqrta) * bIP(0);
+  bsqrta -= root_pi<Scalar>() * erfa / (2 * a) * bIP(0);
 
-  // lon
-  termz = (clon * (1 + clat) * (1 + clat) * slon - slon * slat * slat) /
-          (normu * normu * normu);
-  dxdl = slat * slon / normu + (1 + clon) * slat * termz;
-  dydl = (1 + clat) * clon / normu - (1 + clat) * slon * termz;
-  dzdl = clon * slat / normu - slat * slon * termz;
-  dthetadl = u(1);
-  blon = (dxdl * W.dotR_bx + dydl * W.dotR_by + dzdl * W.dotR_bz -
-          dthetadl * W.dotR_btheta);
+  // Constants
+  bsqrta += 4.0 / root_pi<Scalar>() * term * berfa;
+  ba += bsqrta / (2 * sqrta);
+  ba -= 4 * term * bterm;
+  bsigma = -ba / (sigma * sigma * sigma);
+}
+
+/**
+Compute the Ylm expansion of a spot with an arbitrary azimuthally symmetric
+profile at a given latitude/longitude on the map. The profile is specified
+by the coefficients `b` of the zonal harmonics `Y_{l,0}` of the spot when
+centered at the sub-observer point.
 
-  // sigma
-  W.dotR(dydsigma.transpose(), u(0), u(1), u(2), -theta);
-  dydsigma = W.dotR_result.transpose();
-  bsigma = (by.transpose() * dydsigma).dot(amp);
+*/
+template <class Scalar>
+inline Matrix<Scalar> zonalSpotYlm(const RowVector<Scalar> &amp,
+                                   const RowVector<Scalar> &b,
+                                   const Scalar &lat, const Scalar &lon, int l,
+                                   wigner::Wigner<Scalar> &W) {
+  Matrix<Scalar> y((l + 1) * (l + 1), amp.cols());
+  y.setZero();
+  for (int n = 0; n < l + 1; ++n)
+    y.row(n * n + n) = amp * b(n);
+  rotateSpot(y, lat, lon, W);
+  return y;
+}
 
-  // Compute the actual result (w/o amplitude)
-  W.dotR(y.transpose(), u(0), u(1), u(2), -theta);
-  y = W.dotR_result.transpose();
+/**
+Compute the gradient of the Ylm expansion of a spot with an arbitrary
+azimuthally symmetric profile at a given latitude/longitude on the map.
 
-  // Gradient of amplitude
-  bamp = y.transpose() * by;
+*/
+template <class Scalar>
+inline void zonalSpotYlm(const RowVector<Scalar> &amp,
+                         const RowVector<Scalar> &b, const Scalar &lat,
+                         const Scalar &lon, const Matrix<Scalar> &by, int l,
+                         wigner::Wigner<Scalar> &W, RowVector<Scalar> &bamp,
+                         RowVector<Scalar> &bb, Scalar &blat, Scalar &blon) {
+  Vector<Scalar> y((l + 1) * (l + 1));
+  y.setZero();
+  for (int n = 0; n < l + 1; ++n)
+    y(n * n + n) = b(n);
+  Matrix<Scalar> y_amp = y * amp;
+  rotateSpot(y_amp, lat, lon, by, W, blat, blon);
+  bamp = (W.dotR_bM * y).transpose();
+  bb.resize(l + 1);
+  for (int n = 0; n < l + 1; ++n)
+    bb(n) = amp.dot(W.dotR_bM.col(n * n + n));
 }
 
+/**
+Batched Ylm expansion of many spots on the same map.
+
+The expansions of all spots are summed into a single `(Ny, nw)` matrix
+`y`. Each thread owns one Wigner rotation workspace and one accumulator,
+both of which are allocated once and reused across spots and calls.
+
+*/
+template <class Scalar> class SpotExpansion {
+protected:
+  const int ydeg;
+  const int Ny;
+  int nthreads;
+  std::vector<std::unique_ptr<wigner::Wigner<Scalar>>> W;
+  std::vector<Matrix<Scalar>> acc;
+
+  inline void setup(int nspot, int nw) {
+#ifdef _OPENMP
+    nthreads = (nspot > 1) ? std::min(nspot, omp_get_max_threads()) : 1;
+#else
+    (void)nspot;
+    nthreads = 1;
+#endif
+    while (int(W.size()) < nthreads)
+      W.emplace_back(new wigner::Wigner<Scalar>(ydeg, 0, 0));
+    acc.resize(nthreads);
+    for (int t = 0; t < nthreads; ++t)
+      acc[t].setZero(Ny, nw);
+  }
+
+  template <typename T>
+  inline void check(const Matrix<Scalar> &amp, const T &sigma,
+                    const Vector<Scalar> &lat, const Vector<Scalar> &lon) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((sigma.rows() != amp.rows()) || (lat.size() != amp.rows()) ||
+        (lon.size() != amp.rows()))
+      throw std::invalid_argument(
+          "Arguments `amp`, `sigma`, `lat` and `lon` must have the same "
+          "number of spots.");
+#endif
+  }
+
+  inline void checkZonal(const Matrix<Scalar> &b) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (b.cols() != ydeg + 1)
+      throw std::invalid_argument(
+          "Argument `b` must have `ydeg + 1` columns.");
+#endif
+  }
+
+  inline int thread() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+public:
+  Matrix<Scalar> y;     /**< The summed expansion of all spots */
+  Matrix<Scalar> bamp;  /**< Gradient w/ respect to the amplitudes */
+  Vector<Scalar> bsigma; /**< Gradient w/ respect to the spot sizes */
+  Vector<Scalar> blat;  /**< Gradient w/ respect to the latitudes */
+  Vector<Scalar> blon;  /**< Gradient w/ respect to the longitudes */
+  Matrix<Scalar> bb;    /**< Gradient w/ respect to the zonal profiles */
+
+  explicit SpotExpansion(int ydeg)
+      : ydeg(ydeg), Ny((ydeg + 1) * (ydeg + 1)), nthreads(1) {}
+
+  /**
+  Compute the summed expansion of `amp.rows()` spots.
+
+  */
+  inline void compute(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                      const Vector<Scalar> &lat, const Vector<Scalar> &lon) {
+    check(amp, sigma, lat, lon);
+    int nspot = amp.rows();
+    setup(nspot, amp.cols());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
+#endif
+    for (int k = 0; k < nspot; ++k) {
+      int t = thread();
+      acc[t] += spotYlm<Scalar>(amp.row(k), sigma(k), lat(k), lon(k), ydeg,
+                                *W[t]);
+    }
+    y = acc[0];
+    for (int t = 1; t < nthreads; ++t)
+      y += acc[t];
+  }
+
+  /**
+  Compute the gradient of the summed expansion of `amp.rows()` spots.
+
+  */
+  inline void compute(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                      const Vector<Scalar> &lat, const Vector<Scalar> &lon,
+                      const Matrix<Scalar> &by) {
+    check(amp, sigma, lat, lon);
+    int nspot = amp.rows();
+    setup(nspot, amp.cols());
+    bamp.resize(nspot, amp.cols());
+    bsigma.resize(nspot);
+    blat.resize(nspot);
+    blon.resize(nspot);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
+#endif
+    for (int k = 0; k < nspot; ++k) {
+      RowVector<Scalar> bampk;
+      spotYlm<Scalar>(amp.row(k), sigma(k), lat(k), lon(k), by, ydeg,
+                      *W[thread()], bampk, bsigma(k), blat(k), blon(k));
+      bamp.row(k) = bampk;
+    }
+  }
+
+  /**
+  Compute the summed expansion of `amp.rows()` spots with arbitrary
+  profiles, given by the zonal coefficients in the rows of `b`.
+
+  */
+  inline void computeZonal(const Matrix<Scalar> &amp, const Matrix<Scalar> &b,
+                           const Vector<Scalar> &lat,
+                           const Vector<Scalar> &lon) {
+    check(amp, b, lat, lon);
+    checkZonal(b);
+    int nspot = amp.rows();
+    setup(nspot, amp.cols());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
+#endif
+    for (int k = 0; k < nspot; ++k) {
+      int t = thread();
+      acc[t] += zonalSpotYlm<Scalar>(amp.row(k), b.row(k), lat(k), lon(k),
+                                     ydeg, *W[t]);
+    }
+    y = acc[0];
+    for (int t = 1; t < nthreads; ++t)
+      y += acc[t];
+  }
+
+  /**
+  Compute the gradient of the summed expansion of `amp.rows()` spots
+  with arbitrary profiles.
+
+  */
+  inline void computeZonal(const Matrix<Scalar> &amp, const Matrix<Scalar> &b,
+                           const Vector<Scalar> &lat,
+                           const Vector<Scalar> &lon,
+                           const Matrix<Scalar> &by) {
+    check(amp, b, lat, lon);
+    checkZonal(b);
+    int nspot = amp.rows();
+    setup(nspot, amp.cols());
+    bamp.resize(nspot, amp.cols());
+    bb.resize(nspot, ydeg + 1);
+    blat.resize(nspot);
+    blon.resize(nspot);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
+#endif
+    for (int k = 0; k < nspot; ++k) {
+      RowVector<Scalar> bampk, bbk;
+      zonalSpotYlm<Scalar>(amp.row(k), b.row(k), lat(k), lon(k), by, ydeg,
+                           *W[thread()], bampk, bbk, blat(k), blon(k));
+      bamp.row(k) = bampk;
+      bb.row(k) = bbk;
+    }
+  }
+};
+
 } // namespace misc
 } // namespace starry
 #endif
\ No newline at end of file
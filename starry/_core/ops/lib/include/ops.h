@@ -4,10 +4,16 @@
 
 */
 
+#ifndef _STARRY_OPS_H_
+#define _STARRY_OPS_H_
+
 #include "basis.h"
+#include "doppler.h"
 #include "filter.h"
+#include "minimize.h"
 #include "misc.h"
 #include "oblate/occultation.h"
+#include "pixel.h"
 #include "reflected/occultation.h"
 #include "reflected/phasecurve.h"
 #include "solver.h"
@@ -44,6 +50,19 @@ public:
   oblate::occultation::Occultation<Scalar, 0> OBL;
   oblate::occultation::Occultation<Scalar, 4> OBLAD;
 
+  // Map minimum
+  minimize::Minimizer<Scalar> M;
+
+  // Batched spot expansion
+  misc::SpotExpansion<Scalar> SP;
+
+  // Doppler line broadening kernels and design operator
+  doppler::Kernel<Scalar> DK;
+  doppler::Operator<Scalar> DO;
+
+  // Spherical harmonic <-> pixel transforms
+  pixel::Transform<Scalar> PX;
+
   // Spot gradients
   RowVector<Scalar> bamp;
   Scalar bsigma;
@@ -55,7 +74,8 @@ public:
       : ydeg(ydeg), Ny((ydeg + 1) * (ydeg + 1)), udeg(udeg), Nu(udeg + 1),
         fdeg(fdeg), Nf((fdeg + 1) * (fdeg + 1)), deg(ydeg + udeg + fdeg),
         N((deg + 1) * (deg + 1)), B(ydeg, udeg, fdeg), W(ydeg, udeg, fdeg),
-        G(deg), F(B), RP(deg, B), RO(deg, B), OBL(deg), OBLAD(deg) {
+        G(deg), F(B), RP(deg, B), RO(deg, B), OBL(deg), OBLAD(deg), SP(ydeg),
+        DK(B, W, F), DO(B, W, F), PX(B) {
     // Bounds checks
 #ifndef STARRY_NO_EXCEPTIONS
     if ((ydeg < 0) || (ydeg > STARRY_MAX_LMAX))
@@ -79,10 +99,286 @@ public:
   // given latitude/longitude on the map.
   inline void spotYlm(const RowVector<Scalar> &amp, const Scalar &sigma,
                       const Scalar &lat, const Scalar &lon,
-                      const Matrix<double> &by) {
+                      const Matrix<Scalar> &by) {
     misc::spotYlm(amp, sigma, lat, lon, by, ydeg, W, bamp, bsigma, blat, blon);
   }
 
+  // Compute the summed Ylm expansion of many gaussian spots.
+  // Each row of `amp` holds the amplitude(s) of one spot.
+  inline void spotsYlm(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                       const Vector<Scalar> &lat, const Vector<Scalar> &lon) {
+    SP.compute(amp, sigma, lat, lon);
+  }
+
+  // Compute the gradient of the summed Ylm expansion of many gaussian spots.
+  inline void spotsYlm(const Matrix<Scalar> &amp, const Vector<Scalar> &sigma,
+                       const Vector<Scalar> &lat, const Vector<Scalar> &lon,
+                       const Matrix<Scalar> &by) {
+    SP.compute(amp, sigma, lat, lon, by);
+  }
+
+  // Compute the summed Ylm expansion of many spots with arbitrary
+  // profiles. Each row of `b` holds the zonal coefficients of one spot.
+  inline void spotsZonalYlm(const Matrix<Scalar> &amp, const Matrix<Scalar> &b,
+                            const Vector<Scalar> &lat,
+                            const Vector<Scalar> &lon) {
+    SP.computeZonal(amp, b, lat, lon);
+  }
+
+  // Compute the gradient of the summed Ylm expansion of many spots
+  // with arbitrary profiles.
+  inline void spotsZonalYlm(const Matrix<Scalar> &amp, const Matrix<Scalar> &b,
+                            const Vector<Scalar> &lat,
+                            const Vector<Scalar> &lon,
+                            const Matrix<Scalar> &by) {
+    SP.computeZonal(amp, b, lat, lon, by);
+  }
+
+  // Find the global minimum of the (filtered) map intensity.
+  // The lat/lon lattice for the coarse search is cached between calls.
+  inline void minimize(const Vector<Scalar> &y, const Vector<Scalar> &u,
+                       const Vector<Scalar> &f, const int oversample,
+                       const int ntries, const Scalar &latmin,
+                       const Scalar &latmax, const Scalar &lonmin,
+                       const Scalar &lonmax) {
+    Vector<Scalar> p = B.A1 * y;
+    if (udeg + fdeg > 0) {
+      F.computeF(u, f);
+      p = F.F * p;
+    }
+    M.setup(deg, oversample, latmin, latmax, lonmin, lonmax);
+    M.compute(deg, p, ntries);
+  }
+
+  // Compute the operators needed to evaluate rows of the light curve
+  // design matrix in chunks. The rotation from the map frame to the sky
+  // frame is folded into the rotation row `rTA1R` and the occultation
+  // operator `AR`; the rotation `Rpol` from the polar frame to the
+  // observer's frame must be applied to the right of each chunk.
+  // The Wigner and Filter instances are passed in so that the operators
+  // of several maps may be computed in parallel.
+  inline void designOperators(const Scalar &inc, const Scalar &obl,
+                              const Vector<Scalar> &u,
+                              const Vector<Scalar> &f,
+                              wigner::Wigner<Scalar> &W,
+                              filter::Filter<Scalar> &F, Matrix<Scalar> &Rpol,
+                              RowVector<Scalar> &rTA1R, Matrix<Scalar> &AR) {
+    Matrix<Scalar> Rsky = Matrix<Scalar>::Identity(Ny, Ny);
+    Rpol = Matrix<Scalar>::Identity(Ny, Ny);
+    if (ydeg > 0) {
+      W.dotR(Rsky, -cos(obl), -sin(obl), Scalar(0.0),
+             -(0.5 * pi<Scalar>() - inc));
+      W.dotR(Matrix<Scalar>(W.dotR_result), Scalar(0.0), Scalar(0.0),
+             Scalar(1.0), obl);
+      W.dotR(Matrix<Scalar>(W.dotR_result), Scalar(1.0), Scalar(0.0),
+             Scalar(0.0), -0.5 * pi<Scalar>());
+      Rsky = W.dotR_result;
+      W.dotR(Rpol, Scalar(1.0), Scalar(0.0), Scalar(0.0),
+             0.5 * pi<Scalar>());
+      Rpol = W.dotR_result;
+    }
+    if (udeg + fdeg > 0) {
+      F.computeF(u, f);
+      rTA1R = B.rT * F.F * B.A1;
+      AR = B.A1Inv * F.F * B.A1;
+    } else {
+      rTA1R = B.rTA1;
+      AR = Matrix<Scalar>::Identity(N, Ny);
+    }
+    for (int l = 0; l < ydeg + 1; ++l) {
+      auto R = Rsky.block(l * l, l * l, 2 * l + 1, 2 * l + 1);
+      rTA1R.segment(l * l, 2 * l + 1) =
+          (rTA1R.segment(l * l, 2 * l + 1) * R).eval();
+      AR.middleCols(l * l, 2 * l + 1) =
+          (AR.middleCols(l * l, 2 * l + 1) * R).eval();
+    }
+  }
+
+  // Compute the design operators using this instance's workspace.
+  inline void designOperators(const Scalar &inc, const Scalar &obl,
+                              const Vector<Scalar> &u,
+                              const Vector<Scalar> &f, Matrix<Scalar> &Rpol,
+                              RowVector<Scalar> &rTA1R, Matrix<Scalar> &AR) {
+    designOperators(inc, obl, u, f, W, F, Rpol, rTA1R, AR);
+  }
+
+  // Compute `nc` rows of the light curve design matrix starting at cadence
+  // `n0`, up to the polar rotation `Rpol`, given the operators returned by
+  // `designOperators`. The Wigner and Greens instances are passed in so
+  // that different chunks may be computed in parallel.
+  inline void designRows(const int n0, const int nc,
+                         const Vector<Scalar> &theta, const Vector<Scalar> &xo,
+                         const Vector<Scalar> &yo, const Vector<Scalar> &zo,
+                         const Scalar &ro, const RowVector<Scalar> &rTA1R,
+                         const Matrix<Scalar> &AR, wigner::Wigner<Scalar> &W,
+                         solver::Greens<Scalar> &G, Matrix<Scalar> &X) {
+    bool rotate_z = (ydeg + fdeg > 0);
+
+    // Rotation rows
+    X.resize(nc, Ny);
+    std::vector<int> iocc;
+    Scalar b;
+    for (int k = 0; k < nc; ++k) {
+      int n = n0 + k;
+      b = sqrt(xo(n) * xo(n) + yo(n) * yo(n));
+      if ((b >= 1 + ro) || (zo(n) <= 0) || (ro == 0)) {
+        X.row(k) = rTA1R;
+      } else {
+        iocc.push_back(k);
+      }
+    }
+
+    // Occultation rows
+    if (iocc.size()) {
+      Matrix<Scalar> sTA(iocc.size(), N);
+      Vector<Scalar> theta_z(iocc.size());
+      for (size_t j = 0; j < iocc.size(); ++j) {
+        int n = n0 + iocc[j];
+        G.compute(sqrt(xo(n) * xo(n) + yo(n) * yo(n)), ro);
+        sTA.row(j) = G.sT * B.A;
+        theta_z(j) = atan2(xo(n), yo(n));
+      }
+      if (rotate_z) {
+        W.tensordotRz(sTA, theta_z);
+        sTA = W.tensordotRz_result * AR;
+      } else {
+        sTA = sTA * AR;
+      }
+      for (size_t j = 0; j < iocc.size(); ++j)
+        X.row(iocc[j]) = sTA.row(j);
+    }
+
+    // Rotate to the correct phase
+    if (rotate_z) {
+      W.tensordotRz(X, Vector<Scalar>(theta.segment(n0, nc)));
+      X = W.tensordotRz_result;
+    }
+  }
+
+  // Compute the product of the light curve design matrix `X` and a
+  // matrix `M` without ever storing `X`: this is `X . M` for `M` of shape
+  // `(Ny, K)` or, if `TRANSPOSE`, `X^T . M` for `M` of shape `(nt, K)`.
+  // The rows of `X` are computed in chunks of `STARRY_DESIGN_CHUNK`
+  // cadences and dotted into the result on the fly, and the rotations
+  // that don't depend on time are folded in only once.
+  template <bool TRANSPOSE>
+  inline void dotX(const Vector<Scalar> &theta, const Vector<Scalar> &xo,
+                   const Vector<Scalar> &yo, const Vector<Scalar> &zo,
+                   const Scalar &ro, const Scalar &inc, const Scalar &obl,
+                   const Vector<Scalar> &u, const Vector<Scalar> &f,
+                   const Matrix<Scalar> &M, Matrix<Scalar> &result) {
+    int nt = theta.size();
+    int K = M.cols();
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((xo.size() != nt) || (yo.size() != nt) || (zo.size() != nt) ||
+        (M.rows() != (TRANSPOSE ? nt : Ny)))
+      throw std::invalid_argument("Mismatch in the dimensions of the inputs.");
+#endif
+    Matrix<Scalar> Rpol, AR;
+    RowVector<Scalar> rTA1R;
+    designOperators(inc, obl, u, f, Rpol, rTA1R, AR);
+
+    // Fold the polar rotation into `M`
+    Matrix<Scalar> MR;
+    if (TRANSPOSE) {
+      MR.setZero(Ny, K);
+    } else {
+      MR.resize(Ny, K);
+      for (int l = 0; l < ydeg + 1; ++l) {
+        MR.middleRows(l * l, 2 * l + 1) =
+            Rpol.block(l * l, l * l, 2 * l + 1, 2 * l + 1) *
+            M.middleRows(l * l, 2 * l + 1);
+      }
+      result.resize(nt, K);
+    }
+
+    // Loop over chunks of cadences
+    Matrix<Scalar> X;
+    for (int n0 = 0; n0 < nt; n0 += STARRY_DESIGN_CHUNK) {
+      int nc = std::min(STARRY_DESIGN_CHUNK, nt - n0);
+      designRows(n0, nc, theta, xo, yo, zo, ro, rTA1R, AR, W, G, X);
+      if (TRANSPOSE) {
+        MR.noalias() += X.transpose() * M.middleRows(n0, nc);
+      } else {
+        result.middleRows(n0, nc).noalias() = X * MR;
+      }
+    }
+
+    // Apply the polar rotation to the result
+    if (TRANSPOSE) {
+      result.resize(Ny, K);
+      for (int l = 0; l < ydeg + 1; ++l) {
+        result.middleRows(l * l, 2 * l + 1) =
+            Rpol.block(l * l, l * l, 2 * l + 1, 2 * l + 1).transpose() *
+            MR.middleRows(l * l, 2 * l + 1);
+      }
+    }
+  }
+
+  // Accumulate the normal equation matrices `X^T C^-1 X` and `X^T C^-1 f`
+  // for a diagonal data covariance `C` without ever storing the light
+  // curve design matrix `X`. Chunks of `STARRY_DESIGN_CHUNK` cadences are
+  // computed, accumulated, and discarded in turn, so the memory footprint
+  // is `O(Ny^2)`. When compiled with OpenMP, each thread accumulates its
+  // own chunks and we reduce the results at the end.
+  inline void normalX(const Vector<Scalar> &theta, const Vector<Scalar> &xo,
+                      const Vector<Scalar> &yo, const Vector<Scalar> &zo,
+                      const Scalar &ro, const Scalar &inc, const Scalar &obl,
+                      const Vector<Scalar> &u, const Vector<Scalar> &f,
+                      const Vector<Scalar> &CInv, const Vector<Scalar> &flux,
+                      Matrix<Scalar> &XTCInvX, Vector<Scalar> &XTCInvf) {
+    int nt = theta.size();
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((xo.size() != nt) || (yo.size() != nt) || (zo.size() != nt) ||
+        (CInv.size() != nt) || (flux.size() != nt))
+      throw std::invalid_argument("Mismatch in the dimensions of the inputs.");
+#endif
+    Matrix<Scalar> Rpol, AR;
+    RowVector<Scalar> rTA1R;
+    designOperators(inc, obl, u, f, Rpol, rTA1R, AR);
+    int nchunks = (nt + STARRY_DESIGN_CHUNK - 1) / STARRY_DESIGN_CHUNK;
+    Matrix<Scalar> S = Matrix<Scalar>::Zero(Ny, Ny);
+    Vector<Scalar> s = Vector<Scalar>::Zero(Ny);
+
+#ifdef _OPENMP
+#pragma omp parallel if (nchunks > 1)
+#endif
+    {
+      // Thread-local workspace and accumulators
+      wigner::Wigner<Scalar> W_(ydeg, udeg, fdeg);
+      solver::Greens<Scalar> G_(deg);
+      Matrix<Scalar> X, CInvX;
+      Matrix<Scalar> S_ = Matrix<Scalar>::Zero(Ny, Ny);
+      Vector<Scalar> s_ = Vector<Scalar>::Zero(Ny);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int c = 0; c < nchunks; ++c) {
+        int n0 = c * STARRY_DESIGN_CHUNK;
+        int nc = std::min(STARRY_DESIGN_CHUNK, nt - n0);
+        designRows(n0, nc, theta, xo, yo, zo, ro, rTA1R, AR, W_, G_, X);
+        CInvX = CInv.segment(n0, nc).asDiagonal() * X;
+        S_.noalias() += X.transpose() * CInvX;
+        s_.noalias() += CInvX.transpose() * flux.segment(n0, nc);
+      }
+
+      // Reduce
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      {
+        S += S_;
+        s += s_;
+      }
+    }
+
+    // Apply the polar rotation
+    XTCInvX = Rpol.transpose() * S * Rpol;
+    XTCInvf = Rpol.transpose() * s;
+  }
+
 }; // class Ops
 
-} // namespace starry
\ No newline at end of file
+} // namespace starry
+#endif
\ No newline at end of file
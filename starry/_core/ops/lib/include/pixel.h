@@ -0,0 +1,161 @@
+/**
+\file pixel.h
+\brief Cached transforms between spherical harmonics and pixels.
+
+*/
+
+#ifndef _STARRY_PIXEL_H_
+#define _STARRY_PIXEL_H_
+
+#include "basis.h"
+#include "utils.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace starry {
+namespace pixel {
+
+using namespace utils;
+
+/**
+Compute the dense product `out = A * M`, splitting the columns of `M`
+(or, if there are fewer columns than threads, the rows of `A`) into one
+contiguous block per thread. Each block is a regular (single-threaded)
+Eigen product, so this is a batched GEMM over the columns of `M`.
+
+*/
+template <typename Scalar>
+inline void dot(const Matrix<Scalar> &A, const Matrix<Scalar> &M,
+                Matrix<Scalar> &out) {
+  int nrows = A.rows();
+  int ncols = M.cols();
+  out.resize(nrows, ncols);
+  int nthreads = 1;
+#ifdef _OPENMP
+  if (!omp_in_parallel())
+    nthreads = omp_get_max_threads();
+#endif
+  if (nthreads == 1) {
+    out.noalias() = A * M;
+    return;
+  }
+  bool split_cols = ncols >= nthreads;
+  int n = split_cols ? ncols : nrows;
+  int size = (n + nthreads - 1) / nthreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads)
+#endif
+  for (int b = 0; b < nthreads; ++b) {
+    int start = b * size;
+    int len = std::min(size, n - start);
+    if (len <= 0)
+      continue;
+    if (split_cols)
+      out.middleCols(start, len).noalias() = A * M.middleCols(start, len);
+    else
+      out.middleRows(start, len).noalias() = A.middleRows(start, len) * M;
+  }
+}
+
+/**
+The transform between the spherical harmonic coefficients of a map and
+its intensity on a set of `npix` points on the unit sphere.
+
+Given the Cartesian coordinates `(x, y, z)` of the points in the frame
+of the map, we compute the forward operator `Y2P = pT A1` of shape
+`(npix, Ny)`, which evaluates the intensity at each point, and its
+regularized (weighted) pseudo-inverse
+
+    P2Y = (Y2P^T W Y2P + eps I)^-1 Y2P^T W
+
+of shape `(Ny, npix)`, where `W` is the diagonal matrix of pixel
+weights `w`. Both are cached, along with the points, weights and `eps`
+they were computed for, so repeated calls on the same grid (e.g., when
+transforming many maps, or every wavelength bin of a spectral map) only
+cost the matrix products.
+
+*/
+template <class Scalar> class Transform {
+
+protected:
+  basis::Basis<Scalar> &B;
+  const int ydeg;
+  const int Ny;
+
+  // The cache
+  RowVector<Scalar> x_, y_, z_;
+  Vector<Scalar> w_;
+  Scalar eps_;
+
+public:
+  Matrix<Scalar> Y2P;
+  Matrix<Scalar> P2Y;
+
+  explicit Transform(basis::Basis<Scalar> &B)
+      : B(B), ydeg(B.ydeg), Ny((B.ydeg + 1) * (B.ydeg + 1)), eps_(-1) {}
+
+  /**
+  Compute the transforms on the grid `(x, y, z)`, unless they are
+  already cached.
+
+  */
+  inline void compute(const RowVector<Scalar> &x, const RowVector<Scalar> &y,
+                      const RowVector<Scalar> &z, const Vector<Scalar> &w,
+                      const Scalar &eps) {
+    int npix = x.size();
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((y.size() != npix) || (z.size() != npix) || (w.size() != npix))
+      throw std::invalid_argument("Mismatch in the number of pixels.");
+#endif
+
+    // Check the cache
+    if ((npix == x_.size()) && (eps == eps_) && (x == x_) && (y == y_) &&
+        (z == z_) && (w == w_))
+      return;
+
+    // The forward transform
+    B.computePolyBasis(ydeg, x, y, z);
+    Y2P = B.pT * B.A1;
+
+    // The regularized pseudo-inverse
+    Matrix<Scalar> WY2P = w.asDiagonal() * Y2P;
+    Matrix<Scalar> A(Ny, Ny);
+    dot<Scalar>(Y2P.transpose(), WY2P, A);
+    A.diagonal().array() += eps;
+    Eigen::LDLT<Matrix<Scalar>> solver(A);
+#ifndef STARRY_NO_EXCEPTIONS
+    if (solver.info() != Eigen::Success)
+      throw std::runtime_error(
+          "Unable to factorize the pixel transform normal matrix.");
+#endif
+    P2Y = solver.solve(WY2P.transpose());
+
+    // Update the cache
+    x_ = x;
+    y_ = y;
+    z_ = z;
+    w_ = w;
+    eps_ = eps;
+  }
+
+  /**
+  Transform the columns of `M` from pixels to spherical harmonics
+  (`P2Y * M`) or, if `inverse` is true, from spherical harmonics to
+  pixels (`Y2P * M`).
+
+  */
+  inline void apply(const Matrix<Scalar> &M, const bool inverse,
+                    Matrix<Scalar> &out) const {
+    const Matrix<Scalar> &A = inverse ? Y2P : P2Y;
+#ifndef STARRY_NO_EXCEPTIONS
+    if (M.rows() != A.cols())
+      throw std::invalid_argument("Invalid shape in the pixel transform.");
+#endif
+    dot<Scalar>(A, M, out);
+  }
+};
+
+} // namespace pixel
+} // namespace starry
+#endif
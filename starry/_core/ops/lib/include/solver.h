@@ -13,6 +13,7 @@ harmonic map during a single-body occultation using Green's theorem.
 #include "ellip.h"
 #include "quad.h"
 #include "utils.h"
+#include <memory>
 
 namespace starry {
 namespace solver {
@@ -502,8 +503,24 @@ inline void computeS2_(const Scalar &b, const Scalar &r, const Scalar &ksq,
   s2 = ((1.0 - int(r > b)) * 2 * pi<Scalar>() - Lambda1) * third;
 }
 
-template <class T, bool AUTODIFF> class Solver {
+/**
+The occultation solver.
+
+If `LMAX` is not `Eigen::Dynamic`, the solver is specialized to a map of
+that degree: the loop bounds are known at compile time and all of the
+working vectors are stored inline rather than on the heap.
+
+*/
+template <class T, bool AUTODIFF, int LMAX = Eigen::Dynamic> class Solver {
 public:
+  // Storage types
+  using IVector =
+      Eigen::Matrix<T, Eigen::Dynamic, 1, Eigen::ColMajor,
+                    (LMAX == Eigen::Dynamic) ? Eigen::Dynamic : LMAX + 3, 1>;
+  using SVector = Eigen::Matrix<
+      T, 1, Eigen::Dynamic, Eigen::RowMajor, 1,
+      (LMAX == Eigen::Dynamic) ? Eigen::Dynamic : (LMAX + 1) * (LMAX + 1)>;
+
   // Indices
   int lmax;
   int N;
@@ -534,30 +551,34 @@ public:
   T third;
   T dummy;
   bool qcond;
-  Vector<T> pow_ksq;
-  Vector<T> cjlow;
-  Vector<T> cjhigh;
+  IVector pow_ksq;
+  IVector cjlow;
+  IVector cjhigh;
   std::vector<int> jvseries;
 
   // Integrals
   Vieta<T> A;
   HIntegral<T> H;
-  Vector<T> I;
-  Vector<T> IGamma;
-  Vector<T> J;
+  IVector I;
+  IVector IGamma;
+  IVector J;
 
   // Numerical integration
   Quad<T> QUAD;
 
   // The solution vector
-  RowVector<T> sT;
+  SVector sT;
 
   explicit Solver(int lmax)
       : lmax(lmax), N((lmax + 1) * (lmax + 1)), ivmax(lmax + 2),
         jvmax(lmax > 0 ? lmax - 1 : 0), pow_ksq(ivmax + 1),
-        cjlow(Vector<T>::Zero(jvmax + 2)), cjhigh(Vector<T>::Zero(jvmax + 2)),
+        cjlow(IVector::Zero(jvmax + 2)), cjhigh(IVector::Zero(jvmax + 2)),
         A(lmax), H(lmax), I(ivmax + 1), IGamma(ivmax + 1), J(jvmax + 1),
-        sT(RowVector<T>::Zero(N)) {
+        sT(SVector::Zero(N)) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((LMAX != Eigen::Dynamic) && (lmax != LMAX))
+      throw std::invalid_argument("Degree mismatch in specialized solver.");
+#endif
     third = T(1.0) / T(3.0);
     dummy = 0.0;
     pow_ksq(0) = 1.0;
@@ -902,6 +923,10 @@ public:
 
   */
   inline void compute(const T &b_, const T &r_) {
+    // Compile-time degree, if we have it
+    const int lmax_ = (LMAX == Eigen::Dynamic) ? lmax : LMAX;
+    const int ivmax_ = lmax_ + 2;
+
     // Initialize b and r
     b = b_;
     r = r_;
@@ -976,7 +1001,7 @@ public:
       return;
 
     // Compute powers of ksq
-    for (int v = 1; v < ivmax + 1; ++v)
+    for (int v = 1; v < ivmax_ + 1; ++v)
       pow_ksq(v) = pow_ksq(v - 1) * ksq;
 
     // Compute the helper integrals
@@ -1008,7 +1033,7 @@ public:
 
     // Compute the other terms of the solution vector
     int n = 4;
-    for (int l = 2; l < lmax + 1; ++l) {
+    for (int l = 2; l < lmax_ + 1; ++l) {
       // Update the pre-factors
       tworlp2 *= twor;
       lfac *= twor;
@@ -1059,38 +1084,113 @@ public:
 };
 
 /**
-Greens integral solver wrapper class.
-Emitted light specialization.
+Abstract interface to the emitted light solvers, so that `Greens`
+can pick a degree-specialized instantiation at run time.
 
 */
-template <class Scalar> class Greens {
+template <class Scalar> class GreensBase {
+public:
+  virtual ~GreensBase() {}
+  virtual void compute(const Scalar &b, const Scalar &r,
+                       RowVector<Scalar> &sT) = 0;
+  virtual void compute(const Scalar &b, const Scalar &r, RowVector<Scalar> &sT,
+                       RowVector<Scalar> &dsTdb, RowVector<Scalar> &dsTdr) = 0;
+};
+
+/**
+Emitted light solvers for a map of degree `LMAX`.
+
+*/
+template <class Scalar, int LMAX>
+class GreensImpl : public GreensBase<Scalar> {
 protected:
   using ADType = ADScalar<Scalar, 2>;
 
   // Indices
-  int lmax;
   int N;
 
   // Solvers
-  Solver<Scalar, false> ScalarSolver;
-  Solver<ADType, true> ADTypeSolver;
+  Solver<Scalar, false, LMAX> ScalarSolver;
+  Solver<ADType, true, LMAX> ADTypeSolver;
 
   // AutoDiff
   ADType b_ad;
   ADType r_ad;
 
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit GreensImpl(int lmax)
+      : N((lmax + 1) * (lmax + 1)), ScalarSolver(lmax), ADTypeSolver(lmax),
+        b_ad(ADType(0.0, Vector<Scalar>::Unit(2, 0))),
+        r_ad(ADType(0.0, Vector<Scalar>::Unit(2, 1))) {}
+
+  inline void compute(const Scalar &b, const Scalar &r,
+                      RowVector<Scalar> &sT) override {
+    ScalarSolver.compute(b, r);
+    sT = ScalarSolver.sT;
+  }
+
+  inline void compute(const Scalar &b, const Scalar &r, RowVector<Scalar> &sT,
+                      RowVector<Scalar> &dsTdb,
+                      RowVector<Scalar> &dsTdr) override {
+    b_ad.value() = b;
+    r_ad.value() = r;
+    ADTypeSolver.compute(b_ad, r_ad);
+    for (int n = 0; n < N; ++n) {
+      sT(n) = ADTypeSolver.sT(n).value();
+      dsTdb(n) = ADTypeSolver.sT(n).derivatives()(0);
+      dsTdr(n) = ADTypeSolver.sT(n).derivatives()(1);
+    }
+  }
+};
+
+/**
+Instantiate the emitted light solver for a map of degree `lmax`,
+specialized at compile time if `lmax <= STARRY_MAX_FIXED_DEG`.
+
+*/
+template <class Scalar, int L = STARRY_MAX_FIXED_DEG> struct GreensFactory {
+  static GreensBase<Scalar> *make(int lmax) {
+    if (lmax == L)
+      return new GreensImpl<Scalar, L>(lmax);
+    else
+      return GreensFactory<Scalar, L - 1>::make(lmax);
+  }
+};
+
+template <class Scalar> struct GreensFactory<Scalar, Eigen::Dynamic> {
+  static GreensBase<Scalar> *make(int lmax) {
+    return new GreensImpl<Scalar, Eigen::Dynamic>(lmax);
+  }
+};
+
+/**
+Greens integral solver wrapper class.
+Emitted light specialization.
+
+*/
+template <class Scalar> class Greens {
+protected:
+  // Indices
+  int lmax;
+  int N;
+
+  // Solver
+  std::unique_ptr<GreensBase<Scalar>> solver;
+
 public:
   // Solutions
-  RowVector<Scalar> &sT;
+  RowVector<Scalar> sT;
   RowVector<Scalar> dsTdb;
   RowVector<Scalar> dsTdr;
 
   // Constructor
   explicit Greens(int lmax)
-      : lmax(lmax), N((lmax + 1) * (lmax + 1)), ScalarSolver(lmax),
-        ADTypeSolver(lmax), b_ad(ADType(0.0, Vector<Scalar>::Unit(2, 0))),
-        r_ad(ADType(0.0, Vector<Scalar>::Unit(2, 1))), sT(ScalarSolver.sT),
-        dsTdb(RowVector<Scalar>::Zero(N)), dsTdr(RowVector<Scalar>::Zero(N)) {}
+      : lmax(lmax), N((lmax + 1) * (lmax + 1)),
+        solver(GreensFactory<Scalar>::make(lmax)),
+        sT(RowVector<Scalar>::Zero(N)), dsTdb(RowVector<Scalar>::Zero(N)),
+        dsTdr(RowVector<Scalar>::Zero(N)) {}
 
   /**
   Compute the `s^T` occultation solution vector
@@ -1100,17 +1200,9 @@ public:
   template <bool GRADIENT = false>
   inline void compute(const Scalar &b, const Scalar &r) {
     if (!GRADIENT) {
-      ScalarSolver.compute(b, r);
-
+      solver->compute(b, r, sT);
     } else {
-      b_ad.value() = b;
-      r_ad.value() = r;
-      ADTypeSolver.compute(b_ad, r_ad);
-      for (int n = 0; n < N; ++n) {
-        sT(n) = ADTypeSolver.sT(n).value();
-        dsTdb(n) = ADTypeSolver.sT(n).derivatives()(0);
-        dsTdr(n) = ADTypeSolver.sT(n).derivatives()(1);
-      }
+      solver->compute(b, r, sT, dsTdb, dsTdr);
     }
   }
 };
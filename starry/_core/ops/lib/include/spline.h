@@ -0,0 +1,280 @@
+/**
+\file spline.h
+\brief Sparse spline resampling operators.
+
+*/
+
+#ifndef _STARRY_SPLINE_H_
+#define _STARRY_SPLINE_H_
+
+#include "utils.h"
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <vector>
+
+namespace starry {
+namespace spline {
+
+using namespace utils;
+
+/**
+The linear operator `S` that interpolates data on a grid `x` of size `n`
+onto a grid `xo` of size `no` with an interpolating spline of order `k`.
+
+The spline is the same as that of `scipy`'s
+`InterpolatedUnivariateSpline`: its knots are placed as in FITPACK for
+zero smoothing (i.e., at the data points, or halfway between them for
+even `k`, with "not-a-knot" conditions at the ends), and points outside
+the range of `x` are extrapolated with the end polynomials. We write
+
+    S = E A^-1
+
+where `A` is the `(n, n)` collocation matrix of the B-splines at `x` and
+`E` is the `(no, n)` matrix of the B-splines at `xo`. Each row of these
+has at most `k + 1` nonzero entries, so `A` is banded and we factorize
+it (without pivoting, since it is totally positive) in `O(n k^2)`. The
+products with `S` and its transpose then cost a banded solve and a
+sparse product, `O((n + no) k)` per column.
+
+The operator itself is not banded for `k > 1`, but its entries decay
+geometrically away from the diagonal. The `matrix` method computes each
+of its rows by solving with `A^T` locally, stopping as soon as the
+entries drop below a tolerance, so the sparse matrix is computed in
+`O(no k w)`, where `w` is the (tolerance-dependent) half-width of the
+band of entries we keep. For `k = 1`, `A` is the identity and `S = E`.
+
+*/
+template <typename Scalar> class Resampler {
+
+protected:
+  const int k;
+  int n;
+  int no;
+  int kl;                           // Lower bandwidth of `A`
+  int ku;                           // Upper bandwidth of `A`
+  std::vector<Scalar> t;            // The knots
+  Matrix<Scalar> LU;                // The band of the LU factors of `A`
+  Eigen::SparseMatrix<Scalar, RowMajor> E;
+
+  // Entry `(i, j)` of the LU factors of `A`
+  inline Scalar &lu(const int i, const int j) { return LU(i, j - i + kl); }
+  inline const Scalar &lu(const int i, const int j) const {
+    return LU(i, j - i + kl);
+  }
+
+  /**
+  Evaluate the `k + 1` B-splines that are nonzero on the knot interval
+  containing `xv` (or, outside the knots, on the first or last interval),
+  returning the index of the first one.
+
+  */
+  inline int basis(const Scalar &xv, std::vector<Scalar> &N) const {
+    int mu = int(std::upper_bound(t.begin() + k + 1, t.begin() + n, xv) -
+                 t.begin()) -
+             1;
+    std::vector<Scalar> left(k + 1), right(k + 1);
+    N.assign(k + 1, 0.0);
+    N[0] = 1.0;
+    for (int j = 1; j <= k; ++j) {
+      left[j] = xv - t[mu + 1 - j];
+      right[j] = t[mu + j] - xv;
+      Scalar saved = 0.0;
+      for (int r = 0; r < j; ++r) {
+        Scalar tmp = N[r] / (right[r + 1] + left[j - r]);
+        N[r] = saved + right[r + 1] * tmp;
+        saved = left[j - r] * tmp;
+      }
+      N[j] = saved;
+    }
+    return mu - k;
+  }
+
+public:
+  explicit Resampler(const Vector<Scalar> &x, const Vector<Scalar> &xo,
+                     const int k)
+      : k(k), n(x.size()), no(xo.size()) {
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((k < 1) || (n <= k))
+      throw std::invalid_argument(
+          "The number of data points must be larger than the spline order.");
+    for (int i = 1; i < n; ++i) {
+      if (!(x(i) > x(i - 1)))
+        throw std::invalid_argument(
+            "The input grid must be strictly increasing.");
+    }
+#endif
+
+    // The knots
+    t.resize(n + k + 1);
+    for (int j = 0; j <= k; ++j) {
+      t[j] = x(0);
+      t[n + j] = x(n - 1);
+    }
+    for (int j = 0; j < n - k - 1; ++j) {
+      if (k % 2)
+        t[k + 1 + j] = x(j + (k + 1) / 2);
+      else
+        t[k + 1 + j] = 0.5 * (x(j + k / 2) + x(j + k / 2 + 1));
+    }
+
+    // The collocation matrix
+    std::vector<Scalar> N;
+    std::vector<int> first(n);
+    Matrix<Scalar> rows(n, k + 1);
+    kl = 0;
+    ku = 0;
+    for (int i = 0; i < n; ++i) {
+      first[i] = basis(x(i), N);
+      for (int r = 0; r <= k; ++r) {
+        rows(i, r) = N[r];
+        if (N[r] != 0) {
+          kl = std::max(kl, i - first[i] - r);
+          ku = std::max(ku, first[i] + r - i);
+        }
+      }
+    }
+    LU.setZero(n, kl + ku + 1);
+    for (int i = 0; i < n; ++i) {
+      for (int r = 0; r <= k; ++r) {
+        if (rows(i, r) != 0)
+          lu(i, first[i] + r) = rows(i, r);
+      }
+    }
+
+    // Banded LU factorization
+    for (int p = 0; p < n; ++p) {
+#ifndef STARRY_NO_EXCEPTIONS
+      if (lu(p, p) == 0)
+        throw std::runtime_error("Singular spline collocation matrix.");
+#endif
+      for (int i = p + 1; i <= std::min(n - 1, p + kl); ++i) {
+        Scalar l = lu(i, p) / lu(p, p);
+        lu(i, p) = l;
+        for (int j = p + 1; j <= std::min(n - 1, p + ku); ++j)
+          lu(i, j) -= l * lu(p, j);
+      }
+    }
+
+    // The evaluation matrix
+    std::vector<Eigen::Triplet<Scalar>> triplets;
+    triplets.reserve(no * (k + 1));
+    for (int m = 0; m < no; ++m) {
+      int j0 = basis(xo(m), N);
+      for (int r = 0; r <= k; ++r)
+        triplets.push_back(Eigen::Triplet<Scalar>(m, j0 + r, N[r]));
+    }
+    E.resize(no, n);
+    E.setFromTriplets(triplets.begin(), triplets.end());
+  }
+
+  /**
+  Compute `out = S M`, where `M` has shape `(n, m)`.
+
+  */
+  inline void dot(const Matrix<Scalar> &M, Matrix<Scalar> &out) const {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (M.rows() != n)
+      throw std::invalid_argument("Invalid shape in the spline operator.");
+#endif
+    Matrix<Scalar, RowMajor> X = M;
+    for (int i = 0; i < n; ++i) {
+      for (int p = std::max(0, i - kl); p < i; ++p)
+        X.row(i) -= lu(i, p) * X.row(p);
+    }
+    for (int i = n - 1; i >= 0; --i) {
+      for (int j = i + 1; j <= std::min(n - 1, i + ku); ++j)
+        X.row(i) -= lu(i, j) * X.row(j);
+      X.row(i) /= lu(i, i);
+    }
+    out = E * X;
+  }
+
+  /**
+  Compute `out = S^T M`, where `M` has shape `(no, m)`.
+
+  */
+  inline void dotT(const Matrix<Scalar> &M, Matrix<Scalar> &out) const {
+#ifndef STARRY_NO_EXCEPTIONS
+    if (M.rows() != no)
+      throw std::invalid_argument("Invalid shape in the spline operator.");
+#endif
+    Matrix<Scalar, RowMajor> X = E.transpose() * M;
+    for (int i = 0; i < n; ++i) {
+      for (int p = std::max(0, i - ku); p < i; ++p)
+        X.row(i) -= lu(p, i) * X.row(p);
+      X.row(i) /= lu(i, i);
+    }
+    for (int i = n - 1; i >= 0; --i) {
+      for (int j = i + 1; j <= std::min(n - 1, i + kl); ++j)
+        X.row(i) -= lu(j, i) * X.row(j);
+    }
+    out = X;
+  }
+
+  /**
+  Return the operator `S` as a sparse matrix, dropping entries whose
+  absolute value is smaller than `tol`. Row `m` is the solution of
+  `A^T s = E_m^T`; we start the forward (`U^T`) and backward (`L^T`)
+  substitutions at the nonzero entries of `E_m` and stop them once
+  `max(kl, ku)` consecutive entries are smaller than `tol` times
+  `STARRY_SPLINE_TOL_FACTOR`. If `tol` is zero, we keep all entries.
+
+  */
+  inline Eigen::SparseMatrix<Scalar, RowMajor>
+  matrix(const Scalar &tol) const {
+    std::vector<Eigen::Triplet<Scalar>> triplets;
+    Scalar cut = tol * STARRY_SPLINE_TOL_FACTOR;
+    int bw = std::max(1, std::max(kl, ku));
+    Vector<Scalar> w = Vector<Scalar>::Zero(n);
+    for (int m = 0; m < no; ++m) {
+      int j0 = n, j1 = -1;
+      for (typename Eigen::SparseMatrix<Scalar, RowMajor>::InnerIterator it(
+               E, m);
+           it; ++it) {
+        w(it.col()) = it.value();
+        j0 = std::min(j0, int(it.col()));
+        j1 = std::max(j1, int(it.col()));
+      }
+      if (j1 < 0)
+        continue;
+
+      // Forward substitution with `U^T`
+      int i1 = j0, nsmall = 0;
+      for (int i = j0; i < n; ++i) {
+        for (int p = std::max(j0, i - ku); p < i; ++p)
+          w(i) -= lu(p, i) * w(p);
+        w(i) /= lu(i, i);
+        i1 = i;
+        nsmall = (std::abs(w(i)) < cut) ? nsmall + 1 : 0;
+        if ((i >= j1) && (nsmall >= bw) && (cut > 0))
+          break;
+      }
+
+      // Backward substitution with `L^T`
+      int i0 = 0;
+      nsmall = 0;
+      for (int i = i1; i >= 0; --i) {
+        for (int j = i + 1; j <= std::min(i1, i + kl); ++j)
+          w(i) -= lu(j, i) * w(j);
+        i0 = i;
+        nsmall = (std::abs(w(i)) < cut) ? nsmall + 1 : 0;
+        if ((i <= j0) && (nsmall >= bw) && (cut > 0))
+          break;
+      }
+
+      // Keep the large entries and reset the workspace
+      for (int i = i0; i <= i1; ++i) {
+        if (std::abs(w(i)) >= tol)
+          triplets.push_back(Eigen::Triplet<Scalar>(m, i, w(i)));
+        w(i) = 0.0;
+      }
+    }
+    Eigen::SparseMatrix<Scalar, RowMajor> S(no, n);
+    S.setFromTriplets(triplets.begin(), triplets.end());
+    return S;
+  }
+};
+
+} // namespace spline
+} // namespace starry
+#endif
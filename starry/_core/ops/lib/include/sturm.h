@@ -20,8 +20,19 @@ namespace sturm {
 
 #define POLYTOL 1e-10
 
+/**
+A polynomial coefficient vector with a compile-time upper bound on its
+size. Limb darkening polynomials are at most of degree `STARRY_MAX_LMAX`,
+so their Sturm sequences can live entirely on the stack.
+
+*/
 template <typename T>
-inline T polyval(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p, const double x) {
+using PolyVector = Eigen::Matrix<T, Eigen::Dynamic, 1, Eigen::ColMajor,
+                                 STARRY_MAX_LMAX + 1, 1>;
+
+template <typename V>
+inline typename V::Scalar polyval(const V &p, const double x) {
+  using T = typename V::Scalar;
   T result = T(0.0);
   for (int i = 0; i < p.rows(); ++i)
     result = result * x + p[i];
@@ -58,19 +69,14 @@ polymul(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p1,
   return result;
 }
 
-template <typename T>
-inline Eigen::Matrix<T, Eigen::Dynamic, 1>
-polyrem(const Eigen::Matrix<T, Eigen::Dynamic, 1> &u,
-        const Eigen::Matrix<T, Eigen::Dynamic, 1> &v) {
+template <typename V> inline V polyrem(const V &u, const V &v) {
+  using T = typename V::Scalar;
   int m = u.rows() - 1, n = v.rows() - 1, p = m - n + 1;
   using std::abs;
   T d, scale = T(1.0) / v[0];
-  Eigen::Matrix<T, Eigen::Dynamic, 1> q(std::max(p, 1)),
-      r = u; // This makes a copy!
-  q.setConstant(T(0.0));
+  V r = u; // This makes a copy!
   for (int k = 0; k < p; ++k) {
     d = scale * r[k];
-    q[k] = d;
     for (int i = 0; i < n + 1; ++i)
       r[k + i] -= d * v[i];
   }
@@ -83,11 +89,9 @@ polyrem(const Eigen::Matrix<T, Eigen::Dynamic, 1> &u,
   return r.tail(1);
 }
 
-template <typename T>
-inline Eigen::Matrix<T, Eigen::Dynamic, 1>
-polyder(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p) {
+template <typename V> inline V polyder(const V &p) {
   int n = p.rows() - 1;
-  Eigen::Matrix<T, Eigen::Dynamic, 1> d = p; // Copy.
+  V d = p; // Copy.
   for (int i = 0; i < n; ++i) {
     d[i] *= n - i;
   }
@@ -120,16 +124,19 @@ template <typename T> inline int sgn(T val) {
 
 // Count the positive roots of a polynomial over the domain [0, 1] using Sturm's
 // theorem. `p` are the polynomial coefficients, highest order first.
-template <typename T>
-inline int polycountroots(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p,
-                          const T &a = 0, const T &b = 1) {
+// The vector type `V` may be a `PolyVector`, in which case no heap
+// allocations are performed.
+template <typename V>
+inline int polycountroots_(const V &p, const typename V::Scalar &a,
+                           const typename V::Scalar &b) {
+  using T = typename V::Scalar;
   if (p.rows() <= 1)
     return 0;
 
   int n = p.rows() - 1, count = 0;
 
   // Compute the initial signs and count any initial sign change.
-  Eigen::Matrix<T, Eigen::Dynamic, 1> p0 = p;
+  V p0 = p;
 
   // HACK: for stability
   if (p0(n) == 0)
@@ -137,8 +144,8 @@ inline int polycountroots(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p,
   if ((n > 1) && (p0(n - 1) == 0))
     p0(n - 1) = utils::mach_eps<T>();
 
-  Eigen::Matrix<T, Eigen::Dynamic, 1> p1 = polyder(p0);
-  Eigen::Matrix<T, Eigen::Dynamic, 1> tmp;
+  V p1 = polyder(p0);
+  V tmp;
 
   // Sign at x = a
   int s_0 = sgn(polyval(p1, a));
@@ -171,6 +178,73 @@ inline int polycountroots(const Eigen::Matrix<T, Eigen::Dynamic, 1> &p,
   return count;
 }
 
+// Count the positive roots of a polynomial over the domain [0, 1] using Sturm's
+// theorem. `p` are the polynomial coefficients, highest order first.
+template <typename Derived>
+inline int polycountroots(const Eigen::MatrixBase<Derived> &p,
+                          const typename Derived::Scalar &a = 0,
+                          const typename Derived::Scalar &b = 1) {
+  using T = typename Derived::Scalar;
+  if (p.size() <= STARRY_MAX_LMAX + 1) {
+    PolyVector<T> p_ = p;
+    return polycountroots_(p_, a, b);
+  } else {
+    Eigen::Matrix<T, Eigen::Dynamic, 1> p_ = p;
+    return polycountroots_(p_, a, b);
+  }
+}
+
+/**
+Check whether each of a batch of limb darkening profiles is physical,
+i.e., whether the intensity is positive and monotonically decreasing
+toward the limb. Each row of `U` is a vector of limb darkening
+coefficients `u`, where `u(0) = -1` by convention.
+
+*/
+template <typename T>
+inline Eigen::Matrix<int, Eigen::Dynamic, 1>
+isphysical(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic,
+                               Eigen::RowMajor> &U) {
+  int nvec = U.rows();
+  int Nu = U.cols();
+#ifndef STARRY_NO_EXCEPTIONS
+  if (Nu > STARRY_MAX_LMAX + 1)
+    throw std::out_of_range("Limb darkening degree out of range.");
+#endif
+  Eigen::Matrix<int, Eigen::Dynamic, 1> result(nvec);
+#ifdef _OPENMP
+#pragma omp parallel for if (nvec > 64)
+#endif
+  for (int k = 0; k < nvec; ++k) {
+
+    // Ensure the function is *decreasing* toward the limb
+    if (U.row(k).sum() < -1) {
+      result(k) = 0;
+      continue;
+    }
+
+    // Sturm's theorem on the intensity to ensure positivity
+    if (polycountroots(U.row(k).reverse().transpose(), T(0), T(1)) > 0) {
+      result(k) = 0;
+      continue;
+    }
+
+    // Sturm's theorem on the derivative to ensure monotonicity
+    if (Nu > 1) {
+      PolyVector<T> dp(Nu - 1);
+      for (int i = 1; i < Nu; ++i)
+        dp(Nu - 1 - i) = i * U(k, i);
+      if (polycountroots(dp, T(0), T(1)) > 0) {
+        result(k) = 0;
+        continue;
+      }
+    }
+
+    result(k) = 1;
+  }
+  return result;
+}
+
 } // namespace sturm
 } // namespace starry
 
@@ -0,0 +1,273 @@
+/**
+\file system.h
+\brief Batched light curves of Keplerian systems.
+
+*/
+
+#ifndef _STARRY_SYSTEM_H_
+#define _STARRY_SYSTEM_H_
+
+#include "kepler.h"
+#include "ops.h"
+#include "utils.h"
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace starry {
+namespace system {
+
+using namespace utils;
+
+/**
+The total flux of a batch of Keplerian systems that share the same
+bodies (and map degrees) but may differ in any of their parameters.
+
+Body `0` is the primary, which sits at the origin, and all others are
+secondaries; `ops[k]` holds the operators of the map of body `k`. The
+parameters of the bodies are matrices of shape `(nbatch, nbody)` in
+the internal units of the `System` class (the orbital elements of the
+primary are ignored), `u[k]` and `y[k]` hold the limb darkening and
+the amplitude-weighted spherical harmonic coefficients of body `k`,
+one row per system, and `f[k]` is its filter. The light curves are
+integrated over exposures of length `texp` with the offsets `dt` (in
+units of `texp`) and the weights `stencil`.
+
+The systems are distributed over threads, each with its own rotation,
+filter, and solver workspaces for every body. We never store the design
+matrix of a system: its rows are computed in chunks of
+`STARRY_DESIGN_CHUNK` cadences and dotted into the (rotated) map
+coefficients on the fly, and the occultation rows are only computed at
+the cadences returned by `kepler::occultations`.
+
+*/
+template <typename Scalar> class Batch {
+protected:
+  std::vector<Ops<Scalar> *> ops;
+  const int nbody;
+  const Scalar G; /**< Gravitational constant */
+  const Scalar c; /**< Speed of light */
+  const bool light_delay;
+
+  // Per-thread workspace for the maps of all bodies
+  struct Workspace {
+    std::vector<std::unique_ptr<wigner::Wigner<Scalar>>> W;
+    std::vector<std::unique_ptr<solver::Greens<Scalar>>> G;
+    std::vector<std::unique_ptr<filter::Filter<Scalar>>> F;
+    explicit Workspace(std::vector<Ops<Scalar> *> &ops) {
+      for (auto op : ops) {
+        W.emplace_back(
+            new wigner::Wigner<Scalar>(op->ydeg, op->udeg, op->fdeg));
+        G.emplace_back(new solver::Greens<Scalar>(op->deg));
+        F.emplace_back(new filter::Filter<Scalar>(op->B));
+      }
+    }
+  };
+
+  /**
+  Add the light curve of body `k` of system `n` on the fine time grid
+  `tf` to `ftot`.
+
+  */
+  inline void body(const int n, const int k, const Vector<Scalar> &tf,
+                   const Matrix<Scalar> &x, const Matrix<Scalar> &y,
+                   const Matrix<Scalar> &z, const Vector<int> &idx,
+                   const Vector<int> &ptr, const Matrix<Scalar> &r,
+                   const Matrix<Scalar> &prot, const Matrix<Scalar> &t0,
+                   const Matrix<Scalar> &theta0, const Matrix<Scalar> &inc,
+                   const Matrix<Scalar> &obl,
+                   const std::vector<Matrix<Scalar>> &u,
+                   const std::vector<Vector<Scalar>> &f,
+                   const std::vector<Matrix<Scalar>> &yk, Workspace &ws,
+                   Vector<Scalar> &ftot) {
+    Ops<Scalar> &op = *ops[k];
+    int nf = tf.size();
+
+    // Rotational phase (a period of zero means no rotation)
+    Vector<Scalar> theta;
+    if (prot(n, k) == 0) {
+      theta.setConstant(nf, theta0(n, k));
+    } else {
+      theta = (2 * pi<Scalar>() / prot(n, k)) *
+                  (tf.array() - t0(n, k)).matrix() +
+              Vector<Scalar>::Constant(nf, theta0(n, k));
+    }
+
+    // Design operators; fold the polar rotation into the coefficients
+    Matrix<Scalar> Rpol, AR, X;
+    RowVector<Scalar> rTA1R;
+    op.designOperators(inc(n, k), obl(n, k), u[k].row(n).transpose(), f[k],
+                       *ws.W[k], *ws.F[k], Rpol, rTA1R, AR);
+    Vector<Scalar> yR(op.Ny);
+    for (int l = 0; l < op.ydeg + 1; ++l) {
+      yR.segment(l * l, 2 * l + 1) =
+          Rpol.block(l * l, l * l, 2 * l + 1, 2 * l + 1) *
+          yk[k].row(n).segment(l * l, 2 * l + 1).transpose();
+    }
+
+    // Phase curve
+    Vector<Scalar> phase(nf);
+    Vector<Scalar> zero = Vector<Scalar>::Zero(nf);
+    for (int n0 = 0; n0 < nf; n0 += STARRY_DESIGN_CHUNK) {
+      int nc = std::min(STARRY_DESIGN_CHUNK, nf - n0);
+      op.designRows(n0, nc, theta, zero, zero, zero, Scalar(0.0), rTA1R, AR,
+                    *ws.W[k], *ws.G[k], X);
+      phase.segment(n0, nc) = X * yR;
+    }
+    ftot += phase;
+
+    // Occultations of this body by each of the others
+    for (int j = 0; j < nbody; ++j) {
+      int p0 = ptr(k * nbody + j);
+      int ne = ptr(k * nbody + j + 1) - p0;
+      if ((j == k) || (ne == 0))
+        continue;
+      Vector<Scalar> theta_o(ne), xo(ne), yo(ne), zo(ne);
+      for (int e = 0; e < ne; ++e) {
+        int i = idx(p0 + e);
+        theta_o(e) = theta(i);
+        xo(e) = (x(i, j) - x(i, k)) / r(n, k);
+        yo(e) = (y(i, j) - y(i, k)) / r(n, k);
+        zo(e) = (z(i, j) - z(i, k)) / r(n, k);
+      }
+      Scalar ro = r(n, j) / r(n, k);
+      for (int e0 = 0; e0 < ne; e0 += STARRY_DESIGN_CHUNK) {
+        int nc = std::min(STARRY_DESIGN_CHUNK, ne - e0);
+        op.designRows(e0, nc, theta_o, xo, yo, zo, ro, rTA1R, AR, *ws.W[k],
+                      *ws.G[k], X);
+        Vector<Scalar> fo = X * yR;
+        for (int e = 0; e < nc; ++e) {
+          int i = idx(p0 + e0 + e);
+          ftot(i) += fo(e) - phase(i);
+        }
+      }
+    }
+  }
+
+public:
+  Matrix<Scalar> flux; /**< The flux, shape `(nbatch, nt)` */
+
+  explicit Batch(const std::vector<Ops<Scalar> *> &ops, const Scalar &G,
+                 const Scalar &c, const bool light_delay)
+      : ops(ops), nbody(ops.size()), G(G), c(c), light_delay(light_delay) {}
+
+  /**
+  Compute the flux of all systems at the times `t`.
+
+  */
+  inline void compute(const Vector<Scalar> &t, const Vector<Scalar> &dt,
+                      const Vector<Scalar> &stencil, const Scalar &texp,
+                      const Matrix<Scalar> &r, const Matrix<Scalar> &m,
+                      const Matrix<Scalar> &prot, const Matrix<Scalar> &t0,
+                      const Matrix<Scalar> &theta0,
+                      const Matrix<Scalar> &porb, const Matrix<Scalar> &ecc,
+                      const Matrix<Scalar> &w, const Matrix<Scalar> &Omega,
+                      const Matrix<Scalar> &iorb, const Matrix<Scalar> &inc,
+                      const Matrix<Scalar> &obl,
+                      const std::vector<Matrix<Scalar>> &u,
+                      const std::vector<Vector<Scalar>> &f,
+                      const std::vector<Matrix<Scalar>> &y) {
+    int nbatch = r.rows();
+    int nt = t.size();
+    int ns = dt.size();
+    int nf = nt * ns;
+    int nsec = nbody - 1;
+#ifndef STARRY_NO_EXCEPTIONS
+    if ((nbody < 1) || (int(u.size()) != nbody) ||
+        (int(f.size()) != nbody) || (int(y.size()) != nbody))
+      throw std::invalid_argument("Mismatch in the number of bodies.");
+    for (auto M : {&r, &m, &prot, &t0, &theta0, &porb, &ecc, &w, &Omega,
+                   &iorb, &inc, &obl}) {
+      if ((M->rows() != nbatch) || (M->cols() != nbody))
+        throw std::invalid_argument(
+            "Body parameters must have shape `(nbatch, nbody)`.");
+    }
+    for (int k = 0; k < nbody; ++k) {
+      if ((u[k].rows() != nbatch) || (u[k].cols() != ops[k]->Nu) ||
+          (y[k].rows() != nbatch) || (y[k].cols() != ops[k]->Ny) ||
+          (f[k].size() != ops[k]->Nf))
+        throw std::invalid_argument("Invalid shape for the map coefficients.");
+    }
+    if (stencil.size() != ns)
+      throw std::invalid_argument("Mismatch in the size of the stencil.");
+    for (int n = 0; n < nbatch; ++n) {
+      for (int k = 1; k < nbody; ++k) {
+        if ((ecc(n, k) < 0) || (ecc(n, k) >= 1))
+          throw std::invalid_argument(
+              "Eccentricity must be in the range [0, 1).");
+        if (porb(n, k) <= 0)
+          throw std::invalid_argument("Orbital period must be positive.");
+      }
+    }
+#endif
+
+    // The times at which we evaluate the light curves
+    Vector<Scalar> tf(nf);
+    for (int i = 0; i < nt; ++i) {
+      for (int s = 0; s < ns; ++s)
+        tf(i * ns + s) = t(i) + texp * dt(s);
+    }
+
+    flux.resize(nbatch, nt);
+    std::exception_ptr error = nullptr;
+
+#ifdef _OPENMP
+#pragma omp parallel if (nbatch > 1)
+#endif
+    {
+      // Thread-local workspace
+      Workspace ws(ops);
+      kepler::Orbit<Scalar> orbit(G, c);
+      Matrix<Scalar> x = Matrix<Scalar>::Zero(nf, nbody);
+      Matrix<Scalar> y_ = Matrix<Scalar>::Zero(nf, nbody);
+      Matrix<Scalar> z = Matrix<Scalar>::Zero(nf, nbody);
+      Vector<Scalar> ftot(nf);
+      Vector<int> idx, ptr;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int n = 0; n < nbatch; ++n) {
+        try {
+          // Positions of the secondaries relative to the primary
+          if (nsec > 0) {
+            orbit.compute(tf, m(n, 0), m.row(n).tail(nsec).transpose(),
+                          t0.row(n).tail(nsec).transpose(),
+                          porb.row(n).tail(nsec).transpose(),
+                          ecc.row(n).tail(nsec).transpose(),
+                          w.row(n).tail(nsec).transpose(),
+                          Omega.row(n).tail(nsec).transpose(),
+                          iorb.row(n).tail(nsec).transpose(),
+                          Vector<Scalar>::Ones(nsec), light_delay);
+            x.rightCols(nsec) = orbit.x;
+            y_.rightCols(nsec) = orbit.y;
+            z.rightCols(nsec) = orbit.z;
+          }
+          kepler::occultations(x, y_, z, Vector<Scalar>(r.row(n).transpose()),
+                               idx, ptr);
+
+          // Light curves of all bodies
+          ftot.setZero();
+          for (int k = 0; k < nbody; ++k)
+            body(n, k, tf, x, y_, z, idx, ptr, r, prot, t0, theta0, inc, obl,
+                 u, f, y, ws, ftot);
+
+          // Integrate over the exposures
+          for (int i = 0; i < nt; ++i)
+            flux(n, i) = stencil.dot(ftot.segment(i * ns, ns));
+        } catch (...) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+          error = std::current_exception();
+        }
+      }
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
+
+} // namespace system
+} // namespace starry
+#endif
@@ -1,7 +1,7 @@
 # -*- coding: utf-8 -*-
-from ...compat import Apply, Op, theano, tt, change_flags
+from ...compat import Apply, Op, tt
 import numpy as np
-from scipy.optimize import minimize
+from scipy.optimize import OptimizeResult
 
 
 __all__ = ["minimizeOp", "LDPhysicalOp"]
@@ -13,91 +13,48 @@ class minimizeOp(Op):
     Returns the tuple `(lat, lon, I)`.
 
     .. note::
-        This op is not very optimized. The idea here is to
-        do a coarse grid search, find the minimum, then run
-        a quick gradient descent to refine the result.
+        The search is done entirely in C++: we evaluate the intensity on
+        a deterministic Fibonacci lattice over the sphere (or over the
+        region specified by `bounds`), then refine the `ntries` lowest
+        points with a damped Newton iteration using the analytic
+        gradient and Hessian of the polynomial representation of the map.
     """
 
-    def __init__(self, intensity, P, ydeg, udeg, fdeg):
-        self.intensity = intensity
-        self.P = P
+    def __init__(self, func, ydeg, udeg, fdeg, norm=1.0):
+        self.func = func
         self.ydeg = ydeg
         self.udeg = udeg
         self.fdeg = fdeg
-        self._do_setup = True
+        self.norm = norm
         self.oversample = 1
         self.ntries = 1
         self.result = None
-        self.bounds = None
+        self.bounds = (
+            (-0.5 * np.pi, 0.5 * np.pi),
+            (-np.pi, np.pi),
+        )
+
+        # The minimum is computed with the identity filter
+        self.u0 = np.zeros(self.udeg + 1)
+        self.u0[0] = -1.0
+        self.f0 = np.zeros((self.fdeg + 1) ** 2)
+        self.f0[0] = np.pi
 
     def setup(self, oversample=1, ntries=1, bounds=None):
-        self.ntries = ntries
-
-        # Don't setup unless the user actually calls this function,
-        # since there's quite a bit of overhead
-        if self._do_setup or (oversample != self.oversample):
-
-            self.oversample = oversample
-
-            # Create the lat-lon grid
-            # TODO: Use a mollweide grid instead of
-            # random samples!
-            # Require at least `oversample * l ** 2 points`
-            s = np.random.RandomState(0)
-            npts = oversample * self.ydeg ** 2
-            self.lat_grid = np.arccos(2 * s.rand(npts) - 1) - np.pi / 2
-            self.lon_grid = (s.rand(npts) - 0.5) * 2 * np.pi
-
-            # Restrict grid in latitude/longitude to a certain range
-            if bounds is not None:
-                self.bounds = (
-                    (bounds[0][0] * np.pi / 180, bounds[0][1] * np.pi / 180),
-                    (bounds[1][0] * np.pi / 180, bounds[1][1] * np.pi / 180),
-                )
-
-                mask_lat = np.logical_and(
-                    self.lat_grid > self.bounds[0][0],
-                    self.lat_grid < self.bounds[0][1],
-                )
-                mask_lon = np.logical_and(
-                    self.lon_grid > self.bounds[1][0],
-                    self.lon_grid < self.bounds[1][1],
-                )
-                mask_com = np.logical_and(mask_lat, mask_lon)
-
-                self.lat_grid = self.lat_grid[mask_com]
-                self.lon_grid = self.lon_grid[mask_com]
-
-            self.P_grid = self.P(
-                tt.as_tensor_variable(self.lat_grid),
-                tt.as_tensor_variable(self.lon_grid),
-            ).eval()
-
-            # Set up the cost & grad function for the nonlinear solver
-            u0 = np.zeros(self.udeg + 1)
-            u0[0] = -1.0
-            u0 = tt.as_tensor_variable(u0)
-            f0 = np.zeros((self.fdeg + 1) ** 2)
-            f0[0] = np.pi
-            f0 = tt.as_tensor_variable(f0)
-            latlon = tt.dvector()
-            y = tt.dvector()
-            with change_flags(compute_test_value="off"):
-                self.I = theano.function(
-                    [latlon, y],
-                    [
-                        self.intensity(
-                            latlon[0], latlon[1], y, u0, f0, 0.0, 0.0
-                        )[0],
-                        *theano.grad(
-                            self.intensity(
-                                latlon[0], latlon[1], y, u0, f0, 0.0, 0.0
-                            )[0],
-                            [latlon],
-                        ),
-                    ],
-                )
-            self._do_setup = False
+        self.oversample = int(oversample)
+        self.ntries = int(ntries)
+
+        # Restrict the search in latitude/longitude to a certain range
+        if bounds is not None:
+            self.bounds = (
+                (bounds[0][0] * np.pi / 180, bounds[0][1] * np.pi / 180),
+                (bounds[1][0] * np.pi / 180, bounds[1][1] * np.pi / 180),
+            )
+        else:
+            self.bounds = (
+                (-0.5 * np.pi, 0.5 * np.pi),
+                (-np.pi, np.pi),
+            )
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
@@ -112,70 +69,62 @@ class minimizeOp(Op):
         return [(), (), ()]
 
     def perform(self, node, inputs, outputs):
-
-        assert self._do_setup is False, "Must run `setup()` first."
-
-        y = inputs[0]
-
-        # Initial guess
-        I_grid = np.dot(self.P_grid, y)
-        outputs[2][0] = np.inf
-
-        for n in range(self.ntries):
-            ind = np.argmin(I_grid)
-            x0 = np.array([self.lat_grid[ind], self.lon_grid[ind]])
-
-            # Minimize
-            result = minimize(
-                self.I, x0, args=(y,), jac=True, bounds=self.bounds
-            )
-
-            if result.fun < outputs[2][0]:
-                outputs[0][0] = np.array(result.x[0])
-                outputs[1][0] = np.array(result.x[1])
-                outputs[2][0] = np.array(result.fun)
-
-            # Prepare for next iteration
-            I_grid[ind] = np.inf
+        y = np.array(inputs[0], dtype="float64")
+        lat, lon, I, nit = self.func(
+            y,
+            self.u0,
+            self.f0,
+            self.oversample,
+            self.ntries,
+            self.bounds[0][0],
+            self.bounds[0][1],
+            self.bounds[1][0],
+            self.bounds[1][1],
+        )
+        I *= self.norm
+        outputs[0][0] = np.array(lat)
+        outputs[1][0] = np.array(lon)
+        outputs[2][0] = np.array(I)
 
         # Save
-        self.result = result
+        self.result = OptimizeResult(
+            x=np.array([lat, lon]), fun=I, nit=nit, success=True
+        )
 
 
 class LDPhysicalOp(Op):
     """
     Check whether a limb darkening profile is physical using Sturm's theorem.
 
+    The input may be a single vector of coefficients `u` or a matrix
+    whose rows are independent coefficient vectors, in which case
+    the output is a vector of flags, one per row.
+
     """
 
-    def __init__(self, nroots):
-        self.nroots = nroots
+    def __init__(self, func):
+        self.func = func
 
     def make_node(self, *inputs):
         inputs = [tt.as_tensor_variable(i) for i in inputs]
-        outputs = [tt.bscalar()]
+        if inputs[0].ndim > 1:
+            outputs = [tt.bvector()]
+        else:
+            outputs = [tt.bscalar()]
         return Apply(self, inputs, outputs)
 
     def infer_shape(self, *args):
-        return [()]
+        shapes = args[-1]
+        if len(shapes[0]) > 1:
+            return [(shapes[0][0],)]
+        else:
+            return [()]
 
     def perform(self, node, inputs, outputs):
-        u = inputs[0]
-        outputs[0][0] = 1
-
-        # Ensure the function is *decreasing* toward the limb
-        if u.sum() < -1:
-            outputs[0][0] = 0
-            return
-
-        # Sturm's theorem on the intensity to ensure positivity
-        p = u[::-1]
-        if self.nroots(p, 0, 1) > 0:
-            outputs[0][0] = 0
-            return
-
-        # Sturm's theorem on the derivative to ensure monotonicity
-        p = (u[1:] * np.arange(1, len(u)))[::-1]
-        if self.nroots(p, 0, 1) > 0:
-            outputs[0][0] = 0
-            return
+        u = np.array(inputs[0], dtype="float64")
+        if u.ndim > 1:
+            outputs[0][0] = np.array(self.func(u), dtype="int8")
+        else:
+            outputs[0][0] = np.array(
+                self.func(np.reshape(u, (1, -1)))[0], dtype="int8"
+            )
@@ -0,0 +1,126 @@
+# -*- coding: utf-8 -*-
+from ...compat import Apply, Op, tt, theano
+import numpy as np
+
+__all__ = ["OrbitOp", "OccultationsOp"]
+
+
+class OrbitOp(Op):
+    """Positions of all secondary bodies on Keplerian orbits.
+
+    The inputs are the times ``t``, the mass of the primary, and the masses,
+    reference times, periods, eccentricities, arguments of periastron,
+    longitudes of ascending node, and inclinations of the secondaries,
+    followed by the scale factors ``fac`` for each of them. The outputs
+    are the ``x``, ``y``, and ``z`` positions of each body relative to the
+    primary, times ``fac``, each with shape ``(nt, nsec)``.
+
+    .. note::
+        The orbits are computed in C++ using the same conventions as
+        ``exoplanet.orbits.KeplerianOrbit``.
+    """
+
+    def __init__(self, func, G, c, light_delay=False):
+        self.func = func
+        self.G = G
+        self.c = c
+        self.light_delay = bool(light_delay)
+        self._grad_op = OrbitGradientOp(self)
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [
+            tt.TensorType(inputs[-1].dtype, (False, False))() for i in range(3)
+        ]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return [(shapes[0][0], shapes[2][0]) for i in range(3)]
+
+    def _args(self, inputs):
+        t, pri_m, *sec = inputs
+        return (
+            [np.reshape(t, -1), float(pri_m)]
+            + [np.reshape(arg, -1) for arg in sec]
+            + [self.G, self.c, self.light_delay]
+        )
+
+    def perform(self, node, inputs, outputs):
+        x, y, z = self.func(*self._args(inputs))
+        outputs[0][0] = x
+        outputs[1][0] = y
+        outputs[2][0] = z
+
+    def grad(self, inputs, gradients):
+        outputs = self(*inputs)
+        gradients = [
+            tt.zeros_like(outputs[n])
+            if isinstance(g.type, theano.gradient.DisconnectedType)
+            else g
+            for n, g in enumerate(gradients)
+        ]
+        return self._grad_op(*(inputs + gradients))
+
+
+class OrbitGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-3]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-3]
+
+    def perform(self, node, inputs, outputs):
+        bx, by, bz = inputs[-3:]
+        grads = self.base_op.func(
+            *self.base_op._args(inputs[:-3]),
+            np.atleast_2d(bx),
+            np.atleast_2d(by),
+            np.atleast_2d(bz),
+        )
+        for n, g in enumerate(grads):
+            outputs[n][0] = np.reshape(g, np.shape(inputs[n]))
+
+
+class OccultationsOp(Op):
+    """Index of all occultation events in a system of bodies.
+
+    The inputs are the ``x``, ``y``, and ``z`` sky positions of all bodies,
+    each with shape ``(nt, nbody)``, and their radii. The outputs are the
+    time indices of all events and the pointers into them for each ordered
+    pair of bodies, in compressed sparse row format: the indices at which
+    body ``i`` is occulted by body ``j`` are ``idx[ptr[k]:ptr[k + 1]]``,
+    where ``k = i * nbody + j``.
+
+    .. note::
+        The outputs are integer indices, so this op has no gradient.
+    """
+
+    def __init__(self, func):
+        self.func = func
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [tt.lvector(), tt.lvector()]
+        return Apply(self, inputs, outputs)
+
+    def perform(self, node, inputs, outputs):
+        x, y, z, r = inputs
+        idx, ptr = self.func(
+            np.atleast_2d(x), np.atleast_2d(y), np.atleast_2d(z), r
+        )
+        outputs[0][0] = np.array(idx, dtype="int64")
+        outputs[1][0] = np.array(ptr, dtype="int64")
+
+    def connection_pattern(self, node):
+        # The integer outputs do not depend differentiably on any input
+        return [[False, False] for _ in node.inputs]
+
+    def grad(self, inputs, gradients):
+        return [theano.gradient.disconnected_type() for _ in inputs]
@@ -2,7 +2,7 @@
 from ...compat import Apply, Op, tt
 import numpy as np
 
-__all__ = ["spotYlmOp"]
+__all__ = ["spotYlmOp", "spotsYlmOp"]
 
 
 class spotYlmOp(Op):
@@ -54,3 +54,88 @@ class spotYlmGradientOp(Op):
         outputs[1][0] = np.reshape(bsigma, np.shape(inputs[1]))
         outputs[2][0] = np.reshape(blat, np.shape(inputs[2]))
         outputs[3][0] = np.reshape(blon, np.shape(inputs[3]))
+
+
+class spotsYlmOp(Op):
+    """Summed Ylm expansion of many spots.
+
+    The inputs are the spot amplitudes, with shape ``(nspot,)`` or
+    ``(nspot, nw)`` for spectral maps, and the spot sizes, latitudes
+    and longitudes, each with shape ``(nspot,)``. If ``zonal`` is set,
+    the spot sizes are replaced by the coefficients of the zonal
+    harmonics ``Y_{l,0}`` of each (unrotated) spot profile, with shape
+    ``(nspot, ydeg + 1)``.
+
+    """
+
+    def __init__(self, func, ydeg, nw, zonal=False):
+        self.func = func
+        self._grad_op = spotsYlmGradientOp(self)
+        self.Ny = (ydeg + 1) ** 2
+        self.nw = nw
+        self.zonal = zonal
+
+    def _shapes(self, nspot):
+        """Shapes of the amplitude and size arguments of ``func``."""
+        if self.zonal:
+            return (nspot, -1), (nspot, -1)
+        else:
+            return (nspot, -1), -1
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        if self.nw is None:
+            outputs = [tt.TensorType(inputs[0].dtype, (False,))()]
+        else:
+            outputs = [tt.TensorType(inputs[0].dtype, (False, False))()]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        if self.nw is None:
+            return [(self.Ny,)]
+        else:
+            return [(self.Ny, self.nw)]
+
+    def perform(self, node, inputs, outputs):
+        amp, sigma, lat, lon = inputs
+        amp_shape, sigma_shape = self._shapes(np.size(lat))
+        outputs[0][0] = self.func(
+            np.reshape(amp, amp_shape),
+            np.reshape(sigma, sigma_shape),
+            np.reshape(lat, -1),
+            np.reshape(lon, -1),
+        )
+        if self.nw is None:
+            outputs[0][0] = np.reshape(outputs[0][0], -1)
+
+    def grad(self, inputs, gradients):
+        return self._grad_op(*(inputs + gradients))
+
+
+class spotsYlmGradientOp(Op):
+    def __init__(self, base_op):
+        self.base_op = base_op
+
+    def make_node(self, *inputs):
+        inputs = [tt.as_tensor_variable(i) for i in inputs]
+        outputs = [i.type() for i in inputs[:-1]]
+        return Apply(self, inputs, outputs)
+
+    def infer_shape(self, *args):
+        shapes = args[-1]
+        return shapes[:-1]
+
+    def perform(self, node, inputs, outputs):
+        amp, sigma, lat, lon, by = inputs
+        amp_shape, sigma_shape = self.base_op._shapes(np.size(lat))
+        bamp, bsigma, blat, blon = self.base_op.func(
+            np.reshape(amp, amp_shape),
+            np.reshape(sigma, sigma_shape),
+            np.reshape(lat, -1),
+            np.reshape(lon, -1),
+            np.reshape(by, (self.base_op.Ny, -1)),
+        )
+        outputs[0][0] = np.reshape(bamp, np.shape(amp))
+        outputs[1][0] = np.reshape(bsigma, np.shape(sigma))
+        outputs[2][0] = np.reshape(blat, np.shape(lat))
+        outputs[3][0] = np.reshape(blon, np.shape(lon))
@@ -11,9 +11,8 @@ from .doppler_visualize import Visualize
 from .doppler_solve import Solve
 import numpy as np
 from scipy.ndimage import zoom
-from scipy.interpolate import InterpolatedUnivariateSpline as Spline
 from scipy.sparse import block_diag as sparse_block_diag
-from scipy.sparse import csr_matrix
+from scipy.sparse.linalg import LinearOperator, aslinearoperator
 from warnings import warn
 import os
 import matplotlib.pyplot as plt
@@ -101,6 +100,34 @@ class DopplerMap:
             to ensure that ``map.veq * sin(map.inc)`` is never larger than
             this quantity. Lower values of this quantity will result in faster
             evaluation times. Default is ``100 km/s``.
+        conv_mode (str, optional): How to compute the convolutions of the
+            spectra with the line broadening kernels. Options are
+            ``direct``, ``fft`` (faster for wide kernels, i.e., for rapid
+            rotators or high resolution spectra), or ``auto``, which
+            chooses between the two based on the kernel width and the
+            length of the wavelength grid. Default is ``auto``.
+        precision (str, optional): The precision of the direct
+            convolutions in the flux and design matrix products. Options
+            are ``double`` (default) or ``mixed``, in which the spectra
+            and kernels are rounded to single precision and the sums over
+            each kernel are accumulated in single precision, while the
+            longer reductions (over spherical harmonics, epochs and
+            wavelength blocks) are accumulated in double precision. This
+            is 2-3 times faster, and the error in each element of the
+            flux is at most ``(nk + 2) * 2^-24`` times the flux computed
+            with the absolute values of the map and kernels (where ``nk``
+            is the number of points in the kernel), i.e., typically a
+            relative error of order ``1e-6`` or less; see
+            :py:meth:`validate_precision`. The FFT convolutions always
+            run in double precision. Note that iterative solvers cannot
+            converge to tolerances below this level in mixed precision.
+        kT_cache_size (int, optional): Total memory budget in bytes for
+            caching the line broadening kernels rotated to each epoch,
+            which are reused as long as ``inc``, ``veq``, ``u`` and
+            ``theta`` don't change. The budget is split evenly between the
+            Theano graph and the native solvers, which cache the kernels
+            separately. Set to zero to disable the cache. Default is
+            ``256 MB``.
         angle_unit (``astropy.units.Unit``, optional): The unit used for
             angular quantities. Default ``deg``.
         velocity_unit (``astropy.units.Unit``, optional): The unit used for
@@ -306,8 +333,6 @@ class DopplerMap:
             # These are used to interpolate the model and the design
             # matrix from the internal (i) onto the external (e) grid
             S = self._get_spline_operator(wav_int, wav)
-            S[np.abs(S) < interp_tol] = 0
-            S = csr_matrix(S)
             self._Si2eTr = self._math.sparse_cast(S.T)
             self._Si2eBlk = self._math.sparse_cast(
                 sparse_block_diag([S for n in range(nt)], format="csr")
@@ -318,21 +343,15 @@ class DopplerMap:
 
             # Interpolate from `wav0_` to `wav0`
             S = self._get_spline_operator(wav0_int, wav0)
-            S[np.abs(S) < interp_tol] = 0
-            S = csr_matrix(S)
             self._S0i2e = self._math.sparse_cast(S)
             self._S0i2eTr = self._math.sparse_cast(S.T)
 
             # Interpolate from `wav` to `wav_`
             S = self._get_spline_operator(wav, wav_int)
-            S[np.abs(S) < interp_tol] = 0
-            S = csr_matrix(S)
             self._Se2i = self._math.sparse_cast(S)
 
             # Interpolate from `wav0` to `wav0_`
             S = self._get_spline_operator(wav0, wav0_int)
-            S[np.abs(S) < interp_tol] = 0
-            S = csr_matrix(S)
             self._S0e2i = self._math.sparse_cast(S)
             self._S0e2iTr = self._math.sparse_cast(S.T)
 
@@ -356,6 +375,9 @@ class DopplerMap:
             vsini_max,
             self._clight,
             log_wav0_int,
+            conv_mode=kwargs.pop("conv_mode", "auto"),
+            precision=kwargs.pop("precision", "double"),
+            kT_cache_size=kwargs.pop("kT_cache_size", None),
             **kwargs,
         )
 
@@ -770,37 +792,69 @@ class DopplerMap:
         self.obl = kwargs.pop("obl", 0.0)
         self.veq = kwargs.pop("veq", 0.0)
 
-    def _get_SHT_matrix(self, nlat, nlon, eps=1e-12, smoothing=None):
+    def _get_SHT_smoothing(self, smoothing=None):
         """
-        Return the SHT matrix for transforming a lat-lon intensity
-        grid to a vector of spherical harmonic coefficients.
+        Return the Gaussian smoothing factor for each spherical harmonic
+        coefficient, or None if smoothing is disabled.
 
-        This method is only used internally to load images on rectangular
-        lat-lon grids in the ``load`` method.
+        """
+        if smoothing is None:
+            smoothing = 2.0 / self.ydeg
+        if smoothing > 0:
+            l = np.concatenate(
+                [np.repeat(l, 2 * l + 1) for l in range(self.ydeg + 1)]
+            )
+            return np.exp(-0.5 * l * (l + 1) * smoothing ** 2)
+        else:
+            return None
+
+    def _get_SHT_grid(self, nlat, nlon):
+        """
+        Return the Cartesian points and the (cos(lat)-squared) pixel
+        weights of a rectangular lat-lon grid of shape ``(nlat, nlon)``.
 
         """
-        # Get the lat-lon grid
         lon = np.linspace(-180, 180, nlon) * np.pi / 180
         lat = np.linspace(-90, 90, nlat) * np.pi / 180
         lon, lat = np.meshgrid(lon, lat)
         lon = lon.flatten()
         lat = lat.flatten()
+        x, y, z = self.ops.latlon_to_xyz(lat, lon)
+        return x, y, z, np.cos(lat) ** 2
 
-        # Compute the cos(lat)-weighted SHT
-        w = np.cos(lat)
-        P = self.ops.P(lat, lon)
-        PTSinv = P.T * (w ** 2)[None, :]
-        Q = np.linalg.solve(PTSinv @ P + eps * np.eye(P.shape[1]), PTSinv)
-        if smoothing is None:
-            smoothing = 2.0 / self.ydeg
-        if smoothing > 0:
-            l = np.concatenate(
-                [np.repeat(l, 2 * l + 1) for l in range(self.ydeg + 1)]
-            )
-            s = np.exp(-0.5 * l * (l + 1) * smoothing ** 2)
-            Q *= s[:, None]
+    def _get_SHT_matrix(self, nlat, nlon, eps=1e-12, smoothing=None):
+        """
+        Return the SHT matrix for transforming a lat-lon intensity
+        grid to a vector of spherical harmonic coefficients.
+
+        This is the matrix applied (without instantiating it) by
+        ``_dot_SHT`` to load images on rectangular lat-lon grids in
+        the ``load`` method.
+
+        """
+        # Compute the cos(lat)-weighted SHT (natively, and cached)
+        _, Q = self.ops.pixel_transform(*self._get_SHT_grid(nlat, nlon), eps)
+        s = self._get_SHT_smoothing(smoothing)
+        if s is not None:
+            Q = Q * s[:, None]
         return Q
 
+    def _dot_SHT(self, nlat, nlon, M, eps=1e-12, smoothing=None):
+        """
+        Dot the SHT matrix for a lat-lon grid of shape ``(nlat, nlon)``
+        into the columns of ``M`` without returning the matrix itself.
+        The transform is computed natively and cached, and all columns
+        are transformed in a single (parallel) product.
+
+        """
+        y = self.ops.dot_pixel_transform(
+            *self._get_SHT_grid(nlat, nlon), eps, M
+        )
+        s = self._get_SHT_smoothing(smoothing)
+        if s is not None:
+            y *= s[:, None]
+        return y
+
     def load(
         self,
         *,
@@ -893,9 +947,9 @@ class DopplerMap:
                     raise TypeError("Invalid type for `maps`.")
 
                 # Process each map
-                Q = np.empty((self.Ny, 0))
                 y = np.zeros((self.Ny, self.nc))
                 y[:, 0] = 1.0
+                images = {}
                 for n, image in enumerate(maps):
 
                     # Is this a file name or an array?
@@ -945,16 +999,23 @@ class DopplerMap:
 
                         raise TypeError("Invalid type for one of the `maps`.")
 
-                    # Compute the SHT matrix if needed
-                    nlat, nlon = image.shape
-                    if Q.shape[1] != nlat * nlon:
-                        Q = self._get_SHT_matrix(
-                            nlat, nlon, eps=eps, smoothing=smoothing
-                        )
+                    # Group the images by shape
+                    images.setdefault(image.shape, []).append((n, image))
 
-                    # The Ylm coefficients are just a linear op on the image
-                    # Note that we need to apply the starry 1/pi normalization
-                    y[:, n] = Q @ image.reshape(nlat * nlon) / np.pi
+                # The Ylm coefficients are just a linear op on the images,
+                # so we transform all images on the same grid at once
+                # Note that we need to apply the starry 1/pi normalization
+                for (nlat, nlon), group in images.items():
+                    idx = [n for n, _ in group]
+                    M = np.transpose(
+                        [image.reshape(nlat * nlon) for _, image in group]
+                    )
+                    y[:, idx] = (
+                        self._dot_SHT(
+                            nlat, nlon, M, eps=eps, smoothing=smoothing
+                        )
+                        / np.pi
+                    )
 
                 # Ingest the coeffs
                 self._y = self._math.cast(y)
@@ -1034,27 +1095,28 @@ class DopplerMap:
                 nlat, nlon = U.shape[0], U.shape[1]
                 U = U.reshape(nlat * nlon, self.nc)
 
-            # Get the lat-lon grid
-            Q = self._get_SHT_matrix(nlat, nlon, eps=eps, smoothing=smoothing)
-
             # The Ylm coefficients are just a linear op on the image
             # Note that we need to apply the starry 1/pi normalization
-            y = Q @ U / np.pi
+            y = self._dot_SHT(nlat, nlon, U, eps=eps, smoothing=smoothing)
+            y /= np.pi
             self._y = self._math.reshape(
                 self._math.cast(y), (self.Ny, self.nc)
             )
 
     def _get_spline_operator(self, input_grid, output_grid):
-        """ """
+        """
+        Return the sparse matrix that interpolates a spectrum on
+        ``input_grid`` onto ``output_grid``, dropping entries smaller
+        than ``interp_tol``. This is built natively from the banded
+        spline factorization, so it never forms the dense operator.
+
+        """
         assert not is_tensor(
             input_grid, output_grid
         ), "Wavelength grids must be numerical quantities."
-        S = np.zeros((len(output_grid), len(input_grid)))
-        for n in range(len(input_grid)):
-            y = np.zeros_like(input_grid)
-            y[n] = 1.0
-            S[:, n] = Spline(input_grid, y, k=self._interp_order)(output_grid)
-        return S
+        return self._math.spline_operator(
+            input_grid, output_grid, self._interp_order, self._interp_tol
+        )
 
     def _get_default_theta(self, theta):
         """ """
@@ -1146,27 +1208,85 @@ class DopplerMap:
             evaluated, a matrix of shape ``(npix, 2)``.
 
         """
-        lat, lon, ISHT, SHT, _, _ = self._map.get_pixel_transforms(
-            oversample=oversample, lam=lam
-        )
+        lat, lon, x, y, z = self._map._get_pixel_grid(oversample)
+        ISHT, SHT = self.ops.pixel_transform(x, y, z, 1.0, lam)
         if inverse:
             matrix = ISHT
         else:
             matrix = SHT
-            if smoothing is None:
-                smoothing = 2.0 / self.ydeg
-            if smoothing > 0:
-                l = np.concatenate(
-                    [np.repeat(l, 2 * l + 1) for l in range(self.ydeg + 1)]
-                )
-                s = np.exp(-0.5 * l * (l + 1) * smoothing ** 2)
+            s = self._get_SHT_smoothing(smoothing)
+            if s is not None:
                 matrix *= s[:, None]
         if return_grid:
-            grid = np.vstack((lat, lon)).T
+            grid = np.vstack((lat, lon)).T / self._angle_factor
             return matrix, grid
         else:
             return matrix
 
+    def sht_dot(
+        self, matrix, inverse=False, smoothing=None, oversample=2, lam=1e-6
+    ):
+        """
+        Dot the Spherical Harmonic Transform (SHT) matrix into ``matrix``.
+
+        This is equivalent to ``np.dot(map.sht_matrix(...), matrix)``, but
+        the transform is cached natively between calls and all the columns
+        of ``matrix`` are transformed in a single multi-threaded product,
+        without returning the SHT matrix itself. This is the fastest way to
+        transform a spectral map between its spherical harmonic and pixel
+        representations. For instance, the spectrum at every pixel is
+
+            .. code-block::python
+
+                a = np.reshape(map.spectral_map, (map.Ny, -1))
+                spectra = map.sht_dot(a, inverse=True)
+
+        Args:
+            matrix (ndarray): A vector of shape ``(npix,)`` or a matrix of
+                shape ``(npix, K)`` (or, if ``inverse`` is True, of shape
+                ``(Ny,)`` or ``(Ny, K)``).
+            inverse (bool, optional). If True, applies the inverse
+                transform, from spherical harmonic coefficients to pixels.
+                Default is False.
+            smoothing (float, optional): Gaussian smoothing strength
+                (forward SHT only). See :py:meth:`sht_matrix`.
+            oversample (int, optional): Factor by which to oversample the
+                pixelization grid. Default `2`.
+            lam (float, optional): Regularization parameter for the inverse
+                pixel transform. Default `1e-6`.
+
+        Returns:
+            The transformed vector or matrix.
+
+        .. note::
+            If ``matrix`` is a tensor, this method falls back to a dot
+            product with the (cached) SHT matrix.
+
+        """
+        if is_tensor(matrix):
+            return self._math.dot(
+                self.sht_matrix(
+                    inverse=inverse,
+                    smoothing=smoothing,
+                    oversample=oversample,
+                    lam=lam,
+                ),
+                matrix,
+            )
+        matrix = np.array(matrix)
+        vector = matrix.ndim == 1
+        _, _, x, y, z = self._map._get_pixel_grid(oversample)
+        res = self.ops.dot_pixel_transform(
+            x, y, z, 1.0, lam, matrix.reshape(matrix.shape[0], -1), inverse
+        )
+        if not inverse:
+            s = self._get_SHT_smoothing(smoothing)
+            if s is not None:
+                res *= s[:, None]
+        if vector:
+            res = res.reshape(-1)
+        return res
+
     def design_matrix(self, theta=None, fix_spectrum=False, fix_map=False):
         """
         Return the Doppler imaging design matrix.
@@ -1262,6 +1382,74 @@ class DopplerMap:
 
         return D
 
+    def design_operator(self, theta=None, fix_spectrum=False, fix_map=False):
+        """
+        Return the Doppler imaging design matrix as a linear operator.
+
+        This is a ``scipy.sparse.linalg.LinearOperator`` with the same
+        shape as the matrix returned by :py:meth:`design_matrix` whose
+        products with vectors and matrices (and those of its transpose)
+        are computed on the fly, without ever instantiating the design
+        matrix. Only the line broadening kernels at zero phase are kept in
+        memory; they are rotated to each epoch as needed. This makes it
+        possible to use iterative solvers on problems far too large for
+        the design matrix to fit in memory. Available in greedy mode only.
+
+        Args:
+            theta (vector, optional): The angular phase(s) at which to compute
+                the design matrix, in units of :py:attr:`angle_unit`. This
+                must be a vector of size :py:attr:`nt`. Default is uniformly
+                spaced values in the range ``[0, 2 * pi)``.
+            fix_spectrum (bool, optional): If True, returns the operator
+                for a fixed spectrum. Default is False.
+            fix_map (bool, optional): If True, returns the operator
+                for a fixed map. Default is False.
+
+        """
+        if self.lazy:
+            raise NotImplementedError(
+                "Matrix-free design operators are only available in "
+                "greedy mode."
+            )
+        theta = self._get_default_theta(theta)
+        assert not (
+            fix_spectrum and fix_map
+        ), "Cannot fix both the spectrum and the map."
+        args = (self._inc, theta, self._veq, self._u)
+
+        if fix_spectrum:
+            spectrum = self._spectrum
+            dot = lambda M, transpose: self.ops.dotD_fixed_spectrum(
+                *args, spectrum, M, transpose=transpose
+            )
+            ncols = self._nc * self._Ny
+        elif fix_map:
+            y = self._y
+            dot = lambda M, transpose: self.ops.dotD_fixed_map(
+                *args, y, M, transpose=transpose
+            )
+            ncols = self._nc * self._nw0_int
+        else:
+            dot = lambda M, transpose: self.ops.dotD(
+                *args, M, transpose=transpose
+            )
+            ncols = self._Ny * self._nw0_int
+
+        D = LinearOperator(
+            (self._nt * self._nw_int, ncols),
+            matvec=lambda v: dot(v, False)[:, 0],
+            rmatvec=lambda w: dot(w, True)[:, 0],
+            matmat=lambda V: dot(V, False),
+            rmatmat=lambda W: dot(W, True),
+            dtype=np.float64,
+        )
+
+        # Interpolate to the output grid
+        if self._interp:
+            D = aslinearoperator(self._Si2eBlk).dot(D)
+
+        return D
+
     def flux(self, theta=None, normalize=True, method="dotconv"):
         """
         Return the model for the full spectral timeseries.
@@ -1282,11 +1470,12 @@ class DopplerMap:
                 be one of ``dotconv``, ``convdot``, ``conv``, or ``design``.
                 Default is ``dotconv``, which is the fastest method in most
                 cases. All three of ``dotconv``, ``convdot``, and ``conv``
-                compute the flux via fast two-dimensional convolutions
-                (via ``conv2d``), while ``design`` computes the flux by
-                instantiating the design matrix and dotting it in. This last
-                method is usually extremely slow and memory intensive; its
-                use is not recommended in general.
+                compute the flux via fast native convolutions (direct or
+                FFT-based; see the ``conv_mode`` keyword of the map), while
+                ``design`` computes the flux by instantiating the design
+                matrix and dotting it in. This last method is usually
+                extremely slow and memory intensive; its use is not
+                recommended in general.
 
         This method returns a matrix of shape (:py:attr:`nt`, :py:attr:`nw`)
         corresponding to the model for the observed spectrum (evaluated on the
@@ -1328,6 +1517,42 @@ class DopplerMap:
 
         return flux
 
+    def validate_precision(self, theta=None):
+        """
+        Compare the mixed precision model to the double precision model.
+
+        This computes the (unnormalized) flux on the internal wavelength
+        grid with the mixed precision direct convolution (see the
+        ``precision`` keyword of the map) and in double precision, and
+        returns their difference along with its theoretical upper bound.
+        This can be used to check whether mixed precision is accurate
+        enough for a given dataset, e.g., by comparing the error to the
+        measurement uncertainty.
+
+        Args:
+            theta (vector, optional): The angular phase(s) at which to compute
+                the flux, in units of :py:attr:`angle_unit`. This
+                must be a vector of size :py:attr:`nt`. Default is uniformly
+                spaced values in the range ``[0, 2 * pi)``.
+
+        Returns:
+            A tuple of two matrices of shape (:py:attr:`nt`,
+            :py:attr:`nw_`): the error in the mixed precision flux and its
+            elementwise upper bound.
+
+        .. note::
+            This method is only available in greedy mode.
+
+        """
+        if self.lazy:
+            raise NotImplementedError(
+                "This method is only available in greedy mode."
+            )
+        theta = self._get_default_theta(theta)
+        return self.ops.validate_precision(
+            self._inc, theta, self._veq, self._u, self.spectral_map
+        )
+
     def baseline(self, theta=None, full=False):
         """
         Return the photometric baseline at each epoch.
@@ -1847,11 +2072,13 @@ class DopplerMap:
                 the solution. Default is `1e5`.
             spectral_maxiter (int, optional): Maximum number of iterations in
                 the L1 solver. Default is `100`.
-            spectral_eps (float, optional): Small parameter added to the
-                diagonal of the spectral covariance matrix for stability.
-                Default is `1e-12`.
+            spectral_eps (float, optional): Ignored; kept for backward
+                compatibility. The L1 solver (an alternating direction
+                method of multipliers) no longer needs to regularize the
+                spectral covariance matrix.
             spectral_tol (float, optional): Tolerance for termination of the
-                L1 iterative solver. Default is `1e-8`.
+                L1 iterative solver, on the squared change in the solution
+                between iterations. Default is `1e-8`.
             spectral_method (str, optional): Regularization method when solving
                 for the spectrum. Options are "L1" or "L2" (default). When
                 solving for both the spectrum and the map, the L1 solver is
@@ -1897,6 +2124,29 @@ class DopplerMap:
                 the odds that the solver converges to the global minimum.
                 Different problems in general require different settings for
                 these parameters, so fine tuning is usually required.
+            native (bool, optional): When solving for both the map and the
+                spectrum in greedy mode with diagonal priors and the "L2"
+                ``spectral_method``, use the native alternating least
+                squares solver, which solves each step with the conjugate
+                gradient method without instantiating the design matrices.
+                Default is True.
+            native_cov (bool, optional): Compute the factorized covariances
+                ``cho_ycov`` and ``cho_scov`` of the solution of the native
+                solver? This requires instantiating the dense design
+                matrices and solving the final linear problems once more,
+                so it is off by default, in which case both are None.
+                Default is False.
+            cg_tol (float, optional): Tolerance on the relative residual
+                of the conjugate gradient solves in the native solver.
+                Default is `1e-10`.
+            cg_maxiter (int, optional): Maximum number of iterations of each
+                conjugate gradient solve in the native solver. Default is
+                ten times the number of unknowns.
+            bilinear_tol (float, optional): The native solver stops early
+                once it reaches the final temperature and the relative
+                changes in both the map and the spectrum are smaller than
+                this value. The convergence history is returned in the
+                ``history`` entry of the solution. Default is `1e-8`.
             quiet (bool, optional): Suppress messages and progress bars?
                 Default is False.
 
@@ -31,6 +31,8 @@ class Solve:
         self.nc = map.nc
         self.interp = map._interp
         self.continuum_idx = map._continuum_idx
+        self.lazy = map.lazy
+        self.ops = map.ops
 
         # Methods and matrices
         if map.lazy:
@@ -56,6 +58,7 @@ class Solve:
             maxiter = tt.iscalar()
             eps = tt.dscalar()
             tol = tt.dscalar()
+            x0 = tt.dvector()
 
             # Design matrix conditioned on current spectrum
             f = map.ops.get_D_fixed_spectrum(inc, theta, veq, u, spectrum_)
@@ -101,8 +104,8 @@ class Solve:
 
             # LASSO solver
             self.L1 = theano.function(
-                [ATA, ATy, lam, maxiter, eps, tol],
-                map.ops.L1(ATA, ATy, lam, maxiter, eps, tol),
+                [ATA, ATy, lam, maxiter, eps, tol, x0],
+                map.ops.L1(ATA, ATy, lam, maxiter, eps, tol, x0),
             )
 
             # Interpolation matrices
@@ -129,24 +132,19 @@ class Solve:
 
             self._get_S = _get_S
 
-            # Design matrix dot product conditioned on current map
-            def _dotM(x):
+            # Design matrix dot product conditioned on current map,
+            # computed matrix-free with the kernels rotated on the fly
+            def _get_M():
                 map._y = self.y
-                return map.dot(
-                    x,
-                    theta=self.theta / map._angle_factor,
-                    fix_map=True,
-                    transpose=False,
+                return map.design_operator(
+                    theta=self.theta / map._angle_factor, fix_map=True
                 )
 
+            def _dotM(x):
+                return _get_M().dot(x)
+
             def _dotMT(x):
-                map._y = self.y
-                return map.dot(
-                    x,
-                    theta=self.theta / map._angle_factor,
-                    fix_map=True,
-                    transpose=True,
-                )
+                return _get_M().T.dot(x)
 
             self.dotM = _dotM
             self.dotMT = _dotMT
@@ -241,6 +239,11 @@ class Solve:
         logT0=None,
         logTf=None,
         nlogT=None,
+        native=True,
+        native_cov=False,
+        cg_tol=None,
+        cg_maxiter=None,
+        bilinear_tol=None,
         quiet=False,
     ):
         # --------------------------
@@ -278,6 +281,12 @@ class Solve:
             spectral_eps = 1e-12
         if spectral_tol is None:
             spectral_tol = 1e-8
+        if cg_tol is None:
+            cg_tol = 1e-10
+        if cg_maxiter is None:
+            cg_maxiter = 0
+        if bilinear_tol is None:
+            bilinear_tol = 1e-8
 
         # ----------------------
         # ---- Check shapes ----
@@ -459,6 +468,11 @@ class Solve:
         self.baseline_var = baseline_var
         self.fix_spectrum = fix_spectrum
         self.fix_map = fix_map
+        self.native = native
+        self.native_cov = native_cov
+        self.cg_tol = cg_tol
+        self.cg_maxiter = cg_maxiter
+        self.bilinear_tol = bilinear_tol
         self.quiet = quiet
 
         # Are we lucky enough to do a purely linear solve for the map?
@@ -665,7 +679,11 @@ class Solve:
             mean_flux = self.dotM(mu).reshape(-1)
             term = self.dotMT(np.dot(CInv, flux - mean_flux)).reshape(-1)
 
-            # Solve the L1 problem
+            # Solve the L1 problem, starting from the current spectrum
+            if self.spectrum_ is None:
+                x0 = np.zeros_like(mu)
+            else:
+                x0 = np.reshape(self.spectrum_, (-1,)) - mu
             spectrum_ = mu + self.L1(
                 KInv,
                 term,
@@ -673,6 +691,7 @@ class Solve:
                 self.spectral_maxiter,
                 np.array(self.spectral_eps),
                 np.array(self.spectral_tol),
+                x0,
             )
             choK = None
 
@@ -682,7 +701,10 @@ class Solve:
 
         # Store
         self.spectrum_ = np.reshape(spectrum_, (self.nc, self.nw0_))
-        self.cho_scov = cho_factor(cho_solve(choK, np.eye(choK.shape[0])))
+        if choK is None:
+            self.cho_scov = None
+        else:
+            self.cho_scov = cho_factor(cho_solve(choK, np.eye(choK.shape[0])))
 
     def solve_for_everything_bilinear(self):
         """
@@ -707,13 +729,26 @@ class Solve:
                 self.spectral_maxiter,
                 np.array(self.spectral_eps),
                 np.array(self.spectral_tol),
+                np.zeros_like(term),
             )
         else:
             self.spectrum_ = self.spectral_guess
         self.meta["spectrum_guess"] = self.spectrum_
 
-        # Assume a unit baseline guess
-        self.baseline = np.ones(self.nt)
+        # Assume a unit baseline guess if we don't know it
+        if self.baseline is None:
+            self.baseline = np.ones(self.nt)
+
+        # Use the native solver if we can
+        if (
+            self.native
+            and not self.lazy
+            and self.spatial_inv_cov.ndim == 2
+            and self.spectral_inv_cov.ndim == 2
+            and self.spectral_method.upper() == "L2"
+        ):
+            self.solve_for_everything_native()
+            return
 
         # Iterate
         for i in tqdm(range(len(self.T)), disable=self.quiet):
@@ -734,6 +769,80 @@ class Solve:
             # Solve for the spectrum
             self.solve_for_spectrum_linear()
 
+    def solve_for_everything_native(self):
+        """
+        Solve for both the map and the spectrum with the native
+        alternating least squares solver.
+
+        This performs the same iterations as the Python implementation
+        above, but solves each linear problem with the conjugate gradient
+        method (starting from the previous solution) using only products
+        of the design matrices with vectors. The factorized covariances
+        of the map and the spectrum require the dense design matrices,
+        so they are only computed if ``native_cov`` is True: once, at
+        the end, each conditioned on the solution for the other, as in
+        the last step of the Python implementation.
+
+        """
+        # Ensure the flux error is a matrix
+        if self.flux_err.ndim == 0:
+            flux_err = self.flux_err * np.ones((self.nt, self.nw))
+        else:
+            flux_err = self.flux_err
+
+        # Solve
+        y, spectrum_, baseline, history = self.ops.solve_bilinear(
+            self.inc,
+            self.theta,
+            self.veq,
+            self.u,
+            self.flux,
+            flux_err,
+            self.Si2eTr.T,
+            self.spatial_mean,
+            self.spatial_inv_cov,
+            self.spectral_mean,
+            self.spectral_inv_cov,
+            self.spectrum_,
+            self.baseline,
+            self.baseline_var,
+            self.T,
+            self.linear,
+            self.continuum_idx,
+            cg_tol=self.cg_tol,
+            cg_maxiter=self.cg_maxiter,
+            tol=self.bilinear_tol,
+        )
+
+        # Optionally compute the covariances at the solution
+        self.spectrum_ = spectrum_
+        self.baseline = baseline
+        if self.native_cov:
+            self._S = None
+            if self.linear:
+                self.solve_for_map_linear(T=self.T[-1])
+            else:
+                self.solve_for_map_linear(
+                    T=self.T[-1], baseline_var=self.baseline_var
+                )
+            self.y = y
+            self.solve_for_spectrum_linear()
+            self.spectrum_ = spectrum_
+            self._S = None
+        else:
+            self.cho_ycov = None
+            self.cho_scov = None
+
+        # Store
+        self.y = y
+        self.meta["history"] = {
+            "T": history[:, 0],
+            "dy": history[:, 1],
+            "dspectrum": history[:, 2],
+            "niter_y": history[:, 3].astype(int),
+            "niter_spectrum": history[:, 4].astype(int),
+        }
+
     def solve_bilinear(self, flux, theta, y, spectrum_, veq, inc, u, **kwargs):
         """
         Solve the linear problem for the spatial and/or spectral map
@@ -410,6 +410,24 @@ class System(object):
             be one of the following: ``0`` for a centered Riemann sum
             (equivalent to the "resampling" procedure suggested by Kipping 2010),
             ``1`` for the trapezoid rule, or ``2`` for Simpson’s rule.
+        adaptive (bool, optional): Integrate the exposure time adaptively?
+            If True, the phase curves of cadences far from any occultation
+            are integrated analytically, and only the cadences that may
+            contain an occultation or a contact point are integrated with
+            a three-point Simpson rule, which is refined until two
+            successive estimates agree to within ``tol`` or until
+            ``oversample`` points per exposure are reached. Phase curves
+            in reflected light and of oblate bodies have no closed form,
+            so all their cadences are integrated numerically. The ``order``
+            parameter is ignored in this case. Default is False.
+        tol (float, optional): The tolerance of the adaptive integration
+            scheme, relative to the largest entry of each row of the
+            design matrix. Default is ``1e-8``.
+        incremental (bool, optional): Cache the design matrix and, on
+            subsequent calls, re-compute only the blocks of the bodies whose
+            map or orbit changed, or which are occulted by a body whose orbit
+            changed. This is useful when sampling the parameters of one body
+            at a time. Greedy mode only. Default is False.
     """
 
     def _no_spectral(self):
@@ -427,6 +445,9 @@ class System(object):
         texp=None,
         oversample=7,
         order=0,
+        adaptive=False,
+        tol=1e-8,
+        incremental=False,
     ):
         # Units
         self.time_unit = time_unit
@@ -440,6 +461,9 @@ class System(object):
         assert self._oversample > 0, "Parameter `oversample` must be > 0."
         self._order = int(order)
         assert self._order in [0, 1, 2], "Invalid value for parameter `order`."
+        self._adaptive = bool(adaptive)
+        self._tol = float(tol)
+        assert self._tol > 0.0, "Parameter `tol` must be > 0."
 
         # Primary body
         assert (
@@ -457,6 +481,13 @@ class System(object):
             self._linalg = math.lazy_linalg
         else:
             self._linalg = math.greedy_linalg
+        self._incremental = bool(incremental)
+        assert not (
+            self._incremental and self._lazy
+        ), "Incremental evaluation is only available in greedy mode."
+        assert not (self._incremental and self._primary._map.nw is not None), (
+            "Incremental evaluation is not implemented for spectral maps."
+        )
 
         # Secondary bodies
         assert len(secondaries) > 0, "There must be at least one secondary."
@@ -515,8 +546,18 @@ class System(object):
             texp=self._texp,
             oversample=self._oversample,
             order=self._order,
+            adaptive=self._adaptive,
+            tol=self._tol,
         )
 
+        # Incremental evaluation cache
+        self._cache = None
+        self._block_inds = []
+        cur = 0
+        for body in self._bodies:
+            self._block_inds.append(cur + np.arange(body._map.ops.ncols))
+            cur += body._map.ops.ncols
+
         # Solve stuff
         self._flux = None
         self._C = None
@@ -547,6 +588,22 @@ class System(object):
         """
         return self._order
 
+    @property
+    def adaptive(self):
+        """Integrate the exposure time adaptively? *Read-only*"""
+        return self._adaptive
+
+    @property
+    def incremental(self):
+        """Re-compute only the blocks of the design matrix that changed?
+        *Read-only*"""
+        return self._incremental
+
+    @property
+    def tol(self):
+        """Tolerance of the adaptive exposure time integration. *Read-only*"""
+        return self._tol
+
     @property
     def time_unit(self):
         """An ``astropy.units`` unit defining the time metric for the system."""
@@ -592,7 +649,12 @@ class System(object):
     ):
         """Visualize the Keplerian system.
 
-        Note that the body surface intensities are not normalized.
+        All bodies are rasterized onto a common image with the native
+        compositor (see :py:meth:`render`), so their intensities are
+        weighted by their amplitudes and share a color scale. Reflected
+        light and oblate maps are not supported by the compositor; in
+        that case each body is rendered separately, and the body surface
+        intensities are not normalized.
 
         Args:
             t (scalar or vector): The time(s) at which to evaluate the orbit and
@@ -634,6 +696,23 @@ class System(object):
         # So we can evaluate stuff in lazy mode
         get_val = evaluator(**kwargs)
 
+        # Rasterize all bodies natively onto a common image if we can
+        if not (self._reflected or self._oblate):
+            image, x, y, z, r = self._render(t, res, window_pad, None, get_val)
+            return self._show_composite(
+                image,
+                x,
+                y,
+                z,
+                r,
+                cmap,
+                interval,
+                file,
+                figsize,
+                html5_video,
+                window_pad,
+            )
+
         # Render the maps & get the orbital positions
         if self._rv:
             self._primary.map._set_RV_filter()
@@ -844,6 +923,99 @@ class System(object):
 
                 return img + circ
 
+        else:
+
+            updatefig = None
+
+        self._show_figure(fig, updatefig, nframes, interval, file, html5_video)
+
+        if self._rv:
+            self._primary.map._unset_RV_filter()
+            for sec in self._secondaries:
+                sec.map._unset_RV_filter()
+
+    def _show_composite(
+        self,
+        image,
+        x,
+        y,
+        z,
+        r,
+        cmap,
+        interval,
+        file,
+        figsize,
+        html5_video,
+        window_pad,
+    ):
+        """Display the composite images returned by :py:meth:`_render`."""
+        nframes = image.shape[0]
+        animated = nframes > 1
+
+        # Set up the plot
+        fig, ax = plt.subplots(1, figsize=figsize)
+        ax.axis("off")
+        lim = 1.0 + window_pad
+        ax.set_xlim(-lim, lim)
+        ax.set_ylim(-lim, lim)
+
+        # Render the first frame
+        img = ax.imshow(
+            image[0],
+            origin="lower",
+            extent=(-lim, lim, -lim, lim),
+            cmap=cmap,
+            interpolation="none",
+            vmin=np.nanmin(image),
+            vmax=np.nanmax(image),
+            animated=animated,
+            zorder=0.0,
+        )
+
+        # Outline the bodies, except when they are hidden behind the
+        # primary (the primary is body `0`, at the origin)
+        def hidden(k, n):
+            return (k > 0) and (z[n, k] < 0) and (
+                x[n, k] ** 2 + y[n, k] ** 2 < (1.0 - r[k]) ** 2
+            )
+
+        circ = []
+        for k in range(len(r)):
+            circ.append(
+                plt.Circle(
+                    (x[0, k], y[0, k]),
+                    r[k],
+                    color="k",
+                    fill=False,
+                    zorder=1.0,
+                    lw=2,
+                    visible=not hidden(k, 0),
+                )
+            )
+            ax.add_artist(circ[k])
+
+        # Animation
+        if animated:
+
+            def updatefig(n):
+                img.set_array(image[n])
+                for k in range(len(r)):
+                    circ[k].center = (x[n, k], y[n, k])
+                    circ[k].set_visible(not hidden(k, n))
+                return [img] + circ
+
+        else:
+
+            updatefig = None
+
+        self._show_figure(fig, updatefig, nframes, interval, file, html5_video)
+
+    def _show_figure(
+        self, fig, updatefig, nframes, interval, file, html5_video
+    ):
+        """Save or display the figure (animated if ``updatefig`` is set)."""
+        if updatefig is not None:
+
             ani = FuncAnimation(
                 fig, updatefig, interval=interval, blit=False, frames=nframes
             )
@@ -887,11 +1059,171 @@ class System(object):
             else:  # pragma: no cover
                 plt.show()
 
+    def render(self, t, res=300, window_pad=1.0, out=None, **kwargs):
+        """Render all bodies in the system onto a common image.
+
+        The maps are rasterized in C++ directly onto the image, with the
+        bodies closer to the observer occulting the ones behind them.
+        Unlike :py:meth:`show`, the intensities of all bodies are
+        weighted by their amplitudes, so they are on the same scale.
+
+        Args:
+            t (scalar or vector): The time(s) at which to render the system
+                in units of :py:attr:`time_unit`.
+            res (int, optional): The resolution of the image in pixels on a
+                side. Defaults to 300.
+            window_pad (float, optional): Padding around the primary in units
+                of the primary radius. Bodies outside of this window will be
+                cropped. Default is 1.0.
+            out (ndarray, optional): A writeable, C-contiguous ``float64``
+                array of shape ``(nt, res, res)`` into which the image is
+                rendered. If not provided, a new array is allocated.
+
+        Returns:
+            An array of shape ``(nt, res, res)`` (``out``, if provided).
+            The image spans ``[-1 - window_pad, 1 + window_pad]`` in units
+            of the primary radius along both axes, with the origin at the
+            lower left. Pixels not covered by any body are ``NaN``.
+
+        .. note::
+            This method is not implemented for reflected light or oblate
+            maps.
+        """
+        # Not yet implemented
+        if self._primary._map.nw is not None:  # pragma: no cover
+            raise NotImplementedError(
+                "Method not implemented for spectral maps."
+            )
+        elif self._reflected or self._oblate:  # pragma: no cover
+            raise NotImplementedError(
+                "Method not implemented for reflected light or oblate maps."
+            )
+
+        image, _, _, _, _ = self._render(
+            t, res, window_pad, out, evaluator(**kwargs)
+        )
+        return image
+
+    def _render(self, t, res, window_pad, out, get_val):
+        """Rasterize all bodies with the native compositor.
+
+        Returns the image and the positions ``x``, ``y``, and ``z`` of all
+        bodies, of shape ``(nt, nbody)``, and their radii, all in units of
+        the primary radius. Body ``0`` is the primary.
+        """
+        # Get the orbital positions & the sky-frame polynomials
+        if self._rv:
+            self._primary.map._set_RV_filter()
+            for sec in self._secondaries:
+                sec.map._set_RV_filter()
+        x, y, z, *p = self.ops.render_poly(
+            self._math.reshape(self._math.to_array_or_tensor(t), [-1])
+            * self._time_factor,
+            self._primary._m,
+            self._primary._prot,
+            self._primary._t0,
+            self._primary._theta0,
+            self._primary._map._amp,
+            getattr(
+                self._primary._map,
+                "_inc",
+                self._math.to_array_or_tensor(0.5 * np.pi),
+            ),
+            getattr(
+                self._primary._map, "_obl", self._math.to_array_or_tensor(0.0)
+            ),
+            self._primary._map._y,
+            self._primary._map._u,
+            self._primary._map._f,
+            self._math.to_array_or_tensor(
+                [sec._m for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._prot for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._t0 for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._theta0 for sec in self._secondaries]
+            ),
+            self._get_periods(),
+            self._math.to_array_or_tensor(
+                [sec._ecc for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._w for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._Omega for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._inc for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._map._amp for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [
+                    getattr(
+                        sec._map,
+                        "_inc",
+                        self._math.to_array_or_tensor(0.5 * np.pi),
+                    )
+                    for sec in self._secondaries
+                ]
+            ),
+            self._math.to_array_or_tensor(
+                [
+                    getattr(
+                        sec._map, "_obl", self._math.to_array_or_tensor(0.0)
+                    )
+                    for sec in self._secondaries
+                ]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._map._y for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._map._u for sec in self._secondaries]
+            ),
+            self._math.to_array_or_tensor(
+                [sec._map._f for sec in self._secondaries]
+            ),
+        )
         if self._rv:
             self._primary.map._unset_RV_filter()
             for sec in self._secondaries:
                 sec.map._unset_RV_filter()
 
+        # Evaluate if needed
+        x = get_val(x)
+        y = get_val(y)
+        z = get_val(z)
+        p = [get_val(pk) for pk in p]
+        r = np.append(
+            get_val(self._primary._r),
+            get_val(
+                self._math.to_array_or_tensor(
+                    [sec._r for sec in self._secondaries]
+                )
+            ),
+        )
+
+        # Rasterize in units of the primary radius
+        x, y, z, r = x / r[0], y / r[0], z / r[0], r / r[0]
+        image = self.ops.composite(
+            p,
+            x,
+            y,
+            z,
+            r,
+            res,
+            (-1.0 - window_pad, 1.0 + window_pad) * 2,
+            out=out,
+        )
+        return image, np.atleast_2d(x), np.atleast_2d(y), np.atleast_2d(z), r
+
     def design_matrix(self, t):
         """Compute the system flux design matrix at times ``t``.
 
@@ -911,7 +1243,14 @@ class System(object):
             t (scalar or vector): An array of times at which to evaluate
                 the design matrix in units of :py:attr:`time_unit`.
         """
-        return self.ops.X(
+        args = self._design_matrix_args(t)
+        if self._incremental:
+            return self._design_matrix_incremental(*args)
+        else:
+            return self.ops.X(*args)
+
+    def _design_matrix_args(self, t):
+        return (
             self._math.reshape(self._math.to_array_or_tensor(t), [-1])
             * self._time_factor,
             self._primary._r,
@@ -1002,18 +1341,180 @@ class System(object):
             ),
         )
 
-    def flux(self, t, total=True, integrated=False):
-        """Compute the system flux at times ``t``.
+    def _design_matrix_incremental(
+        self,
+        t,
+        pri_r,
+        pri_m,
+        pri_prot,
+        pri_t0,
+        pri_theta0,
+        pri_amp,
+        pri_inc,
+        pri_obl,
+        pri_fproj,
+        pri_u,
+        pri_f,
+        sec_r,
+        sec_m,
+        sec_prot,
+        sec_t0,
+        sec_theta0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_iorb,
+        sec_amp,
+        sec_inc,
+        sec_obl,
+        sec_u,
+        sec_f,
+        sec_sigr,
+    ):
+        """Re-compute only the blocks of the design matrix that changed.
 
-        Args:
-            t (scalar or vector): An array of times at which to evaluate
-                the flux in units of :py:attr:`time_unit`.
-            total (bool, optional): Return the total system flux? Defaults to
-                True. If False, returns arrays corresponding to the flux
-                from each body.
+        The block of each body depends on the parameters of its map, on
+        its orbit, and on the orbits of the bodies that occult it. We
+        keep the design matrix from the previous call and re-compute
+        only the blocks for which any of these changed.
         """
-        X = self.design_matrix(t)
+        nsec = len(self._secondaries)
+        args = (
+            pri_r,
+            pri_m,
+            pri_prot,
+            pri_t0,
+            pri_theta0,
+            pri_amp,
+            pri_inc,
+            pri_obl,
+            pri_fproj,
+            pri_u,
+            pri_f,
+            sec_r,
+            sec_m,
+            sec_prot,
+            sec_t0,
+            sec_theta0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+            sec_amp,
+            sec_inc,
+            sec_obl,
+            sec_u,
+            sec_f,
+            sec_sigr,
+        )
+
+        def signature(*params):
+            return tuple(np.asarray(p, dtype=float).tobytes() for p in params)
+
+        # The parameters each block depends on
+        maps = [
+            signature(
+                pri_prot,
+                pri_t0,
+                pri_theta0,
+                pri_amp,
+                pri_inc,
+                pri_obl,
+                pri_fproj,
+                pri_u,
+                pri_f,
+            )
+        ] + [
+            signature(
+                # In reflected light, the primary's amplitude scales the
+                # illumination of every secondary
+                pri_amp if self._reflected else 1.0,
+                sec_prot[k],
+                sec_theta0[k],
+                sec_amp[k],
+                sec_inc[k],
+                sec_obl[k],
+                sec_u[k],
+                sec_f[k],
+                sec_sigr[k],
+            )
+            for k in range(nsec)
+        ]
+        orbits = [signature(pri_r, pri_m)] + [
+            signature(
+                sec_r[k],
+                sec_m[k],
+                sec_t0[k],
+                sec_porb[k],
+                sec_ecc[k],
+                sec_w[k],
+                sec_Omega[k],
+                sec_iorb[k],
+            )
+            for k in range(nsec)
+        ]
+        occultors = self.ops.occultors(
+            t,
+            pri_r,
+            pri_m,
+            sec_r,
+            sec_m,
+            sec_t0,
+            sec_porb,
+            sec_ecc,
+            sec_w,
+            sec_Omega,
+            sec_iorb,
+        )
 
+        # Determine which blocks changed
+        cache = self._cache
+        if cache is None or not np.array_equal(cache["t"], t):
+            dirty = np.ones(nsec + 1, dtype=bool)
+        else:
+            moved = np.array(
+                [orbit != old for orbit, old in zip(orbits, cache["orbits"])]
+            )
+            if not np.array_equal(pri_m, cache["pri_m"]):
+                # All secondaries move if the primary mass changes
+                moved[:] = True
+            dirty = np.array(
+                [
+                    (maps[k] != cache["maps"][k])
+                    or moved[k]
+                    or moved[list(occultors[k] | cache["occultors"][k])].any()
+                    for k in range(nsec + 1)
+                ]
+            )
+            if self._reflected:
+                # The illumination depends on the position and radius
+                # of the primary (its amplitude is in each signature)
+                dirty[1:] |= moved[0]
+
+        # Re-compute them
+        if cache is None:
+            X = self.ops.X_blocks(t, *args, dirty.astype(float))
+        else:
+            X = np.array(cache["X"])
+            if dirty.any():
+                Xd = self.ops.X_blocks(t, *args, dirty.astype(float))
+                for k in np.flatnonzero(dirty):
+                    X[:, self._block_inds[k]] = Xd[:, self._block_inds[k]]
+
+        self._cache = dict(
+            t=np.array(t),
+            pri_m=np.array(pri_m),
+            maps=maps,
+            orbits=orbits,
+            occultors=occultors,
+            X=X,
+        )
+        return np.array(X)
+
+    def _get_weighted_ylms(self):
+        """Return the list of amplitude-weighted Ylm vectors of all bodies."""
         # Weight the ylms by amplitude
         if self._reflected:
             # If we're doing reflected light, scale the amplitude of
@@ -1043,6 +1544,21 @@ class System(object):
         else:
             ay = [body.map.amp * body._map._y for body in self._bodies]
 
+        return ay
+
+    def flux(self, t, total=True, integrated=False):
+        """Compute the system flux at times ``t``.
+
+        Args:
+            t (scalar or vector): An array of times at which to evaluate
+                the flux in units of :py:attr:`time_unit`.
+            total (bool, optional): Return the total system flux? Defaults to
+                True. If False, returns arrays corresponding to the flux
+                from each body.
+        """
+        X = self.design_matrix(t)
+        ay = self._get_weighted_ylms()
+
         if total:
             ay = self._math.concatenate(ay)
             if integrated and self.primary.map.nw is not None:
@@ -1075,6 +1591,226 @@ class System(object):
                     for i, idx in enumerate(inds)
                 ]
 
+    def flux_batch(self, t, primary=None, secondaries=None):
+        """Compute the total flux of a batch of systems at times ``t``.
+
+        All systems in the batch share the configuration of this one (the
+        number of bodies, their map degrees, the integration settings, etc.)
+        but may differ in any of their parameters. The parameters that vary
+        across the batch are specified as arrays whose leading dimension is
+        the batch size; all others are taken from the current state of the
+        bodies. The entire batch is evaluated in a single native call,
+        parallelized over the systems (or, for reflected light, oblate, and
+        adaptively integrated systems, in a single compiled function).
+        Greedy mode only.
+
+        Args:
+            t (vector): An array of times at which to evaluate the flux in
+                units of :py:attr:`time_unit`.
+            primary (dict, optional): A dictionary mapping the names of
+                attributes of the primary (e.g., ``"r"``) to arrays of
+                values, one per system, in the units of the corresponding
+                attribute. The names ``"map.amp"``, ``"map.inc"``, and
+                ``"map.obl"`` refer to attributes of the body's map,
+                ``"map.y"`` refers to all of its spherical harmonic
+                coefficients except ``Y_{0,0}``, and ``"map.u"`` refers to
+                all of its limb darkening coefficients except ``u_0``.
+            secondaries (list, optional): A list of such dictionaries (or
+                ``None``), one per secondary.
+
+        Returns:
+            A matrix of shape ``(nbatch, nt)``.
+        """
+        self._no_spectral()
+        assert not self._lazy, "Method only available in greedy mode."
+        if secondaries is None:
+            secondaries = [None for sec in self._secondaries]
+        assert len(secondaries) == len(
+            self._secondaries
+        ), "There must be one entry in `secondaries` per secondary."
+        params = [primary or {}] + [p or {} for p in secondaries]
+        nbatch = set(len(v) for p in params for v in p.values())
+        assert len(nbatch) <= 1, "All parameters must have the same length."
+        nbatch = nbatch.pop() if len(nbatch) else 1
+
+        # The parameters of all bodies for each system, in internal units
+        bodies = [
+            self._batch_params(body, p, nbatch)
+            for body, p in zip(self._bodies, params)
+        ]
+        pri, secs = bodies[0], bodies[1:]
+        for sec in secs:
+            if sec["porb"] is None:
+                sec["porb"] = (
+                    (2 * np.pi)
+                    * sec["a"] ** (3 / 2)
+                    / np.sqrt(G_grav * (pri["m"] + sec["m"]))
+                )
+
+        # Amplitude-weighted Ylms
+        ay = [body["amp"][:, None] * body["y"] for body in bodies]
+        if self._reflected:
+            ay = [ay[0]] + [pri["amp"][:, None] * y for y in ay[1:]]
+        t = np.array(t, dtype=np.float64).reshape(-1) * self._time_factor
+
+        # Evaluate all systems at once
+        if not (
+            self._reflected
+            or self._oblate
+            or (self.ops.texp != 0.0 and self.ops.adaptive)
+        ):
+
+            def stack(name):
+                return np.array([body[name] for body in bodies]).T
+
+            return self.ops.flux_batch(
+                t,
+                *[
+                    stack(name)
+                    for name in (
+                        "r",
+                        "m",
+                        "prot",
+                        "t0",
+                        "theta0",
+                        "porb",
+                        "ecc",
+                        "w",
+                        "Omega",
+                        "iorb",
+                        "inc",
+                        "obl",
+                    )
+                ],
+                [body["u"] for body in bodies],
+                [body["f"] for body in bodies],
+                ay,
+            )
+        else:
+
+            def stack(name):
+                return np.moveaxis(np.array([sec[name] for sec in secs]), 0, 1)
+
+            return self.ops.flux_batch_scan(
+                t,
+                pri["r"],
+                pri["m"],
+                pri["prot"],
+                pri["t0"],
+                pri["theta0"],
+                np.ones(nbatch),  # we treat `amp` separately in `ay`
+                pri["inc"],
+                pri["obl"],
+                pri["fproj"],
+                pri["u"],
+                np.tile(pri["f"], (nbatch, 1)),
+                stack("r"),
+                stack("m"),
+                stack("prot"),
+                stack("t0"),
+                stack("theta0"),
+                stack("porb"),
+                stack("ecc"),
+                stack("w"),
+                stack("Omega"),
+                stack("iorb"),
+                np.ones((nbatch, len(secs))),
+                stack("inc"),
+                stack("obl"),
+                stack("u"),
+                np.tile([sec["f"] for sec in secs], (nbatch, 1, 1)),
+                stack("sigr"),
+                np.hstack(ay),
+            )
+
+    def _batch_params(self, body, params, nbatch):
+        """Return the parameters of ``body`` for each of the ``nbatch``
+        systems of a batch in internal units, given the dictionary
+        ``params`` of the ones that vary across the batch (see
+        :py:meth:`flux_batch`)."""
+        factors = {
+            "r": body._length_factor,
+            "m": body._mass_factor,
+            "prot": body._time_factor,
+            "t0": body._time_factor,
+            "theta0": body._angle_factor,
+            "map.amp": 1.0,
+            "map.inc": body._angle_factor,
+            "map.obl": body._angle_factor,
+            "map.y": 1.0,
+            "map.u": 1.0,
+        }
+        if body is not self._primary:
+            factors.update(
+                porb=body._time_factor,
+                a=body._length_factor,
+                ecc=1.0,
+                w=body._angle_factor,
+                omega=body._angle_factor,
+                Omega=body._angle_factor,
+                inc=body._angle_factor,
+            )
+        for name in params:
+            if name not in factors:
+                raise ValueError(
+                    "Parameter `{}` cannot be varied in a batch.".format(name)
+                )
+        params = dict(params)
+        if "omega" in params:
+            params["w"] = params.pop("omega")
+
+        def get(name, default):
+            if name in params:
+                value = np.array(params[name], dtype=np.float64)
+                return value * factors[name] * np.ones(nbatch)
+            else:
+                return float(default) * np.ones(nbatch)
+
+        def coeffs(name, default):
+            default = np.array(default, dtype=np.float64)
+            value = np.tile(default, (nbatch, 1))
+            if name in params:
+                value[:, 1:] = np.reshape(params[name], (nbatch, -1))
+            return value
+
+        map = body._map
+        batch = dict(
+            r=get("r", body._r),
+            m=get("m", body._m),
+            prot=get("prot", body._prot),
+            t0=get("t0", body._t0),
+            theta0=get("theta0", body._theta0),
+            amp=get("map.amp", map.amp),
+            inc=get("map.inc", getattr(map, "_inc", 0.5 * np.pi)),
+            obl=get("map.obl", getattr(map, "_obl", 0.0)),
+            u=coeffs("map.u", map._u),
+            f=np.array(map._f, dtype=np.float64),
+            y=coeffs("map.y", map._y),
+            sigr=float(getattr(map, "_sigr", 0.0)) * np.ones(nbatch),
+        )
+        if hasattr(map, "_fobl"):
+            batch["fproj"] = 1 - np.sqrt(
+                1 - map._fobl * (2 - map._fobl) * np.sin(batch["inc"]) ** 2
+            )
+        else:
+            batch["fproj"] = np.zeros(nbatch)
+
+        # Orbital elements (the primary's are never used)
+        if body is self._primary:
+            for name in ("porb", "ecc", "w", "Omega", "iorb"):
+                batch[name] = np.zeros(nbatch)
+        else:
+            batch["ecc"] = get("ecc", body._ecc)
+            batch["w"] = get("w", body._w)
+            batch["Omega"] = get("Omega", body._Omega)
+            batch["iorb"] = get("inc", body._inc)
+            if "porb" in params or ("a" not in params and body._porb):
+                batch["porb"] = get("porb", body._porb)
+            else:
+                batch["a"] = get("a", body._a)
+                batch["porb"] = None
+        return batch
+
     def rv(self, t, keplerian=True, total=True):
         """Compute the observed radial velocity of the system at times ``t``.
 
@@ -1315,12 +2051,13 @@ class System(object):
 
         Args:
             flux (vector): The observed system light curve.
-            C (scalar, vector, or matrix): The data covariance. This may be
-                a scalar, in which case the noise is assumed to be
-                homoscedastic, a vector, in which case the covariance
-                is assumed to be diagonal, or a matrix specifying the full
-                covariance of the dataset. Default is None. Either `C` or
-                `cho_C` must be provided.
+            C (scalar, vector, matrix, or StructuredCovariance): The data
+                covariance. This may be a scalar, in which case the noise is
+                assumed to be homoscedastic, a vector, in which case the
+                covariance is assumed to be diagonal, a matrix specifying the
+                full covariance of the dataset, or one of the structured
+                covariances in :py:mod:`starry.linalg`. Default is None.
+                Either `C` or `cho_C` must be provided.
             cho_C (matrix): The lower Cholesky factorization of the data
                 covariance matrix. Defaults to None. Either `C` or
                 `cho_C` must be provided.
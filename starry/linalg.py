@@ -1,8 +1,21 @@
 # -*- coding: utf-8 -*-
 from ._core import math
+from ._core.math import (
+    BandedCovariance,
+    SemiseparableCovariance,
+    LowRankCovariance,
+)
 from . import config
 import numpy as np
 
+__all__ = [
+    "solve",
+    "lnlike",
+    "BandedCovariance",
+    "SemiseparableCovariance",
+    "LowRankCovariance",
+]
+
 
 def solve(
     design_matrix,
@@ -15,6 +28,9 @@ def solve(
     cho_L=None,
     N=None,
     lazy=None,
+    method="direct",
+    tol=1e-10,
+    maxiter=None,
 ):
     """
     Solve the generalized least squares (GLS) problem.
@@ -23,12 +39,16 @@ def solve(
         design_matrix (matrix): The design matrix that transforms a vector
             from coefficient space to data space.
         data (vector): The observed dataset.
-        C (scalar, vector, or matrix): The data covariance. This may be
-            a scalar, in which case the noise is assumed to be
-            homoscedastic, a vector, in which case the covariance
-            is assumed to be diagonal, or a matrix specifying the full
-            covariance of the dataset. Default is None. Either `C` or
-            `cho_C` must be provided.
+        C (scalar, vector, matrix, or StructuredCovariance): The data
+            covariance. This may be a scalar, in which case the noise is
+            assumed to be homoscedastic, a vector, in which case the
+            covariance is assumed to be diagonal, a matrix specifying the
+            full covariance of the dataset, or an instance of
+            :py:class:`BandedCovariance`, :py:class:`SemiseparableCovariance`,
+            or :py:class:`LowRankCovariance`, in which case the solve is
+            performed in linear time without instantiating the full
+            covariance. Default is None. Either `C` or `cho_C` must be
+            provided.
         cho_C (matrix): The lower Cholesky factorization of the data
             covariance matrix. Defaults to None. Either `C` or
             `cho_C` must be provided.
@@ -45,11 +65,24 @@ def solve(
             `cho_L` must be provided.
         N (int, optional): The number of regression coefficients. This is
             necessary only if both ``mu`` and ``L`` are provided as scalars.
+        method (str, optional): The solver, either ``direct`` or ``cg``.
+            The latter uses the preconditioned conjugate gradient method,
+            which only requires products of the design matrix with vectors,
+            so ``design_matrix`` may be a
+            ``scipy.sparse.linalg.LinearOperator``. It is only available
+            in greedy mode and does not compute the posterior covariance.
+            Default is ``direct``.
+        tol (float, optional): The relative tolerance of the conjugate
+            gradient solver. Default is ``1e-10``.
+        maxiter (int, optional): The maximum number of iterations of the
+            conjugate gradient solver. Default is ten times the number
+            of coefficients.
 
     Returns:
         A tuple containing the posterior mean for the regression \
         coefficients (a vector) and the Cholesky factorization \
-        of the posterior covariance (a lower triangular matrix).
+        of the posterior covariance (a lower triangular matrix), which \
+        is ``None`` if ``method`` is ``cg``.
 
     """
     if lazy is None:
@@ -61,7 +94,10 @@ def solve(
         _math = math.greedy_math
         _linalg = math.greedy_linalg
 
-    design_matrix = _math.cast(design_matrix)
+    if method == "direct":
+        design_matrix = _math.cast(design_matrix)
+    elif method != "cg":
+        raise ValueError("Invalid value for `method`.")
     data = _math.cast(data)
     C = _linalg.Covariance(C, cho_C, N=data.shape[0])
     mu = _math.cast(mu)
@@ -85,7 +121,18 @@ def solve(
     if mu.ndim == 0:
         mu = mu * _math.ones(N)
     L = _linalg.Covariance(L, cho_L, N=N)
-    return _linalg.solve(design_matrix, data, C.cholesky, mu, L.inverse)
+    if method == "cg":
+        return _linalg.solve_cg(
+            design_matrix,
+            data,
+            C.inverse,
+            mu,
+            L.inverse,
+            tol=tol,
+            maxiter=maxiter,
+        )
+    else:
+        return _linalg.solve(design_matrix, data, C.cholesky, mu, L.inverse)
 
 
 def lnlike(
@@ -108,11 +155,18 @@ def lnlike(
         design_matrix (matrix): The design matrix that transforms a vector
             from coefficient space to data space.
         data (vector): The observed dataset.
-        C (scalar, vector, or matrix): The data covariance. This may be
-            a scalar, in which case the noise is assumed to be
-            homoscedastic, a vector, in which case the covariance
-            is assumed to be diagonal, or a matrix specifying the full
-            covariance of the dataset. Default is None. Either `C` or
+        C (scalar, vector, matrix, or StructuredCovariance): The data
+            covariance. This may be a scalar, in which case the noise is
+            assumed to be homoscedastic, a vector, in which case the
+            covariance is assumed to be diagonal, a matrix specifying the
+            full covariance of the dataset, or an instance of
+            :py:class:`BandedCovariance`, :py:class:`SemiseparableCovariance`,
+            or :py:class:`LowRankCovariance`, in which case the solve is
+            performed in linear time without instantiating the full
+            covariance. In lazy mode, the likelihood may be differentiated
+            with respect to the parameters of banded and low-rank
+            covariances, but not (yet) with respect to those of
+            semiseparable covariances. Default is None. Either `C` or
             `cho_C` must be provided.
         cho_C (matrix): The lower Cholesky factorization of the data
             covariance matrix. Defaults to None. Either `C` or
@@ -29,6 +29,7 @@ from mpl_toolkits.axes_grid1 import make_axes_locatable
 from IPython.display import HTML
 from astropy import units
 from scipy.ndimage import zoom
+from scipy.sparse.linalg import LinearOperator
 import os
 import sys
 import logging
@@ -759,12 +760,13 @@ class MapBase(object):
 
         Args:
             flux (vector): The observed light curve.
-            C (scalar, vector, or matrix): The data covariance. This may be
-                a scalar, in which case the noise is assumed to be
-                homoscedastic, a vector, in which case the covariance
-                is assumed to be diagonal, or a matrix specifying the full
-                covariance of the dataset. Default is None. Either `C` or
-                `cho_C` must be provided.
+            C (scalar, vector, matrix, or StructuredCovariance): The data
+                covariance. This may be a scalar, in which case the noise is
+                assumed to be homoscedastic, a vector, in which case the
+                covariance is assumed to be diagonal, a matrix specifying the
+                full covariance of the dataset, or one of the structured
+                covariances in :py:mod:`starry.linalg`. Default is None.
+                Either `C` or `cho_C` must be provided.
             cho_C (matrix): The lower Cholesky factorization of the data
                 covariance matrix. Defaults to None. Either `C` or
                 `cho_C` must be provided.
@@ -819,7 +821,26 @@ class MapBase(object):
         self._mu = None
         self._L = None
 
-    def solve(self, *, design_matrix=None, **kwargs):
+    def _design_operator(self, **kwargs):
+        raise NotImplementedError(
+            "Matrix-free solves are not implemented for this map type."
+        )
+
+    def _normal_matrices(self, CInv, flux, **kwargs):
+        raise NotImplementedError(
+            "Matrix-free solves are not implemented for this map type."
+        )
+
+    def solve(
+        self,
+        *,
+        design_matrix=None,
+        method="direct",
+        tol=1e-10,
+        maxiter=None,
+        lam=None,
+        **kwargs
+    ):
         """Solve the linear least-squares problem for the posterior over maps.
 
         This method solves the generalized least squares problem given a
@@ -832,13 +853,45 @@ class MapBase(object):
             design_matrix (matrix, optional): The flux design matrix, the
                 quantity returned by :py:meth:`design_matrix`. Default is
                 None, in which case this is computed based on ``kwargs``.
+                If ``method`` is ``cg``, this may also be a
+                ``scipy.sparse.linalg.LinearOperator``. Ignored if
+                ``method`` is ``streaming``.
+            method (str, optional): The solver, one of ``direct``,
+                ``streaming``, ``cg``, or ``l1``. The ``streaming`` solver
+                accumulates the normal equation matrices over chunks of
+                the light curve, so the memory footprint is independent of
+                the number of cadences; it requires a scalar or diagonal
+                data covariance. The ``cg`` solver uses the preconditioned
+                conjugate gradient method with only products of the design
+                matrix and vectors, which are computed on the fly without
+                ever storing the design matrix; it does not compute the
+                posterior covariance. Both are useful for high-degree maps
+                and long light curves but are only available in greedy
+                mode. The ``l1`` solver adds a Laplace prior with
+                regularization parameter ``lam`` on the deviations of the
+                coefficients from the prior mean, which favors sparse
+                solutions; it is solved natively with the alternating
+                direction method of multipliers, warm-started at the
+                previous solution (if any). It also does not compute the
+                posterior covariance and is only available in greedy mode.
+                Default is ``direct``.
+            tol (float, optional): The relative tolerance of the conjugate
+                gradient solver, or the tolerance on the squared change in
+                the solution between iterations of the L1 solver. Default
+                is ``1e-10``.
+            maxiter (int, optional): The maximum number of iterations of the
+                conjugate gradient or L1 solvers. Default is ten times the
+                number of coefficients.
+            lam (float, optional): The L1 regularization parameter. Required
+                if ``method`` is ``l1``.
             kwargs (optional): Keyword arguments to be passed directly to
                 :py:meth:`design_matrix`, if a design matrix is not provided.
 
         Returns:
             A tuple containing the posterior mean for the amplitude-weighted \
             spherical harmonic coefficients (a vector) and the Cholesky factorization \
-            of the posterior covariance (a lower triangular matrix).
+            of the posterior covariance (a lower triangular matrix), which
+            is ``None`` if ``method`` is ``cg`` or ``l1``.
 
         .. note::
             Users may call :py:meth:`draw` to draw from the
@@ -853,15 +906,59 @@ class MapBase(object):
         elif self._mu is None or self._L is None:
             raise ValueError("Please provide a prior with `set_prior()`.")
 
-        # Get the design matrix & remove any amplitude weighting
-        if design_matrix is None:
-            design_matrix = self.design_matrix(**kwargs)
-        X = self._math.cast(design_matrix)
-
         # Compute the MAP solution
-        self._solution = self._linalg.solve(
-            X, self._flux, self._C.cholesky, self._mu, self._L.inverse
-        )
+        if method == "cg":
+            if design_matrix is None:
+                design_matrix = self._design_operator(**kwargs)
+            self._solution = self._linalg.solve_cg(
+                design_matrix,
+                self._flux,
+                self._C.inverse,
+                self._mu,
+                self._L.inverse,
+                tol=tol,
+                maxiter=maxiter,
+            )
+        elif method == "l1":
+            if lam is None:
+                raise ValueError(
+                    "Please provide the regularization parameter `lam`."
+                )
+            if design_matrix is None:
+                design_matrix = self.design_matrix(**kwargs)
+            x0 = None if self._solution is None else self._solution[0]
+            self._solution = self._linalg.solve_l1(
+                design_matrix,
+                self._flux,
+                self._C.inverse,
+                self._mu,
+                self._L.inverse,
+                lam,
+                tol=tol,
+                maxiter=maxiter,
+                x0=x0,
+            )
+        elif method == "streaming":
+            if self._C.kind not in ["scalar", "vector"]:
+                raise ValueError(
+                    "The streaming solver requires a scalar or diagonal "
+                    "data covariance."
+                )
+            XTCInvX, XTCInvf = self._normal_matrices(
+                self._C.inverse, self._flux, **kwargs
+            )
+            self._solution = self._linalg.solve_normal(
+                XTCInvX, XTCInvf, self._mu, self._L.inverse
+            )
+        elif method == "direct":
+            if design_matrix is None:
+                design_matrix = self.design_matrix(**kwargs)
+            X = self._math.cast(design_matrix)
+            self._solution = self._linalg.solve(
+                X, self._flux, self._C.cholesky, self._mu, self._L.inverse
+            )
+        else:
+            raise ValueError("Invalid value for `method`.")
 
         # Set the amplitude and coefficients
         x, _ = self._solution
@@ -965,6 +1062,11 @@ class MapBase(object):
 
         # Fast multivariate sampling using the Cholesky factorization
         yhat, cho_ycov = self._solution
+        if cho_ycov is None:
+            raise ValueError(
+                "The posterior covariance is not available "
+                "when solving with `method='cg'` or `method='l1'`."
+            )
         u = self._math.cast(np.random.randn(self.Ny))
         x = yhat + self._math.dot(cho_ycov, u)
         self.amp = x[0]
@@ -1084,6 +1186,39 @@ class YlmBase(legacy.YlmBase):
             theta, xo, yo, zo, ro, self._inc, self._obl, self._u, self._f
         )
 
+    def _get_matrix_free_args(self, kwargs):
+        if self.lazy:
+            raise NotImplementedError(
+                "Matrix-free solves are only available in greedy mode."
+            )
+        elif self.__props__["reflected"] or self.__props__["oblate"]:
+            raise NotImplementedError(
+                "Matrix-free solves are not implemented for this map type."
+            )
+        self._no_spectral()
+        theta, xo, yo, zo, ro = self._get_flux_kwargs(kwargs)
+        return (theta, xo, yo, zo, ro, self._inc, self._obl, self._u, self._f)
+
+    def _design_operator(self, **kwargs):
+        """Return the design matrix as a ``LinearOperator`` whose products
+        are computed on the fly without instantiating the matrix."""
+        args = self._get_matrix_free_args(kwargs)
+        return LinearOperator(
+            (args[0].shape[0], self.Ny),
+            matvec=lambda v: self.ops.dotX(*args, v)[:, 0],
+            rmatvec=lambda w: self.ops.dotXT(*args, w)[:, 0],
+            matmat=lambda V: self.ops.dotX(*args, V),
+            rmatmat=lambda W: self.ops.dotXT(*args, W),
+            dtype=np.float64,
+        )
+
+    def _normal_matrices(self, CInv, flux, **kwargs):
+        """Return ``X^T C^-1 X`` and ``X^T C^-1 flux`` for a diagonal
+        data covariance, accumulated in chunks of time without
+        instantiating the design matrix ``X``."""
+        args = self._get_matrix_free_args(kwargs)
+        return self.ops.normalX(*args, CInv, flux)
+
     def intensity_design_matrix(self, lat=0, lon=0):
         """Compute and return the pixelization matrix ``P``.
 
@@ -1445,7 +1580,7 @@ class YlmBase(legacy.YlmBase):
             self._y = self._math.transpose(y)
 
     def spot(self, *, contrast=1.0, radius=None, lat=0.0, lon=0.0, **kwargs):
-        r"""Add the expansion of a circular spot to the map.
+        r"""Add the expansion of one or more circular spots to the map.
 
         This function adds a spot whose functional form is a top
         hat in :math:`\Delta\theta`, the
@@ -1454,22 +1589,30 @@ class YlmBase(legacy.YlmBase):
         parameter ``contrast``, defined as the fractional change in the
         intensity at the center of the spot.
 
+        To add many spots at once, pass arrays of contrasts, radii,
+        latitudes, and/or longitudes (one entry per spot); scalars are
+        broadcast across all spots. The expansions of all spots are
+        computed and summed in a single native call, which is much faster
+        than calling this method once per spot.
+
         Args:
             contrast (scalar or vector, optional): The contrast of the spot.
                 This is equal to the fractional change in the intensity of the
                 map at the *center* of the spot relative to the baseline intensity
                 of an unspotted map. If the map has more than one
                 wavelength bin, this must be a vector of length equal to the
-                number of wavelength bins. Positive values of the contrast
-                result in dark spots; negative values result in bright
-                spots. Default is ``1.0``, corresponding to a spot with
+                number of wavelength bins (or a matrix of shape
+                ``(nspot, nw)`` for many spots). Positive values of the
+                contrast result in dark spots; negative values result in
+                bright spots. Default is ``1.0``, corresponding to a spot with
                 central intensity close to zero.
-            radius (scalar, optional): The angular radius of the spot in
-                units of :py:attr:`angle_unit`. Defaults to ``20.0`` degrees.
-            lat (scalar, optional): The latitude of the spot in units of
-                :py:attr:`angle_unit`. Defaults to ``0.0``.
-            lon (scalar, optional): The longitude of the spot in units of
-                :py:attr:`angle_unit`. Defaults to ``0.0``.
+            radius (scalar or vector, optional): The angular radius of the
+                spot in units of :py:attr:`angle_unit`. Defaults to ``20.0``
+                degrees.
+            lat (scalar or vector, optional): The latitude of the spot in
+                units of :py:attr:`angle_unit`. Defaults to ``0.0``.
+            lon (scalar or vector, optional): The longitude of the spot in
+                units of :py:attr:`angle_unit`. Defaults to ``0.0``.
 
         .. note::
 
@@ -1537,9 +1680,16 @@ class YlmBase(legacy.YlmBase):
         if self.nw is None:
             contrast = self._math.cast(contrast)
         else:
-            contrast = self._math.cast(contrast) * self._math.ones(self.nw)
+            contrast = self._math.atleast_2d(
+                self._math.cast(contrast) * self._math.ones(self.nw)
+            )
+
+        # One entry per spot along the first axis
+        contrast, radius, lat, lon = self._math.vectorize(
+            contrast, radius, lat, lon
+        )
 
-        # Add the spot to the map
+        # Add the spots to the map
         y_spot = self.ops.spot(contrast, radius, lat, lon)
         x = self._amp * self._y + y_spot
         self._amp = x[0]
@@ -1667,6 +1817,67 @@ class YlmBase(legacy.YlmBase):
         else:
             return matrix
 
+    def _get_pixel_grid(self, oversample=2):
+        """
+        Return the latitude and longitude (in radians) and the Cartesian
+        coordinates (in the frame of the map) of the points of the
+        equal-area Mollweide grid used by ``get_pixel_transforms``.
+
+        """
+        # Target number of pixels
+        npix = oversample * (self.ydeg + 1) ** 2
+        Ny = int(np.sqrt(npix * np.pi / 4.0))
+        Nx = 2 * Ny
+        y, x = np.meshgrid(
+            np.sqrt(2) * np.linspace(-1, 1, Ny),
+            2 * np.sqrt(2) * np.linspace(-1, 1, Nx),
+        )
+        x = x.flatten()
+        y = y.flatten()
+
+        # Remove off-grid points
+        a = np.sqrt(2)
+        b = 2 * np.sqrt(2)
+        idx = (y / a) ** 2 + (x / b) ** 2 <= 1
+        y = y[idx]
+        x = x[idx]
+
+        # https://en.wikipedia.org/wiki/Mollweide_projection
+        theta = np.arcsin(y / np.sqrt(2))
+        lat = np.arcsin((2 * theta + np.sin(2 * theta)) / np.pi)
+        lon0 = 3 * np.pi / 2
+        lon = lon0 + np.pi * x / (2 * np.sqrt(2) * np.cos(theta))
+
+        # Add points at the poles
+        lat = np.append(lat, [-np.pi / 2, 0, 0, np.pi / 2])
+        lon = np.append(
+            lon, [1.5 * np.pi, 1.5 * np.pi, 2.5 * np.pi, 1.5 * np.pi]
+        )
+
+        # Back to Cartesian, this time on the *sky*
+        x = np.reshape(np.cos(lat) * np.cos(lon), [1, -1])
+        y = np.reshape(np.cos(lat) * np.sin(lon), [1, -1])
+        z = np.reshape(np.sin(lat), [1, -1])
+        R = self.ops.RAxisAngle(
+            np.array([1.0, 0.0, 0.0]), np.array(-np.pi / 2)
+        )
+        x, y, z = np.dot(R, np.concatenate((x, y, z)))
+        x = x.reshape(-1)
+        y = y.reshape(-1)
+        z = z.reshape(-1)
+
+        # Flatten and fix the longitude offset, then sort by latitude
+        lat = lat.reshape(-1)
+        lon = (lon - 1.5 * np.pi).reshape(-1)
+        idx = np.lexsort([lon, lat])
+        lat = lat[idx]
+        lon = lon[idx]
+        x = x[idx]
+        y = y[idx]
+        z = z[idx]
+
+        return lat, lon, x, y, z
+
     def get_pixel_transforms(self, oversample=2, lam=1e-6, eps=1e-6):
         """
         Return several linear operators for pixel transformations.
@@ -1731,59 +1942,10 @@ class YlmBase(legacy.YlmBase):
         if self.ydeg <= 1:
             self.oversample = max(oversample, 3)
 
-        # Target number of pixels
-        npix = oversample * (self.ydeg + 1) ** 2
-        Ny = int(np.sqrt(npix * np.pi / 4.0))
-        Nx = 2 * Ny
-        y, x = np.meshgrid(
-            np.sqrt(2) * np.linspace(-1, 1, Ny),
-            2 * np.sqrt(2) * np.linspace(-1, 1, Nx),
-        )
-        x = x.flatten()
-        y = y.flatten()
-
-        # Remove off-grid points
-        a = np.sqrt(2)
-        b = 2 * np.sqrt(2)
-        idx = (y / a) ** 2 + (x / b) ** 2 <= 1
-        y = y[idx]
-        x = x[idx]
-
-        # https://en.wikipedia.org/wiki/Mollweide_projection
-        theta = np.arcsin(y / np.sqrt(2))
-        lat = np.arcsin((2 * theta + np.sin(2 * theta)) / np.pi)
-        lon0 = 3 * np.pi / 2
-        lon = lon0 + np.pi * x / (2 * np.sqrt(2) * np.cos(theta))
-
-        # Add points at the poles
-        lat = np.append(lat, [-np.pi / 2, 0, 0, np.pi / 2])
-        lon = np.append(
-            lon, [1.5 * np.pi, 1.5 * np.pi, 2.5 * np.pi, 1.5 * np.pi]
-        )
+        # Get the grid
+        lat, lon, x, y, z = self._get_pixel_grid(oversample)
         npix = len(lat)
 
-        # Back to Cartesian, this time on the *sky*
-        x = np.reshape(np.cos(lat) * np.cos(lon), [1, -1])
-        y = np.reshape(np.cos(lat) * np.sin(lon), [1, -1])
-        z = np.reshape(np.sin(lat), [1, -1])
-        R = self.ops.RAxisAngle(
-            np.array([1.0, 0.0, 0.0]), np.array(-np.pi / 2)
-        )
-        x, y, z = np.dot(R, np.concatenate((x, y, z)))
-        x = x.reshape(-1)
-        y = y.reshape(-1)
-        z = z.reshape(-1)
-
-        # Flatten and fix the longitude offset, then sort by latitude
-        lat = lat.reshape(-1)
-        lon = (lon - 1.5 * np.pi).reshape(-1)
-        idx = np.lexsort([lon, lat])
-        lat = lat[idx]
-        lon = lon[idx]
-        x = x[idx]
-        y = y[idx]
-        z = z[idx]
-
         # Get the forward pixel transform
         pT = self.ops.pT(x, y, z)[:, : (self.ydeg + 1) ** 2]
         Y2P = pT * self.ops._c_ops.A1
@@ -12,3 +12,29 @@ import pytest
 cpp = pytest.mark.skipif(
     not Ops.STARRY_UNIT_TESTS, reason="c++ unit tests not found"
 )
+
+
+@cpp
+@pytest.mark.parametrize("lmax", [0, 1, 2, 3, 5])
+@pytest.mark.parametrize("r", [0.01, 0.1, 0.5, 0.99, 1.0, 1.5, 10.0])
+def test_fixed_degree_solver(lmax, r):
+    """
+    Test that the occultation solver specialized to a fixed degree
+    yields the same solution vector and derivatives as the dynamic one.
+
+    """
+    # Points strictly inside the occultation, including the edge cases
+    # (the derivatives are singular at `b = |1 - r|` for both solvers)
+    b = np.concatenate(
+        (
+            np.linspace(0, 1 + r, 300, endpoint=False),
+            [r, abs(1 - r), abs(1 - r) + 1e-8, 1 + r - 1e-8],
+        )
+    )
+    sT_fixed = Ops.sT_solver(lmax, b, r, True)
+    sT_dynamic = Ops.sT_solver(lmax, b, r, False)
+    N = (lmax + 1) ** 2
+    assert np.all(np.isfinite(sT_fixed[:, :N]))
+    assert np.allclose(
+        sT_fixed, sT_dynamic, rtol=1e-12, atol=1e-12, equal_nan=True
+    )
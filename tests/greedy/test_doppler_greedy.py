@@ -76,6 +76,176 @@ def test_dot(map, random, ranktwo, transpose, fix_spectrum, fix_map):
     assert np.allclose(np.squeeze(product1), np.squeeze(product2))
 
 
+@pytest.mark.parametrize("transpose", [False, True])
+def test_conv_mode(random, transpose):
+    """
+    Test that the direct and FFT convolutions yield the same flux
+    and design matrix products.
+
+    """
+    maps = [
+        starry.DopplerMap(ydeg=5, udeg=2, nt=3, veq=50000, conv_mode=mode)
+        for mode in ["direct", "fft"]
+    ]
+    for map in maps:
+        map.load(maps=["spot"])
+    flux1, flux2 = [map.flux(method="conv") for map in maps]
+    assert np.allclose(flux1, flux2)
+    if transpose:
+        size = [maps[0].nt * maps[0].nw, 5]
+    else:
+        size = [maps[0].nw0_ * maps[0].Ny, 5]
+    matrix = random.normal(size=size)
+    product1, product2 = [
+        map.dot(matrix, transpose=transpose) for map in maps
+    ]
+    assert np.allclose(product1, product2)
+
+
+@pytest.mark.parametrize("fix_spectrum", [False, True])
+@pytest.mark.parametrize("fix_map", [False, True])
+def test_design_operator(map, random, fix_spectrum, fix_map):
+    """
+    Test that the matrix-free design operator yields the same products
+    as the instantiated design matrix.
+
+    """
+    # Skip invalid combo
+    if fix_spectrum and fix_map:
+        return
+
+    D = map.design_matrix(fix_spectrum=fix_spectrum, fix_map=fix_map)
+    if hasattr(D, "todense"):
+        D = D.todense()
+    D = np.asarray(D)
+    op = map.design_operator(fix_spectrum=fix_spectrum, fix_map=fix_map)
+    assert op.shape == D.shape
+
+    v = random.normal(size=D.shape[1])
+    assert np.allclose(op.matvec(v), D @ v)
+    W = random.normal(size=(D.shape[0], 3))
+    assert np.allclose(op.rmatmat(W), D.T @ W)
+
+
+def test_D_toeplitz(map):
+    """
+    Test that the natively assembled sparse Doppler matrix is the
+    block-Toeplitz stack of the kernels.
+
+    """
+    theta = map._get_default_theta(None)
+    kT = map.ops.get_kT(map._inc, theta, map._veq, map._u)
+    D = map.ops.get_D(map._inc, theta, map._veq, map._u)
+    nt, Ny, nk = kT.shape
+    nwp = map.nw0_
+    nw = nwp - nk + 1
+    assert D.shape == (nt * nw, Ny * nwp)
+    assert D.nnz == nt * nw * Ny * nk
+    D = D.toarray()
+    for t in range(nt):
+        for w in [0, nw // 2, nw - 1]:
+            row = np.zeros((Ny, nwp))
+            row[:, w : w + nk] = kT[t]
+            assert np.allclose(D[t * nw + w], row.reshape(-1))
+
+
+def test_D_operator(map, random):
+    """
+    Test that the structured block-Toeplitz operator, which stores each
+    kernel once, agrees with the explicit Doppler matrices.
+
+    """
+    theta = map._get_default_theta(None)
+    D = map.ops.get_D(map._inc, theta, map._veq, map._u).toarray()
+    op = map.ops.get_D_operator(map._inc, theta, map._veq, map._u)
+    assert op.shape == D.shape
+    assert np.allclose(op.matrix().toarray(), D)
+    assert np.allclose(op.dense(), D)
+    idx, val = op.row(1)
+    assert np.allclose(D[1, idx], val)
+    assert np.count_nonzero(D[1]) <= len(idx)
+    M = random.normal(size=(D.shape[1], 3))
+    assert np.allclose(op.dot(M, False), D @ M)
+    W = random.normal(size=(D.shape[0], 3))
+    assert np.allclose(op.dot(W, True), D.T @ W)
+
+    # The fixed map matrix is assembled from the kernels of the map
+    Y = np.kron(map._y, np.eye(map.nw0_))
+    DY = map.ops.get_D_fixed_map(map._inc, theta, map._veq, map._u, map._y)
+    assert DY.nnz == D.shape[0] * map.nc * map.ops.nk
+    assert np.allclose(DY.toarray(), D @ Y)
+
+
+def test_kT_cache(map):
+    """
+    Test that the cached line broadening kernels are reused at fixed
+    geometry and yield the same flux as the uncached kernels.
+
+    """
+    size = map.ops.kT_cache_size
+    assert map.ops._kT.cache_size + map.ops._c_ops.dopplerCacheSize == size
+    assert map.ops._kT.cache_size <= size // 2
+    map.ops._kT.clear_cache()
+    flux0 = map.flux()
+    assert len(map.ops._kT._cache) > 0
+    nbytes = map.ops._kT._cache_nbytes
+    flux1 = map.flux()
+    assert map.ops._kT._cache_nbytes == nbytes
+    map.ops.kT_cache_size = 0
+    assert len(map.ops._kT._cache) == 0
+    flux2 = map.flux()
+    map.ops.kT_cache_size = size
+    assert np.allclose(flux0, flux1)
+    assert np.allclose(flux0, flux2)
+
+    # Inputs with the same bytes but a different shape or dtype
+    # must not share a cache entry
+    op = map.ops._kT
+    op.clear_cache()
+    u = np.array(map._u)
+    veq = np.array(map._veq)
+    inc = np.array(map._inc)
+    kT = []
+    for theta in [np.zeros(2), np.zeros(4, dtype=np.float32)]:
+        out = [[None]]
+        op.perform(None, [veq, inc, theta, u], out)
+        kT.append(out[0][0])
+    assert len(op._cache) == 2
+    assert kT[0].shape[0] == 2
+    assert kT[1].shape[0] == 4
+
+
+def test_sht(map, random):
+    """
+    Test the native pixel transforms against the dense NumPy transforms.
+
+    """
+    # The Mollweide grid transforms
+    _, _, Y2P, P2Y, _, _ = map._map.get_pixel_transforms(lam=1e-6)
+    assert np.allclose(map.sht_matrix(inverse=True), Y2P)
+    assert np.allclose(map.sht_matrix(smoothing=0), P2Y)
+
+    # Batched products with the spectral map
+    a = np.reshape(map.spectral_map, (map.Ny, -1))
+    p = map.sht_dot(a, inverse=True)
+    assert np.allclose(p, Y2P @ a)
+    assert np.allclose(map.sht_dot(p[:, 0], smoothing=0), P2Y @ p[:, 0])
+    A = map.sht_matrix(smoothing=0.1)
+    assert np.allclose(map.sht_dot(p, smoothing=0.1), A @ p)
+
+    # The cos(lat)-weighted lat-lon grid transform used in `load`
+    nlat, nlon = 30, 60
+    lon = np.linspace(-180, 180, nlon) * np.pi / 180
+    lat = np.linspace(-90, 90, nlat) * np.pi / 180
+    lon, lat = np.meshgrid(lon, lat)
+    P = map.ops.P(lat.flatten(), lon.flatten())
+    PTSinv = P.T * np.cos(lat.flatten())[None, :] ** 2
+    Q = np.linalg.solve(PTSinv @ P + 1e-12 * np.eye(map.Ny), PTSinv)
+    assert np.allclose(map._get_SHT_matrix(nlat, nlon, smoothing=0), Q)
+    M = random.normal(size=(nlat * nlon, 2))
+    assert np.allclose(map._dot_SHT(nlat, nlon, M, smoothing=0), Q @ M)
+
+
 def test_D_fixed_spectrum(map, random):
     """
     Test that our fast method for computing the design matrix
@@ -260,3 +430,119 @@ def test_ylm_indices(map, random):
             ).reshape(-1),
             y,
         )
+
+
+@pytest.mark.parametrize("normalized", [False, True])
+def test_solve_native(normalized):
+    """
+    Test that the native bilinear solver yields the same solution as
+    the Python implementation.
+
+    """
+    map = starry.DopplerMap(ydeg=3, udeg=0, nt=4, nc=1, veq=50000)
+    map.load(maps=["spot"])
+    flux = map.flux(normalize=normalized)
+    kwargs = dict(
+        flux_err=1e-3,
+        spectral_guess=0.9,
+        normalized=normalized,
+        logT0=2,
+        nlogT=5,
+        quiet=True,
+    )
+    soln0 = map.solve(flux, native=False, **kwargs)
+    y0, spectrum0 = soln0["y"], soln0["spectrum_"]
+    soln = map.solve(flux, native=True, cg_tol=1e-12, **kwargs)
+    assert np.allclose(soln["y"], y0, atol=1e-6)
+    assert np.allclose(soln["spectrum_"], spectrum0, atol=1e-6)
+    assert len(soln["history"]["T"]) == 5
+
+    # The factorized covariances are only computed on request
+    assert soln["cho_ycov"] is None
+    assert soln["cho_scov"] is None
+    soln = map.solve(flux, native=True, native_cov=True, **kwargs)
+    ycov0 = soln0["cho_ycov"].dot(soln0["cho_ycov"].T)
+    ycov = soln["cho_ycov"].dot(soln["cho_ycov"].T)
+    assert np.allclose(ycov, ycov0, rtol=1e-3, atol=1e-12)
+    assert soln["cho_scov"] is not None
+    assert soln["cho_scov"][0].shape == soln0["cho_scov"][0].shape
+
+
+def test_mixed_precision(map, random):
+    """
+    Test that the mixed precision products agree with the double
+    precision products to within the theoretical error bound.
+
+    """
+    # The error bound on the flux
+    error, bound = map.validate_precision()
+    assert np.all(np.abs(error) <= bound)
+    assert np.max(bound) < 1e-4 * np.max(np.abs(map.flux(normalize=False)))
+
+    # The flux and the design matrix products
+    mixed = starry.DopplerMap(
+        ydeg=10,
+        udeg=2,
+        nt=3,
+        nc=map.nc,
+        veq=50000,
+        conv_mode="direct",
+        precision="mixed",
+    )
+    mixed.load(maps=["spot", "earth"][: map.nc])
+    assert np.allclose(mixed.flux(), map.flux(), rtol=1e-5)
+    for transpose in [False, True]:
+        if transpose:
+            size = [map.nt * map.nw, 5]
+        else:
+            size = [map.nw0_ * map.Ny, 5]
+        matrix = random.normal(size=size)
+        product1 = map.dot(matrix, transpose=transpose)
+        product2 = mixed.dot(matrix, transpose=transpose)
+        assert np.allclose(
+            product1, product2, atol=1e-5 * np.max(np.abs(product1))
+        )
+
+    # Invalid precision
+    with pytest.raises(ValueError):
+        starry.DopplerMap(ydeg=1, precision="half")
+
+
+@pytest.mark.parametrize("k", [1, 2, 3, 5])
+def test_spline_operator(random, k):
+    """
+    Test the native spline resampling operator against the dense
+    operator computed with scipy, including extrapolation.
+
+    """
+    from scipy.interpolate import InterpolatedUnivariateSpline
+    from starry._core.math import greedy_math
+
+    x = np.sort(random.uniform(642.0, 644.0, size=150))
+    xout = np.linspace(641.9, 644.1, 200)
+    S_scipy = np.zeros((len(xout), len(x)))
+    for n in range(len(x)):
+        y = np.zeros_like(x)
+        y[n] = 1.0
+        S_scipy[:, n] = InterpolatedUnivariateSpline(x, y, k=k)(xout)
+
+    # The full operator
+    S = greedy_math.spline_operator(x, xout, k=k).toarray()
+    assert np.allclose(S, S_scipy, atol=1e-10)
+
+    # The thresholded operator
+    S = greedy_math.spline_operator(x, xout, k=k, tol=1e-8)
+    assert np.all(np.abs(S.data) >= 1e-8)
+    assert np.allclose(S.toarray(), S_scipy, atol=1e-8)
+
+    # Matrix-free products
+    M = random.normal(size=(len(x), 3))
+    assert np.allclose(
+        greedy_math.spline_dot(x, xout, M, k=k), S_scipy.dot(M), atol=1e-10
+    )
+    M = random.normal(size=(len(xout), 3))
+    assert np.allclose(
+        greedy_math.spline_dot(x, xout, M, k=k, transpose=True),
+        S_scipy.T.dot(M),
+        atol=1e-10,
+    )
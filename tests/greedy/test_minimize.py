@@ -63,6 +63,23 @@ def test_bounded_minimize():
     assert val_m <= val
 
 
+def test_minimize_intensity():
+    # Check that the reported minimum is consistent with the
+    # intensity evaluated at that location, and that the search
+    # is deterministic
+    np.random.seed(2)
+    map = starry.Map(ydeg=5)
+    map[1:, :] = 0.1 * np.random.randn(map.Ny - 1)
+    lat, lon, val = map.minimize(oversample=2, ntries=3)
+    assert np.allclose(val, map.intensity(lat=lat, lon=lon))
+    assert np.allclose((lat, lon, val), map.minimize(oversample=2, ntries=3))
+
+    # Compare to a dense grid search
+    res = 300
+    image = map.render(projection="rect", res=res)
+    assert val <= np.nanmin(image) + 1e-8
+
+
 def test_sturm():
     # Check that we can count the real
     # roots of a polynomial in the range [0, 1]
@@ -92,3 +109,17 @@ def test_limbdark_physical():
     for i in range(500):
         map[1:] = np.random.randn(2)
         assert map.limbdark_is_physical() == is_physical(map.u)
+
+
+def test_limbdark_physical_batch():
+    # Check the batched version of the physicality test
+    np.random.seed(1)
+    U = np.random.randn(1000, 3)
+    U[:, 0] = -1.0
+    flags = starry._c_ops.ld_is_physical(U)
+    expected = (
+        (U[:, 1] + U[:, 2] < 1)
+        & (U[:, 1] > 0)
+        & (U[:, 1] + 2 * U[:, 2] > 0)
+    )
+    assert np.array_equal(np.array(flags, dtype=bool), expected)
@@ -0,0 +1,122 @@
+# -*- coding: utf-8 -*-
+"""Test the native Keplerian solver against `exoplanet`."""
+import starry
+from starry._constants import G_grav, c_light
+import exoplanet
+import numpy as np
+import pytest
+
+
+# A few bodies on eccentric, inclined orbits
+t = np.linspace(-5.0, 5.0, 1000)
+pri_m = 1.1
+sec_m = np.array([1e-3, 0.05, 0.2])
+sec_t0 = np.array([0.1, -0.3, 1.2])
+sec_porb = np.array([1.3, 2.7, 5.0])
+sec_ecc = np.array([0.0, 0.3, 0.8])
+sec_w = np.array([0.5 * np.pi, 1.0, -2.0])
+sec_Omega = np.array([0.0, 0.3, 1.2])
+sec_inc = np.array([0.5 * np.pi, 1.4, 1.0])
+
+
+def get_orbit():
+    return exoplanet.orbits.KeplerianOrbit(
+        period=sec_porb,
+        t0=sec_t0,
+        incl=sec_inc,
+        ecc=sec_ecc,
+        omega=sec_w,
+        Omega=sec_Omega,
+        m_planet=sec_m,
+        m_star=pri_m,
+        r_star=1.0,
+    )
+
+
+@pytest.mark.parametrize("light_delay", [False, True])
+def test_relative_position(light_delay):
+    try:
+        xyz0 = get_orbit().get_relative_position(t, light_delay=light_delay)
+    except TypeError:
+        pytest.skip("This version of `exoplanet` does not model light delays.")
+    xyz = starry._c_ops.orbit(
+        t,
+        pri_m,
+        sec_m,
+        sec_t0,
+        sec_porb,
+        sec_ecc,
+        sec_w,
+        sec_Omega,
+        sec_inc,
+        np.ones_like(sec_m),
+        G_grav,
+        c_light,
+        light_delay,
+    )
+    for v, v0 in zip(xyz, xyz0):
+        assert np.allclose(v, np.reshape(v0.eval(), v.shape))
+
+
+def test_system_position():
+    pri = starry.Primary(starry.Map(), m=pri_m)
+    secs = [
+        starry.Secondary(
+            starry.Map(),
+            m=sec_m[k],
+            t0=sec_t0[k],
+            porb=sec_porb[k],
+            ecc=sec_ecc[k],
+            w=sec_w[k] * 180 / np.pi,
+            Omega=sec_Omega[k] * 180 / np.pi,
+            inc=sec_inc[k] * 180 / np.pi,
+        )
+        for k in range(len(sec_m))
+    ]
+    sys = starry.System(pri, *secs)
+    x, y, z = sys.position(t)
+    orbit = get_orbit()
+    xyz_pri = orbit.get_star_position(t)
+    xyz_sec = orbit.get_planet_position(t)
+    for v, v_pri, v_sec in zip((x, y, z), xyz_pri, xyz_sec):
+        assert np.allclose(v[0], np.sum(v_pri.eval(), axis=-1))
+        assert np.allclose(v[1:], np.transpose(v_sec.eval()))
+
+
+def test_occultations():
+    np.random.seed(0)
+    x, y, z = np.random.uniform(-3, 3, size=(3, 500, 5))
+    r = np.array([1.0, 0.3, 0.0, 0.5, 0.1])
+    idx, ptr = starry._c_ops.occultations(x, y, z, r)
+    for i in range(5):
+        for j in range(5):
+            b = np.hypot(x[:, j] - x[:, i], y[:, j] - y[:, i])
+            occ = (i != j) & (r[i] > 0) & (r[j] > 0)
+            occ &= (b < r[i] + r[j]) & (z[:, j] > z[:, i])
+            k = i * 5 + j
+            assert np.array_equal(idx[ptr[k] : ptr[k + 1]], np.where(occ)[0])
+
+
+def test_light_delay_flux():
+    # A dark body transiting a limb-darkened star, whose flux depends
+    # only on the sky positions, on a wide orbit so the delay is large
+    def get_system(light_delay):
+        pri = starry.Primary(starry.Map(udeg=2), m=1.0, r=1.0)
+        pri.map[1:] = [0.4, 0.2]
+        sec = starry.Secondary(
+            starry.Map(amp=0.0), m=1e-3, r=0.1, porb=30.0, t0=0.0
+        )
+        return starry.System(pri, sec, light_delay=light_delay)
+
+    # The delayed orbit is the undelayed one evaluated at the retarded
+    # time `t + z / c`, where `z` is the relative line-of-sight position
+    t = np.linspace(-0.3, 0.3, 1000)
+    sys = get_system(False)
+    _, _, z = sys.position(t)
+    delay = (z[1] - z[0]) / c_light
+    flux0 = sys.flux(t + delay)
+    flux = get_system(True).flux(t)
+
+    # Make sure the delay actually matters here
+    assert np.max(np.abs(flux - sys.flux(t))) > 1e-4
+    assert np.allclose(flux, flux0, rtol=0.0, atol=1e-12)
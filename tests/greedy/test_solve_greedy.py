@@ -121,3 +121,153 @@ def test_lnlike(L, C, woodbury, data):
     # Verify that we get the correct inclination
     assert incs[np.argmax(ll)] == 60
     assert np.allclose(ll[np.argmax(ll)], 974.221605)  # benchmarked
+
+
+@pytest.mark.parametrize("kind", ["banded", "semiseparable", "lowrank"])
+def test_structured_covariance(kind):
+    np.random.seed(3)
+    N, M = 300, 4
+    X = np.random.randn(N, M)
+    flux = np.random.randn(N)
+    t = np.sort(np.random.uniform(0, 10, N))
+    tau = np.abs(t[:, None] - t[None, :])
+
+    # The structured covariance and its dense equivalent
+    if kind == "banded":
+        ab = np.zeros((N, 3))
+        ab[:, 0] = 2.0
+        ab[1:, 1] = 0.5
+        ab[2:, 2] = 0.1
+        C = starry.linalg.BandedCovariance(ab)
+        C_dense = (
+            np.diag(ab[:, 0])
+            + np.diag(ab[1:, 1], -1)
+            + np.diag(ab[1:, 1], 1)
+            + np.diag(ab[2:, 2], -2)
+            + np.diag(ab[2:, 2], 2)
+        )
+    elif kind == "semiseparable":
+        C = starry.linalg.SemiseparableCovariance(
+            t,
+            0.1,
+            real_terms=([1.0], [0.5]),
+            complex_terms=([0.7], [0.05], [0.3], [2.0]),
+        )
+        C_dense = (
+            0.1 * np.eye(N)
+            + np.exp(-0.5 * tau)
+            + np.exp(-0.3 * tau)
+            * (0.7 * np.cos(2.0 * tau) + 0.05 * np.sin(2.0 * tau))
+        )
+    else:
+        U = np.random.randn(N, 2)
+        C = starry.linalg.LowRankCovariance(0.5, U, [1.0, 2.0])
+        C_dense = 0.5 * np.eye(N) + U.dot(np.diag([1.0, 2.0])).dot(U.T)
+
+    # Compare the solution and the likelihood to the dense case
+    kwargs = dict(mu=0.1, L=2.0, N=M)
+    mu, cho_cov = starry.linalg.solve(X, flux, C=C, **kwargs)
+    mu0, cho_cov0 = starry.linalg.solve(X, flux, C=C_dense, **kwargs)
+    assert np.allclose(mu, mu0)
+    assert np.allclose(cho_cov, cho_cov0)
+    lnlike = starry.linalg.lnlike(X, flux, C=C, **kwargs)
+    lnlike0 = starry.linalg.lnlike(
+        X, flux, C=C_dense, woodbury=False, **kwargs
+    )
+    assert np.allclose(lnlike, lnlike0)
+
+    # The covariance is factorized only once
+    factor = C.factor()
+    X1, lndet = C.solve(X, lazy=False)
+    assert C.factor() is factor
+    assert np.allclose(X1, np.linalg.solve(C_dense, X))
+    assert np.allclose(lndet, np.linalg.slogdet(C_dense)[1])
+    assert np.allclose(C.lndet(lazy=False), lndet)
+
+
+@pytest.mark.parametrize("udeg", [0, 2])
+def test_solve_cg(udeg):
+    np.random.seed(4)
+    map = starry.Map(ydeg=4, udeg=udeg)
+    if udeg > 0:
+        map[1:] = [0.5, 0.25]
+    map.inc = 70
+    map.obl = 20
+    kwargs = dict(
+        theta=np.linspace(0, 720, 1200),
+        xo=np.linspace(-1.5, 1.5, 1200),
+        yo=0.2,
+        ro=0.3,
+    )
+
+    # The matrix-free products
+    X = map.design_matrix(**kwargs)
+    X_op = map._design_operator(**kwargs)
+    v = np.random.randn(map.Ny, 3)
+    w = np.random.randn(1200, 3)
+    assert np.allclose(X_op.matmat(v), X.dot(v))
+    assert np.allclose(X_op.rmatmat(w), X.T.dot(w))
+
+    # Compare the solutions
+    flux = X.dot(np.random.randn(map.Ny)) + 0.03 * np.random.randn(1200)
+    map.set_data(flux, C=1e-3)
+    map.set_prior(L=np.ones(map.Ny))
+    mu0, _ = map.solve(**kwargs)
+    mu, cho_cov = map.solve(method="cg", tol=1e-12, **kwargs)
+    assert cho_cov is None
+    assert np.allclose(mu, mu0)
+
+
+def test_solve_streaming():
+    np.random.seed(5)
+    map = starry.Map(ydeg=3, udeg=1)
+    map[1] = 0.4
+    map.inc = 60
+    kwargs = dict(
+        theta=np.linspace(0, 360, 1500),
+        xo=np.linspace(-1.5, 1.5, 1500),
+        yo=-0.3,
+        ro=0.2,
+    )
+    X = map.design_matrix(**kwargs)
+    flux = X.dot(np.random.randn(map.Ny)) + 0.01 * np.random.randn(1500)
+    map.set_data(flux, C=np.random.uniform(1, 2, 1500) * 1e-4)
+    map.set_prior(L=np.ones(map.Ny))
+    mu0, cho_cov0 = map.solve(**kwargs)
+    mu, cho_cov = map.solve(method="streaming", **kwargs)
+    assert np.allclose(mu, mu0)
+    assert np.allclose(cho_cov, cho_cov0)
+
+
+def test_solve_l1():
+    np.random.seed(6)
+    map = starry.Map(ydeg=3)
+    map.inc = 60
+    kwargs = dict(theta=np.linspace(0, 360, 500))
+    X = map.design_matrix(**kwargs)
+    y = np.zeros(map.Ny)
+    y[[0, 2, 6]] = [1.0, 0.3, -0.2]
+    flux = X.dot(y) + 1e-3 * np.random.randn(500)
+    map.set_data(flux, C=1e-6)
+    map.set_prior(L=np.ones(map.Ny))
+
+    # A tiny penalty recovers the L2 solution
+    mu0, _ = map.solve(**kwargs)
+    mu, cho_cov = map.solve(method="l1", lam=1e-8, tol=1e-20, **kwargs)
+    assert cho_cov is None
+    assert np.allclose(mu, mu0, atol=1e-6)
+
+    # The optimality conditions hold (approximately) for a large penalty
+    lam = 1e7
+    mu, _ = map.solve(
+        method="l1", lam=lam, tol=1e-24, maxiter=10000, **kwargs
+    )
+    grad = X.T.dot(flux - X.dot(mu)) / 1e-6 - mu
+    nz = np.abs(mu) > 1e-8
+    assert np.any(~nz)
+    assert np.allclose(grad[nz], lam * np.sign(mu[nz]), rtol=5e-2)
+    assert np.all(np.abs(grad[~nz]) <= lam * (1 + 5e-2))
+
+    # The L1 solver requires a penalty
+    with pytest.raises(ValueError):
+        map.solve(method="l1", **kwargs)
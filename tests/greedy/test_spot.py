@@ -72,3 +72,59 @@ def test_two_spots():
     map.spot(lon=0)
     map.spot(lon=90)
     return np.isclose(map.intensity(lon=0), map.intensity(lon=90))
+
+
+def test_many_spots():
+    """
+    Test that the batched spot expansion equals the sum of the
+    expansions of the individual spots.
+
+    """
+    map = starry.Map(ydeg=10, nw=2)
+    np.random.seed(0)
+    nspot = 20
+    amp = 0.01 * np.random.randn(nspot, 2)
+    sigma = 0.1 + 0.05 * np.random.rand(nspot)
+    lat = np.pi * (np.random.rand(nspot) - 0.5)
+    lon = 2 * np.pi * (np.random.rand(nspot) - 0.5)
+    y = map.ops.spotsYlm(amp, sigma, lat, lon)
+    y0 = np.sum(
+        [
+            map.ops.spotYlm(amp[k], sigma[k], lat[k], lon[k])
+            for k in range(nspot)
+        ],
+        axis=0,
+    )
+    assert np.allclose(y, y0)
+
+
+def test_spot_vectorized():
+    """
+    Test that adding many spots in one call to `spot` is the same as
+    adding them one at a time.
+
+    """
+    np.random.seed(0)
+    nspot = 10
+    contrast = 0.1 * np.random.rand(nspot, 2)
+    radius = 10 + 20 * np.random.rand(nspot)
+    lat = 180 * (np.random.rand(nspot) - 0.5)
+    lon = 360 * (np.random.rand(nspot) - 0.5)
+    map = starry.Map(ydeg=15, nw=2)
+    map.spot(contrast=contrast, radius=radius, lat=lat, lon=lon)
+    map0 = starry.Map(ydeg=15, nw=2)
+    for k in range(nspot):
+        map0.spot(
+            contrast=contrast[k], radius=radius[k], lat=lat[k], lon=lon[k]
+        )
+    assert np.allclose(map.amp, map0.amp)
+    assert np.allclose(map.y, map0.y)
+
+    # Scalars are broadcast across all spots
+    map = starry.Map(ydeg=15)
+    map.spot(contrast=0.1, radius=radius, lat=30)
+    map0 = starry.Map(ydeg=15)
+    for k in range(nspot):
+        map0.spot(contrast=0.1, radius=radius[k], lat=30)
+    assert np.allclose(map.amp, map0.amp)
+    assert np.allclose(map.y, map0.y)
@@ -77,6 +77,30 @@ def test_integration():
     assert np.allclose(flux, flux2)
 
 
+def test_adaptive_integration():
+    pri = starry.Primary(starry.Map(udeg=2), r=1.0)
+    pri.map[1:] = [0.5, 0.25]
+    sec = starry.Secondary(starry.Map(ydeg=1), porb=1.0, prot=0.1, r=0.25)
+    sec.map[1, 0] = 0.5
+    sec.map[1, 1] = 0.3
+
+    # Manual integration. The exposures far from the transit are
+    # integrated analytically, which we check against the rotational
+    # modulation of the secondary
+    t = np.linspace(-0.2, 0.2, 20000)
+    sys = starry.System(pri, sec, texp=0)
+    flux = sys.flux(t)
+    t = t.reshape(-1, 1000).mean(axis=1)
+    flux = flux.reshape(-1, 1000).mean(axis=1)
+
+    sys = starry.System(
+        pri, sec, texp=0.02, oversample=129, adaptive=True, tol=1e-10
+    )
+    assert sys.adaptive
+    assert sys.tol == 1e-10
+    assert np.allclose(flux, sys.flux(t))
+
+
 def test_reflected_light():
     pri = starry.Primary(starry.Map(amp=0), r=1)
     sec = starry.Secondary(starry.Map(reflected=True), porb=1.0, r=1)
@@ -85,3 +109,164 @@ def test_reflected_light():
     flux = sys.flux(t)
 
     # TODO: Add an analytic validation here
+
+
+def test_incremental():
+    pri = starry.Primary(starry.Map(ydeg=1, udeg=2), r=1.0)
+    pri.map[1:] = [0.5, 0.25]
+    pri.map[1, 0] = 0.1
+    b = starry.Secondary(starry.Map(ydeg=1), porb=1.0, r=0.1, t0=0.0)
+    c = starry.Secondary(starry.Map(ydeg=1), porb=3.0, r=0.2, t0=0.5)
+    b.map[1, 0] = 0.5
+    t = np.linspace(-0.6, 0.6, 500)
+    sys = starry.System(pri, b, c, incremental=True)
+    ref = starry.System(pri, b, c)
+    assert sys.incremental
+
+    # The first call computes everything
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+
+    # Change a map, an orbit, and the primary mass in turn
+    b.map.inc = 60.0
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    c.t0 = 0.0
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    pri.m = 1.2
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    assert np.allclose(sys.flux(t), ref.flux(t))
+
+
+def test_incremental_reflected():
+    pri = starry.Primary(starry.Map(), r=1.0)
+    b = starry.Secondary(
+        starry.Map(ydeg=1, reflected=True), porb=1.0, r=0.1, t0=0.0
+    )
+    c = starry.Secondary(
+        starry.Map(ydeg=1, reflected=True), porb=3.0, r=0.2, t0=0.5
+    )
+    b.map[1, 0] = 0.5
+    t = np.linspace(-0.6, 0.6, 500)
+    sys = starry.System(pri, b, c, incremental=True)
+    ref = starry.System(pri, b, c)
+    assert np.allclose(sys.flux(t), ref.flux(t))
+
+    # The illumination of the secondaries depends on the primary
+    pri.map.amp = 2.5
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    assert np.allclose(sys.flux(t), ref.flux(t))
+    pri.r = 1.3
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    assert np.allclose(sys.flux(t), ref.flux(t))
+
+
+def test_incremental_oblate():
+    map = starry.Map(ydeg=1, udeg=2, oblate=True)
+    map[1:] = [0.5, 0.25]
+    map[1, 0] = 0.1
+    map.omega = 0.5
+    map.beta = 1.23
+    map.tpole = 8000
+    map.f = 1 - 2 / (map.omega ** 2 + 2)
+    pri = starry.Primary(map, r=1.5)
+    b = starry.Secondary(starry.Map(ydeg=1), porb=1.0, r=0.1, t0=0.0)
+    c = starry.Secondary(starry.Map(ydeg=1), porb=3.0, r=0.2, t0=0.5)
+    t = np.linspace(-0.6, 0.6, 500)
+    sys = starry.System(pri, b, c, incremental=True)
+    ref = starry.System(pri, b, c)
+    X = sys.design_matrix(t)
+    assert X.shape[1] == sum(len(i) for i in sys.map_indices)
+    assert np.allclose(X, ref.design_matrix(t))
+
+    # Change a secondary map, then the primary map
+    b.map.inc = 60.0
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    pri.map.obl = 30.0
+    assert np.allclose(sys.design_matrix(t), ref.design_matrix(t))
+    assert np.allclose(sys.flux(t), ref.flux(t))
+
+
+@pytest.mark.parametrize(
+    "kwargs", [dict(), dict(texp=0.01, light_delay=True)]
+)
+def test_flux_batch(kwargs):
+    pri = starry.Primary(starry.Map(udeg=2), r=1.0)
+    pri.map[1:] = [0.5, 0.25]
+    b = starry.Secondary(starry.Map(ydeg=1), porb=1.0, r=0.1)
+    c = starry.Secondary(starry.Map(ydeg=1), a=5.0, r=0.2, t0=0.3)
+    sys = starry.System(pri, b, c, **kwargs)
+    t = np.linspace(-0.5, 0.5, 300)
+
+    # Vary a few parameters across the batch
+    r = np.array([0.9, 1.0, 1.1])
+    m = np.array([0.8, 1.0, 1.2])
+    u = np.array([[0.5, 0.25], [0.4, 0.2], [0.3, 0.1]])
+    inc = np.array([88.0, 89.0, 90.0])
+    y = np.array([[0.1, 0.2, 0.3], [0.0, 0.0, 0.0], [-0.1, 0.5, 0.0]])
+    amp = np.array([0.1, 0.2, 0.3])
+    flux = sys.flux_batch(
+        t,
+        primary={"r": r, "m": m, "map.u": u},
+        secondaries=[{"inc": inc, "map.y": y}, {"map.amp": amp}],
+    )
+    assert flux.shape == (3, len(t))
+
+    # Compare to evaluating each system in turn
+    for n in range(3):
+        pri.r = r[n]
+        pri.m = m[n]
+        pri.map[1:] = u[n]
+        b.inc = inc[n]
+        b.map[1:, :] = y[n]
+        c.map.amp = amp[n]
+        assert np.allclose(flux[n], sys.flux(t))
+
+
+def test_flux_batch_reflected():
+    pri = starry.Primary(starry.Map(ydeg=1), r=1.0)
+    sec = starry.Secondary(
+        starry.Map(ydeg=1, reflected=True), porb=1.0, r=0.1, t0=0.5
+    )
+    sys = starry.System(pri, sec)
+    t = np.linspace(-0.5, 0.5, 100)
+
+    # Vary the illumination and the size of the secondary
+    amp = np.array([0.5, 1.0])
+    r = np.array([0.1, 0.2])
+    flux = sys.flux_batch(
+        t, primary={"map.amp": amp}, secondaries=[{"r": r}]
+    )
+    for n in range(2):
+        pri.map.amp = amp[n]
+        sec.r = r[n]
+        assert np.allclose(flux[n], sys.flux(t))
+
+
+def test_render():
+    pri = starry.Primary(starry.Map(ydeg=1), r=1.0)
+    sec = starry.Secondary(starry.Map(ydeg=1, amp=0.0), porb=1.0, r=0.5)
+    sys = starry.System(pri, sec)
+    img = sys.render([0.0, 0.25, 0.5], res=101, window_pad=1.0)
+    assert img.shape == (3, 101, 101)
+
+    # The primary is uniform away from the secondary
+    I0 = pri.map.intensity(lat=0, lon=0)
+    assert np.allclose(img[:, 50, 35], I0)
+
+    # The secondary occults the primary in transit...
+    assert np.allclose(img[0, 50, 50], 0.0)
+
+    # ...and is hidden behind it at secondary eclipse
+    assert np.allclose(img[2, 50, 50], I0)
+
+    # Background pixels are NaN
+    assert np.isnan(img[:, 0, 0]).all()
+
+    # Render into a preallocated array
+    out = np.zeros((3, 101, 101))
+    img2 = sys.render([0.0, 0.25, 0.5], res=101, window_pad=1.0, out=out)
+    assert img2 is out
+    assert np.array_equal(out, img, equal_nan=True)
+
+    # The output array must have the right shape
+    with pytest.raises(ValueError):
+        sys.render([0.0, 0.25], res=101, window_pad=1.0, out=out)
@@ -462,6 +462,110 @@ def test_spot_spectral(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
         )
 
 
+def test_spots(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.Map(ydeg=5)
+        amp = [-0.01, -0.02, 0.01]
+        sigma = [0.1, 0.15, 0.1]
+        lat = np.array([30, -20, 0]) * np.pi / 180
+        lon = np.array([45, 100, -60]) * np.pi / 180
+        theano.gradient.verify_grad(
+            map.ops.spotsYlm,
+            (amp, sigma, lat, lon),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
+def test_spots_zonal(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.Map(ydeg=5, nw=2)
+        amp = [[-0.01, 0.02], [-0.02, 0.01], [0.01, 0.03]]
+        b = np.random.randn(3, 6)
+        lat = np.array([30, -20, 10]) * np.pi / 180
+        lon = np.array([45, 100, -60]) * np.pi / 180
+        theano.gradient.verify_grad(
+            map.ops.spotsYlm,
+            (amp, b, lat, lon),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
+@pytest.mark.parametrize("kind", ["banded", "lowrank"])
+def test_covariance_solve(kind, abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._core.ops import CovarianceSolveOp
+
+    np.random.seed(0)
+    N = 10
+    B = np.random.randn(N, 2)
+    if kind == "banded":
+        op = CovarianceSolveOp(starry._c_ops.BandedCovariance)
+        ab = 0.1 * np.random.randn(N, 3)
+        ab[:, 0] += 1.0
+        params = (ab,)
+    else:
+        op = CovarianceSolveOp(starry._c_ops.LowRankCovariance)
+        D = 1.0 + np.random.rand(N)
+        U = np.random.randn(N, 2)
+        S = np.array([[1.0, 0.0], [0.3, 2.0]])
+        params = (D, U, S)
+
+    def func(B, *params):
+        X, lndet = op(B, *params)
+        return tt.sum(X ** 2) + lndet
+
+    with change_flags(compute_test_value="off"):
+        theano.gradient.verify_grad(
+            func,
+            (B,) + params,
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
+def test_orbit(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._constants import G_grav, c_light
+    from starry._core.ops import OrbitOp
+
+    with change_flags(compute_test_value="off"):
+        op = OrbitOp(starry._c_ops.orbit, G_grav, c_light, light_delay=True)
+
+        def func(*args):
+            x, y, z = op(*args)
+            return x + 2 * y + 3 * z
+
+        theano.gradient.verify_grad(
+            func,
+            (
+                np.linspace(-1.0, 1.0, 10),
+                1.0,
+                np.array([1e-3, 0.1]),
+                np.array([0.0, 0.3]),
+                np.array([1.0, 3.0]),
+                np.array([0.1, 0.4]),
+                np.array([0.5, 1.0]),
+                np.array([0.0, 0.3]),
+                np.array([1.5, 1.2]),
+                np.array([1.0, 0.8]),
+            ),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
 def test_sT_reflected(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
     with change_flags(compute_test_value="off"):
         map = starry.Map(ydeg=2, reflected=True)
@@ -512,3 +616,105 @@ def test_doppler_rT(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
             n_tests=1,
             rng=np.random,
         )
+
+
+def test_doppler_kT(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    with change_flags(compute_test_value="off"):
+        map = starry.DopplerMap(ydeg=3, udeg=2, nt=3)
+        inc = np.array(1.0)
+        theta = np.array([0.1, 0.5, 1.0])
+        veq = np.array(30000.0)
+        u = np.array([-1.0, 0.5, 0.25])
+        theano.gradient.verify_grad(
+            map.ops.get_kT,
+            (inc, theta, veq, u),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
+# Direct, FFT, and mixed precision direct convolutions. The latter are
+# only accurate to single precision, so we use a larger step and looser
+# tolerances for them.
+conv_modes = [
+    (1, dict(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7)),
+    (2, dict(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7)),
+    (1 | 4, dict(abs_tol=1e-2, rel_tol=1e-2, eps=1e-4)),
+]
+
+
+@pytest.mark.parametrize("mode,tols", conv_modes)
+def test_doppler_conv(mode, tols):
+    from starry._core.ops import convDopplerOp
+
+    with change_flags(compute_test_value="off"):
+        map = starry.DopplerMap(ydeg=1)
+        op = convDopplerOp(map.ops._c_ops.convDoppler, 2, mode)
+        x = np.random.randn(3 * 2, 20)
+        k = np.random.randn(2 * 2, 5)
+        theano.gradient.verify_grad(
+            op, (x, k), n_tests=1, rng=np.random, **tols
+        )
+
+
+@pytest.mark.parametrize("mode,tols", conv_modes)
+def test_doppler_convT(mode, tols):
+    from starry._core.ops import convTDopplerOp
+
+    with change_flags(compute_test_value="off"):
+        map = starry.DopplerMap(ydeg=1)
+        op = convTDopplerOp(map.ops._c_ops.convTDoppler, 2, mode)
+        y = np.random.randn(3 * 2, 16)
+        k = np.random.randn(2 * 2, 5)
+        theano.gradient.verify_grad(
+            op, (y, k), n_tests=1, rng=np.random, **tols
+        )
+
+
+def test_doppler_toeplitz(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._core.ops import toeplitzDopplerOp
+    from starry.compat import ts
+
+    with change_flags(compute_test_value="off"):
+        op = toeplitzDopplerOp(starry._c_ops.DopplerToeplitz, 12)
+        kT = np.random.randn(2, 4, 5)
+        theano.gradient.verify_grad(
+            lambda kT: ts.dense_from_sparse(op(kT)),
+            (kT,),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+        op = toeplitzDopplerOp(starry._c_ops.DopplerToeplitz, 12, dense=True)
+        theano.gradient.verify_grad(
+            op,
+            (kT,),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )
+
+
+def test_doppler_dot_toeplitz(abs_tol=1e-5, rel_tol=1e-5, eps=1e-7):
+    from starry._core.ops import dotToeplitzDopplerOp
+
+    with change_flags(compute_test_value="off"):
+        op = dotToeplitzDopplerOp(starry._c_ops.DopplerToeplitz, 12)
+        kT = np.random.randn(2, 4, 5)
+        M = np.random.randn(4 * 12, 3)
+        theano.gradient.verify_grad(
+            op,
+            (kT, M),
+            abs_tol=abs_tol,
+            rel_tol=rel_tol,
+            eps=eps,
+            n_tests=1,
+            rng=np.random,
+        )